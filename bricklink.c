@@ -467,13 +467,67 @@ static const size_t blPriceGuideOffsetTable[2][6] =
   }
 };
 
-static int blHtmlParsePriceGuide( bsxPriceGuide *pgnew, bsxPriceGuide *pgused, char *string, int stringlength )
+/* Tokens of the price guide page, found in a single pass by dispatching on their first char */
+enum
 {
-  int section, sub, value;
+  BL_PG_TOKEN_NONE,
+  BL_PG_TOKEN_SALES,
+  BL_PG_TOKEN_STOCK,
+  BL_PG_TOKEN_NEW,
+  BL_PG_TOKEN_USED,
+  BL_PG_TOKEN_VALUE
+};
+
+typedef struct
+{
+  const char *string;
+  int length;
+} blPriceGuideToken;
+
+static const blPriceGuideToken blPriceGuideTokenTable[] =
+{
+  [BL_PG_TOKEN_NONE] = { "", 0 },
+  [BL_PG_TOKEN_SALES] = { "Past 6 Months Sales", 19 },
+  [BL_PG_TOKEN_STOCK] = { "Current Items for Sale", 22 },
+  [BL_PG_TOKEN_NEW] = { "New", 3 },
+  [BL_PG_TOKEN_USED] = { "Used", 4 },
+  [BL_PG_TOKEN_VALUE] = { "SIZE=\"2\">&nbsp;", 15 }
+};
+
+static const unsigned char blPriceGuideTokenFirstChar[256] =
+{
+  ['P'] = BL_PG_TOKEN_SALES,
+  ['C'] = BL_PG_TOKEN_STOCK,
+  ['N'] = BL_PG_TOKEN_NEW,
+  ['U'] = BL_PG_TOKEN_USED,
+  ['S'] = BL_PG_TOKEN_VALUE
+};
+
+#define BL_PG_VALUE_COUNT (6)
+
+/* Parse one value following a value token, counts first then prices */
+static int blPriceGuideParseValue( bsxPriceGuide *pg, int section, int value, char *string, char *stringend )
+{
+  int length;
+  char buffer[64];
+
+  length = (int)( stringend - string );
+  if( length > (int)sizeof(buffer) - 1 )
+    length = (int)sizeof(buffer) - 1;
+  memcpy( buffer, string, length );
+  buffer[length] = 0;
+  if( value < 2 )
+    return ( sscanf( buffer, "%d", (int *)ADDRESS( pg, blPriceGuideOffsetTable[section][value] ) ) == 1 );
+  return ( sscanf( buffer, "$%f", (float *)ADDRESS( pg, blPriceGuideOffsetTable[section][value] ) ) == 1 );
+}
+
+/* The sales and stock summaries each hold New then Used values; a section runs until the first occurrence of the other's title */
+int blHtmlParsePriceGuide( bsxPriceGuide *pgnew, bsxPriceGuide *pgused, char *string, int stringlength )
+{
+  int token, section, sub, seenmask;
+  int valuecount[2];
   int64_t curtime;
-  char *sectionstr[2], *substr[2];
-  char *valstr;
-  void *writeaddr;
+  char *stringend;
   bsxPriceGuide *pg;
   bsxPriceGuide pgdummy;
 
@@ -484,46 +538,72 @@ static int blHtmlParsePriceGuide( bsxPriceGuide *pgnew, bsxPriceGuide *pgused, c
 
   memset( pgnew, 0, sizeof(bsxPriceGuide) );
   memset( pgused, 0, sizeof(bsxPriceGuide) );
-  sectionstr[0] = ccSeqFindStrSkip( string, stringlength, "Past 6 Months Sales" );
-  sectionstr[1] = ccSeqFindStrSkip( string, stringlength, "Current Items for Sale" );
-  string[stringlength-1] = 0;
-  if( sectionstr[0] )
-    sectionstr[0][-1] = 0;
-  if( sectionstr[1] )
-    sectionstr[1][-1] = 0;
-
-  for( section = 0 ; section < 2 ; section++ )
-  {
-    /* Get sale numbers out */
-    if( !( sectionstr[section] ) )
+  if( stringlength <= 0 )
+    return 0;
+  /* Last char is not examined, as a terminator used to be written there */
+  stringend = string + stringlength - 1;
+
+  section = -1;
+  seenmask = 0;
+  /* Per condition of current section: -1 until its title is seen, then the count of values read */
+  valuecount[0] = -1;
+  valuecount[1] = -1;
+  for( ; ; )
+  {
+    while( ( string < stringend ) && !( blPriceGuideTokenFirstChar[ (unsigned char)*string ] ) )
+      string++;
+    if( string >= stringend )
+      break;
+    token = blPriceGuideTokenFirstChar[ (unsigned char)*string ];
+    if( ( (int)( stringend - string ) < blPriceGuideTokenTable[token].length ) || ( string[1] != blPriceGuideTokenTable[token].string[1] ) || ( memcmp( string, blPriceGuideTokenTable[token].string, blPriceGuideTokenTable[token].length ) ) )
+    {
+      string++;
       continue;
-    substr[0] = ccStrFindStrSkip( sectionstr[section], "New" );
-    substr[1] = ccStrFindStrSkip( sectionstr[section], "Used" );
-    for( sub = 0 ; sub < 2 ; sub++ )
+    }
+    string += blPriceGuideTokenTable[token].length;
+    switch( token )
     {
-      valstr = substr[sub];
-      if( !( valstr ) )
-        continue;
-      pg = ( sub ? pgused : pgnew );
-      for( value = 0 ; value < 2 ; value++ )
-      {
-        writeaddr = ADDRESS( pg, blPriceGuideOffsetTable[section][value] );
-        valstr = ccStrFindStrSkip( valstr, "SIZE=\"2\">&nbsp;" );
-        if( !( valstr ) )
-          return 0;
-        if( sscanf( valstr, "%d", (int *)writeaddr ) != 1 )
-          return 0;
-      }
-      for( ; value < 6 ; value++ )
-      {
-        writeaddr = ADDRESS( pg, blPriceGuideOffsetTable[section][value] );
-        valstr = ccStrFindStrSkip( valstr, "SIZE=\"2\">&nbsp;" );
-        if( !( valstr ) )
-          return 0;
-        if( sscanf( valstr, "$%f", (float *)writeaddr ) != 1 )
-          return 0;
-      }
+      case BL_PG_TOKEN_SALES:
+      case BL_PG_TOKEN_STOCK:
+        if( seenmask & ( 1 << token ) )
+          break;
+        /* Values of the previous section must be complete */
+        for( sub = 0 ; sub < 2 ; sub++ )
+        {
+          if( ( valuecount[sub] >= 0 ) && ( valuecount[sub] < BL_PG_VALUE_COUNT ) )
+            return 0;
+        }
+        seenmask |= 1 << token;
+        section = ( token == BL_PG_TOKEN_SALES ? 0 : 1 );
+        valuecount[0] = -1;
+        valuecount[1] = -1;
+        break;
+      case BL_PG_TOKEN_NEW:
+      case BL_PG_TOKEN_USED:
+        sub = ( token == BL_PG_TOKEN_NEW ? 0 : 1 );
+        if( ( section >= 0 ) && ( valuecount[sub] < 0 ) )
+          valuecount[sub] = 0;
+        break;
+      case BL_PG_TOKEN_VALUE:
+        for( sub = 0 ; sub < 2 ; sub++ )
+        {
+          if( ( valuecount[sub] < 0 ) || ( valuecount[sub] >= BL_PG_VALUE_COUNT ) )
+            continue;
+          pg = ( sub ? pgused : pgnew );
+          if( !( blPriceGuideParseValue( pg, section, valuecount[sub], string, stringend ) ) )
+            return 0;
+          valuecount[sub]++;
+        }
+        break;
     }
+    /* Stop once both sections are seen and the last one is complete */
+    if( ( seenmask == ( ( 1 << BL_PG_TOKEN_SALES ) | ( 1 << BL_PG_TOKEN_STOCK ) ) ) && ( valuecount[0] == BL_PG_VALUE_COUNT ) && ( valuecount[1] == BL_PG_VALUE_COUNT ) )
+      break;
+  }
+  for( sub = 0 ; sub < 2 ; sub++ )
+  {
+    if( ( valuecount[sub] >= 0 ) && ( valuecount[sub] < BL_PG_VALUE_COUNT ) )
+      return 0;
   }
 
   curtime = time( 0 );
@@ -1711,6 +1791,7 @@ static int blParseLot( jsonParser *parser, void *uservalue )
 
   /* Correct any bad item data */
   bsxVerifyItem( item );
+  bsxInternItem( inv, item );
 
   /* Some extra processing */
   inv->partcount += item->quantity;
@@ -1782,6 +1863,28 @@ int blReadInventory( bsxInventory *inv, char *string, ioLog *log )
 }
 
 
+void blReadInventoryStreamInit( jsonStream *stream, bsxInventory *inv, ioLog *log )
+{
+  DEBUG_SET_TRACKER();
+
+  jsonStreamInit( stream, (void *)inv, blParseLot, log );
+  return;
+}
+
+int blReadInventoryStreamEnd( jsonStream *stream )
+{
+  char *skeleton;
+
+  DEBUG_SET_TRACKER();
+
+  skeleton = jsonStreamFinish( stream );
+  if( !( skeleton ) )
+    return 0;
+  /* Lots were parsed as they arrived, the skeleton still holds the meta and an empty data list to check */
+  return blReadOrderInventory( (bsxInventory *)stream->uservalue, skeleton, stream->log );
+}
+
+
 ////
 
 
@@ -29,6 +29,9 @@ char *blQueryPriceGuide( size_t *retsize, char itemtypeid, char *itemid, int ite
 int blFetchInventory( bsxInventory *inv, char itemtypeid, char *itemid );
 int blFetchPriceGuide( bsxPriceGuide *pgnew, bsxPriceGuide *pgused, char itemtypeid, char *itemid, int itemcolorid );
 
+/* Parse a priceGuide.asp page, the string is not modified */
+int blHtmlParsePriceGuide( bsxPriceGuide *pgnew, bsxPriceGuide *pgused, char *string, int stringlength );
+
 
 ////
 
@@ -43,6 +46,12 @@ int blReadOrderInventory( bsxInventory *inv, char *string, ioLog *log );
 /* Read inventory */
 int blReadInventory( bsxInventory *inv, char *string, ioLog *log );
 
+/* Streaming inventory read, lots are added to inv as the reply is fed to the stream */
+void blReadInventoryStreamInit( jsonStream *stream, bsxInventory *inv, ioLog *log );
+
+/* Check the rest of the streamed reply once received, return 0 on failure ; the stream must still be freed */
+int blReadInventoryStreamEnd( jsonStream *stream );
+
 /* Read lotID for a single lot, as reply to a lot creation */
 int blReadLotID( int64_t *retlotid, char *string, ioLog *log );
 
@@ -393,13 +393,6 @@ void boFreeOrderList( bsOrderList *orderlist )
 ////
 
 
-typedef struct
-{
-  void *uservalue;
-  void (*callback)( void *uservalue, boItem *boitem );
-} boParserState;
-
-
 static void boParserInitBoItem( boItem *boitem )
 {
   memset( boitem, 0, sizeof(boItem) );
@@ -909,6 +902,32 @@ static int boParseInvLot( jsonParser *parser, void *uservalue )
 }
 
 
+void boReadInventoryStreamInit( jsonStream *stream, boParserState *state, void *uservalue, void (*callback)( void *uservalue, boItem *boitem ), ioLog *log )
+{
+  DEBUG_SET_TRACKER();
+
+  state->uservalue = uservalue;
+  state->callback = callback;
+  jsonStreamInit( stream, (void *)state, boParseInvLot, log );
+  return;
+}
+
+int boReadInventoryStreamEnd( jsonStream *stream )
+{
+  char *skeleton;
+  boParserState *state;
+
+  DEBUG_SET_TRACKER();
+
+  skeleton = jsonStreamFinish( stream );
+  if( !( skeleton ) )
+    return 0;
+  /* Whatever remains, an empty list or a reply that wasn't a list of lots */
+  state = stream->uservalue;
+  return boReadInventory( state->uservalue, state->callback, skeleton, stream->log );
+}
+
+
 int boReadInventory( void *uservalue, void (*callback)( void *uservalue, boItem *boitem ), char *string, ioLog *log )
 {
   int retval;
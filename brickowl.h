@@ -80,6 +80,18 @@ int boReadOrderInventory( void *uservalue, void (*callback)( void *uservalue, bo
 /* Read inventory and call callback for every item found */
 int boReadInventory( void *uservalue, void (*callback)( void *uservalue, boItem *boitem ), char *string, ioLog *log );
 
+typedef struct
+{
+  void *uservalue;
+  void (*callback)( void *uservalue, boItem *boitem );
+} boParserState;
+
+/* Streaming inventory read, callback is called for every item as the reply is fed to the stream, state must remain valid until the end */
+void boReadInventoryStreamInit( jsonStream *stream, boParserState *state, void *uservalue, void (*callback)( void *uservalue, boItem *boitem ), ioLog *log );
+
+/* Check the rest of the streamed reply once received, return 0 on failure ; the stream must still be freed */
+int boReadInventoryStreamEnd( jsonStream *stream );
+
 /* Read color table */
 int boReadColorTable( boColorTable *colortable, char *string, ioLog *log );
 
@@ -44,19 +44,12 @@
 #include "brickowl.h"
 #include "colortable.h"
 #include "bstranslation.h"
+#include "brickowlinv.h"
 
 
 ////
 
 
-typedef struct
-{
-  bsxInventory *orderinv;
-  bsxInventory *stockinv;
-  translationTable *translationtable;
-  ioLog *log;
-} boOrderInvState;
-
 static void boReadBoItemCallback( void *uservalue, boItem *boitem )
 {
   int blcolorid, urloffset;
@@ -188,5 +181,24 @@ int boReadInventoryTranslate( bsxInventory *orderinv, bsxInventory *stockinv, vo
   return boReadInventory( (void *)&invstate, boReadBoItemCallback, string, log );
 }
 
+void boReadInventoryTranslateStreamInit( boInventoryStream *invstream, bsxInventory *orderinv, bsxInventory *stockinv, void *translationtable, ioLog *log )
+{
+  DEBUG_SET_TRACKER();
+
+  invstream->invstate.orderinv = orderinv;
+  invstream->invstate.stockinv = stockinv;
+  invstream->invstate.translationtable = translationtable;
+  invstream->invstate.log = log;
+  boReadInventoryStreamInit( &invstream->stream, &invstream->parserstate, (void *)&invstream->invstate, boReadBoItemCallback, log );
+  return;
+}
+
+int boReadInventoryTranslateStreamEnd( boInventoryStream *invstream )
+{
+  DEBUG_SET_TRACKER();
+
+  return boReadInventoryStreamEnd( &invstream->stream );
+}
+
 
 
@@ -27,3 +27,26 @@ int boReadOrderInventoryTranslate( bsxInventory *orderinv, bsxInventory *stockin
 /* Fill up inv given stockinv as reference for lot IDs */
 int boReadInventoryTranslate( bsxInventory *orderinv, bsxInventory *stockinv, void *translationtable, char *string, ioLog *log );
 
+
+typedef struct
+{
+  bsxInventory *orderinv;
+  bsxInventory *stockinv;
+  void *translationtable;
+  ioLog *log;
+} boOrderInvState;
+
+typedef struct
+{
+  /* First member, a pointer to the stream is also a pointer to the boInventoryStream */
+  jsonStream stream;
+  boParserState parserstate;
+  boOrderInvState invstate;
+} boInventoryStream;
+
+/* Streaming variant of boReadInventoryTranslate(), feed the reply to invstream->stream as it is received */
+void boReadInventoryTranslateStreamInit( boInventoryStream *invstream, bsxInventory *orderinv, bsxInventory *stockinv, void *translationtable, ioLog *log );
+
+/* Check the rest of the streamed reply once received, return 0 on failure ; invstream->stream must still be freed */
+int boReadInventoryTranslateStreamEnd( boInventoryStream *invstream );
+
@@ -148,7 +148,12 @@ void bsFatalError( bsContext *context )
   ioLog *output;
   output = 0;
   if( context )
+  {
     output = &context->output;
+    /* Complete pending writes, a journaled state is still consistent */
+    bsPersistFlush( context );
+    bsPersistEnd( context );
+  }
   ioPrintf( output, IO_MODEBIT_FLUSH, BSMSG_ERROR IO_RED "Fatal error encountered." IO_DEFAULT "\n" );
   ioPrintf( output, IO_MODEBIT_FLUSH, BSMSG_ERROR IO_RED "Exiting now." IO_DEFAULT "\n" );
   ioLogEnd( output );
@@ -170,7 +175,7 @@ bsContext *bsInit( char *statepath, int *retstateloaded )
 {
   int stateloaded, conferrorcount;
   size_t stateloadsize;
-  char *cwdret, *sysname;
+  char *cwdret, *sysname, *pgdbpath;
   bsContext *context;
   bsFileState state;
 
@@ -235,6 +240,8 @@ bsContext *bsInit( char *statepath, int *retstateloaded )
   context->puzzlesolution.i = 24;
 #endif
   context->bricklink.pipelinequeuesize = BS_BRICKLINK_PIPELINED_FETCH;
+  context->bricklink.connectioncount = BS_BRICKLINK_CONNECTIONS;
+  context->bricklink.webconnectioncount = BS_BRICKLINK_WEB_CONNECTIONS;
   context->bricklink.orderinitdate = 0;
   context->bricklink.ordertopdate = 0;
   context->bricklink.syncdelay = BS_SYNC_DELAY_BASE;
@@ -248,6 +255,7 @@ bsContext *bsInit( char *statepath, int *retstateloaded )
   context->bricklink.xmluploadindex = 0;
   context->bricklink.xmlupdateindex = 0;
   context->brickowl.pipelinequeuesize = BS_BRICKLINK_PIPELINED_FETCH;
+  context->brickowl.connectioncount = BS_BRICKOWL_CONNECTIONS;
   context->brickowl.orderinitdate = 0;
   context->brickowl.ordertopdate = 0;
   context->brickowl.syncdelay = BS_SYNC_DELAY_BASE;
@@ -259,6 +267,7 @@ bsContext *bsInit( char *statepath, int *retstateloaded )
   context->priceguidepath = 0;
   context->priceguideflags = BSX_PRICEGUIDE_FLAGS_BRICKSTOCK;
   context->priceguidecachetime = BS_PRICEGUIDE_CACHETIME_DEFAULT;
+  context->priceguidehistoryperiod = BS_PRICEGUIDE_HISTORY_PERIOD_DEFAULT;
   context->retainemptylotsflag = 0;
   context->checkmessageflag = 1;
   context->curtime = time( 0 );
@@ -303,6 +312,20 @@ bsContext *bsInit( char *statepath, int *retstateloaded )
     context->brickowl.pipelinequeuesize = 1;
   else if( context->brickowl.pipelinequeuesize > BS_BRICKOWL_PIPELINED_FETCH_MAX )
     context->brickowl.pipelinequeuesize = BS_BRICKOWL_PIPELINED_FETCH_MAX;
+  if( context->bricklink.connectioncount < 1 )
+    context->bricklink.connectioncount = 1;
+  else if( context->bricklink.connectioncount > BS_HTTP_CONNECTIONS_MAX )
+    context->bricklink.connectioncount = BS_HTTP_CONNECTIONS_MAX;
+  if( context->bricklink.webconnectioncount < 1 )
+    context->bricklink.webconnectioncount = 1;
+  else if( context->bricklink.webconnectioncount > BS_HTTP_CONNECTIONS_MAX )
+    context->bricklink.webconnectioncount = BS_HTTP_CONNECTIONS_MAX;
+  if( context->brickowl.connectioncount < 1 )
+    context->brickowl.connectioncount = 1;
+  else if( context->brickowl.connectioncount > BS_HTTP_CONNECTIONS_MAX )
+    context->brickowl.connectioncount = BS_HTTP_CONNECTIONS_MAX;
+  if( context->priceguiderefreshrate > BS_PRICEGUIDE_REFRESH_RATE_MAX )
+    context->priceguiderefreshrate = BS_PRICEGUIDE_REFRESH_RATE_MAX;
 
   /* Verify configuration variables */
   conferrorcount = 0;
@@ -339,6 +362,41 @@ bsContext *bsInit( char *statepath, int *retstateloaded )
 
   ioPrintf( &context->output, 0, BSMSG_INIT "Configuration loaded.\n" );
 
+  /* Open price guide database if configured */
+  if( context->priceguideflags & BSX_PRICEGUIDE_FLAGS_DATABASE )
+  {
+#if CC_UNIX
+    mkdir( context->priceguidepath, S_IRWXU | S_IRGRP | S_IXGRP | S_IROTH | S_IXOTH );
+#elif CC_WINDOWS
+    _mkdir( context->priceguidepath );
+#endif
+    pgdbpath = ccStrAllocPrintf( "%s" CC_DIR_SEPARATOR_STRING "%s", context->priceguidepath, BS_PRICEGUIDE_DB_FILE );
+    context->priceguidedb = bsxOpenPriceGuideDb( pgdbpath );
+    if( !( context->priceguidedb ) )
+    {
+      ioPrintf( &context->output, IO_MODEBIT_FLUSH, BSMSG_ERROR "Failed to open price guide database \"" IO_MAGENTA "%s" IO_WHITE "\".\n", pgdbpath );
+      free( pgdbpath );
+      goto error;
+    }
+    free( pgdbpath );
+  }
+  bsPriceGuideCacheInit( context );
+
+  /* Open price guide history */
+  if( context->priceguidehistoryperiod )
+  {
+#if CC_UNIX
+    mkdir( context->priceguidepath, S_IRWXU | S_IRGRP | S_IXGRP | S_IROTH | S_IXOTH );
+#elif CC_WINDOWS
+    _mkdir( context->priceguidepath );
+#endif
+    pgdbpath = ccStrAllocPrintf( "%s" CC_DIR_SEPARATOR_STRING "%s", context->priceguidepath, BS_PRICEGUIDE_HISTORY_FILE );
+    context->priceguidehistory = bsxOpenPriceGuideHistory( pgdbpath );
+    if( !( context->priceguidehistory ) )
+      ioPrintf( &context->output, IO_MODEBIT_FLUSH, BSMSG_WARNING "Failed to open price guide history \"" IO_MAGENTA "%s" IO_WHITE "\", price history won't be recorded.\n", pgdbpath );
+    free( pgdbpath );
+  }
+
   /* Load state file */
   stateloaded = 0;
   stateloadsize = ccFileLoadDirect( BS_STATE_FILE, &state, sizeof(bsFileStateBase), sizeof(bsFileState) );
@@ -462,6 +520,14 @@ bsContext *bsInit( char *statepath, int *retstateloaded )
   /* Increase BrickOwl timeout due to absurd times required to download inventory */
   httpSetTimeout( context->brickowl.http, 120*1000, 120*1000 );
 
+  /* Spread queries over parallel keep-alive links */
+  httpSetPoolSize( context->bricklink.http, context->bricklink.connectioncount );
+  httpSetPoolSize( context->bricklink.webhttp, context->bricklink.webconnectioncount );
+  httpSetPoolSize( context->brickowl.http, context->brickowl.connectioncount );
+  bsPipelineInit( &context->bricklink.pipeline, context->bricklink.pipelinequeuesize * context->bricklink.connectioncount );
+  bsPipelineInit( &context->bricklink.webpipeline, context->bricklink.pipelinequeuesize * context->bricklink.webconnectioncount );
+  bsPipelineInit( &context->brickowl.pipeline, context->brickowl.pipelinequeuesize * context->brickowl.connectioncount );
+
   /* Determine next synchronization times */
   context->curtime = time( 0 );
   context->bricklink.checktime = context->curtime;
@@ -534,6 +600,15 @@ int bsSaveState( bsContext *context, journalDef *journal )
   state.base.lastruntime = context->curtime;
   memcpy( &state.blapihistory, &context->bricklink.apihistory, sizeof(bsApiHistory) );
   memcpy( &state.boapihistory, &context->brickowl.apihistory, sizeof(bsApiHistory) );
+  /* Without a journal, the persistence thread writes a copy in the background */
+  if( !( journal ) && ( context->persist.activeflag ) )
+  {
+    bsPersistFile( context, BS_STATE_TEMP_FILE, BS_STATE_FILE, &state, sizeof(bsFileState) );
+    context->contextflags &= ~BS_CONTEXT_FLAGS_UPDATED_STATE;
+    return bsPersistPoll( context );
+  }
+  if( !( bsPersistFlush( context ) ) )
+    return 0;
   /* Store temporary file with fsync and record journal entry */
   if( !( ccFileStore( BS_STATE_TEMP_FILE, &state, sizeof(bsFileState), 1 ) ) )
   {
@@ -555,33 +630,144 @@ int bsSaveState( bsContext *context, journalDef *journal )
 }
 
 
-int bsSaveInventory( bsContext *context, journalDef *journal )
+/* Remove log segments made obsolete by the last snapshot */
+static void bsInventoryLogPurge( bsContext *context )
 {
+  uint32_t sequence;
+  char *segmentpath;
+
+  for( sequence = context->inventorylogpurge ; sequence ; sequence-- )
+  {
+    segmentpath = ccStrAllocPrintf( BS_INVENTORY_LOG_PATH, (unsigned int)sequence );
+    if( remove( segmentpath ) )
+    {
+      free( segmentpath );
+      break;
+    }
+    free( segmentpath );
+  }
+  context->inventorylogpurge = 0;
+  return;
+}
+
+
+/* Write changed items as a new log segment, or a full snapshot when the log has grown large */
+/* Called from the persistence thread when no journal is given, so no output here */
+int bsWriteInventory( bsContext *context, bsxInventory *inv, journalDef *journal, ioLog *output, char **retfailpath )
+{
+  int writeresult, maxchanges;
+  bsxLog *log;
+  char *oldpath, *newpath;
   journalEntry journalentry;
 
-  DEBUG_SET_TRACKER();
+  log = &context->inventorylog;
+  bsInventoryLogPurge( context );
 
   /* Store temporary file with fsync and record journal entry */
-  if( !( bsxSaveInventory( BS_INVENTORY_TEMP_FILE, context->inventory, 1, 0 ) ) )
+  writeresult = BSX_LOG_WRITE_OVERFLOW;
+  if( ( log->segmentcount < BS_INVENTORY_LOG_SEGMENT_MAX ) && ( log->logsize < ( ( (size_t)inv->itemcount * BS_INVENTORY_LOG_ITEM_BYTES ) + 65536 ) ) )
+  {
+    maxchanges = 64 + ( inv->itemcount >> 3 );
+    writeresult = bsxLogWrite( BS_INVENTORY_LOG_TEMP_FILE, log, inv, maxchanges, 0, 1 );
+  }
+  if( writeresult == BSX_LOG_WRITE_UNCHANGED )
+    return 1;
+  else if( writeresult == BSX_LOG_WRITE_DONE )
+  {
+    oldpath = BS_INVENTORY_LOG_TEMP_FILE;
+    newpath = ccStrAllocPrintf( BS_INVENTORY_LOG_PATH, (unsigned int)log->sequence );
+  }
+  else if( ( writeresult == BSX_LOG_WRITE_OVERFLOW ) && ( bsxSaveSnapshot( BS_INVENTORY_TEMP_FILE, inv, log, 1 ) ) )
+  {
+    /* Segments up to the snapshot's sequence are obsolete once the journal is executed */
+    context->inventorylogpurge = log->sequence;
+    oldpath = BS_INVENTORY_TEMP_FILE;
+    newpath = ccStrDup( BS_INVENTORY_FILE );
+  }
+  else
   {
-    ioPrintf( &context->output, IO_MODEBIT_FLUSH, BSMSG_ERROR "Failed to write inventory file as \"" IO_RED "%s" CC_DIR_SEPARATOR_STRING "%s" IO_WHITE "\".\n", context->cwd, BS_INVENTORY_TEMP_FILE );
+    *retfailpath = ( writeresult == BSX_LOG_WRITE_FAILED ? BS_INVENTORY_LOG_TEMP_FILE : BS_INVENTORY_TEMP_FILE );
     return 0;
   }
+
   /* Add to journal if any, otherwise update straight away */
   if( journal )
-    journalAddEntry( journal, BS_INVENTORY_TEMP_FILE, BS_INVENTORY_FILE, 0, 0 );
+    journalAddEntry( journal, oldpath, newpath, 0, 1 );
   else
   {
-    journalentry.oldpath = BS_INVENTORY_TEMP_FILE;
-    journalentry.newpath = BS_INVENTORY_FILE;
-    if( !( journalExecute( BS_JOURNAL_FILE, BS_JOURNAL_TEMP_FILE, &context->output, &journalentry, 1 ) ) )
+    journalentry.oldpath = oldpath;
+    journalentry.newpath = newpath;
+    if( !( journalExecute( BS_JOURNAL_FILE, BS_JOURNAL_TEMP_FILE, output, &journalentry, 1 ) ) )
+    {
+      free( newpath );
       return 0;
+    }
+    free( newpath );
+  }
+  return 1;
+}
+
+
+/* Save the tracked inventory, in the background when no journal is given */
+int bsSaveInventory( bsContext *context, journalDef *journal )
+{
+  char *failpath;
+
+  DEBUG_SET_TRACKER();
+
+  if( !( journal ) && ( context->persist.activeflag ) )
+  {
+    bsPersistInventory( context );
+    context->contextflags &= ~BS_CONTEXT_FLAGS_UPDATED_INVENTORY;
+    return bsPersistPoll( context );
+  }
+  /* Pending writes own the inventory log, and journaled batches must follow them */
+  if( !( bsPersistFlush( context ) ) )
+    return 0;
+  failpath = 0;
+  if( !( bsWriteInventory( context, context->inventory, journal, &context->output, &failpath ) ) )
+  {
+    if( failpath )
+      ioPrintf( &context->output, IO_MODEBIT_FLUSH, BSMSG_ERROR "Failed to write inventory file as \"" IO_RED "%s" CC_DIR_SEPARATOR_STRING "%s" IO_WHITE "\".\n", context->cwd, failpath );
+    return 0;
   }
   context->contextflags &= ~BS_CONTEXT_FLAGS_UPDATED_INVENTORY;
   return 1;
 }
 
 
+/* Load the tracked inventory snapshot and replay the log segments following it */
+int bsLoadInventory( bsContext *context )
+{
+  int applyresult;
+  uint32_t segmentcount;
+  char *segmentpath;
+  bsxLog *log;
+
+  DEBUG_SET_TRACKER();
+
+  log = &context->inventorylog;
+  if( !( bsxLoadSnapshot( context->inventory, BS_INVENTORY_FILE, log ) ) )
+    return 0;
+  context->inventorylogpurge = log->sequence;
+  bsInventoryLogPurge( context );
+  for( segmentcount = 0 ; ; segmentcount++ )
+  {
+    segmentpath = ccStrAllocPrintf( BS_INVENTORY_LOG_PATH, (unsigned int)( log->sequence + 1 ) );
+    applyresult = bsxLogApply( context->inventory, segmentpath, log );
+    if( applyresult < 0 )
+      ioPrintf( &context->output, IO_MODEBIT_FLUSH, BSMSG_ERROR "Failed to replay inventory log segment \"" IO_RED "%s" CC_DIR_SEPARATOR_STRING "%s" IO_WHITE "\".\n", context->cwd, segmentpath );
+    free( segmentpath );
+    if( applyresult < 0 )
+      return 0;
+    if( !( applyresult ) )
+      break;
+  }
+  ioPrintf( &context->output, IO_MODEBIT_LOGONLY, "LOG: Replayed %d inventory log segments.\n", (int)segmentcount );
+  return 1;
+}
+
+
 ////
 
 
@@ -625,7 +811,7 @@ void bsItemSetUniqueExtID( bsContext *context, bsxInventory *inv, bsxItem *item
     if( !( bsxFindExtID( inv, extid ) ) )
       break;
   }
-  item->extid = extid;
+  bsxSetItemExtID( inv, item, extid );
   return;
 }
 
@@ -726,7 +912,7 @@ int bsBrickOwlSaveOrder( bsContext *context, bsOrder *order, bsxInventory *inv,
 
 
 /* Returned string must be free()'d */
-char *bsInventoryBackupPath( bsContext *context, int tempflag )
+static char *bsBackupPath( bsContext *context, int tempflag, char *extension )
 {
   time_t curtime;
   struct tm timeinfo;
@@ -746,7 +932,7 @@ char *bsInventoryBackupPath( bsContext *context, int tempflag )
 #else
  #error Unknown/Unsupported platform!
 #endif
-  pathstring = ccStrAllocPrintf( "%s" CC_DIR_SEPARATOR_STRING "%s" "%05d.bsx", dirstring, ( tempflag ? ".tmp" : "" ), context->backupindex );
+  pathstring = ccStrAllocPrintf( "%s" CC_DIR_SEPARATOR_STRING "%s" "%05d%s", dirstring, ( tempflag ? ".tmp" : "" ), context->backupindex, extension );
   if( !( tempflag ) )
     context->backupindex++;
   context->contextflags |= BS_CONTEXT_FLAGS_UPDATED_STATE;
@@ -756,20 +942,60 @@ char *bsInventoryBackupPath( bsContext *context, int tempflag )
 }
 
 
+/* Returned string must be free()'d */
+char *bsInventoryBackupPath( bsContext *context, int tempflag )
+{
+  return bsBackupPath( context, tempflag, ".bsx" );
+}
+
+
 /* Save a backup of the tracked inventory, with fsync() and journaling */
 int bsStoreBackup( bsContext *context, journalDef *journal )
 {
-  int retval;
+  int retval, backupindex;
   journalEntry journalentry;
   char *backupoldpath, *backupnewpath;
 
   DEBUG_SET_TRACKER();
 
-  backupoldpath = bsInventoryBackupPath( context, 1 );
-  backupnewpath = bsInventoryBackupPath( context, 0 );
+  /* Incremental backups are named by the writer, as a delta or a snapshot */
+  backupindex = context->backupindex;
+  if( context->backupdeltaflag )
+  {
+    backupoldpath = bsBackupPath( context, 1, "" );
+    backupnewpath = bsBackupPath( context, 0, "" );
+    ioPrintf( &context->output, 0, BSMSG_INFO "Saving incremental backup " IO_CYAN "#%d" IO_DEFAULT " of tracked inventory at \"" IO_MAGENTA "%s" IO_DEFAULT "\".\n", backupindex, backupnewpath );
+  }
+  else
+  {
+    backupoldpath = bsBackupPath( context, 1, ".bsx" );
+    backupnewpath = bsBackupPath( context, 0, ".bsx" );
+    ioPrintf( &context->output, 0, BSMSG_INFO "Saving backup of tracked inventory at \"" IO_MAGENTA "%s" IO_DEFAULT "\".\n", backupnewpath );
+  }
   retval = 1;
-  ioPrintf( &context->output, 0, BSMSG_INFO "Saving backup of tracked inventory at \"" IO_MAGENTA "%s" IO_DEFAULT "\".\n", backupnewpath );
-  if( !( bsxSaveInventory( backupoldpath, context->inventory, 1, 0 ) ) )
+  /* Without a journal, the persistence thread saves a copy in the background */
+  if( !( journal ) && ( context->persist.activeflag ) )
+  {
+    bsPersistBackup( context, backupindex, backupoldpath, backupnewpath );
+    return bsPersistPoll( context );
+  }
+  if( !( bsPersistFlush( context ) ) )
+  {
+    free( backupoldpath );
+    free( backupnewpath );
+    return 0;
+  }
+  if( context->backupdeltaflag )
+  {
+    if( !( bsWriteBackupDelta( context, context->inventory, backupindex, backupoldpath, backupnewpath, journal, &context->output ) ) )
+    {
+      ioPrintf( &context->output, IO_MODEBIT_FLUSH, BSMSG_ERROR "Failed to write inventory backup to \"" IO_RED "%s" IO_WHITE "\".\n", backupoldpath );
+      retval = 0;
+    }
+    free( backupoldpath );
+    free( backupnewpath );
+  }
+  else if( !( bsxSaveInventory( backupoldpath, context->inventory, 1, 0 ) ) )
   {
     ioPrintf( &context->output, IO_MODEBIT_FLUSH, BSMSG_ERROR "Failed to write inventory backup to \"" IO_RED "%s" IO_WHITE "\".\n", backupoldpath );
     retval = 0;
@@ -794,6 +1020,219 @@ int bsStoreBackup( bsContext *context, journalDef *journal )
 }
 
 
+/* Write the changes since the previous backup as "%05d.delta", or a full "%05d.snapshot" to start a new chain */
+/* Chains never span directories, so that a day of backups can be pruned on its own */
+/* Called from the persistence thread when no journal is given, so no output here */
+int bsWriteBackupDelta( bsContext *context, bsxInventory *inv, int backupindex, char *backupoldpath, char *backupnewpath, journalDef *journal, ioLog *output )
+{
+  int writeresult, dirlength;
+  char *oldpath, *newpath;
+  bsxLog *log;
+  journalEntry journalentry;
+
+  log = &context->backuplog;
+  dirlength = ccStrFindCharLast( backupnewpath, CC_DIR_SEPARATOR_CHAR );
+  if( dirlength < 0 )
+    dirlength = 0;
+  writeresult = BSX_LOG_WRITE_OVERFLOW;
+  oldpath = ccStrAllocPrintf( "%s.delta", backupoldpath );
+  if( ( log->itemhash ) && ( context->backupchaindir ) && ( (int)strlen( context->backupchaindir ) == dirlength ) && ( ccStrCmpSeq( backupnewpath, context->backupchaindir, dirlength ) ) && ( log->segmentcount < BS_BACKUP_DELTA_CHAIN_MAX ) )
+  {
+    /* Deltas are numbered by backup index, an unchanged backup stores an empty delta so that lost files can be told apart */
+    log->sequence = backupindex - 1;
+    writeresult = bsxLogWrite( oldpath, log, inv, 64 + ( inv->itemcount >> 3 ), 1, 1 );
+  }
+  if( writeresult == BSX_LOG_WRITE_DONE )
+    newpath = ccStrAllocPrintf( "%s.delta", backupnewpath );
+  else if( writeresult == BSX_LOG_WRITE_OVERFLOW )
+  {
+    /* Don't chain on a snapshot that might not have been written */
+    free( context->backupchaindir );
+    context->backupchaindir = 0;
+    free( oldpath );
+    oldpath = ccStrAllocPrintf( "%s.snapshot", backupoldpath );
+    log->sequence = backupindex;
+    if( !( bsxSaveSnapshot( oldpath, inv, log, 1 ) ) )
+    {
+      free( oldpath );
+      return 0;
+    }
+    newpath = ccStrAllocPrintf( "%s.snapshot", backupnewpath );
+    context->backupchaindir = ccStrAllocPrintf( "%.*s", dirlength, backupnewpath );
+  }
+  else
+  {
+    free( oldpath );
+    return 0;
+  }
+
+  if( journal )
+    journalAddEntry( journal, oldpath, newpath, 1, 1 );
+  else
+  {
+    journalentry.oldpath = oldpath;
+    journalentry.newpath = newpath;
+    writeresult = journalExecute( BS_JOURNAL_FILE, BS_JOURNAL_TEMP_FILE, output, &journalentry, 1 );
+    free( oldpath );
+    free( newpath );
+    if( !( writeresult ) )
+      return 0;
+  }
+  return 1;
+}
+
+
+enum
+{
+  BS_BACKUP_FILE_NONE,
+  BS_BACKUP_FILE_BSX,
+  BS_BACKUP_FILE_SNAPSHOT,
+  BS_BACKUP_FILE_DELTA
+};
+
+/* Parse "%05d.bsx", "%05d.snapshot" or "%05d.delta" */
+static int bsBackupFileType( char *filename, int *retindex )
+{
+  int index;
+  char *string;
+
+  index = 0;
+  for( string = filename ; ( *string >= '0' ) && ( *string <= '9' ) ; string++ )
+    index = ( index * 10 ) + ( *string - '0' );
+  if( ( string == filename ) || ( *string != '.' ) )
+    return BS_BACKUP_FILE_NONE;
+  *retindex = index;
+  string++;
+  if( ccStrCmpEqual( string, "bsx" ) )
+    return BS_BACKUP_FILE_BSX;
+  if( ccStrCmpEqual( string, "snapshot" ) )
+    return BS_BACKUP_FILE_SNAPSHOT;
+  if( ccStrCmpEqual( string, "delta" ) )
+    return BS_BACKUP_FILE_DELTA;
+  return BS_BACKUP_FILE_NONE;
+}
+
+
+/* Rebuild the tracked inventory as saved by the backup of that index */
+/* Full BSX backups are loaded as is, otherwise the closest snapshot is loaded and its deltas applied */
+bsxInventory *bsLoadBackup( bsContext *context, int backupindex )
+{
+  int filetype, fileindex, baseindex, deltaindex, applyresult;
+  char *filename, *subfilename, *filepath;
+  char *bsxpath, *basedir;
+  ccDir *backupdir, *subdir;
+  bsxInventory *inv;
+  bsxLog log;
+
+  DEBUG_SET_TRACKER();
+
+  backupdir = ccOpenDir( BS_BACKUP_DIR );
+  if( !( backupdir ) )
+  {
+    ioPrintf( &context->output, 0, BSMSG_ERROR "We failed to open the directory \"" IO_RED "%s" IO_WHITE "\" for reading.\n", BS_BACKUP_DIR );
+    return 0;
+  }
+  bsxpath = 0;
+  basedir = 0;
+  baseindex = -1;
+  for( ; ; )
+  {
+    filename = ccReadDir( backupdir );
+    if( !( filename ) )
+      break;
+    if( filename[0] == '.' )
+      continue;
+    filepath = ccStrAllocPrintf( BS_BACKUP_DIR CC_DIR_SEPARATOR_STRING "%s", filename );
+    subdir = ccOpenDir( filepath );
+    if( subdir )
+    {
+      for( ; ; )
+      {
+        subfilename = ccReadDir( subdir );
+        if( !( subfilename ) )
+          break;
+        filetype = bsBackupFileType( subfilename, &fileindex );
+        if( ( filetype == BS_BACKUP_FILE_BSX ) && ( fileindex == backupindex ) && !( bsxpath ) )
+          bsxpath = ccStrAllocPrintf( "%s" CC_DIR_SEPARATOR_STRING "%s", filepath, subfilename );
+        else if( ( filetype == BS_BACKUP_FILE_SNAPSHOT ) && ( fileindex <= backupindex ) && ( fileindex > baseindex ) )
+        {
+          baseindex = fileindex;
+          free( basedir );
+          basedir = ccStrDup( filepath );
+        }
+      }
+      ccCloseDir( subdir );
+    }
+    free( filepath );
+  }
+  ccCloseDir( backupdir );
+
+  inv = bsxNewInventory();
+  if( bsxpath )
+  {
+    if( !( bsxLoadInventory( inv, bsxpath ) ) )
+    {
+      ioPrintf( &context->output, 0, BSMSG_ERROR "Failed to load inventory backup \"" IO_RED "%s" IO_WHITE "\".\n", bsxpath );
+      bsxFreeInventory( inv );
+      inv = 0;
+    }
+    free( bsxpath );
+    free( basedir );
+    return inv;
+  }
+  if( !( basedir ) )
+  {
+    ioPrintf( &context->output, 0, BSMSG_ERROR "No backup found for index " IO_RED "#%d" IO_WHITE ".\n", backupindex );
+    bsxFreeInventory( inv );
+    return 0;
+  }
+
+  memset( &log, 0, sizeof(bsxLog) );
+  filepath = ccStrAllocPrintf( "%s" CC_DIR_SEPARATOR_STRING "%05d.snapshot", basedir, baseindex );
+  if( !( bsxLoadSnapshot( inv, filepath, &log ) ) )
+  {
+    ioPrintf( &context->output, 0, BSMSG_ERROR "Failed to load inventory snapshot \"" IO_RED "%s" IO_WHITE "\".\n", filepath );
+    goto error;
+  }
+  free( filepath );
+  /* Every index of the chain must have its delta, except indices used by full BSX backups */
+  for( deltaindex = baseindex + 1 ; deltaindex <= backupindex ; deltaindex++ )
+  {
+    filepath = ccStrAllocPrintf( "%s" CC_DIR_SEPARATOR_STRING "%05d.delta", basedir, deltaindex );
+    log.sequence = deltaindex - 1;
+    applyresult = bsxLogApply( inv, filepath, &log );
+    if( applyresult < 0 )
+    {
+      ioPrintf( &context->output, 0, BSMSG_ERROR "Failed to apply inventory delta \"" IO_RED "%s" IO_WHITE "\".\n", filepath );
+      goto error;
+    }
+    if( !( applyresult ) )
+    {
+      free( filepath );
+      filepath = ccStrAllocPrintf( "%s" CC_DIR_SEPARATOR_STRING "%05d.bsx", basedir, deltaindex );
+      if( !( ccFileExists( filepath ) ) )
+      {
+        free( filepath );
+        filepath = ccStrAllocPrintf( "%s" CC_DIR_SEPARATOR_STRING "%05d.delta", basedir, deltaindex );
+        ioPrintf( &context->output, 0, BSMSG_ERROR "Inventory delta \"" IO_RED "%s" IO_WHITE "\" is missing or stale, backup " IO_RED "#%d" IO_WHITE " can not be rebuilt.\n", filepath, backupindex );
+        goto error;
+      }
+    }
+    free( filepath );
+  }
+  bsxLogFree( &log );
+  free( basedir );
+  return inv;
+
+  error:
+  free( filepath );
+  bsxLogFree( &log );
+  free( basedir );
+  bsxFreeInventory( inv );
+  return 0;
+}
+
+
 /* Returned string must be free()'d */
 char *bsErrorStoragePath( bsContext *context, int tempflag )
 {
@@ -1137,8 +1576,12 @@ int main( int argc, char **argv )
   if( stateloaded )
   {
     ioPrintf( &context->output, 0, BSMSG_INIT "BrickSync state successfully loaded.\n" );
-    /* Attempt to load local inventory from disk */
-    if( !( bsxLoadInventory( context->inventory, BS_INVENTORY_FILE ) ) )
+    /* Attempt to load local inventory from disk, falling back to the BSX file of previous versions */
+    if( bsLoadInventory( context ) )
+      ioPrintf( &context->output, IO_MODEBIT_LOGONLY, "LOG: Loaded tracked inventory, %d lots.\n", context->inventory->itemcount );
+    else if( !( ccFileExists( BS_INVENTORY_FILE ) ) && ( bsxLoadInventory( context->inventory, BS_INVENTORY_BSX_FILE ) ) && ( bsxSaveSnapshot( BS_INVENTORY_TEMP_FILE, context->inventory, &context->inventorylog, 1 ) ) && ( journalRenameSync( BS_INVENTORY_TEMP_FILE, BS_INVENTORY_FILE, 1 ) ) )
+      ioPrintf( &context->output, 0, BSMSG_INFO "Imported tracked inventory from \"" IO_CYAN "%s" IO_DEFAULT "\".\n", BS_INVENTORY_BSX_FILE );
+    else
     {
       stateloaded = 0;
       ioPrintf( &context->output, IO_MODEBIT_FLUSH, BSMSG_ERROR "No main inventory file found at \"" IO_RED "%s" CC_DIR_SEPARATOR_STRING "%s" IO_WHITE "\".\n", context->cwd, BS_INVENTORY_FILE );
@@ -1201,13 +1644,11 @@ int main( int argc, char **argv )
     bsInventoryFilterOutItems( context, context->inventory );
     context->stateflags |= BS_STATE_FLAGS_BRICKOWL_INITSYNC;
     journalAlloc( &journal, 2 );
-    if( !( bsxSaveInventory( BS_INVENTORY_TEMP_FILE, context->inventory, 1, 0 ) ) )
+    if( !( bsSaveInventory( context, &journal ) ) )
     {
-      ioPrintf( &context->output, IO_MODEBIT_FLUSH, BSMSG_ERROR "Failed to save inventory file \"" IO_RED "%s" IO_WHITE "\"!\n", BS_INVENTORY_TEMP_FILE );
       bsFatalError( context );
       return 0;
     }
-    journalAddEntry( &journal, BS_INVENTORY_TEMP_FILE, BS_INVENTORY_FILE, 0, 0 );
     if( !( bsSaveState( context, &journal ) ) )
     {
       bsFatalError( context );
@@ -1328,6 +1769,9 @@ int main( int argc, char **argv )
   ioPrintf( &context->output, 0, BSMSG_INFO "Type \"" IO_CYAN "help" IO_DEFAULT "\" for the list of commands.\n" );
   ioPrintf( &context->output, 0, "\n" );
 
+  /* From now on, saves without a journal are written in the background */
+  bsPersistInit( context );
+
   /* We enter the main loop, yaarrr! */
 #if BS_ENABLE_ANTIDEBUG
   statusflag = 0;
@@ -1381,6 +1825,12 @@ int main( int argc, char **argv )
         return 0;
       }
     }
+    /* Any failed background write is fatal */
+    if( !( bsPersistPoll( context ) ) )
+    {
+      bsFatalError( context );
+      return 0;
+    }
 
     /* Flush buffered I/O on log file */
     ioLogFlush( &context->output );
@@ -1618,6 +2068,9 @@ int main( int argc, char **argv )
 
       } while( workloop );
 
+      /* Trickle price guide refreshes while idle */
+      bsPriceGuideRefreshIdle( context );
+
 #if BS_ENABLE_ANTIDEBUG
       /* Initialize some anti-debugging stuff */
       if( !( antidebuginit( context, &cpuinfo ) ) )
@@ -1668,7 +2121,15 @@ int main( int argc, char **argv )
     bsFlushTcpProcessHttp( context );
   }
 
+  /* Complete pending writes before releasing the tracked inventory */
+  bsPersistFlush( context );
+  bsPersistEnd( context );
   bsxFreeInventory( context->inventory );
+  bsxLogFree( &context->inventorylog );
+  bsxLogFree( &context->backuplog );
+  free( context->backupchaindir );
+  bsxClosePriceGuideDb( context->priceguidedb );
+  bsxClosePriceGuideHistory( context->priceguidehistory );
   bsxFreeInventory( context->bricklink.diffinv );
   bsxFreeInventory( context->brickowl.diffinv );
 
@@ -1677,6 +2138,9 @@ int main( int argc, char **argv )
   httpClose( context->bricklink.http );
   httpClose( context->bricklink.webhttp );
   httpClose( context->brickowl.http );
+  bsPriceGuideRefreshFree( context );
+  bsPriceGuideCacheFree( context );
+  bsSetInvCacheFree( context );
 
 #if BS_ENABLE_ANTIDEBUG
   if( !( statusflag ) )
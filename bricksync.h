@@ -55,8 +55,13 @@
 #define BS_GLOBAL_PATH "data" CC_DIR_SEPARATOR_STRING
 
 /* BrickSync file paths */
-#define BS_INVENTORY_FILE BS_GLOBAL_PATH "bricksync.inventory.bsx"
-#define BS_INVENTORY_TEMP_FILE BS_GLOBAL_PATH "temp.bricksync.inventory.bsx"
+#define BS_INVENTORY_FILE BS_GLOBAL_PATH "bricksync.inventory.snapshot"
+#define BS_INVENTORY_TEMP_FILE BS_GLOBAL_PATH "temp.bricksync.inventory.snapshot"
+/* Tracked inventory of previous versions, imported when no snapshot is found */
+#define BS_INVENTORY_BSX_FILE BS_GLOBAL_PATH "bricksync.inventory.bsx"
+/* Segments of changes to the tracked inventory since its snapshot */
+#define BS_INVENTORY_LOG_PATH BS_GLOBAL_PATH "bricksync.inventory.log.%u"
+#define BS_INVENTORY_LOG_TEMP_FILE BS_GLOBAL_PATH "temp.bricksync.inventory.log"
 #define BS_STATE_FILE BS_GLOBAL_PATH "bricksync.state"
 #define BS_STATE_TEMP_FILE BS_GLOBAL_PATH "temp.bricksync.state"
 #define BS_JOURNAL_FILE BS_GLOBAL_PATH "bricksync.journal"
@@ -76,6 +81,10 @@
 #define BS_BRICKOWL_ORDER_PATH BS_GLOBAL_PATH "orders" CC_DIR_SEPARATOR_STRING "brickowl-%lld.bsx"
 #define BS_BRICKOWL_ORDER_TEMP_PATH BS_GLOBAL_PATH "orders" CC_DIR_SEPARATOR_STRING".temp.brickowl-%lld.bsx"
 #define BS_PRICEGUIDE_DIR BS_GLOBAL_PATH "pgcache"
+#define BS_PRICEGUIDE_DB_FILE "priceguide.db"
+#define BS_PRICEGUIDE_HISTORY_FILE "priceguide.hist"
+#define BS_SETINV_CACHE_FILE BS_GLOBAL_PATH "bricksync.setinv.cache"
+#define BS_SETINV_CACHE_TEMP_FILE BS_GLOBAL_PATH "temp.bricksync.setinv.cache"
 
 /* BrickSync XML output */
 #define BS_BLXMLUPLOAD_FILE "blupload%03d.xml.txt"
@@ -86,6 +95,19 @@
 #define BS_BRICKOWL_PIPELINED_FETCH (4)
 #define BS_BRICKOWL_PIPELINED_FETCH_MAX (8)
 
+/* Count of parallel keep-alive links per service */
+#define BS_BRICKLINK_CONNECTIONS (1)
+#define BS_BRICKLINK_WEB_CONNECTIONS (2)
+#define BS_BRICKOWL_CONNECTIONS (1)
+#define BS_HTTP_CONNECTIONS_MAX (8)
+
+/* Pipeline depth control: halve on errors, shrink when the per-reply time exceeds the minimum by that factor */
+#define BS_PIPELINE_ERROR_DECREASE (0.5)
+#define BS_PIPELINE_DELAY_DECREASE (0.75)
+#define BS_PIPELINE_DELAY_FACTOR (2.0)
+/* Count of reply time samples before the minimum is measured again */
+#define BS_PIPELINE_MINRTT_WINDOW (256)
+
 
 /*
  * Upon initialization, fetch all BrickLink orders from up to 30 days back
@@ -105,6 +127,13 @@
 #define BS_SYNC_DELAY_MAX (60*30)
 #define BS_SYNC_DELAY_FAIL_FACTOR (3)
 
+/* Inventory log segments and bytes per lot before writing a full snapshot */
+#define BS_INVENTORY_LOG_SEGMENT_MAX (256)
+#define BS_INVENTORY_LOG_ITEM_BYTES (64)
+
+/* Incremental backups: deltas per full snapshot, a new chain also starts every day */
+#define BS_BACKUP_DELTA_CHAIN_MAX (128)
+
 #define BS_BRICKLINK_APICOUNT_LIMIT_DEFAULT (5000)
 #define BS_BRICKLINK_APICOUNT_PRICELIMIT_DEFAULT (2500)
 #define BS_BRICKLINK_APICOUNT_NOTESLIMIT_DEFAULT (3600)
@@ -113,6 +142,19 @@
 
 #define BS_PRICEGUIDE_CACHETIME_DEFAULT (5*24*60*60)
 
+/* Background price guide refresh: entries examined per main loop iteration, and how often the list is rebuilt from the inventory */
+#define BS_PRICEGUIDE_REFRESH_SCAN_CHUNK (64)
+#define BS_PRICEGUIDE_REFRESH_REBUILD_INTERVAL (60*60)
+/* Ceiling of refreshes per hour, one per second */
+#define BS_PRICEGUIDE_REFRESH_RATE_MAX (60*60)
+/* Entries of the in-memory price guide cache, one per condition */
+#define BS_PRICEGUIDE_CACHE_SIZE (65536)
+/* Moving average period of the price guide history, in days */
+#define BS_PRICEGUIDE_HISTORY_PERIOD_DEFAULT (30)
+
+/* Set inventories rarely change, keep cached ones for a long time */
+#define BS_SETINV_CACHETIME (90*24*60*60)
+
 /* Secret offset to be decrypted by registration key */
 #define BS_REGISTRATION_SECRET_OFFSET (0x9a6fc)
 
@@ -194,6 +236,127 @@ typedef struct
   uint32_t total;
 } bsApiHistory __attribute__ ((aligned(8)));
 
+/* Background writer of state, tracked inventory and backups, see bspersist.c */
+typedef struct
+{
+  int activeflag;
+  int quitflag;
+  mtThread thread;
+  mtMutex mutex;
+  /* Wakes the thread when a task is queued */
+  mtSignal tasksignal;
+  /* Wakes bsPersistFlush() when the queue is drained */
+  mtSignal idlesignal;
+  void *taskfirst;
+  void *tasklast;
+  /* Queued tasks plus the one being written */
+  int taskcount;
+  /* Sticky failure, message is printed once by the main thread */
+  int failedflag;
+  char *failmessage;
+} bsPersist;
+
+/* In-memory LRU of price guide records read from or written to the cache directory, see bspriceguide.c */
+typedef struct
+{
+  uint32_t hashkey;
+  char typeid;
+  char condition;
+  int colorid;
+  char *id;
+  bsxPriceGuide pg;
+  /* Hash chain and LRU list links, entry indices or -1 */
+  int hashnext;
+  int lruprev;
+  int lrunext;
+} bsPriceGuideCacheEntry;
+
+typedef struct
+{
+  int activeflag;
+  /* Lookups also come from the worker threads of bsProcessInventoryPriceGuide() */
+  mtMutex mutex;
+  bsPriceGuideCacheEntry *entrylist;
+  int entrycount;
+  int *hashtable;
+  uint32_t hashmask;
+  /* Most recently used first */
+  int lrufirst;
+  int lrulast;
+  int64_t hitcount;
+  int64_t misscount;
+} bsPriceGuideCache;
+
+typedef struct
+{
+  char typeid;
+  int colorid;
+  int64_t modtime;
+  char *id;
+} bsPriceGuideRefreshEntry;
+
+/* Background price guide refresh, oldest cached entries of the tracked inventory first, see bsfetchpriceguide.c */
+typedef struct
+{
+  bsPriceGuideRefreshEntry *entrylist;
+  int entrycount;
+  /* Entries up to scanindex have their modtime, the list is sorted oldest first once complete */
+  int scanindex;
+  int nextindex;
+  int64_t buildtime;
+  int64_t fetchtime;
+  /* Single query in flight, key copied as the list may be rebuilt */
+  int pendingflag;
+  char pendingtypeid;
+  int pendingcolorid;
+  char *pendingid;
+  int refreshcount;
+  int failcount;
+} bsPriceGuideRefresh;
+
+/* Cached set inventories, loaded on first use; see bsfetchset.c */
+typedef struct
+{
+  int64_t modtime;
+  uint64_t offset;
+  int32_t size;
+  int32_t partcount;
+  char typeid;
+  char id[47];
+} bsSetInvEntry;
+
+typedef struct
+{
+  int loadedflag;
+  int dirtyflag;
+  /* Part lists, entries point into it */
+  char *data;
+  size_t datasize;
+  size_t dataalloc;
+  /* Sorted by typeid and id for binary searches */
+  bsSetInvEntry *entrylist;
+  int entrycount;
+  int entryalloc;
+} bsSetInvCache;
+
+/* AIMD control of the count of queries in flight; see bricksyncnet.c */
+typedef struct
+{
+  /* Current depth, fractional for additive increase */
+  double depth;
+  /* Ceiling, configured pipeline queue size times the count of links */
+  int maxdepth;
+  /* Smoothed and minimum per-reply times in milliseconds */
+  double srtt;
+  double minrtt;
+  /* Minimum of the current window, replaces minrtt once the window is full */
+  double windowminrtt;
+  int windowcount;
+  /* Count of replies to observe before another decrease is allowed */
+  int holdcount;
+  int decreasecount;
+} bsPipeline;
+
 typedef struct
 {
   /* Access credentials */
@@ -210,6 +373,12 @@ typedef struct
   httpConnection *webhttp;
   /* Pipelined fetch count */
   int pipelinequeuesize;
+  /* Count of parallel links for API and web connections */
+  int connectioncount;
+  int webconnectioncount;
+  /* Adaptive count of queries in flight for API and web connections */
+  bsPipeline pipeline;
+  bsPipeline webpipeline;
   /* Timestamp of latest order + 1 */
   int64_t orderinitdate;
   int64_t ordertopdate;
@@ -250,6 +419,10 @@ typedef struct
   httpConnection *http;
   /* Pipelined fetch count */
   int pipelinequeuesize;
+  /* Count of parallel links for API connection */
+  int connectioncount;
+  /* Adaptive count of queries in flight for API connection */
+  bsPipeline pipeline;
   /* Timestamp of latest order + 1 */
   int64_t orderinitdate;
   int64_t ordertopdate;
@@ -296,10 +469,22 @@ typedef struct
   char *priceguidepath;
   int priceguideflags;
   int priceguidecachetime;
+  bsxPriceGuideDb *priceguidedb;
+  /* Count of price guides refreshed per hour during idle time, zero disables */
+  int priceguiderefreshrate;
+  bsPriceGuideRefresh pgrefresh;
+  bsPriceGuideCache pgcache;
+  /* Snapshots appended on each price guide write, zero period disables */
+  bsxPriceGuideHistory *priceguidehistory;
+  int priceguidehistoryperiod;
+
+  /* Set inventory cache */
+  bsSetInvCache setinvcache;
 
   /* User options */
   int retainemptylotsflag;
   int checkmessageflag;
+  int backupdeltaflag;
 
 #if BS_ENABLE_LIMITS
   int64_t limitinvhardmaxmask;
@@ -327,6 +512,15 @@ typedef struct
 
   /* Tracked local inventory */
   bsxInventory *inventory;
+  /* Log of changes to the tracked inventory since its snapshot */
+  bsxLog inventorylog;
+  /* Log segments up to this sequence are obsolete, removed on next save */
+  uint32_t inventorylogpurge;
+  /* Inventory state of the last incremental backup, and the directory of its chain */
+  bsxLog backuplog;
+  char *backupchaindir;
+  /* Owns inventorylog, inventorylogpurge and backuplog while tasks are pending */
+  bsPersist persist;
 
 #if BS_ENABLE_MATHPUZZLE
   int puzzlequestiontype;
@@ -513,6 +707,9 @@ void bsFreeReply( bsContext *context, bsQueryReply *reply );
 
 void bsBrickLinkAddQuery( bsContext *context, char *methodstring, char *pathstring, char *paramstring, char *bodystring, void *uservalue, void (*querycallback)( void *uservalue, int resultcode, httpResponse *response ) );
 void bsBrickOwlAddQuery( bsContext *context, char *querystring, int httpflags, void *uservalue, void (*querycallback)( void *uservalue, int resultcode, httpResponse *response ) );
+/* Same as above, the reply content is handed to contentcallback() as it is received instead of being assembled */
+void bsBrickLinkAddStreamQuery( bsContext *context, char *methodstring, char *pathstring, char *paramstring, char *bodystring, void *uservalue, void (*querycallback)( void *uservalue, int resultcode, httpResponse *response ), void (*contentcallback)( void *uservalue, httpResponse *response, void *data, size_t size ) );
+void bsBrickOwlAddStreamQuery( bsContext *context, char *querystring, int httpflags, void *uservalue, void (*querycallback)( void *uservalue, int resultcode, httpResponse *response ), void (*contentcallback)( void *uservalue, httpResponse *response, void *data, size_t size ) );
 
 /* Flush tcp callbacks and process all http connections */
 void bsFlushTcpProcessHttp( bsContext *context );
@@ -523,6 +720,11 @@ void bsWaitBrickLinkWebQueries( bsContext *context, int maxpending );
 void bsWaitBrickOwlQueries( bsContext *context, int maxpending );
 void bsWaitBrickSyncWebQueries( bsContext *context, int maxpending );
 
+/* Adaptive count of queries in flight */
+void bsPipelineInit( bsPipeline *pipeline, int maxdepth );
+int bsPipelineDepth( bsPipeline *pipeline );
+int bsPipelineWaitCount( bsPipeline *pipeline, int querycount );
+
 /* Connection status generic handling */
 void bsTrackerInit( bsTracker *tracker, httpConnection *http );
 int bsTrackerAccumResult( bsContext *context, bsTracker *tracker, int httpresult, int accumflags );
@@ -565,15 +767,23 @@ int bsBrickOwlSaveOrder( bsContext *context, bsOrder *order, bsxInventory *inv,
 char *bsInventoryBackupPath( bsContext *context, int tempflag );
 /* Store backup */
 int bsStoreBackup( bsContext *context, journalDef *journal );
+/* Write backup as a delta of the previous one or a new snapshot, paths are without extension; no output */
+int bsWriteBackupDelta( bsContext *context, bsxInventory *inv, int backupindex, char *backupoldpath, char *backupnewpath, journalDef *journal, ioLog *output );
+/* Rebuild the tracked inventory as saved by the backup of that index */
+bsxInventory *bsLoadBackup( bsContext *context, int backupindex );
 
 /* Store error path, returned string must be free()'d */
 char *bsErrorStoragePath( bsContext *context, int tempflag );
 /* Store error */
 int bsStoreError( bsContext *context, char *errortype, char *header, size_t headerlength, void *data, size_t datasize );
 
+int bsLoadInventory( bsContext *context );
 int bsSaveInventory( bsContext *context, journalDef *journal );
 int bsSaveState( bsContext *context, journalDef *journal );
 
+/* Write inventory log segment or snapshot, no output, *retfailpath is set if a file failed to write */
+int bsWriteInventory( bsContext *context, bsxInventory *inv, journalDef *journal, ioLog *log, char **retfailpath );
+
 
 
 /* Defined in bricsyncinit.c */
@@ -787,8 +997,11 @@ int bsApiHistoryCountPeriod( bsApiHistory *history, int64_t seconds );
 
 /* Defined in bsfetchset.c */
 
-/* Fetch the inventory for a set ID */
+/* Fetch the inventory for a set ID, from the set inventory cache when present */
 bsxInventory *bsBrickLinkFetchSetInventory( bsContext *context, char itemtypeid, char *setid );
+/* Fetch and cache the inventories of many sets over the pipelined connection, return the count of sets cached */
+int bsBrickLinkPrefetchSetInventories( bsContext *context, char itemtypeid, char **setidlist, int setidcount, int forceflag );
+void bsSetInvCacheFree( bsContext *context );
 
 
 
@@ -796,6 +1009,12 @@ bsxInventory *bsBrickLinkFetchSetInventory( bsContext *context, char itemtypeid,
 
 /* Populate the price guide cache with all items flagged BSX_ITEM_XFLAGS_FETCH_PRICE_GUIDE */
 int bsBrickLinkFetchPriceGuide( bsContext *context, bsxInventory *inv, void *callbackpointer, void (*callback)( bsContext *context, bsxInventory *inv, bsxItem *item, bsxPriceGuide *pg, void *callbackpointer ) );
+/* Same, queueing items as they are examined by scan(), which returns the count of items examined and blocks for progress if waitflag is set */
+int bsBrickLinkFetchPriceGuideScan( bsContext *context, bsxInventory *inv, void *callbackpointer, void (*callback)( bsContext *context, bsxInventory *inv, bsxItem *item, bsxPriceGuide *pg, void *callbackpointer ), void *scanpointer, int (*scan)( bsContext *context, void *scanpointer, int waitflag ) );
+
+/* Trickle refreshes of the oldest price guides of the tracked inventory, called from the main loop */
+void bsPriceGuideRefreshIdle( bsContext *context );
+void bsPriceGuideRefreshFree( bsContext *context );
 
 
 /* Defined in bsoutputxml.c */
@@ -809,16 +1028,28 @@ int bsOutputBrickLinkXML( bsContext *context, bsxInventory *inv, int apiwarningf
 
 typedef struct
 {
-  int quantity;
   double value;
-  double sale;
-  double price;
-  double pgq;
-  double pgp;
-  int stockflag;
-  int itemindex;
+  int batchindex;
 } bsPriceGuideAlt;
 
+/* Per-item columns gathered by bsPriceGuideSumCallback(), resolved and summed in one pass by bsPriceGuideFinishState() */
+typedef struct
+{
+  int count;
+  int alloc;
+  int *itemindex;
+  int *alternateid;
+  double *quantity;
+  double *value;
+  double *sale;
+  double *price;
+  double *pgq;
+  double *pgp;
+  /* Set to 1.0 or 0.0 by stock status, both are cleared for discarded alternates */
+  double *stockmask;
+  double *newmask;
+} bsPriceGuideBatch;
+
 typedef struct
 {
   bsxInventory *inv;
@@ -826,6 +1057,7 @@ typedef struct
   int removealtflag;
   int altcount;
   bsPriceGuideAlt *altlist;
+  bsPriceGuideBatch batch;
 
   int stocklots;
   int stockcount;
@@ -850,10 +1082,17 @@ typedef struct
   double totalpgp;
 } bsPriceGuideState;
 
+void bsPriceGuideCacheInit( bsContext *context );
+void bsPriceGuideCacheFree( bsContext *context );
+int bsPriceGuideRead( bsContext *context, bsxPriceGuide *pg, char itemtypeid, char *itemid, int itemcolorid, char itemcondition );
+int bsPriceGuideWrite( bsContext *context, bsxPriceGuide *pgnew, bsxPriceGuide *pgused, char itemtypeid, char *itemid, int itemcolorid );
+int bsPriceGuideHistoryAverage( bsContext *context, char itemtypeid, char *itemid, int itemcolorid, char itemcondition, int64_t starttime, float *retaverage );
+
 int bsProcessInventoryPriceGuide( bsContext *context, bsxInventory *inv, int cachetime, void *callbackpointer, void (*callback)( bsContext *context, bsxInventory *inv, bsxItem *item, bsxPriceGuide *pg, void *callbackpointer ) );
 
 void bsPriceGuideInitState( bsPriceGuideState *pgstate, bsxInventory *inv, int showaltflag, int removealtflag );
 void bsPriceGuideFinishState( bsPriceGuideState *pgstate );
+void bsPriceGuideFreeState( bsPriceGuideState *pgstate );
 void bsPriceGuideSumCallback( bsContext *context, bsxInventory *inv, bsxItem *item, bsxPriceGuide *pg, void *callbackpointer );
 void bsPriceGuideListRangeCallback( bsContext *context, bsxInventory *inv, bsxItem *item, bsxPriceGuide *pg, void *callbackpointer );
 
@@ -932,6 +1171,26 @@ void bsReadBrickSyncMessage( bsContext *context );
 
 
 
+/* Defined in bspersist.c */
+
+/* Without a journal, bsSaveState(), bsSaveInventory() and bsStoreBackup() queue their writes to a persistence thread */
+/* Tasks are written and journaled in order; bsPersistFlush() must be called before any mutating API batch */
+void bsPersistInit( bsContext *context );
+void bsPersistEnd( bsContext *context );
+/* Wait for all queued writes, return 0 if any write failed */
+int bsPersistFlush( bsContext *context );
+/* Return 0 if any write failed, doesn't wait */
+int bsPersistPoll( bsContext *context );
+
+/* Queue a copy of data to store at temppath, journaled to path */
+void bsPersistFile( bsContext *context, char *temppath, char *path, void *data, size_t datasize );
+/* Queue a copy of the tracked inventory to write through bsWriteInventory() */
+void bsPersistInventory( bsContext *context );
+/* Queue a copy of the tracked inventory to save as backup, takes ownership of paths */
+void bsPersistBackup( bsContext *context, int backupindex, char *backupoldpath, char *backupnewpath );
+
+
+
 /* Defined in bsorderdir.c */
 
 typedef struct
@@ -347,6 +347,18 @@ static int bsConfParse( bsContext *context, bsConfParser *parser )
             goto error;
           context->bricklink.pipelinequeuesize = (int)readint;
         }
+        else if( ccStrMatchSeq( "connections", tokenstring, token->length ) )
+        {
+          if( !( bsConfReadInteger( context, parser, &readint ) ) )
+            goto error;
+          context->bricklink.connectioncount = (int)readint;
+        }
+        else if( ccStrMatchSeq( "webconnections", tokenstring, token->length ) )
+        {
+          if( !( bsConfReadInteger( context, parser, &readint ) ) )
+            goto error;
+          context->bricklink.webconnectioncount = (int)readint;
+        }
         else
         {
           bsConfErrorUnknownScopeMember( context, parser, token );
@@ -389,6 +401,12 @@ static int bsConfParse( bsContext *context, bsConfParser *parser )
             goto error;
           context->brickowl.pipelinequeuesize = (int)readint;
         }
+        else if( ccStrMatchSeq( "connections", tokenstring, token->length ) )
+        {
+          if( !( bsConfReadInteger( context, parser, &readint ) ) )
+            goto error;
+          context->brickowl.connectioncount = (int)readint;
+        }
         else if( ccStrMatchSeq( "reuseempty", tokenstring, token->length ) )
         {
           if( !( bsConfReadInteger( context, parser, &readint ) ) )
@@ -428,6 +446,8 @@ static int bsConfParse( bsContext *context, bsConfParser *parser )
             context->priceguideflags = BSX_PRICEGUIDE_FLAGS_BRICKSTORE;
           else if( ccStrLowCmpWord( readstring, "brickstock" ) )
             context->priceguideflags = BSX_PRICEGUIDE_FLAGS_BRICKSTOCK;
+          else if( ccStrLowCmpWord( readstring, "database" ) )
+            context->priceguideflags = BSX_PRICEGUIDE_FLAGS_DATABASE;
           else
           {
             linecount = bsConfResolveLine( context, parser, &lineoffset );
@@ -443,6 +463,18 @@ static int bsConfParse( bsContext *context, bsConfParser *parser )
             goto error;
           context->priceguidecachetime = 24*60*60 * (int)readint;
         }
+        else if( ccStrMatchSeq( "refreshrate", tokenstring, token->length ) )
+        {
+          if( !( bsConfReadInteger( context, parser, &readint ) ) )
+            goto error;
+          context->priceguiderefreshrate = ( readint > 0 ? (int)readint : 0 );
+        }
+        else if( ccStrMatchSeq( "historyperiod", tokenstring, token->length ) )
+        {
+          if( !( bsConfReadInteger( context, parser, &readint ) ) )
+            goto error;
+          context->priceguidehistoryperiod = ( readint > 0 ? (int)readint : 0 );
+        }
         else
         {
           bsConfErrorUnknownScopeMember( context, parser, token );
@@ -461,6 +493,12 @@ static int bsConfParse( bsContext *context, bsConfParser *parser )
           goto error;
         context->checkmessageflag = (int)readint;
       }
+      else if( ccStrMatchSeq( "backupdelta", tokenstring, token->length ) )
+      {
+        if( !( bsConfReadInteger( context, parser, &readint ) ) )
+          goto error;
+        context->backupdeltaflag = (int)readint;
+      }
       else if( ccStrMatchSeq( "registrationkey", tokenstring, token->length ) )
       {
 #if BS_ENABLE_REGISTRATION
@@ -110,7 +110,7 @@ int bsInitBrickLink( bsContext *context )
   context->inventory = inv;
 
   /* BrickLink inventory is now the tracked inventory */
-  if( bsxSaveInventory( BS_INVENTORY_FILE, context->inventory, 0, 0 ) )
+  if( bsxSaveSnapshot( BS_INVENTORY_FILE, context->inventory, &context->inventorylog, 0 ) )
     ioPrintf( &context->output, IO_MODEBIT_FLUSH, BSMSG_INFO "We saved the BrickLink inventory as our locally tracked inventory.\n" );
   else
   {
@@ -213,7 +213,7 @@ static void bsInitMatchBrickOwlInventory( bsContext *context, bsxInventory *stoc
       if( stockitem )
       {
         /* Set stock's BOID and register the BLID<->BOID translation */
-        stockitem->boid = item->boid;
+        bsxSetItemBOID( stockinv, stockitem, item->boid );
         translationTableRegisterEntry( &context->translationtable, stockitem->typeid, stockitem->id, item->boid );
       }
     }
@@ -245,13 +245,14 @@ static void bsInitFinalizeBrickOwlInventory( bsContext *context, bsxInventory *s
       continue;
     bsxSetItemId( item, blid, strlen(blid) );
     item->typeid = bltypeid;
+    bsxReindexItem( inv, item );
 
     /* Try to resolve lotID */
     if( item->lotid == -1 )
     {
       stockitem = bsxFindItem( stockinv, item->typeid, item->id, item->colorid, item->condition );
       if( stockitem )
-        item->lotid = stockitem->lotid;
+        bsxSetItemLotID( inv, item, stockitem->lotid );
     }
   }
 
@@ -603,8 +603,8 @@ static int bsLoadVerifyInventory( bsContext *context, bsxInventory *inv, int ver
     {
       if( ( item->bolotid >= 0 ) || ( item->lotid >= 0 ) )
         ioPrintf( &context->output, IO_MODEBIT_LOGONLY | IO_MODEBIT_FLUSH, "LOG: Mismatch for item with LotID " CC_LLD " and OwlLotID " CC_LLD ", dropping item's Lot ID references.\n", item->lotid, item->bolotid );
-      item->lotid = -1;
-      item->bolotid = -1;
+      bsxSetItemLotID( inv, item, -1 );
+      bsxSetItemOwlLotID( inv, item, -1 );
     }
     if( ( verifyflags & BS_LOADINV_VERIFYFLAGS_PRICES ) && ( item->price <= 0.0005 ) )
     {
@@ -866,7 +866,8 @@ static void bsPrintHelpItemCommand( bsContext *context, char *command, char *suf
 void bsCommandStatus( bsContext *context, int argc, char **argv )
 {
   int cmdflags;
-  int64_t freediskspace;
+  int64_t freediskspace, pgcachehit, pgcachemiss;
+  int pgcachecount;
   bsxInventory *inv, *deltainv;
   ccGrowth growth;
   char *colorstring;
@@ -930,6 +931,24 @@ void bsCommandStatus( bsContext *context, int argc, char **argv )
     colorstring = IO_GREEN;
   ioPrintf( &context->output, 0, BSMSG_INFO "BrickLink API usage : " "%s" "%d" IO_DEFAULT " (" "%s" "%.2f%%" IO_DEFAULT ") in the past 24 hours; " "%s" "%d" IO_DEFAULT " in the past hour.\n", colorstring, (int)context->bricklink.apihistory.total, colorstring, 100.0 * apihistoryratio, colorstring, bsApiHistoryCountPeriod( &context->bricklink.apihistory, 3600 ) );
   ioPrintf( &context->output, 0, BSMSG_INFO "BrickOwl API usage  : " IO_GREEN "%d" IO_DEFAULT " in the past 24 hours; " IO_GREEN "%d" IO_DEFAULT " in the past hour.\n", (int)context->brickowl.apihistory.total, bsApiHistoryCountPeriod( &context->brickowl.apihistory, 3600 ) );
+  if( context->priceguiderefreshrate )
+  {
+    if( context->pgrefresh.scanindex < context->pgrefresh.entrycount )
+      ioPrintf( &context->output, 0, BSMSG_INFO "Price guide refresh : examining cache, " IO_GREEN "%d" IO_DEFAULT " of " IO_GREEN "%d" IO_DEFAULT " entries.\n", context->pgrefresh.scanindex, context->pgrefresh.entrycount );
+    else
+      ioPrintf( &context->output, 0, BSMSG_INFO "Price guide refresh : " IO_GREEN "%d" IO_DEFAULT " refreshed, " IO_GREEN "%d" IO_DEFAULT " failed, " IO_GREEN "%d" IO_DEFAULT " entries tracked.\n", context->pgrefresh.refreshcount, context->pgrefresh.failcount, context->pgrefresh.entrycount );
+  }
+  if( context->pgcache.activeflag )
+  {
+    mtMutexLock( &context->pgcache.mutex );
+    pgcachehit = context->pgcache.hitcount;
+    pgcachemiss = context->pgcache.misscount;
+    pgcachecount = context->pgcache.entrycount;
+    mtMutexUnlock( &context->pgcache.mutex );
+    ioPrintf( &context->output, 0, BSMSG_INFO "Price guide cache   : " IO_GREEN CC_LLD IO_DEFAULT " hits, " IO_GREEN CC_LLD IO_DEFAULT " misses (" IO_GREEN "%.1f%%" IO_DEFAULT " hit rate); " IO_GREEN "%d" IO_DEFAULT " of " IO_GREEN "%d" IO_DEFAULT " entries in memory.\n", (long long)pgcachehit, (long long)pgcachemiss, ( pgcachehit + pgcachemiss ? 100.0 * (double)pgcachehit / (double)( pgcachehit + pgcachemiss ) : 0.0 ), pgcachecount, BS_PRICEGUIDE_CACHE_SIZE );
+  }
+  if( context->priceguidehistory )
+    ioPrintf( &context->output, 0, BSMSG_INFO "Price guide history : " IO_GREEN CC_LLD IO_DEFAULT " snapshots of " IO_GREEN "%d" IO_DEFAULT " items.\n", (long long)bsxPriceGuideHistorySampleCount( context->priceguidehistory ), bsxPriceGuideHistoryKeyCount( context->priceguidehistory ) );
 
   freediskspace = ccGetFreeDiskSpace( BS_BACKUP_DIR );
   if( freediskspace >= 0 )
@@ -960,7 +979,7 @@ static void bsCommandHelp( bsContext *context, int argc, char **argv )
     ioPrintf( &context->output, 0, BSMSG_INFO "Type \"" IO_GREEN "help " IO_CYAN "[topic]" IO_DEFAULT "\" for help on a specific topic.\n" );
     ioPrintf( &context->output, 0, BSMSG_INFO "\n" );
     ioPrintf( &context->output, 0, BSMSG_INFO IO_WHITE "General commands:\n" IO_DEFAULT );
-    ioPrintf( &context->output, IO_MODEBIT_NODATE, BSMSG_INFO IO_CYAN "status help check sync verify autocheck about message runfile backup quit prunebackups resetapihistory" IO_DEFAULT "\n" );
+    ioPrintf( &context->output, IO_MODEBIT_NODATE, BSMSG_INFO IO_CYAN "status help check sync verify autocheck about message runfile backup restorebackup quit prunebackups resetapihistory" IO_DEFAULT "\n" );
     ioPrintf( &context->output, 0, BSMSG_INFO "\n" );
     ioPrintf( &context->output, 0, BSMSG_INFO IO_WHITE "Inventory management commands:\n" IO_DEFAULT );
     ioPrintf( &context->output, IO_MODEBIT_NODATE, BSMSG_INFO IO_CYAN "sort blmaster add sub loadprices loadnotes loadmycost loadall merge invblxml invmycost setallremarksfromblid" IO_DEFAULT "\n" );
@@ -969,7 +988,7 @@ static void bsCommandHelp( bsContext *context, int argc, char **argv )
     ioPrintf( &context->output, IO_MODEBIT_NODATE, BSMSG_INFO IO_CYAN "find item listempty setquantity setprice setcomments setremarks setblid delete owlresolve consolidate regradeused" IO_DEFAULT "\n" );
     ioPrintf( &context->output, 0, BSMSG_INFO "\n" );
     ioPrintf( &context->output, 0, BSMSG_INFO IO_WHITE "Evaluation commands:\n" IO_DEFAULT );
-    ioPrintf( &context->output, IO_MODEBIT_NODATE, BSMSG_INFO IO_CYAN "evalset evalgear evalpartout evalinv checkprices" IO_DEFAULT "\n" );
+    ioPrintf( &context->output, IO_MODEBIT_NODATE, BSMSG_INFO IO_CYAN "evalset evalgear evalpartout evalinv checkprices prefetchsets pgimport pgexport pghistory" IO_DEFAULT "\n" );
     ioPrintf( &context->output, 0, BSMSG_INFO "\n" );
     ioPrintf( &context->output, 0, BSMSG_INFO IO_WHITE "Order commands:\n" IO_DEFAULT );
     ioPrintf( &context->output, IO_MODEBIT_NODATE, BSMSG_INFO IO_CYAN "findorder findordertime saveorderlist" IO_DEFAULT "\n" );
@@ -1046,6 +1065,13 @@ static void bsCommandHelp( bsContext *context, int argc, char **argv )
     ioPrintf( &context->output, 0, BSMSG_INFO "The command quits BrickSync.\n" );
     ioPrintf( &context->output, 0, BSMSG_INFO "Operations will resume safely when BrickSync is launched again.\n" );
   }
+  else if( ccStrLowCmpWord( argv[1], "restorebackup" ) )
+  {
+    ioPrintf( &context->output, 0, BSMSG_INFO "Command syntax : \"" IO_CYAN "restorebackup BackupNumber RestoredBackup.bsx" IO_DEFAULT "\".\n" );
+    ioPrintf( &context->output, 0, BSMSG_INFO "The command rebuilds the tracked inventory as it was saved by an automated backup, and saves it as a BSX file at the path specified.\n" );
+    ioPrintf( &context->output, 0, BSMSG_INFO "Backups are numbered in the order they are saved, full BSX backups and incremental backups (" IO_CYAN "backupdelta" IO_DEFAULT " option) are both supported.\n" );
+    ioPrintf( &context->output, 0, BSMSG_INFO "The tracked inventory is not modified.\n" );
+  }
   else if( ccStrLowCmpWord( argv[1], "prunebackups" ) )
   {
     ioPrintf( &context->output, 0, BSMSG_INFO "Command syntax : \"" IO_CYAN "prunebackups " IO_MAGENTA "[-p]" IO_CYAN " CountOfDays" IO_DEFAULT "\".\n" );
@@ -1257,6 +1283,33 @@ static void bsCommandHelp( bsContext *context, int argc, char **argv )
     ioPrintf( &context->output, 0, BSMSG_INFO "It lists any price that falls outside of the relative range defined by the " IO_GREEN "low" IO_DEFAULT " to " IO_GREEN "high" IO_DEFAULT " bounds.\n" );
     ioPrintf( &context->output, 0, BSMSG_INFO "If ommited, the " IO_GREEN "low" IO_DEFAULT " and " IO_GREEN "high" IO_DEFAULT " parameters are defined as " IO_WHITE "0.5" IO_DEFAULT " and " IO_WHITE "1.5" IO_DEFAULT ".\n" );
   }
+  else if( ccStrLowCmpWord( argv[1], "prefetchsets" ) )
+  {
+    ioPrintf( &context->output, 0, BSMSG_INFO "Command syntax : \"" IO_CYAN "prefetchsets " IO_MAGENTA "[-r] [-f SetList.txt] [SetNumber] [SetNumber] ..." IO_DEFAULT "\".\n" );
+    ioPrintf( &context->output, 0, BSMSG_INFO "The command fetches the inventories of many sets at once and stores them in the set inventory cache.\n" );
+    ioPrintf( &context->output, 0, BSMSG_INFO "Set numbers are read from the arguments, or from a text file with the " IO_CYAN "-f" IO_DEFAULT " flag.\n" );
+    ioPrintf( &context->output, 0, BSMSG_INFO "Sets already cached are skipped, unless the " IO_CYAN "-r" IO_DEFAULT " flag is specified to refresh them.\n" );
+    ioPrintf( &context->output, 0, BSMSG_INFO "The " IO_CYAN "evalset" IO_DEFAULT ", " IO_CYAN "evalgear" IO_DEFAULT " and " IO_CYAN "evalpartout" IO_DEFAULT " commands then use the cached inventories.\n" );
+  }
+  else if( ccStrLowCmpWord( argv[1], "pgimport" ) )
+  {
+    ioPrintf( &context->output, 0, BSMSG_INFO "Command syntax : \"" IO_CYAN "pgimport " IO_MAGENTA "brickstore|brickstock" IO_CYAN " Path" IO_DEFAULT "\".\n" );
+    ioPrintf( &context->output, 0, BSMSG_INFO "The command imports a BrickStore or BrickStock price guide cache directory into the price guide database.\n" );
+    ioPrintf( &context->output, 0, BSMSG_INFO "The database must be enabled with the " IO_CYAN "priceguide.cacheformat" IO_DEFAULT " option set to \"" IO_GREEN "database" IO_DEFAULT "\".\n" );
+  }
+  else if( ccStrLowCmpWord( argv[1], "pgexport" ) )
+  {
+    ioPrintf( &context->output, 0, BSMSG_INFO "Command syntax : \"" IO_CYAN "pgexport " IO_MAGENTA "brickstore|brickstock" IO_CYAN " Path" IO_DEFAULT "\".\n" );
+    ioPrintf( &context->output, 0, BSMSG_INFO "The command exports the price guide database as a BrickStore or BrickStock price guide cache directory.\n" );
+    ioPrintf( &context->output, 0, BSMSG_INFO "Existing price guide files at the path are overwritten.\n" );
+  }
+  else if( ccStrLowCmpWord( argv[1], "pghistory" ) )
+  {
+    ioPrintf( &context->output, 0, BSMSG_INFO "Command syntax : \"" IO_CYAN "pghistory ItemType ItemID " IO_MAGENTA "[ColorID] [Days]" IO_DEFAULT "\".\n" );
+    ioPrintf( &context->output, 0, BSMSG_INFO "The command lists the price guide snapshots recorded for an item, such as \"" IO_CYAN "pghistory P 3001 11 90" IO_DEFAULT "\".\n" );
+    ioPrintf( &context->output, 0, BSMSG_INFO "A snapshot is recorded each time a price guide is fetched, as long as " IO_CYAN "priceguide.historyperiod" IO_DEFAULT " is not zero.\n" );
+    ioPrintf( &context->output, 0, BSMSG_INFO "If ommited, " IO_GREEN "Days" IO_DEFAULT " defaults to " IO_CYAN "priceguide.historyperiod" IO_DEFAULT ", also the period averaged by " IO_CYAN "checkprices" IO_DEFAULT ".\n" );
+  }
   else if( ccStrLowCmpWord( argv[1], "findorder" ) )
   {
     ioPrintf( &context->output, 0, BSMSG_INFO "Command syntax : \"" IO_CYAN "findorder term0 " IO_MAGENTA "[term1] [term2] ..." IO_DEFAULT "\".\n" );
@@ -1341,6 +1394,8 @@ static void bsCommandHelp( bsContext *context, int argc, char **argv )
       pgcacheformat = "BrickStore";
     if( context->priceguideflags & BSX_PRICEGUIDE_FLAGS_BRICKSTOCK )
       pgcacheformat = "BrickStock";
+    if( context->priceguideflags & BSX_PRICEGUIDE_FLAGS_DATABASE )
+      pgcacheformat = "Database";
     ioPrintf( &context->output, 0, BSMSG_INFO "Price Guide Format : " IO_CYAN "%s" IO_DEFAULT ".\n", pgcacheformat );
   }
   else if( ccStrLowCmpWord( argv[1], "sysinfo" ) )
@@ -1378,13 +1433,27 @@ static void bsCommandHelp( bsContext *context, int argc, char **argv )
       pgcacheformat = "BrickStore";
     if( context->priceguideflags & BSX_PRICEGUIDE_FLAGS_BRICKSTOCK )
       pgcacheformat = "BrickStock";
+    if( context->priceguideflags & BSX_PRICEGUIDE_FLAGS_DATABASE )
+      pgcacheformat = "Database";
     ioPrintf( &context->output, 0, BSMSG_INFO "Format of Price Guide storage : " IO_GREEN "%s" IO_DEFAULT ".\n", pgcacheformat );
     ccGrowthInit( &growth, 512 );
     ccGrowthElapsedTimeString( &growth, (int64_t)context->priceguidecachetime, 4 );
     ioPrintf( &context->output, 0, BSMSG_INFO "Caching time for Price Guide data : " IO_GREEN "%s" IO_DEFAULT ".\n", growth.data );
     ccGrowthFree( &growth );
+    if( context->priceguiderefreshrate )
+      ioPrintf( &context->output, 0, BSMSG_INFO "Background Price Guide refresh rate : " IO_GREEN "%d per hour" IO_DEFAULT ".\n", context->priceguiderefreshrate );
+    else
+      ioPrintf( &context->output, 0, BSMSG_INFO "Background Price Guide refresh rate : " IO_YELLOW "Disabled" IO_DEFAULT ".\n" );
+    if( context->priceguidehistoryperiod )
+      ioPrintf( &context->output, 0, BSMSG_INFO "Price Guide history averaging period : " IO_GREEN "%d days" IO_DEFAULT ".\n", context->priceguidehistoryperiod );
+    else
+      ioPrintf( &context->output, 0, BSMSG_INFO "Price Guide history averaging period : " IO_YELLOW "Disabled" IO_DEFAULT ".\n" );
     ioPrintf( &context->output, 0, BSMSG_INFO "Size of BrickLink HTTP pipeline queue : " IO_GREEN "%d requests" IO_DEFAULT ".\n", context->bricklink.pipelinequeuesize );
     ioPrintf( &context->output, 0, BSMSG_INFO "Size of BrickOwl HTTP pipeline queue  : " IO_GREEN "%d requests" IO_DEFAULT ".\n", context->brickowl.pipelinequeuesize );
+    ioPrintf( &context->output, 0, BSMSG_INFO "BrickLink API/WEB pipeline depth      : " IO_GREEN "%d" IO_DEFAULT " / " IO_GREEN "%d" IO_DEFAULT " requests in flight.\n", bsPipelineDepth( &context->bricklink.pipeline ), bsPipelineDepth( &context->bricklink.webpipeline ) );
+    ioPrintf( &context->output, 0, BSMSG_INFO "BrickOwl API pipeline depth          : " IO_GREEN "%d" IO_DEFAULT " requests in flight.\n", bsPipelineDepth( &context->brickowl.pipeline ) );
+    ioPrintf( &context->output, 0, BSMSG_INFO "BrickLink API/WEB connection links   : " IO_GREEN "%d" IO_DEFAULT " / " IO_GREEN "%d" IO_DEFAULT ".\n", httpGetPoolSize( context->bricklink.http ), httpGetPoolSize( context->bricklink.webhttp ) );
+    ioPrintf( &context->output, 0, BSMSG_INFO "BrickOwl API connection links        : " IO_GREEN "%d" IO_DEFAULT ".\n", httpGetPoolSize( context->brickowl.http ) );
   }
   else
   {
@@ -1897,9 +1966,10 @@ static void bsCommandSetBLID( bsContext *context, int argc, char **argv )
   /* Update core inventory */
   ioPrintf( &context->output, 0, BSMSG_INFO "Changing BLID for item, from \"" IO_CYAN "%s" IO_DEFAULT "\" to \"" IO_CYAN "%s" IO_DEFAULT "\".\n", item->id, argv[2] );
   bsxSetItemId( item, argv[2], strlen( argv[2] ) );
-  item->boid = translationBLIDtoBOID( &context->translationtable, item->typeid, item->id );
-  item->lotid = -1;
-  item->bolotid = -1;
+  bsxReindexItem( context->inventory, item );
+  bsxSetItemBOID( context->inventory, item, translationBLIDtoBOID( &context->translationtable, item->typeid, item->id ) );
+  bsxSetItemLotID( context->inventory, item, -1 );
+  bsxSetItemOwlLotID( context->inventory, item, -1 );
 
   /* Resolve BOID for item */
   if( item->boid == -1 )
@@ -1908,7 +1978,7 @@ static void bsCommandSetBLID( bsContext *context, int argc, char **argv )
     deltaitem = bsxAddCopyItem( inv, item );
     if( !( bsQueryBrickOwlLookupBoids( context, inv, BS_RESOLVE_FLAGS_TRYFALLBACK, 0 ) ) )
       ioPrintf( &context->output, 0, BSMSG_WARNING "Lookup of BOIDs failed.\n" );
-    item->boid = deltaitem->boid;
+    bsxSetItemBOID( context->inventory, item, deltaitem->boid );
     bsxFreeInventory( inv );
   }
 
@@ -2445,7 +2515,7 @@ static void bsCommandOwlQueryBLID( bsContext *context, int argc, char **argv )
           continue;
         if( ( ccStrCmpEqual( item->id, blid ) ) && ( item->boid != boid ) )
         {
-          item->boid = boid;
+          bsxSetItemBOID( inv, item, boid );
           updatecount[0] += item->quantity;
           updatecount[1]++;
         }
@@ -2788,7 +2858,7 @@ static void bsCommandOwlForceBLID( bsContext *context, int argc, char **argv )
       continue;
     if( ccStrCmpEqual( item->id, blid ) )
     {
-      item->boid = boid;
+      bsxSetItemBOID( inv, item, boid );
       forcecount[0] += item->quantity;
       forcecount[1]++;
     }
@@ -3169,6 +3239,167 @@ static void bsCommandBackup( bsContext *context, int argc, char **argv )
 }
 
 
+static int bsCmdIsBackupChainFile( char *filename )
+{
+  int extoffset;
+  extoffset = ccStrFindCharLast( filename, '.' );
+  if( extoffset < 0 )
+    return 0;
+  return ( ccStrCmpEqual( &filename[extoffset+1], "snapshot" ) || ccStrCmpEqual( &filename[extoffset+1], "delta" ) );
+}
+
+
+static void bsCommandRestoreBackup( bsContext *context, int argc, char **argv )
+{
+  int32_t backupindex;
+  bsxInventory *inv;
+
+  if( argc != 3 )
+  {
+    syntaxerror:
+    ioPrintf( &context->output, 0, BSMSG_ERROR "Incorrect parameter count, usage is \"" IO_CYAN "restorebackup BackupNumber RestoredBackup.bsx" IO_WHITE "\"" IO_DEFAULT ".\n" );
+    return;
+  }
+  if( !( ccStrParseInt32( argv[1], &backupindex ) ) || ( backupindex < 0 ) )
+    goto syntaxerror;
+  /* Backups might still be queued for writing */
+  if( !( bsPersistFlush( context ) ) )
+  {
+    bsFatalError( context );
+    return;
+  }
+  inv = bsLoadBackup( context, (int)backupindex );
+  if( !( inv ) )
+  {
+    ioPrintf( &context->output, 0, BSMSG_ERROR "We failed to rebuild the inventory of backup " IO_RED "#%d" IO_WHITE ".\n", (int)backupindex );
+    return;
+  }
+  if( !( bsxSaveInventory( argv[2], inv, 0, 0 ) ) )
+  {
+    ioPrintf( &context->output, 0, BSMSG_ERROR "We failed to save a BSX file at path \"" IO_RED "%s" IO_WHITE "\".\n", argv[2] );
+    ioPrintf( &context->output, 0, BSMSG_INFO "Current working directory is: \"" IO_GREEN "%s" IO_DEFAULT "\".\n", context->cwd );
+  }
+  else
+    ioPrintf( &context->output, 0, BSMSG_INFO "We saved backup " IO_CYAN "#%d" IO_DEFAULT " with " IO_CYAN "%d" IO_DEFAULT " items in " IO_CYAN "%d" IO_DEFAULT " lots to \"" IO_GREEN "%s" IO_DEFAULT "\".\n", (int)backupindex, inv->partcount, inv->itemcount - inv->itemfreecount, argv[2] );
+  bsxFreeInventory( inv );
+  return;
+}
+
+
+static int bsCommandPriceGuideDbFormat( bsContext *context, int argc, char **argv )
+{
+  if( argc != 3 )
+    return 0;
+  if( ccStrLowCmpWord( argv[1], "brickstore" ) )
+    return BSX_PRICEGUIDE_FLAGS_BRICKSTORE;
+  if( ccStrLowCmpWord( argv[1], "brickstock" ) )
+    return BSX_PRICEGUIDE_FLAGS_BRICKSTOCK;
+  return 0;
+}
+
+
+static void bsCommandPgImport( bsContext *context, int argc, char **argv )
+{
+  int pgflags, count;
+
+  pgflags = bsCommandPriceGuideDbFormat( context, argc, argv );
+  if( !( pgflags ) )
+  {
+    ioPrintf( &context->output, 0, BSMSG_ERROR "Incorrect parameters, usage is \"" IO_CYAN "pgimport " IO_MAGENTA "brickstore|brickstock" IO_CYAN " Path" IO_WHITE "\"" IO_DEFAULT ".\n" );
+    return;
+  }
+  if( !( context->priceguidedb ) )
+  {
+    ioPrintf( &context->output, 0, BSMSG_ERROR "The price guide database is not enabled, set " IO_CYAN "priceguide.cacheformat" IO_WHITE " to \"" IO_GREEN "database" IO_WHITE "\".\n" );
+    return;
+  }
+  ioPrintf( &context->output, IO_MODEBIT_FLUSH, BSMSG_INFO "Importing price guide cache from \"" IO_GREEN "%s" IO_DEFAULT "\".\n", argv[2] );
+  count = bsxImportPriceGuideDb( context->priceguidedb, argv[2], pgflags );
+  if( count < 0 )
+  {
+    ioPrintf( &context->output, 0, BSMSG_ERROR "We failed to import the price guide cache at \"" IO_RED "%s" IO_WHITE "\".\n", argv[2] );
+    return;
+  }
+  ioPrintf( &context->output, 0, BSMSG_INFO "Imported " IO_CYAN "%d" IO_DEFAULT " price guide entries.\n", count );
+  return;
+}
+
+
+static void bsCommandPgExport( bsContext *context, int argc, char **argv )
+{
+  int pgflags, count;
+
+  pgflags = bsCommandPriceGuideDbFormat( context, argc, argv );
+  if( !( pgflags ) )
+  {
+    ioPrintf( &context->output, 0, BSMSG_ERROR "Incorrect parameters, usage is \"" IO_CYAN "pgexport " IO_MAGENTA "brickstore|brickstock" IO_CYAN " Path" IO_WHITE "\"" IO_DEFAULT ".\n" );
+    return;
+  }
+  if( !( context->priceguidedb ) )
+  {
+    ioPrintf( &context->output, 0, BSMSG_ERROR "The price guide database is not enabled, set " IO_CYAN "priceguide.cacheformat" IO_WHITE " to \"" IO_GREEN "database" IO_WHITE "\".\n" );
+    return;
+  }
+  ioPrintf( &context->output, IO_MODEBIT_FLUSH, BSMSG_INFO "Exporting price guide database to \"" IO_GREEN "%s" IO_DEFAULT "\".\n", argv[2] );
+  count = bsxExportPriceGuideDb( context->priceguidedb, argv[2], pgflags );
+  if( count < 0 )
+  {
+    ioPrintf( &context->output, 0, BSMSG_ERROR "We failed to export the price guide database to \"" IO_RED "%s" IO_WHITE "\".\n", argv[2] );
+    return;
+  }
+  ioPrintf( &context->output, 0, BSMSG_INFO "Exported " IO_CYAN "%d" IO_DEFAULT " price guide entries.\n", count );
+  return;
+}
+
+
+static void bsCommandPgHistory( bsContext *context, int argc, char **argv )
+{
+  int colorid, days, samplecount, sampleindex;
+  time_t sampletime;
+  struct tm timeinfo;
+  bsxPriceGuide *pgnew, *pgused;
+  bsxPriceGuideSample *samplelist;
+  char itemtypeid;
+  char timebuf[64];
+
+  colorid = 0;
+  days = context->priceguidehistoryperiod;
+  if( ( argc < 3 ) || ( argc > 5 ) || ( argv[1][0] == 0 ) || ( argv[1][1] != 0 ) || ( ( argc >= 4 ) && !( ccStrParseInt32( argv[3], &colorid ) ) ) || ( ( argc >= 5 ) && ( !( ccStrParseInt32( argv[4], &days ) ) || ( days <= 0 ) ) ) )
+  {
+    ioPrintf( &context->output, 0, BSMSG_ERROR "Incorrect parameters, usage is \"" IO_CYAN "pghistory ItemType ItemID " IO_MAGENTA "[ColorID] [Days]" IO_WHITE "\"" IO_DEFAULT ".\n" );
+    return;
+  }
+  if( !( context->priceguidehistory ) )
+  {
+    ioPrintf( &context->output, 0, BSMSG_ERROR "The price guide history is not enabled, set " IO_CYAN "priceguide.historyperiod" IO_WHITE " to a count of days.\n" );
+    return;
+  }
+  itemtypeid = argv[1][0];
+  if( ( itemtypeid >= 'a' ) && ( itemtypeid <= 'z' ) )
+    itemtypeid += 'A' - 'a';
+  samplecount = bsxReadPriceGuideHistory( context->priceguidehistory, itemtypeid, argv[2], colorid, context->curtime - ( (int64_t)days * 24*60*60 ), INT64_MAX, &samplelist );
+  if( samplecount < 0 )
+  {
+    ioPrintf( &context->output, 0, BSMSG_ERROR "We failed to read the price guide history.\n" );
+    return;
+  }
+  ioPrintf( &context->output, 0, BSMSG_INFO "Price guide history of item \"" IO_CYAN "%s" IO_DEFAULT "\", type " IO_CYAN "%c" IO_DEFAULT ", color " IO_CYAN "%d" IO_DEFAULT ", in the past " IO_CYAN "%d" IO_DEFAULT " days : " IO_GREEN "%d" IO_DEFAULT " snapshots.\n", argv[2], itemtypeid, colorid, days, samplecount );
+  if( samplecount )
+    ioPrintf( &context->output, 0, BSMSG_INFO IO_WHITE "Date                : New Sale (Qty)      New Stock (Qty)     Used Sale (Qty)     Used Stock (Qty)\n" );
+  for( sampleindex = 0 ; sampleindex < samplecount ; sampleindex++ )
+  {
+    pgnew = &samplelist[sampleindex].pg[0];
+    pgused = &samplelist[sampleindex].pg[1];
+    sampletime = (time_t)samplelist[sampleindex].time;
+    timeinfo = *( localtime( &sampletime ) );
+    strftime( timebuf, 64, "%Y-%m-%d %H:%M:%S", &timeinfo );
+    ioPrintf( &context->output, 0, BSMSG_INFO IO_CYAN "%s" IO_DEFAULT " : %8.3f (%6d) %8.3f (%6d) %8.3f (%6d) %8.3f (%6d)\n", timebuf, pgnew->saleqtyaverage, pgnew->saleqty, pgnew->stockqtyaverage, pgnew->stockqty, pgused->saleqtyaverage, pgused->saleqty, pgused->stockqtyaverage, pgused->stockqty );
+  }
+  free( samplelist );
+  return;
+}
+
+
 void bsCommandPruneBackups( bsContext *context, int argc, char **argv )
 {
   int cmdflags, deletecount, subdirkeepflag, pretendflag;
@@ -3217,10 +3448,26 @@ void bsCommandPruneBackups( bsContext *context, int argc, char **argv )
     if( filename[0] == '.' )
       continue;
     filepath = ccStrAllocPrintf( BS_BACKUP_DIR CC_DIR_SEPARATOR_STRING "%s", filename );
+    /* Incremental backups depend on the whole chain of their directory, keep it all if any is kept */
+    subdirkeepflag = 0;
     subdir = ccOpenDir( filepath );
     if( subdir )
     {
-      subdirkeepflag = 0;
+      for( ; ; )
+      {
+        subfilename = ccReadDir( subdir );
+        if( !( subfilename ) )
+          break;
+        subfilepath = ccStrAllocPrintf( BS_BACKUP_DIR CC_DIR_SEPARATOR_STRING "%s" CC_DIR_SEPARATOR_STRING "%s", filename, subfilename );
+        if( ( subfilename[0] != '.' ) && ( ccFileStat( subfilepath, &filesize, &filetime ) ) && ( filetime >= deletetimestamp ) )
+          subdirkeepflag = 1;
+        free( subfilepath );
+      }
+      ccCloseDir( subdir );
+      subdir = ccOpenDir( filepath );
+    }
+    if( subdir )
+    {
       for( ; ; )
       {
         subfilename = ccReadDir( subdir );
@@ -3231,7 +3478,7 @@ void bsCommandPruneBackups( bsContext *context, int argc, char **argv )
         subfilepath = ccStrAllocPrintf( BS_BACKUP_DIR CC_DIR_SEPARATOR_STRING "%s" CC_DIR_SEPARATOR_STRING "%s", filename, subfilename );
         if( ccFileStat( subfilepath, &filesize, &filetime ) )
         {
-          if( filetime < deletetimestamp )
+          if( ( filetime < deletetimestamp ) && !( ( subdirkeepflag ) && ( bsCmdIsBackupChainFile( subfilename ) ) ) )
           {
             if( !( pretendflag ) )
               remove( subfilepath );
@@ -3339,6 +3586,7 @@ static int bsCommandEvalSetInternal( bsContext *context, int argc, char **argv,
   bsPriceGuideInitState( &pgstate, inv, showaltflag, removealtflag );
   if( !( bsProcessInventoryPriceGuide( context, inv, cachetime, (void *)&pgstate, bsPriceGuideSumCallback ) ) )
   {
+    bsPriceGuideFreeState( &pgstate );
     bsxFreeInventory( inv );
     ioPrintf( &context->output, 0, BSMSG_ERROR "We failed to fetch price guide information for the inventory.\n" );
     return 1;
@@ -3435,6 +3683,83 @@ static void bsCommandEvalInv( bsContext *context, int argc, char **argv )
 }
 
 
+/* Set numbers without a variant suffix are the first variant, as with evalset */
+static void bsCommandPrefetchSetsAdd( char ***setidlist, int *setidcount, int *setidalloc, char *setid, int length )
+{
+  if( *setidcount >= *setidalloc )
+  {
+    *setidalloc = ( *setidalloc ? *setidalloc << 1 : 64 );
+    *setidlist = realloc( *setidlist, *setidalloc * sizeof(char *) );
+  }
+  if( ccSeqFindChar( setid, length, '-' ) >= 0 )
+    (*setidlist)[ (*setidcount)++ ] = ccStrAllocPrintf( "%.*s", length, setid );
+  else
+    (*setidlist)[ (*setidcount)++ ] = ccStrAllocPrintf( "%.*s-1", length, setid );
+  return;
+}
+
+static void bsCommandPrefetchSets( bsContext *context, int argc, char **argv )
+{
+  int argindex, forceflag, setidcount, setidalloc, setindex, offset, length, cachedcount;
+  char *filedata;
+  char **setidlist;
+
+  forceflag = 0;
+  setidcount = 0;
+  setidalloc = 0;
+  setidlist = 0;
+  for( argindex = 1 ; argindex < argc ; argindex++ )
+  {
+    if( ccStrCmpEqual( argv[argindex], "-r" ) )
+      forceflag = 1;
+    else if( ccStrCmpEqual( argv[argindex], "-f" ) )
+    {
+      if( ++argindex >= argc )
+      {
+        for( setindex = 0 ; setindex < setidcount ; setindex++ )
+          free( setidlist[setindex] );
+        setidcount = 0;
+        break;
+      }
+      filedata = ccFileLoad( argv[argindex], 16*1048576, 0 );
+      if( !( filedata ) )
+      {
+        ioPrintf( &context->output, 0, BSMSG_ERROR "We failed to load a file at path \"" IO_RED "%s" IO_WHITE "\".\n", argv[argindex] );
+        ioPrintf( &context->output, 0, BSMSG_INFO "Current working directory is: \"" IO_GREEN "%s" IO_DEFAULT "\".\n", context->cwd );
+        goto end;
+      }
+      /* Set numbers separated by blanks, commas or new lines */
+      for( offset = 0 ; filedata[offset] ; offset += length )
+      {
+        for( length = 0 ; ( (unsigned char)filedata[offset+length] > ' ' ) && ( filedata[offset+length] != ',' ) ; length++ );
+        if( length )
+          bsCommandPrefetchSetsAdd( &setidlist, &setidcount, &setidalloc, &filedata[offset], length );
+        else
+          length = 1;
+      }
+      free( filedata );
+    }
+    else
+      bsCommandPrefetchSetsAdd( &setidlist, &setidcount, &setidalloc, argv[argindex], strlen( argv[argindex] ) );
+  }
+  if( !( setidcount ) )
+  {
+    ioPrintf( &context->output, 0, BSMSG_ERROR "Usage is \"" IO_CYAN "prefetchsets " IO_MAGENTA "[-r] [-f SetList.txt] [SetNumber] [SetNumber] ..." IO_WHITE "\"" IO_DEFAULT ".\n" );
+    goto end;
+  }
+
+  ioPrintf( &context->output, IO_MODEBIT_FLUSH, BSMSG_INFO "Fetching inventories for " IO_CYAN "%d" IO_DEFAULT " sets.\n", setidcount );
+  cachedcount = bsBrickLinkPrefetchSetInventories( context, 'S', setidlist, setidcount, forceflag );
+  ioPrintf( &context->output, 0, BSMSG_INFO "Cached " IO_GREEN "%d" IO_DEFAULT " set inventories, " IO_GREEN "%d" IO_DEFAULT " sets in the set inventory cache.\n", cachedcount, context->setinvcache.entrycount );
+
+  end:
+  for( setindex = 0 ; setindex < setidcount ; setindex++ )
+    free( setidlist[setindex] );
+  free( setidlist );
+  return;
+}
+
+
 static void bsCommandCheckPrices( bsContext *context, int argc, char **argv )
 {
   int cmdflags, cachetime;
@@ -3952,6 +4277,14 @@ static int bsRunCommand( bsContext *context, char *input, int runfileflag )
     bsCommandEvalInv( context, argc, argv );
   else if( ccStrLowCmpWord( argv[0], "checkprices" ) )
     bsCommandCheckPrices( context, argc, argv );
+  else if( ccStrLowCmpWord( argv[0], "prefetchsets" ) )
+    bsCommandPrefetchSets( context, argc, argv );
+  else if( ccStrLowCmpWord( argv[0], "pgimport" ) )
+    bsCommandPgImport( context, argc, argv );
+  else if( ccStrLowCmpWord( argv[0], "pgexport" ) )
+    bsCommandPgExport( context, argc, argv );
+  else if( ccStrLowCmpWord( argv[0], "pghistory" ) )
+    bsCommandPgHistory( context, argc, argv );
   else if( ccStrLowCmpWord( argv[0], "findorder" ) )
     bsCommandFindOrder( context, argc, argv );
   else if( ccStrLowCmpWord( argv[0], "findordertime" ) )
@@ -3977,6 +4310,8 @@ static int bsRunCommand( bsContext *context, char *input, int runfileflag )
     bsCommandRegister( context, argc, argv );
   else if( ccStrLowCmpWord( argv[0], "backup" ) )
     bsCommandBackup( context, argc, argv );
+  else if( ccStrLowCmpWord( argv[0], "restorebackup" ) )
+    bsCommandRestoreBackup( context, argc, argv );
   else if( ccStrLowCmpWord( argv[0], "prunebackups" ) )
     bsCommandPruneBackups( context, argc, argv );
   else if( ccStrLowCmpWord( argv[0], "resetapihistory" ) )
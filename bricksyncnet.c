@@ -132,7 +132,7 @@ void bsFreeReply( bsContext *context, bsQueryReply *reply )
   return;
 }
 
-void bsBrickLinkAddQuery( bsContext *context, char *methodstring, char *pathstring, char *paramstring, char *bodystring, void *uservalue, void (*querycallback)( void *uservalue, int resultcode, httpResponse *response ) )
+static void bsBrickLinkQueueQuery( bsContext *context, char *methodstring, char *pathstring, char *paramstring, char *bodystring, void *uservalue, void (*querycallback)( void *uservalue, int resultcode, httpResponse *response ), void (*contentcallback)( void *uservalue, httpResponse *response, void *data, size_t size ) )
 {
   char *oauthstring;
   char *querystring;
@@ -162,7 +162,7 @@ void bsBrickLinkAddQuery( bsContext *context, char *methodstring, char *pathstri
   ccGrowthPrintf( &growth, "%s %s", methodstring, pathstring );
   if( paramstring )
     ccGrowthPrintf( &growth, "?%s", paramstring );
-  ccGrowthPrintf( &growth, " HTTP/1.1\r\nHost: %s\r\nConnection: Keep-Alive\r\n%s\r\n", BS_BRICKLINK_API_SERVER, oauthstring );
+  ccGrowthPrintf( &growth, " HTTP/1.1\r\nHost: %s\r\nConnection: Keep-Alive\r\n" HTTP_ACCEPT_ENCODING "%s\r\n", BS_BRICKLINK_API_SERVER, oauthstring );
   if( bodystring )
     ccGrowthPrintf( &growth, "Content-Type: application/json\r\nContent-Length: %d\r\n\r\n%s", (int)strlen( bodystring ), bodystring );
   else
@@ -174,7 +174,10 @@ void bsBrickLinkAddQuery( bsContext *context, char *methodstring, char *pathstri
 #endif
 
   /* Don't specify HTTP_QUERY_FLAGS_RETRY, we can't reuse oauth nonce */
-  httpAddQuery( context->bricklink.http, (char *)growth.data, growth.offset, 0, uservalue, querycallback );
+  if( contentcallback )
+    httpAddStreamQuery( context->bricklink.http, (char *)growth.data, growth.offset, 0, uservalue, querycallback, contentcallback );
+  else
+    httpAddQuery( context->bricklink.http, (char *)growth.data, growth.offset, 0, uservalue, querycallback );
 
   /* Free OAuth string */
   free( oauthstring );
@@ -184,6 +187,23 @@ void bsBrickLinkAddQuery( bsContext *context, char *methodstring, char *pathstri
 }
 
 
+void bsBrickLinkAddQuery( bsContext *context, char *methodstring, char *pathstring, char *paramstring, char *bodystring, void *uservalue, void (*querycallback)( void *uservalue, int resultcode, httpResponse *response ) )
+{
+  DEBUG_SET_TRACKER();
+
+  bsBrickLinkQueueQuery( context, methodstring, pathstring, paramstring, bodystring, uservalue, querycallback, 0 );
+  return;
+}
+
+void bsBrickLinkAddStreamQuery( bsContext *context, char *methodstring, char *pathstring, char *paramstring, char *bodystring, void *uservalue, void (*querycallback)( void *uservalue, int resultcode, httpResponse *response ), void (*contentcallback)( void *uservalue, httpResponse *response, void *data, size_t size ) )
+{
+  DEBUG_SET_TRACKER();
+
+  bsBrickLinkQueueQuery( context, methodstring, pathstring, paramstring, bodystring, uservalue, querycallback, contentcallback );
+  return;
+}
+
+
 void bsBrickOwlAddQuery( bsContext *context, char *querystring, int httpflags, void *uservalue, void (*querycallback)( void *uservalue, int resultcode, httpResponse *response ) )
 {
   DEBUG_SET_TRACKER();
@@ -197,6 +217,19 @@ void bsBrickOwlAddQuery( bsContext *context, char *querystring, int httpflags, v
   return;
 }
 
+void bsBrickOwlAddStreamQuery( bsContext *context, char *querystring, int httpflags, void *uservalue, void (*querycallback)( void *uservalue, int resultcode, httpResponse *response ), void (*contentcallback)( void *uservalue, httpResponse *response, void *data, size_t size ) )
+{
+  DEBUG_SET_TRACKER();
+
+#if BS_HTTP_DEBUG
+  ioPrintf( &context->output, 0, "=== Our BrickOwl Query Header ===\n" );
+  ioPrintf( &context->output, 0, "%s\n", (char *)querystring );
+#endif
+  httpAddStreamQuery( context->brickowl.http, querystring, strlen( querystring ), httpflags, uservalue, querycallback, contentcallback );
+  bsApiHistoryIncrement( context, &context->brickowl.apihistory );
+  return;
+}
+
 
 ////
 
@@ -301,6 +334,123 @@ void bsWaitBrickSyncWebQueries( bsContext *context, int maxpending )
 ////
 
 
+void bsPipelineInit( bsPipeline *pipeline, int maxdepth )
+{
+  DEBUG_SET_TRACKER();
+
+  pipeline->maxdepth = ( maxdepth < 1 ? 1 : maxdepth );
+  /* Start halfway, additive increase reaches the ceiling soon enough */
+  pipeline->depth = (double)( ( pipeline->maxdepth + 1 ) >> 1 );
+  pipeline->srtt = 0.0;
+  pipeline->minrtt = 0.0;
+  pipeline->windowminrtt = 0.0;
+  pipeline->windowcount = 0;
+  pipeline->holdcount = 0;
+  pipeline->decreasecount = 0;
+  return;
+}
+
+int bsPipelineDepth( bsPipeline *pipeline )
+{
+  return (int)pipeline->depth;
+}
+
+/* Count of pending queries to wait for before queuing more, one reply or more if the depth shrank */
+int bsPipelineWaitCount( bsPipeline *pipeline, int querycount )
+{
+  int depth;
+  depth = bsPipelineDepth( pipeline );
+  if( querycount > depth )
+    return depth - 1;
+  return querycount - 1;
+}
+
+static void bsPipelineDecrease( bsPipeline *pipeline, double factor )
+{
+  /* Replies still in flight were queued at the previous depth, ignore them */
+  pipeline->holdcount = (int)pipeline->depth;
+  pipeline->depth *= factor;
+  if( pipeline->depth < 1.0 )
+    pipeline->depth = 1.0;
+  pipeline->srtt = 0.0;
+  pipeline->decreasecount++;
+  return;
+}
+
+/* Additive increase per window of successful replies, multiplicative decrease on errors or growing latency */
+static void bsPipelineUpdate( bsPipeline *pipeline, int httpresult, int errorcount, int roundtripcount, int64_t roundtripsum )
+{
+  double rtt;
+
+  DEBUG_SET_TRACKER();
+
+  if( roundtripcount )
+  {
+    rtt = fmax( (double)roundtripsum / (double)roundtripcount, 1.0 );
+    if( ( pipeline->minrtt <= 0.0 ) || ( rtt < pipeline->minrtt ) )
+      pipeline->minrtt = rtt;
+    /* Age the minimum, a fast early sample shouldn't hold for the whole session */
+    if( ( pipeline->windowminrtt <= 0.0 ) || ( rtt < pipeline->windowminrtt ) )
+      pipeline->windowminrtt = rtt;
+    pipeline->windowcount += roundtripcount;
+    if( pipeline->windowcount >= BS_PIPELINE_MINRTT_WINDOW )
+    {
+      pipeline->minrtt = pipeline->windowminrtt;
+      pipeline->windowminrtt = 0.0;
+      pipeline->windowcount = 0;
+    }
+    if( !( pipeline->holdcount ) )
+      pipeline->srtt = ( pipeline->srtt > 0.0 ? ( 0.875 * pipeline->srtt ) + ( 0.125 * rtt ) : rtt );
+  }
+  if( pipeline->holdcount )
+  {
+    pipeline->holdcount--;
+    return;
+  }
+  switch( httpresult )
+  {
+    case HTTP_RESULT_SUCCESS:
+      break;
+    /* Connection trouble or the server refusing queries, likely throttling */
+    case HTTP_RESULT_CONNECT_ERROR:
+    case HTTP_RESULT_TRYAGAIN_ERROR:
+    case HTTP_RESULT_NOREPLY_ERROR:
+    case HTTP_RESULT_BADFORMAT_ERROR:
+    case HTTP_RESULT_CODE_ERROR:
+      errorcount++;
+      break;
+    /* Reply handling problems say nothing about the connection */
+    default:
+      return;
+  }
+  if( errorcount )
+    bsPipelineDecrease( pipeline, BS_PIPELINE_ERROR_DECREASE );
+  else if( pipeline->srtt > ( pipeline->minrtt * BS_PIPELINE_DELAY_FACTOR ) )
+    bsPipelineDecrease( pipeline, BS_PIPELINE_DELAY_DECREASE );
+  else
+  {
+    pipeline->depth += 1.0 / pipeline->depth;
+    if( pipeline->depth > (double)pipeline->maxdepth )
+      pipeline->depth = (double)pipeline->maxdepth;
+  }
+  return;
+}
+
+static bsPipeline *bsTrackerPipeline( bsContext *context, httpConnection *http )
+{
+  if( http == context->bricklink.http )
+    return &context->bricklink.pipeline;
+  else if( http == context->bricklink.webhttp )
+    return &context->bricklink.webpipeline;
+  else if( http == context->brickowl.http )
+    return &context->brickowl.pipeline;
+  return 0;
+}
+
+
+////
+
+
 #define BS_TRACKER_SUCCESS_TO_ERROR_VALUE (64)
 #define BS_TRACKER_SUCCESS_SATURATE (128)
 
@@ -321,10 +471,22 @@ void bsTrackerInit( bsTracker *tracker, httpConnection *http )
 /* Accumulate httpresults, return failure flag */
 int bsTrackerAccumResult( bsContext *context, bsTracker *tracker, int httpresult, int accumflags )
 {
+  int errorcount, roundtripcount;
+  int64_t roundtripsum;
+  bsPipeline *pipeline;
+
   DEBUG_SET_TRACKER();
 
   /* Accumulate count of connection errors */
-  tracker->errorcount += httpGetClearErrorCount( tracker->http );
+  errorcount = httpGetClearErrorCount( tracker->http );
+  tracker->errorcount += errorcount;
+
+  /* Adjust how many queries we keep in flight on that connection */
+  if( ( pipeline = bsTrackerPipeline( context, tracker->http ) ) )
+  {
+    roundtripcount = httpGetClearRoundTrip( tracker->http, &roundtripsum );
+    bsPipelineUpdate( pipeline, httpresult, errorcount, roundtripcount, roundtripsum );
+  }
 
   if( tracker->failureflag )
     return tracker->failureflag;
@@ -472,7 +634,7 @@ int bsQueryBrickOwlUserDetails( bsContext *context, boUserDetails *userdetails )
   {
     ioPrintf( &context->output, IO_MODEBIT_FLUSH, BSMSG_INIT "Fetching BrickOwl user information...\n" );
     /* Add an userdetails query */
-    querystring = ccStrAllocPrintf( "GET /v1/token/details?key=%s HTTP/1.1\r\nHost: api.brickowl.com\r\nConnection: Keep-Alive\r\n\r\n", context->brickowl.key );
+    querystring = ccStrAllocPrintf( "GET /v1/token/details?key=%s HTTP/1.1\r\nHost: api.brickowl.com\r\nConnection: Keep-Alive\r\n" HTTP_ACCEPT_ENCODING "\r\n", context->brickowl.key );
     reply = bsAllocReply( context, BS_QUERY_TYPE_BRICKOWL, 0, 0, (void *)userdetails );
     bsBrickOwlAddQuery( context, querystring, HTTP_QUERY_FLAGS_RETRY, (void *)reply, bsBrickOwlReplyUserDetails );
     free( querystring );
@@ -403,7 +403,7 @@ static int bsQueueBrickLinkApplyDiff( bsContext *context, bsWorkList *worklist,
   /* Only queue so many queries over HTTP pipelining */
   for( itemindex = worklist->liststart ; itemindex < diffinv->itemcount ; itemindex++ )
   {
-    if( context->bricklink.querycount >= context->bricklink.pipelinequeuesize )
+    if( context->bricklink.querycount >= bsPipelineDepth( &context->bricklink.pipeline ) )
       break;
     if( mmBitMapDirectGet( &worklist->bitmap, itemindex ) )
       continue;
@@ -444,7 +444,7 @@ static int bsQueueBrickLinkApplyDiff( bsContext *context, bsWorkList *worklist,
 /* Query BrickLink, apply updates for whole diff inventory, diffinv is modified */
 int BS_FUNCTION_ALIGN16 bsQueryBrickLinkApplyDiff( bsContext *context, bsxInventory *diffinv, int *retryflag )
 {
-  int waitcount, itemlistindex, accumflags;
+  int itemlistindex, accumflags;
   int32_t itemflags, itemdiscardflags;
   char *actionstring;
   bsQueryReply *reply, *replynext;
@@ -461,6 +461,10 @@ int BS_FUNCTION_ALIGN16 bsQueryBrickLinkApplyDiff( bsContext *context, bsxInvent
     return 1;
   }
 
+  /* Every state and inventory write queued so far must be on disk before we mutate the remote inventory */
+  if( !( bsPersistFlush( context ) ) )
+    return 0;
+
   ioPrintf( &context->output, 0, BSMSG_INFO "Updating BrickLink inventory, " IO_GREEN "%d" IO_DEFAULT " lots are pending for update.\n", diffinv->itemcount );
   lastprogresstime = time( 0 );
 
@@ -468,7 +472,6 @@ int BS_FUNCTION_ALIGN16 bsQueryBrickLinkApplyDiff( bsContext *context, bsxInvent
 
   /* Keep pushing BrickLink inventory updates until we are done */
   bsTrackerInit( &tracker, context->bricklink.http );
-  waitcount = context->bricklink.pipelinequeuesize;
   worklist.liststart = 0;
   mmBitMapInit( &worklist.bitmap, diffinv->itemcount, 0 );
   for( ; ; )
@@ -478,11 +481,9 @@ int BS_FUNCTION_ALIGN16 bsQueryBrickLinkApplyDiff( bsContext *context, bsxInvent
       bsQueueBrickLinkApplyDiff( context, &worklist, diffinv );
     if( !( context->bricklink.querycount ) )
       break;
-    if( context->bricklink.querycount <= waitcount )
-      waitcount = context->bricklink.querycount - 1;
 
     /* Wait for replies */
-    bsWaitBrickLinkQueries( context, waitcount );
+    bsWaitBrickLinkQueries( context, bsPipelineWaitCount( &context->bricklink.pipeline, context->bricklink.querycount ) );
 
     /* Examine all queued replies */
     for( reply = context->replylist.first ; reply ; reply = replynext )
@@ -574,7 +575,7 @@ int BS_FUNCTION_ALIGN16 bsQueryBrickLinkApplyDiff( bsContext *context, bsxInvent
             ioPrintf( &context->output, 0, IO_RED "Unexpected situation at %s:%d. Please notify code maintainer.\n", __FILE__, __LINE__ );
 #endif
           if( stockitem )
-            stockitem->lotid = item->lotid;
+            bsxSetItemLotID( context->inventory, stockitem, item->lotid );
         }
         /* Item succesfully updated, mark it out of the 'diff' inventory */
         bsxRemoveItem( diffinv, item );
@@ -754,7 +755,7 @@ static void bsBrickOwlApplyDiffCreate( bsContext *context, bsxItem *item, int it
     }
   }
   ccGrowthPrintf( &postgrowth, "&condition=%s", conditionstring );
-  querystring = ccStrAllocPrintf( "POST /v1/inventory/create HTTP/1.1\r\nHost: api.brickowl.com\r\nContent-Type: application/x-www-form-urlencoded\r\nContent-Length: %d\r\nConnection: Keep-Alive\r\n\r\n%s", (int)postgrowth.offset, postgrowth.data );
+  querystring = ccStrAllocPrintf( "POST /v1/inventory/create HTTP/1.1\r\nHost: api.brickowl.com\r\nContent-Type: application/x-www-form-urlencoded\r\nContent-Length: %d\r\nConnection: Keep-Alive\r\n" HTTP_ACCEPT_ENCODING "\r\n%s", (int)postgrowth.offset, postgrowth.data );
   reply = bsAllocReply( context, BS_QUERY_TYPE_BRICKOWL, itemindex, (void *)item, (void *)&item->bolotid );
   bsBrickOwlAddQuery( context, querystring, 0, (void *)reply, bsBrickOwlReplyCreate );
   free( querystring );
@@ -780,7 +781,7 @@ static void bsBrickOwlApplyDiffDelete( bsContext *context, bsxItem *item, int it
     poststring = ccStrAllocPrintf( "key=%s&lot_id="CC_LLD"&absolute_quantity=0", context->brickowl.key, (long long)item->bolotid );
   else
     poststring = ccStrAllocPrintf( "key=%s&external_id="CC_LLD"&absolute_quantity=0", context->brickowl.key, (long long)item->lotid );
-  querystring = ccStrAllocPrintf( "POST /v1/inventory/update HTTP/1.1\r\nHost: api.brickowl.com\r\nContent-Type: application/x-www-form-urlencoded\r\nContent-Length: %d\r\nConnection: Keep-Alive\r\n\r\n%s", (int)strlen(poststring), poststring );
+  querystring = ccStrAllocPrintf( "POST /v1/inventory/update HTTP/1.1\r\nHost: api.brickowl.com\r\nContent-Type: application/x-www-form-urlencoded\r\nContent-Length: %d\r\nConnection: Keep-Alive\r\n" HTTP_ACCEPT_ENCODING "\r\n%s", (int)strlen(poststring), poststring );
   reply = bsAllocReply( context, BS_QUERY_TYPE_BRICKOWL, itemindex, (void *)item, 0 );
   bsBrickOwlAddQuery( context, querystring, 0, (void *)reply, bsBrickOwlReplyUpdate );
   free( querystring );
@@ -861,7 +862,7 @@ static void bsBrickOwlApplyDiffUpdate( bsContext *context, bsxItem *item, int it
       ccGrowthPrintf( &postgrowth, "&tier_price=remove" );
   }
 
-  querystring = ccStrAllocPrintf( "POST /v1/inventory/update HTTP/1.1\r\nHost: api.brickowl.com\r\nContent-Type: application/x-www-form-urlencoded\r\nContent-Length: %d\r\nConnection: Keep-Alive\r\n\r\n%s", (int)postgrowth.offset, postgrowth.data );
+  querystring = ccStrAllocPrintf( "POST /v1/inventory/update HTTP/1.1\r\nHost: api.brickowl.com\r\nContent-Type: application/x-www-form-urlencoded\r\nContent-Length: %d\r\nConnection: Keep-Alive\r\n" HTTP_ACCEPT_ENCODING "\r\n%s", (int)postgrowth.offset, postgrowth.data );
   reply = bsAllocReply( context, BS_QUERY_TYPE_BRICKOWL, itemindex, (void *)item, 0 );
   bsBrickOwlAddQuery( context, querystring, 0, (void *)reply, bsBrickOwlReplyUpdate );
   free( querystring );
@@ -903,7 +904,7 @@ static int bsQueueBrickOwlApplyDiff( bsContext *context, bsWorkList *worklist, b
   /* Only queue so many queries over HTTP pipelining */
   for( itemindex = worklist->liststart ; itemindex < diffinv->itemcount ; itemindex++ )
   {
-    if( context->brickowl.querycount >= context->brickowl.pipelinequeuesize )
+    if( context->brickowl.querycount >= bsPipelineDepth( &context->brickowl.pipeline ) )
       break;
     if( mmBitMapDirectGet( &worklist->bitmap, itemindex ) )
       continue;
@@ -928,7 +929,7 @@ static int bsQueueBrickOwlApplyDiff( bsContext *context, bsWorkList *worklist, b
 
 static int bsQueryBrickOwlApplyDiffPass( bsContext *context, bsxInventory *diffinv, int *retryflag )
 {
-  int waitcount, itemlistindex, accumflags;
+  int itemlistindex, accumflags;
   int32_t itemflags, updateflags, itemdiscardflags;
   char *actionstring;
   bsQueryReply *reply, *replynext;
@@ -943,7 +944,6 @@ static int bsQueryBrickOwlApplyDiffPass( bsContext *context, bsxInventory *diffi
 
   /* Keep pushing BrickOwl inventory updates until we are done */
   bsTrackerInit( &tracker, context->brickowl.http );
-  waitcount = context->brickowl.pipelinequeuesize;
   worklist.liststart = 0;
   mmBitMapInit( &worklist.bitmap, diffinv->itemcount, 0 );
   for( ; ; )
@@ -953,11 +953,9 @@ static int bsQueryBrickOwlApplyDiffPass( bsContext *context, bsxInventory *diffi
       bsQueueBrickOwlApplyDiff( context, &worklist, diffinv );
     if( !( context->brickowl.querycount ) )
       break;
-    if( context->brickowl.querycount <= waitcount )
-      waitcount = context->brickowl.querycount - 1;
 
     /* Wait for replies */
-    bsWaitBrickOwlQueries( context, waitcount );
+    bsWaitBrickOwlQueries( context, bsPipelineWaitCount( &context->brickowl.pipeline, context->brickowl.querycount ) );
 
     /* Examine all queued replies */
     for( reply = context->replylist.first ; reply ; reply = replynext )
@@ -1051,7 +1049,7 @@ static int bsQueryBrickOwlApplyDiffPass( bsContext *context, bsxInventory *diffi
               ioPrintf( &context->output, 0, IO_RED "Unexpected situation at %s:%d. Please notify code maintainer.\n", __FILE__, __LINE__ );
 #endif
             if( stockitem )
-              stockitem->bolotid = item->bolotid;
+              bsxSetItemOwlLotID( context->inventory, stockitem, item->bolotid );
           }
           /* BrickOwl's /create can not set a bunch of fields, we need a second "update" pass for created lots */
           updateflags = 0;
@@ -1115,6 +1113,10 @@ int BS_FUNCTION_ALIGN16 bsQueryBrickOwlApplyDiff( bsContext *context, bsxInvento
     return 1;
   }
 
+  /* Every state and inventory write queued so far must be on disk before we mutate the remote inventory */
+  if( !( bsPersistFlush( context ) ) )
+    return 0;
+
   ioPrintf( &context->output, 0, BSMSG_INFO "Updating BrickOwl inventory, " IO_GREEN "%d" IO_DEFAULT " lots are pending for update.\n", diffinv->itemcount );
 
   if( !( bsQueryBrickOwlApplyDiffPass( context, diffinv, retryflag ) ) )
@@ -121,7 +121,7 @@ static int bsSubmitBrickOwlEdit( bsContext *context, bsxItem *item, char *printf
   for( ; ; )
   {
     poststring = ccStrAllocPrintf( "key=%s&boid=" CC_LLD "&type=%s&value=%s", context->brickowl.key, (long long)item->boid, fieldname, fieldstring );
-    querystring = ccStrAllocPrintf( "POST /v1/catalog_edit/basic_edit HTTP/1.1\r\nHost: api.brickowl.com\r\nContent-Type: application/x-www-form-urlencoded\r\nContent-Length: %d\r\nConnection: Keep-Alive\r\n\r\n%s", (int)strlen( poststring ), poststring );
+    querystring = ccStrAllocPrintf( "POST /v1/catalog_edit/basic_edit HTTP/1.1\r\nHost: api.brickowl.com\r\nContent-Type: application/x-www-form-urlencoded\r\nContent-Length: %d\r\nConnection: Keep-Alive\r\n" HTTP_ACCEPT_ENCODING "\r\n%s", (int)strlen( poststring ), poststring );
     reply = bsAllocReply( context, BS_QUERY_TYPE_BRICKOWL, 0, (void *)item, (void *)&item->boid );
     bsBrickOwlAddQuery( context, querystring, HTTP_QUERY_FLAGS_RETRY | HTTP_QUERY_FLAGS_PIPELINING, (void *)reply, bsBrickOwlReplyEdit );
     free( querystring );
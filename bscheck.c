@@ -165,13 +165,11 @@ static int bsCheckBrickLinkOrder( bsContext *context, bsOrder *order, bsxInvento
     }
 
     /* Save updated inventory with fsync() and journalling */
-    if( !( bsxSaveInventory( BS_INVENTORY_TEMP_FILE, context->inventory, 1, 0 ) ) )
+    if( !( bsSaveInventory( context, &journal ) ) )
     {
-      ioPrintf( &context->output, IO_MODEBIT_FLUSH, BSMSG_ERROR "Failed to save inventory file \"" IO_RED "%s" IO_WHITE "\"!\n", BS_INVENTORY_TEMP_FILE );
       bsFatalError( context );
       return 0;
     }
-    journalAddEntry( &journal, BS_INVENTORY_TEMP_FILE, BS_INVENTORY_FILE, 0, 0 );
 
     /* Apply all the queued changes: backup, order inventory, inventory, state file */
     if( !( journalExecute( BS_JOURNAL_FILE, BS_JOURNAL_TEMP_FILE, &context->output, journal.entryarray, journal.entrycount ) ) )
@@ -366,13 +364,11 @@ static int bsCheckBrickOwlOrder( bsContext *context, bsOrder *order, bsxInventor
   }
 
   /* Save updated inventory with fsync() and journalling */
-  if( !( bsxSaveInventory( BS_INVENTORY_TEMP_FILE, context->inventory, 1, 0 ) ) )
+  if( !( bsSaveInventory( context, &journal ) ) )
   {
-    ioPrintf( &context->output, IO_MODEBIT_FLUSH, BSMSG_ERROR "Failed to save inventory file \"" IO_RED "%s" IO_WHITE "\"!\n", BS_INVENTORY_TEMP_FILE );
     bsFatalError( context );
     return 0;
   }
-  journalAddEntry( &journal, BS_INVENTORY_TEMP_FILE, BS_INVENTORY_FILE, 0, 0 );
 
   /* Apply all the queued changes: backup, order inventory, inventory, state file */
   if( !( journalExecute( BS_JOURNAL_FILE, BS_JOURNAL_TEMP_FILE, &context->output, journal.entryarray, journal.entrycount ) ) )
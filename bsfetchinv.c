@@ -73,38 +73,57 @@
 ////
 
 
+/* Feed the inventory to the JSON stream as it is received, lots are parsed while the download is in progress */
+static void bsReceiveInventory( void *uservalue, httpResponse *response, void *data, size_t size )
+{
+  bsQueryReply *reply;
+  jsonStream *stream;
+
+  DEBUG_SET_TRACKER();
+
+  reply = uservalue;
+  stream = (jsonStream *)reply->extpointer;
+  /* Beginning of a reply, discard anything from a previous attempt */
+  if( !( data ) )
+  {
+    bsxEmptyInventory( (bsxInventory *)reply->opaquepointer );
+    jsonStreamReset( stream );
+    return;
+  }
+  jsonStreamFeed( stream, (char *)data, size );
+  return;
+}
+
+
 static void bsBrickLinkReplyInventory( void *uservalue, int resultcode, httpResponse *response )
 {
   bsContext *context;
   bsQueryReply *reply;
-  bsxInventory *inv;
+  jsonStream *stream;
 
   DEBUG_SET_TRACKER();
 
   reply = uservalue;
   context = reply->context;
+  stream = (jsonStream *)reply->extpointer;
 
-#if 0
-  ccFileStore( "zzz.txt", data, datasize, 0 );
-#endif
-
+  /* The content was streamed, what remains of the reply is in the stream's skeleton */
   reply->result = resultcode;
   if( ( response ) && ( response->httpcode != 200 ) )
   {
     if( response->httpcode )
       reply->result = HTTP_RESULT_CODE_ERROR;
-    bsStoreError( context, "BrickLink HTTP Error", response->header, response->headerlength, response->body, response->bodysize );
+    bsStoreError( context, "BrickLink HTTP Error", response->header, response->headerlength, stream->skeleton.data, stream->skeleton.offset );
   }
   mmListDualAddLast( &context->replylist, reply, offsetof(bsQueryReply,list) );
 
-  /* Parse inventory right here */
-  inv = (bsxInventory *)reply->opaquepointer;
-  if( ( reply->result == HTTP_RESULT_SUCCESS ) && ( response->body ) )
+  /* Check the rest of the inventory reply */
+  if( ( reply->result == HTTP_RESULT_SUCCESS ) && ( response ) )
   {
-    if( !( blReadInventory( inv, (char *)response->body, &context->output ) ) )
+    if( !( blReadInventoryStreamEnd( stream ) ) )
     {
       reply->result = HTTP_RESULT_PARSE_ERROR;
-      bsStoreError( context, "BrickLink JSON Parse Error", response->header, response->headerlength, response->body, response->bodysize );
+      bsStoreError( context, "BrickLink JSON Parse Error", response->header, response->headerlength, stream->skeleton.data, stream->skeleton.offset );
     }
   }
 
@@ -118,22 +137,24 @@ bsxInventory *bsQueryBrickLinkInventory( bsContext *context )
   bsQueryReply *reply;
   bsxInventory *inv;
   bsTracker tracker;
+  jsonStream stream;
 
   DEBUG_SET_TRACKER();
 
   bsTrackerInit( &tracker, context->bricklink.http );
   inv = bsxNewInventory();
+  blReadInventoryStreamInit( &stream, inv, &context->output );
   ioPrintf( &context->output, IO_MODEBIT_FLUSH, BSMSG_INFO "Fetching the BrickLink Inventory...\n" );
   for( ; ; )
   {
     /* Add an Inventory query */
-    reply = bsAllocReply( context, BS_QUERY_TYPE_BRICKLINK, 0, 0, (void *)inv );
+    reply = bsAllocReply( context, BS_QUERY_TYPE_BRICKLINK, 0, (void *)&stream, (void *)inv );
 #if 1
     /* Only available inventory */
-    bsBrickLinkAddQuery( context, "GET", "/api/store/v1/inventories", "status=Y", 0, (void *)reply, bsBrickLinkReplyInventory );
+    bsBrickLinkAddStreamQuery( context, "GET", "/api/store/v1/inventories", "status=Y", 0, (void *)reply, bsBrickLinkReplyInventory, bsReceiveInventory );
 #else
     /* Available + stockroom? */
-    bsBrickLinkAddQuery( context, "GET", "/api/store/v1/inventories", "status=Y%2CS", 0, (void *)reply, bsBrickLinkReplyInventory );
+    bsBrickLinkAddStreamQuery( context, "GET", "/api/store/v1/inventories", "status=Y%2CS", 0, (void *)reply, bsBrickLinkReplyInventory, bsReceiveInventory );
 #endif
     /* Wait until all queries are processed */
     bsWaitBrickLinkQueries( context, 0 );
@@ -142,11 +163,13 @@ bsxInventory *bsQueryBrickLinkInventory( bsContext *context )
       break;
     if( tracker.failureflag )
     {
+      jsonStreamFree( &stream );
       bsxFreeInventory( inv );
       return 0;
     }
   }
 
+  jsonStreamFree( &stream );
   return inv;
 }
 
@@ -227,34 +250,31 @@ static void bsBrickOwlReplyInventory( void *uservalue, int resultcode, httpRespo
 {
   bsContext *context;
   bsQueryReply *reply;
-  bsxInventory *inv;
+  boInventoryStream *invstream;
 
   DEBUG_SET_TRACKER();
 
   reply = uservalue;
   context = reply->context;
+  invstream = (boInventoryStream *)reply->extpointer;
 
-#if 0
-  ccFileStore( "zzz.txt", data, datasize, 0 );
-#endif
-
+  /* The content was streamed, what remains of the reply is in the stream's skeleton */
   reply->result = resultcode;
   if( ( response ) && ( response->httpcode != 200 ) )
   {
     if( response->httpcode )
       reply->result = HTTP_RESULT_CODE_ERROR;
-    bsStoreError( context, "BrickOwl HTTP Error", response->header, response->headerlength, response->body, response->bodysize );
+    bsStoreError( context, "BrickOwl HTTP Error", response->header, response->headerlength, invstream->stream.skeleton.data, invstream->stream.skeleton.offset );
   }
   mmListDualAddLast( &context->replylist, reply, offsetof(bsQueryReply,list) );
 
-  /* Parse inventory right here */
-  inv = (bsxInventory *)reply->opaquepointer;
-  if( ( reply->result == HTTP_RESULT_SUCCESS ) && ( response->body ) )
+  /* Check the rest of the inventory reply */
+  if( ( reply->result == HTTP_RESULT_SUCCESS ) && ( response ) )
   {
-    if( !( boReadInventoryTranslate( inv, context->inventory, &context->translationtable, (char *)response->body, &context->output ) ) )
+    if( !( boReadInventoryTranslateStreamEnd( invstream ) ) )
     {
       reply->result = HTTP_RESULT_PARSE_ERROR;
-      bsStoreError( context, "BrickOwl JSON Parse Error", response->header, response->headerlength, response->body, response->bodysize );
+      bsStoreError( context, "BrickOwl JSON Parse Error", response->header, response->headerlength, invstream->stream.skeleton.data, invstream->stream.skeleton.offset );
     }
   }
 
@@ -269,18 +289,20 @@ bsxInventory *bsQueryBrickOwlInventory( bsContext *context )
   bsxInventory *inv;
   char *querystring;
   bsTracker tracker;
+  boInventoryStream invstream;
 
   DEBUG_SET_TRACKER();
 
   bsTrackerInit( &tracker, context->brickowl.http );
   inv = bsxNewInventory();
+  boReadInventoryTranslateStreamInit( &invstream, inv, context->inventory, &context->translationtable, &context->output );
   for( ; ; )
   {
     ioPrintf( &context->output, IO_MODEBIT_FLUSH, BSMSG_INFO "Fetching the BrickOwl Inventory...\n" );
     /* Add an Inventory query */
-    querystring = ccStrAllocPrintf( "GET /v1/inventory/list?key=%s%s HTTP/1.1\r\nHost: api.brickowl.com\r\nConnection: Keep-Alive\r\n\r\n", context->brickowl.key, ( context->brickowl.reuseemptyflag ? "&active_only=0" : "" ) );
-    reply = bsAllocReply( context, BS_QUERY_TYPE_BRICKOWL, 0, 0, (void *)inv );
-    bsBrickOwlAddQuery( context, querystring, HTTP_QUERY_FLAGS_RETRY, (void *)reply, bsBrickOwlReplyInventory );
+    querystring = ccStrAllocPrintf( "GET /v1/inventory/list?key=%s%s HTTP/1.1\r\nHost: api.brickowl.com\r\nConnection: Keep-Alive\r\n" HTTP_ACCEPT_ENCODING "\r\n", context->brickowl.key, ( context->brickowl.reuseemptyflag ? "&active_only=0" : "" ) );
+    reply = bsAllocReply( context, BS_QUERY_TYPE_BRICKOWL, 0, (void *)&invstream.stream, (void *)inv );
+    bsBrickOwlAddStreamQuery( context, querystring, HTTP_QUERY_FLAGS_RETRY, (void *)reply, bsBrickOwlReplyInventory, bsReceiveInventory );
     free( querystring );
     /* Wait until all queries are processed */
     bsWaitBrickOwlQueries( context, 0 );
@@ -289,11 +311,13 @@ bsxInventory *bsQueryBrickOwlInventory( bsContext *context )
       break;
     if( tracker.failureflag )
     {
+      jsonStreamFree( &invstream.stream );
       bsxFreeInventory( inv );
       return 0;
     }
   }
 
+  jsonStreamFree( &invstream.stream );
   return inv;
 }
 
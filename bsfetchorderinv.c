@@ -137,7 +137,7 @@ int bsQueueBrickLinkFetchOrders( bsContext *context, bsOrderList *bsOrderlist, b
   /* Process each order in the OrderList */
   for( orderindex = worklist->liststart ; orderindex < bsOrderlist->ordercount ; orderindex++ )
   {
-    if( context->bricklink.querycount >= context->bricklink.pipelinequeuesize )
+    if( context->bricklink.querycount >= bsPipelineDepth( &context->bricklink.pipeline ) )
       break;
     if( mmBitMapDirectGet( &worklist->bitmap, orderindex ) )
       continue;
@@ -169,7 +169,7 @@ int bsQueueBrickLinkFetchOrders( bsContext *context, bsOrderList *bsOrderlist, b
 /* Fetch orders from orderlist >= basetimestamp, call callback for each, callback must not free 'inv' */
 int bsFetchBrickLinkOrders( bsContext *context, bsOrderList *orderlist, int64_t basetimestamp, int64_t pendingtimestamp, void *uservalue, int (*processorder)( bsContext *context, bsOrder *order, bsxInventory *inv, void *uservalue ) )
 {
-  int waitcount, orderlistindex;
+  int orderlistindex;
   bsxInventory *inv;
   bsOrder *order;
   bsQueryReply *reply, *replynext;
@@ -184,7 +184,6 @@ int bsFetchBrickLinkOrders( bsContext *context, bsOrderList *orderlist, int64_t
 
   /* Put that loop in a function somewhere? */
   bsTrackerInit( &tracker, context->bricklink.http );
-  waitcount = context->bricklink.pipelinequeuesize;
   worklist.liststart = 0;
   mmBitMapInit( &worklist.bitmap, orderlist->ordercount, 0 );
   for( ; ; )
@@ -194,15 +193,13 @@ int bsFetchBrickLinkOrders( bsContext *context, bsOrderList *orderlist, int64_t
       bsQueueBrickLinkFetchOrders( context, orderlist, &worklist, basetimestamp, pendingtimestamp );
     if( !( context->bricklink.querycount ) )
       break;
-    if( context->bricklink.querycount <= waitcount )
-      waitcount = context->bricklink.querycount - 1;
 
 #if BS_ENABLE_DEBUG_SPECIAL
     ioPrintf( &context->output, IO_MODEBIT_FLUSH | IO_MODEBIT_LOGONLY, BSMSG_DEBUG "We have %d BrickLink API queries in queue.\n", context->bricklink.querycount );
 #endif
 
     /* Wait for replies */
-    bsWaitBrickLinkQueries( context, waitcount );
+    bsWaitBrickLinkQueries( context, bsPipelineWaitCount( &context->bricklink.pipeline, context->bricklink.querycount ) );
 
     /* Examine all queued replies */
     for( reply = context->replylist.first ; reply ; reply = replynext )
@@ -302,7 +299,7 @@ int bsQueueBrickOwlFetchOrders( bsContext *context, bsOrderList *bsOrderlist, bs
   /* Process each order in the OrderList */
   for( orderindex = worklist->liststart ; orderindex < bsOrderlist->ordercount ; orderindex++ )
   {
-    if( context->brickowl.querycount >= context->brickowl.pipelinequeuesize )
+    if( context->brickowl.querycount >= bsPipelineDepth( &context->brickowl.pipeline ) )
       break;
     if( mmBitMapDirectGet( &worklist->bitmap, orderindex ) )
       continue;
@@ -318,7 +315,7 @@ int bsQueueBrickOwlFetchOrders( bsContext *context, bsOrderList *bsOrderlist, bs
 #endif
 
     inv = bsxNewInventory();
-    querystring = ccStrAllocPrintf( "GET /v1/order/items?key=%s&order_id="CC_LLD" HTTP/1.1\r\nHost: api.brickowl.com\r\nConnection: Keep-Alive\r\n\r\n", context->brickowl.key, (long long)order->id );
+    querystring = ccStrAllocPrintf( "GET /v1/order/items?key=%s&order_id="CC_LLD" HTTP/1.1\r\nHost: api.brickowl.com\r\nConnection: Keep-Alive\r\n" HTTP_ACCEPT_ENCODING "\r\n", context->brickowl.key, (long long)order->id );
     reply = bsAllocReply( context, BS_QUERY_TYPE_BRICKOWL, orderindex, (void *)order, (void *)inv );
     bsBrickOwlAddQuery( context, querystring, HTTP_QUERY_FLAGS_RETRY, (void *)reply, bsBrickOwlReplyOrderInventory );
     free( querystring );
@@ -332,7 +329,7 @@ int bsQueueBrickOwlFetchOrders( bsContext *context, bsOrderList *bsOrderlist, bs
 /* Fetch orders from orderlist >= basetimestamp, call callback for each, callback must not free 'inv' */
 int bsFetchBrickOwlOrders( bsContext *context, bsOrderList *orderlist, int64_t basetimestamp, int64_t pendingtimestamp, void *uservalue, int (*processorder)( bsContext *context, bsOrder *order, bsxInventory *inv, void *uservalue ) )
 {
-  int waitcount, orderlistindex;
+  int orderlistindex;
   bsxInventory *inv;
   bsOrder *order;
   bsQueryReply *reply, *replynext;
@@ -347,7 +344,6 @@ int bsFetchBrickOwlOrders( bsContext *context, bsOrderList *orderlist, int64_t b
 
   /* Put that loop in a function somewhere? */
   bsTrackerInit( &tracker, context->brickowl.http );
-  waitcount = context->brickowl.pipelinequeuesize;
   worklist.liststart = 0;
   mmBitMapInit( &worklist.bitmap, orderlist->ordercount, 0 );
   for( ; ; )
@@ -357,15 +353,13 @@ int bsFetchBrickOwlOrders( bsContext *context, bsOrderList *orderlist, int64_t b
       bsQueueBrickOwlFetchOrders( context, orderlist, &worklist, basetimestamp, pendingtimestamp );
     if( !( context->brickowl.querycount ) )
       break;
-    if( context->brickowl.querycount <= waitcount )
-      waitcount = context->brickowl.querycount - 1;
 
 #if BS_ENABLE_DEBUG_SPECIAL
     ioPrintf( &context->output, IO_MODEBIT_FLUSH | IO_MODEBIT_LOGONLY, BSMSG_DEBUG "We have %d BrickOwl API queries in queue.\n", context->brickowl.querycount );
 #endif
 
     /* Wait for replies */
-    bsWaitBrickOwlQueries( context, waitcount );
+    bsWaitBrickOwlQueries( context, bsPipelineWaitCount( &context->brickowl.pipeline, context->brickowl.querycount ) );
 
     /* Examine all queued replies */
     for( reply = context->replylist.first ; reply ; reply = replynext )
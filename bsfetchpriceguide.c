@@ -72,97 +72,142 @@
 ////
 
 
-static const size_t blPriceGuideOffsetTable[2][6] =
+/* Fetch planner, a query returns both conditions so each (typeid,id,colorid) is fetched once */
+#define BS_PRICEGUIDE_PLAN_PENDING (0)
+#define BS_PRICEGUIDE_PLAN_DONE (1)
+/* The leader's query failed and won't be attempted again */
+#define BS_PRICEGUIDE_PLAN_FAILED (2)
+
+typedef struct
 {
+  uint32_t hashkey;
+  int leaderindex;
+  int state;
+  /* Other items waiting on the leader's query, linked through followernext[] */
+  int followerfirst;
+  bsxPriceGuide pgnew;
+  bsxPriceGuide pgused;
+} bsPriceGuidePlanKey;
+
+typedef struct
+{
+  bsPriceGuidePlanKey *keylist;
+  int keycount;
+  /* Key index plus one, zero for empty slots */
+  int *hashtable;
+  uint32_t hashmask;
+  int *keyofitem;
+  int *followernext;
+  int sharedcount;
+} bsPriceGuidePlan;
+
+typedef struct
+{
+  bsxInventory *inv;
+  void *callbackpointer;
+  void (*callback)( bsContext *context, bsxInventory *inv, bsxItem *item, bsxPriceGuide *pg, void *callbackpointer );
+  bsPriceGuidePlan *plan;
+} bsFetchPriceGuideCallback;
+
+
+static void bsPriceGuidePlanInit( bsPriceGuidePlan *plan, int itemcount )
+{
+  int hashbits, itemindex;
+
+  for( hashbits = 4 ; ( 1 << hashbits ) < ( itemcount << 1 ) ; hashbits++ );
+  plan->hashmask = ( 1 << hashbits ) - 1;
+  plan->hashtable = malloc( ( plan->hashmask + 1 ) * sizeof(int) );
+  memset( plan->hashtable, 0, ( plan->hashmask + 1 ) * sizeof(int) );
+  plan->keylist = malloc( ( itemcount + 1 ) * sizeof(bsPriceGuidePlanKey) );
+  plan->keycount = 0;
+  plan->keyofitem = malloc( ( itemcount + 1 ) * sizeof(int) );
+  plan->followernext = malloc( ( itemcount + 1 ) * sizeof(int) );
+  for( itemindex = 0 ; itemindex < itemcount ; itemindex++ )
   {
-    offsetof(bsxPriceGuide,salecount), offsetof(bsxPriceGuide,saleqty),
-    offsetof(bsxPriceGuide,saleminimum), offsetof(bsxPriceGuide,saleaverage),
-    offsetof(bsxPriceGuide,saleqtyaverage), offsetof(bsxPriceGuide,salemaximum)
-  },
-  {
-    offsetof(bsxPriceGuide,stockcount), offsetof(bsxPriceGuide,stockqty),
-    offsetof(bsxPriceGuide,stockminimum), offsetof(bsxPriceGuide,stockaverage),
-    offsetof(bsxPriceGuide,stockqtyaverage), offsetof(bsxPriceGuide,stockmaximum)
+    plan->keyofitem[itemindex] = -1;
+    plan->followernext[itemindex] = -1;
   }
-};
+  plan->sharedcount = 0;
+  return;
+}
 
-static int blHtmlParsePriceGuide( bsxPriceGuide *pgnew, bsxPriceGuide *pgused, char *string, int stringlength )
+static void bsPriceGuidePlanFree( bsPriceGuidePlan *plan )
 {
-  int section, sub, value;
-  int64_t curtime;
-  char *sectionstr[2], *substr[2];
-  char *valstr;
-  void *writeaddr;
-  bsxPriceGuide *pg;
-  bsxPriceGuide pgdummy;
-
-  DEBUG_SET_TRACKER();
+  free( plan->hashtable );
+  free( plan->keylist );
+  free( plan->keyofitem );
+  free( plan->followernext );
+  return;
+}
 
-  if( !( pgnew ) )
-    pgnew = &pgdummy;
-  if( !( pgused ) )
-    pgused = &pgdummy;
-
-  memset( pgnew, 0, sizeof(bsxPriceGuide) );
-  memset( pgused, 0, sizeof(bsxPriceGuide) );
-  sectionstr[0] = ccSeqFindStrSkip( string, stringlength, "Past 6 Months Sales" );
-  sectionstr[1] = ccSeqFindStrSkip( string, stringlength, "Current Items for Sale" );
-  string[stringlength-1] = 0;
-  if( sectionstr[0] )
-    sectionstr[0][-1] = 0;
-  if( sectionstr[1] )
-    sectionstr[1][-1] = 0;
-
-  for( section = 0 ; section < 2 ; section++ )
+/* Return the key of the item, the first item to ask for a key becomes its leader */
+static bsPriceGuidePlanKey *bsPriceGuidePlanAssign( bsPriceGuidePlan *plan, bsxInventory *inv, int itemindex )
+{
+  uint32_t hashkey, hashindex;
+  bsxItem *item, *leader;
+  bsPriceGuidePlanKey *key;
+
+  if( plan->keyofitem[itemindex] >= 0 )
+    return &plan->keylist[ plan->keyofitem[itemindex] ];
+  item = &inv->itemlist[itemindex];
+  hashkey = ccHash32Data( item->id, strlen( item->id ) ) ^ ccHash32Int32( ( (uint32_t)item->colorid << 8 ) | (uint8_t)item->typeid );
+  for( hashindex = hashkey & plan->hashmask ; plan->hashtable[hashindex] ; hashindex = ( hashindex + 1 ) & plan->hashmask )
   {
-    /* Get sale numbers out */
-    if( !( sectionstr[section] ) )
+    key = &plan->keylist[ plan->hashtable[hashindex] - 1 ];
+    if( key->hashkey != hashkey )
       continue;
-    substr[0] = ccStrFindStrSkip( sectionstr[section], "New" );
-    substr[1] = ccStrFindStrSkip( sectionstr[section], "Used" );
-    for( sub = 0 ; sub < 2 ; sub++ )
+    leader = &inv->itemlist[ key->leaderindex ];
+    if( ( leader->typeid == item->typeid ) && ( leader->colorid == item->colorid ) && ( strcmp( leader->id, item->id ) == 0 ) )
     {
-      valstr = substr[sub];
-      if( !( valstr ) )
-        continue;
-      pg = ( sub ? pgused : pgnew );
-      for( value = 0 ; value < 2 ; value++ )
-      {
-        writeaddr = ADDRESS( pg, blPriceGuideOffsetTable[section][value] );
-        valstr = ccStrFindStrSkip( valstr, "SIZE=\"2\">&nbsp;" );
-        if( !( valstr ) )
-          return 0;
-        if( sscanf( valstr, "%d", (int *)writeaddr ) != 1 )
-          return 0;
-      }
-      for( ; value < 6 ; value++ )
-      {
-        writeaddr = ADDRESS( pg, blPriceGuideOffsetTable[section][value] );
-        valstr = ccStrFindStrSkip( valstr, "SIZE=\"2\">&nbsp;" );
-        if( !( valstr ) )
-          return 0;
-        if( sscanf( valstr, "$%f", (float *)writeaddr ) != 1 )
-          return 0;
-      }
+      plan->keyofitem[itemindex] = plan->hashtable[hashindex] - 1;
+      return key;
     }
   }
-
-  curtime = time( 0 );
-  pgnew->modtime = curtime;
-  pgused->modtime = curtime;
-  return 1;
+  key = &plan->keylist[ plan->keycount ];
+  key->hashkey = hashkey;
+  key->leaderindex = itemindex;
+  key->state = BS_PRICEGUIDE_PLAN_PENDING;
+  key->followerfirst = -1;
+  plan->keyofitem[itemindex] = plan->keycount;
+  plan->hashtable[hashindex] = ++plan->keycount;
+  return key;
 }
 
+/* Hand a fetched price guide to an item sharing the query of another */
+static void bsPriceGuidePlanDeliver( bsContext *context, bsFetchPriceGuideCallback *pgcallback, bsPriceGuidePlanKey *key, int itemindex )
+{
+  bsxItem *item;
 
-////
+  item = &pgcallback->inv->itemlist[itemindex];
+  if( pgcallback->callback )
+    pgcallback->callback( context, pgcallback->inv, item, ( item->condition == 'N' ? &key->pgnew : &key->pgused ), pgcallback->callbackpointer );
+  item->flags &= ~BSX_ITEM_XFLAGS_FETCH_PRICE_GUIDE;
+  pgcallback->plan->sharedcount++;
+  ioPrintf( &context->output, IO_MODEBIT_LOGONLY | IO_MODEBIT_NODATE, "LOG: Shared price guide fetch for item \"%s\", color %d\n", item->id, item->colorid );
+  return;
+}
 
+static void bsPriceGuidePlanReportError( bsContext *context, bsxItem *item )
+{
+  ioPrintf( &context->output, 0, BSMSG_ERROR "Bad reply from server when fetching price guide for item \"" IO_MAGENTA "%s" IO_WHITE "\", color " IO_MAGENTA "%d" IO_WHITE ".\n", ( item->id ? item->id : item->name ), item->colorid );
+  return;
+}
 
-typedef struct
+/* The leader's query failed for good, so did the items waiting on it ; they keep their fetch flag like the leader */
+static void bsPriceGuidePlanFail( bsContext *context, bsFetchPriceGuideCallback *pgcallback, int leaderindex )
 {
-  bsxInventory *inv;
-  void *callbackpointer;
-  void (*callback)( bsContext *context, bsxInventory *inv, bsxItem *item, bsxPriceGuide *pg, void *callbackpointer );
-} bsFetchPriceGuideCallback;
+  int itemindex;
+  bsPriceGuidePlanKey *key;
+
+  if( !( pgcallback->plan ) || ( pgcallback->plan->keyofitem[ leaderindex ] < 0 ) )
+    return;
+  key = &pgcallback->plan->keylist[ pgcallback->plan->keyofitem[ leaderindex ] ];
+  key->state = BS_PRICEGUIDE_PLAN_FAILED;
+  for( itemindex = key->followerfirst ; itemindex >= 0 ; itemindex = pgcallback->plan->followernext[itemindex] )
+    bsPriceGuidePlanReportError( context, &pgcallback->inv->itemlist[itemindex] );
+  key->followerfirst = -1;
+  return;
+}
 
 
 static void bsBrickLinkReplyPriceGuide( void *uservalue, int resultcode, httpResponse *response )
@@ -172,7 +217,8 @@ static void bsBrickLinkReplyPriceGuide( void *uservalue, int resultcode, httpRes
   bsxItem *item;
   bsxPriceGuide pgnew, pgused;
   bsFetchPriceGuideCallback *pgcallback;
-  char *pgpath;
+  bsPriceGuidePlanKey *key;
+  int itemindex;
 
   DEBUG_SET_TRACKER();
 
@@ -198,17 +244,23 @@ static void bsBrickLinkReplyPriceGuide( void *uservalue, int resultcode, httpRes
     {
       item = reply->extpointer;
       /* Save to price guide cache */
-      pgpath = bsxPriceGuidePath( context->priceguidepath, item->typeid, item->id, item->colorid, context->priceguideflags | BSX_PRICEGUIDE_FLAGS_MKDIR );
-      if( !( bsxWritePriceGuide( &pgnew, &pgused, pgpath, item->typeid, item->id, item->colorid ) ) )
-      {
-        ioPrintf( &context->output, 0, BSMSG_ERROR "We failed to write price guide cache at \"" IO_MAGENTA "%s" IO_WHITE "\".\n", pgpath );
+      if( !( bsPriceGuideWrite( context, &pgnew, &pgused, item->typeid, item->id, item->colorid ) ) )
         reply->result = HTTP_RESULT_PROCESS_ERROR;
-      }
-      free( pgpath );
       /* Call callback if any */
       pgcallback = (bsFetchPriceGuideCallback *)reply->opaquepointer;
       if( ( pgcallback ) && ( pgcallback->callback ) )
         pgcallback->callback( context, pgcallback->inv, item, ( item->condition == 'N' ? &pgnew : &pgused ), pgcallback->callbackpointer );
+      /* Fan out to items of the same key, and keep the result for any flagged later */
+      if( ( pgcallback ) && ( pgcallback->plan ) && ( pgcallback->plan->keyofitem[ reply->extid ] >= 0 ) )
+      {
+        key = &pgcallback->plan->keylist[ pgcallback->plan->keyofitem[ reply->extid ] ];
+        key->state = BS_PRICEGUIDE_PLAN_DONE;
+        key->pgnew = pgnew;
+        key->pgused = pgused;
+        for( itemindex = key->followerfirst ; itemindex >= 0 ; itemindex = pgcallback->plan->followernext[itemindex] )
+          bsPriceGuidePlanDeliver( context, pgcallback, key, itemindex );
+        key->followerfirst = -1;
+      }
     }
     else
     {
@@ -222,19 +274,20 @@ static void bsBrickLinkReplyPriceGuide( void *uservalue, int resultcode, httpRes
 
 
 /* Queue a batch of update queries for lots of the "diff" inventory */
-static int bsQueueBrickLinkPriceGuide( bsContext *context, bsWorkList *worklist, bsxInventory *inv, bsFetchPriceGuideCallback *pgcallback )
+static int bsQueueBrickLinkPriceGuide( bsContext *context, bsWorkList *worklist, bsxInventory *inv, int listend, bsFetchPriceGuideCallback *pgcallback )
 {
   int itemindex;
   char *querystring;
   bsxItem *item;
   bsQueryReply *reply;
+  bsPriceGuidePlanKey *key;
 
   DEBUG_SET_TRACKER();
 
   /* Only queue so many queries over HTTP pipelining */
-  for( itemindex = worklist->liststart ; itemindex < inv->itemcount ; itemindex++ )
+  for( itemindex = worklist->liststart ; itemindex < listend ; itemindex++ )
   {
-    if( context->bricklink.webquerycount >= context->bricklink.pipelinequeuesize )
+    if( context->bricklink.webquerycount >= bsPipelineDepth( &context->bricklink.webpipeline ) )
       break;
     if( mmBitMapDirectGet( &worklist->bitmap, itemindex ) )
       continue;
@@ -244,8 +297,25 @@ static int bsQueueBrickLinkPriceGuide( bsContext *context, bsWorkList *worklist,
       continue;
     if( !( item->flags & BSX_ITEM_XFLAGS_FETCH_PRICE_GUIDE ) )
       continue;
+    if( ( pgcallback->plan ) && ( item->id ) )
+    {
+      key = bsPriceGuidePlanAssign( pgcallback->plan, inv, itemindex );
+      if( key->leaderindex != itemindex )
+      {
+        if( key->state == BS_PRICEGUIDE_PLAN_DONE )
+          bsPriceGuidePlanDeliver( context, pgcallback, key, itemindex );
+        else if( key->state == BS_PRICEGUIDE_PLAN_FAILED )
+          bsPriceGuidePlanReportError( context, item );
+        else
+        {
+          pgcallback->plan->followernext[itemindex] = key->followerfirst;
+          key->followerfirst = itemindex;
+        }
+        continue;
+      }
+    }
     reply = bsAllocReply( context, BS_QUERY_TYPE_WEBBRICKLINK, itemindex, (void *)item, (void *)pgcallback );
-    querystring = ccStrAllocPrintf( "GET /priceGuide.asp?a=%c&viewType=N&colorID=%d&itemID=%s&viewDec=3 HTTP/1.1\r\nHost: www.bricklink.com\r\nConnection: Keep-Alive\r\n\r\n", item->typeid, item->colorid, item->id );
+    querystring = ccStrAllocPrintf( "GET /priceGuide.asp?a=%c&viewType=N&colorID=%d&itemID=%s&viewDec=3 HTTP/1.1\r\nHost: www.bricklink.com\r\nConnection: Keep-Alive\r\n" HTTP_ACCEPT_ENCODING "\r\n", item->typeid, item->colorid, item->id );
     httpAddQuery( context->bricklink.webhttp, querystring, strlen( querystring ), HTTP_QUERY_FLAGS_RETRY, (void *)reply, bsBrickLinkReplyPriceGuide );
     free( querystring );
     ioPrintf( &context->output, IO_MODEBIT_LOGONLY | IO_MODEBIT_NODATE, "LOG: Queued price guide query for item \"%s\", color %d\n", ( item->id ? item->id : item->name ), item->colorid );
@@ -259,12 +329,20 @@ static int bsQueueBrickLinkPriceGuide( bsContext *context, bsWorkList *worklist,
 /* Populate the price guide cache with all items flagged BSX_ITEM_XFLAGS_FETCH_PRICE_GUIDE */
 int bsBrickLinkFetchPriceGuide( bsContext *context, bsxInventory *inv, void *callbackpointer, void (*callback)( bsContext *context, bsxInventory *inv, bsxItem *item, bsxPriceGuide *pg, void *callbackpointer ) )
 {
-  int waitcount, itemlistindex;
+  return bsBrickLinkFetchPriceGuideScan( context, inv, callbackpointer, callback, 0, 0 );
+}
+
+
+/* Same, but items are only queued once the scan function has examined them */
+int bsBrickLinkFetchPriceGuideScan( bsContext *context, bsxInventory *inv, void *callbackpointer, void (*callback)( bsContext *context, bsxInventory *inv, bsxItem *item, bsxPriceGuide *pg, void *callbackpointer ), void *scanpointer, int (*scan)( bsContext *context, void *scanpointer, int waitflag ) )
+{
+  int itemlistindex, listend;
   bsxItem *item;
   bsQueryReply *reply, *replynext;
   bsWorkList worklist;
   bsTracker tracker;
   bsFetchPriceGuideCallback pgcallback;
+  bsPriceGuidePlan plan;
 
   DEBUG_SET_TRACKER();
 
@@ -272,24 +350,34 @@ int bsBrickLinkFetchPriceGuide( bsContext *context, bsxInventory *inv, void *cal
   pgcallback.inv = inv;
   pgcallback.callbackpointer = callbackpointer;
   pgcallback.callback = callback;
+  bsPriceGuidePlanInit( &plan, inv->itemcount );
+  pgcallback.plan = &plan;
 
   /* Keep pushing price guide fetches until we are done */
   bsTrackerInit( &tracker, context->bricklink.webhttp );
-  waitcount = context->bricklink.pipelinequeuesize;
   worklist.liststart = 0;
   mmBitMapInit( &worklist.bitmap, inv->itemcount, 0 );
+  listend = inv->itemcount;
   for( ; ; )
   {
+    /* Advance the scan, only block on it when we have no queries in flight */
+    if( scan )
+      listend = scan( context, scanpointer, !( context->bricklink.webquerycount ) );
     /* Queue updates for the "diff" inventory */
     if( !( tracker.failureflag ) )
-      bsQueueBrickLinkPriceGuide( context, &worklist, inv, &pgcallback );
+      bsQueueBrickLinkPriceGuide( context, &worklist, inv, listend, &pgcallback );
     if( !( context->bricklink.webquerycount ) )
-      break;
-    if( context->bricklink.webquerycount <= waitcount )
-      waitcount = context->bricklink.webquerycount - 1;
+    {
+      if( ( listend >= inv->itemcount ) || ( tracker.failureflag ) )
+        break;
+      continue;
+    }
 
-    /* Wait for replies */
-    bsWaitBrickLinkWebQueries( context, waitcount );
+    /* Wait for replies, just the next one while the scan is still in progress */
+    if( listend < inv->itemcount )
+      bsWaitBrickLinkWebQueries( context, context->bricklink.webquerycount - 1 );
+    else
+      bsWaitBrickLinkWebQueries( context, bsPipelineWaitCount( &context->bricklink.webpipeline, context->bricklink.webquerycount ) );
 
     /* Examine all queued replies */
     for( reply = context->replylist.first ; reply ; reply = replynext )
@@ -300,7 +388,10 @@ int bsBrickLinkFetchPriceGuide( bsContext *context, bsxInventory *inv, void *cal
       if( reply->result != HTTP_RESULT_SUCCESS )
       {
         if( ( reply->result == HTTP_RESULT_CODE_ERROR ) || ( reply->result == HTTP_RESULT_PARSE_ERROR ) )
-          ioPrintf( &context->output, 0, BSMSG_ERROR "Bad reply from server when fetching price guide for item \"" IO_MAGENTA "%s" IO_WHITE "\", color " IO_MAGENTA "%d" IO_WHITE ".\n", ( item->id ? item->id : item->name ), item->colorid );
+        {
+          bsPriceGuidePlanReportError( context, item );
+          bsPriceGuidePlanFail( context, &pgcallback, itemlistindex );
+        }
         else if( reply->result != HTTP_RESULT_PROCESS_ERROR )
         {
           ioPrintf( &context->output, 0, BSMSG_WARNING "Price guide fetching failure, attempting again for item \"" IO_MAGENTA "%s" IO_WHITE "\", color " IO_MAGENTA "%d" IO_WHITE ".\n", ( item->id ? item->id : item->name ), item->colorid );
@@ -322,6 +413,9 @@ int bsBrickLinkFetchPriceGuide( bsContext *context, bsxInventory *inv, void *cal
   }
 
   mmBitMapFree( &worklist.bitmap );
+  if( plan.sharedcount )
+    ioPrintf( &context->output, IO_MODEBIT_LOGONLY, "LOG: Price guide fetches shared by %d items of identical type, ID and color.\n", plan.sharedcount );
+  bsPriceGuidePlanFree( &plan );
   if( !( tracker.failureflag ) )
   {
     /* Flag inventory for minor updates, LotIDs and such */
@@ -332,4 +426,184 @@ int bsBrickLinkFetchPriceGuide( bsContext *context, bsxInventory *inv, void *cal
 }
 
 
+////
+
+
+static int bsPriceGuideRefreshCmpKey( const void *p0, const void *p1 )
+{
+  const bsPriceGuideRefreshEntry *entry0, *entry1;
+  int cmp;
+  entry0 = p0;
+  entry1 = p1;
+  if( entry0->typeid != entry1->typeid )
+    return ( entry0->typeid < entry1->typeid ? -1 : 1 );
+  cmp = strcmp( entry0->id, entry1->id );
+  if( cmp )
+    return cmp;
+  return ( entry0->colorid < entry1->colorid ? -1 : ( entry0->colorid > entry1->colorid ? 1 : 0 ) );
+}
+
+static int bsPriceGuideRefreshCmpTime( const void *p0, const void *p1 )
+{
+  const bsPriceGuideRefreshEntry *entry0, *entry1;
+  entry0 = p0;
+  entry1 = p1;
+  return ( entry0->modtime < entry1->modtime ? -1 : ( entry0->modtime > entry1->modtime ? 1 : 0 ) );
+}
+
+static void bsPriceGuideRefreshClear( bsPriceGuideRefresh *refresh )
+{
+  int entryindex;
+  for( entryindex = 0 ; entryindex < refresh->entrycount ; entryindex++ )
+    free( refresh->entrylist[entryindex].id );
+  free( refresh->entrylist );
+  refresh->entrylist = 0;
+  refresh->entrycount = 0;
+  refresh->scanindex = 0;
+  refresh->nextindex = 0;
+  return;
+}
+
+/* One entry per item and color of the tracked inventory, both conditions share a price guide */
+static void bsPriceGuideRefreshBuild( bsContext *context, bsPriceGuideRefresh *refresh )
+{
+  int itemindex, entryindex, entrycount;
+  bsxItem *item;
+  bsxInventory *inv;
+  bsPriceGuideRefreshEntry *entry;
+
+  bsPriceGuideRefreshClear( refresh );
+  inv = context->inventory;
+  refresh->entrylist = malloc( ( inv->itemcount + 1 ) * sizeof(bsPriceGuideRefreshEntry) );
+  entrycount = 0;
+  for( itemindex = 0 ; itemindex < inv->itemcount ; itemindex++ )
+  {
+    item = &inv->itemlist[itemindex];
+    if( ( item->flags & BSX_ITEM_FLAGS_DELETED ) || !( item->id ) || !( item->typeid ) )
+      continue;
+    entry = &refresh->entrylist[entrycount++];
+    entry->typeid = item->typeid;
+    entry->colorid = item->colorid;
+    entry->modtime = 0;
+    entry->id = item->id;
+  }
+  qsort( refresh->entrylist, entrycount, sizeof(bsPriceGuideRefreshEntry), bsPriceGuideRefreshCmpKey );
+  refresh->entrycount = 0;
+  for( entryindex = 0 ; entryindex < entrycount ; entryindex++ )
+  {
+    entry = &refresh->entrylist[entryindex];
+    if( ( refresh->entrycount ) && ( bsPriceGuideRefreshCmpKey( &refresh->entrylist[ refresh->entrycount - 1 ], entry ) == 0 ) )
+      continue;
+    refresh->entrylist[ refresh->entrycount ] = *entry;
+    refresh->entrycount++;
+  }
+  /* Inventory strings may go away, keep our own copies */
+  for( entryindex = 0 ; entryindex < refresh->entrycount ; entryindex++ )
+    refresh->entrylist[entryindex].id = ccStrDup( refresh->entrylist[entryindex].id );
+  refresh->buildtime = context->curtime;
+  return;
+}
+
+
+static void bsBrickLinkReplyPriceGuideRefresh( void *uservalue, int resultcode, httpResponse *response )
+{
+  bsContext *context;
+  bsPriceGuideRefresh *refresh;
+  bsxPriceGuide pgnew, pgused;
+
+  DEBUG_SET_TRACKER();
+
+  context = uservalue;
+  refresh = &context->pgrefresh;
+  refresh->pendingflag = 0;
+  if( ( resultcode == HTTP_RESULT_SUCCESS ) && ( response ) && ( response->httpcode == 200 ) && ( response->body ) && ( blHtmlParsePriceGuide( &pgnew, &pgused, response->body, response->bodysize ) ) )
+  {
+    if( bsPriceGuideWrite( context, &pgnew, &pgused, refresh->pendingtypeid, refresh->pendingid, refresh->pendingcolorid ) )
+    {
+      refresh->refreshcount++;
+      ioPrintf( &context->output, IO_MODEBIT_LOGONLY | IO_MODEBIT_NODATE, "LOG: Refreshed price guide for item \"%s\", color %d\n", refresh->pendingid, refresh->pendingcolorid );
+      return;
+    }
+  }
+  refresh->failcount++;
+  ioPrintf( &context->output, IO_MODEBIT_LOGONLY | IO_MODEBIT_NODATE, "LOG: Failed to refresh price guide for item \"%s\", color %d\n", refresh->pendingid, refresh->pendingcolorid );
+  return;
+}
+
+
+void bsPriceGuideRefreshIdle( bsContext *context )
+{
+  int entryend;
+  int64_t refreshtime;
+  char *querystring;
+  bsxPriceGuide pg;
+  bsPriceGuideRefresh *refresh;
+  bsPriceGuideRefreshEntry *entry;
+
+  DEBUG_SET_TRACKER();
+
+  refresh = &context->pgrefresh;
+  if( !( context->priceguiderefreshrate ) || ( refresh->pendingflag ) )
+    return;
+  /* Stay out of the way of synchronization and of any other price guide fetching */
+  if( context->stateflags & ( BS_STATE_FLAGS_BRICKLINK_MASTER_MODE | BS_STATE_FLAGS_BRICKLINK_MUST_UPDATE | BS_STATE_FLAGS_BRICKLINK_MUST_SYNC | BS_STATE_FLAGS_BRICKOWL_MUST_UPDATE | BS_STATE_FLAGS_BRICKOWL_MUST_SYNC ) )
+    return;
+  if( ( context->bricklink.webquerycount ) || ( httpGetQueryQueueCount( context->bricklink.webhttp ) ) )
+    return;
+
+  if( !( refresh->entrylist ) || ( ( refresh->nextindex >= refresh->entrycount ) && ( context->curtime >= refresh->buildtime + BS_PRICEGUIDE_REFRESH_REBUILD_INTERVAL ) ) )
+    bsPriceGuideRefreshBuild( context, refresh );
+
+  /* Read cached modtimes a chunk at a time, missing entries are the oldest */
+  if( refresh->scanindex < refresh->entrycount )
+  {
+    entryend = refresh->scanindex + BS_PRICEGUIDE_REFRESH_SCAN_CHUNK;
+    if( entryend > refresh->entrycount )
+      entryend = refresh->entrycount;
+    for( ; refresh->scanindex < entryend ; refresh->scanindex++ )
+    {
+      entry = &refresh->entrylist[ refresh->scanindex ];
+      if( ( bsPriceGuideRead( context, &pg, entry->typeid, entry->id, entry->colorid, 'N' ) ) || ( bsPriceGuideRead( context, &pg, entry->typeid, entry->id, entry->colorid, 'U' ) ) )
+        entry->modtime = pg.modtime;
+    }
+    if( refresh->scanindex >= refresh->entrycount )
+      qsort( refresh->entrylist, refresh->entrycount, sizeof(bsPriceGuideRefreshEntry), bsPriceGuideRefreshCmpTime );
+    return;
+  }
+
+  if( context->curtime < refresh->fetchtime )
+    return;
+  /* Refresh entries past half of the cache time, so commands find them still valid */
+  refreshtime = context->curtime - ( context->priceguidecachetime >> 1 );
+  if( refresh->nextindex >= refresh->entrycount )
+    return;
+  entry = &refresh->entrylist[ refresh->nextindex ];
+  if( entry->modtime >= refreshtime )
+  {
+    /* Sorted oldest first, nothing else is due until the next rebuild */
+    refresh->nextindex = refresh->entrycount;
+    return;
+  }
+  refresh->nextindex++;
+
+  free( refresh->pendingid );
+  refresh->pendingid = ccStrDup( entry->id );
+  refresh->pendingtypeid = entry->typeid;
+  refresh->pendingcolorid = entry->colorid;
+  refresh->pendingflag = 1;
+  querystring = ccStrAllocPrintf( "GET /priceGuide.asp?a=%c&viewType=N&colorID=%d&itemID=%s&viewDec=3 HTTP/1.1\r\nHost: www.bricklink.com\r\nConnection: Keep-Alive\r\n" HTTP_ACCEPT_ENCODING "\r\n", entry->typeid, entry->colorid, entry->id );
+  httpAddQuery( context->bricklink.webhttp, querystring, strlen( querystring ), HTTP_QUERY_FLAGS_RETRY, (void *)context, bsBrickLinkReplyPriceGuideRefresh );
+  free( querystring );
+  refresh->fetchtime = context->curtime + ( ( 60*60 ) / context->priceguiderefreshrate );
+  return;
+}
+
+
+void bsPriceGuideRefreshFree( bsContext *context )
+{
+  bsPriceGuideRefreshClear( &context->pgrefresh );
+  free( context->pgrefresh.pendingid );
+  context->pgrefresh.pendingid = 0;
+  return;
+}
 
@@ -72,6 +72,15 @@
 ////
 
 
+static inline int intMin( int x, int y )
+{
+  return ( x < y ? x : y );
+}
+
+
+////
+
+
 /* Find all tab-limited strings, replace tabs with \0 */
 static int blTextTabLineFilter( char **paramlist, int paramlistsize, char *string, int stringlength )
 {
@@ -172,14 +181,337 @@ static int blTextParseInventory( bsxInventory *inv, char *string, int stringleng
 ////
 
 
+#define BS_SETINV_MAGIC (0x43495342)
+#define BS_SETINV_VERSION (1)
+
+typedef struct
+{
+  uint32_t magic;
+  uint32_t version;
+  uint32_t entrycount;
+  uint32_t entrysize;
+  uint64_t datasize;
+} bsSetInvHeader;
+
+/* Followed by the item ID and name, without terminators */
+typedef struct
+{
+  int32_t colorid;
+  int32_t quantity;
+  int32_t alternateid;
+  uint16_t namelength;
+  uint8_t idlength;
+  char typeid;
+} bsSetInvPart;
+
+
+static int bsSetInvCompare( char itemtypeid, char *itemid, bsSetInvEntry *entry )
+{
+  if( itemtypeid != entry->typeid )
+    return ( (uint8_t)itemtypeid < (uint8_t)entry->typeid ? -1 : 1 );
+  return strcmp( itemid, entry->id );
+}
+
+/* Binary search, return the matching entry index or the insertion point as -1-index */
+static int bsSetInvSearch( bsSetInvCache *cache, char itemtypeid, char *itemid )
+{
+  int low, high, mid, cmp;
+  low = 0;
+  high = cache->entrycount - 1;
+  while( low <= high )
+  {
+    mid = ( low + high ) >> 1;
+    cmp = bsSetInvCompare( itemtypeid, itemid, &cache->entrylist[mid] );
+    if( !( cmp ) )
+      return mid;
+    if( cmp < 0 )
+      high = mid - 1;
+    else
+      low = mid + 1;
+  }
+  return -1 - low;
+}
+
+
+static void bsSetInvLoad( bsContext *context )
+{
+  int entryindex;
+  size_t filesize;
+  char *file;
+  bsSetInvHeader *header;
+  bsSetInvEntry *entry;
+  bsSetInvCache *cache;
+
+  cache = &context->setinvcache;
+  if( cache->loadedflag )
+    return;
+  cache->loadedflag = 1;
+  file = ccFileLoad( BS_SETINV_CACHE_FILE, 0, &filesize );
+  if( !( file ) )
+    return;
+  header = (bsSetInvHeader *)file;
+  if( ( filesize < sizeof(bsSetInvHeader) ) || ( header->magic != BS_SETINV_MAGIC ) || ( header->version != BS_SETINV_VERSION ) || ( header->entrysize != sizeof(bsSetInvEntry) ) || ( filesize != sizeof(bsSetInvHeader) + header->datasize + ( (size_t)header->entrycount * sizeof(bsSetInvEntry) ) ) )
+  {
+    ioPrintf( &context->output, 0, BSMSG_WARNING "The set inventory cache \"" IO_MAGENTA "%s" IO_WHITE "\" is invalid and will be rebuilt.\n", BS_SETINV_CACHE_FILE );
+    free( file );
+    return;
+  }
+  cache->datasize = header->datasize;
+  cache->dataalloc = header->datasize;
+  cache->data = malloc( cache->dataalloc + 1 );
+  memcpy( cache->data, ADDRESS( file, sizeof(bsSetInvHeader) ), cache->datasize );
+  cache->entrycount = header->entrycount;
+  cache->entryalloc = header->entrycount + 64;
+  cache->entrylist = malloc( cache->entryalloc * sizeof(bsSetInvEntry) );
+  memcpy( cache->entrylist, ADDRESS( file, sizeof(bsSetInvHeader) + cache->datasize ), cache->entrycount * sizeof(bsSetInvEntry) );
+  free( file );
+
+  /* Drop anything pointing outside of the data */
+  for( entryindex = 0 ; entryindex < cache->entrycount ; entryindex++ )
+  {
+    entry = &cache->entrylist[entryindex];
+    entry->id[sizeof(entry->id)-1] = 0;
+    if( ( entry->size < 0 ) || ( entry->offset + (uint64_t)entry->size > cache->datasize ) )
+    {
+      cache->entrycount = 0;
+      break;
+    }
+  }
+  return;
+}
+
+
+/* Write the cache as header, part lists of live entries and the sorted index */
+static int bsSetInvSave( bsContext *context )
+{
+  int entryindex;
+  size_t datasize, offset;
+  char *file;
+  bsSetInvHeader *header;
+  bsSetInvEntry *entrylist;
+  bsSetInvCache *cache;
+
+  cache = &context->setinvcache;
+  if( !( cache->dirtyflag ) )
+    return 1;
+  datasize = 0;
+  for( entryindex = 0 ; entryindex < cache->entrycount ; entryindex++ )
+    datasize += cache->entrylist[entryindex].size;
+  file = malloc( sizeof(bsSetInvHeader) + datasize + ( cache->entrycount * sizeof(bsSetInvEntry) ) );
+  header = (bsSetInvHeader *)file;
+  memset( header, 0, sizeof(bsSetInvHeader) );
+  header->magic = BS_SETINV_MAGIC;
+  header->version = BS_SETINV_VERSION;
+  header->entrycount = cache->entrycount;
+  header->entrysize = sizeof(bsSetInvEntry);
+  header->datasize = datasize;
+  entrylist = ADDRESS( file, sizeof(bsSetInvHeader) + datasize );
+  offset = 0;
+  for( entryindex = 0 ; entryindex < cache->entrycount ; entryindex++ )
+  {
+    entrylist[entryindex] = cache->entrylist[entryindex];
+    memcpy( ADDRESS( file, sizeof(bsSetInvHeader) + offset ), &cache->data[ cache->entrylist[entryindex].offset ], cache->entrylist[entryindex].size );
+    entrylist[entryindex].offset = offset;
+    offset += cache->entrylist[entryindex].size;
+  }
+  if( !( ccFileStore( BS_SETINV_CACHE_TEMP_FILE, file, sizeof(bsSetInvHeader) + datasize + ( cache->entrycount * sizeof(bsSetInvEntry) ), 1 ) ) || !( ccRenameFile( BS_SETINV_CACHE_TEMP_FILE, BS_SETINV_CACHE_FILE ) ) )
+  {
+    ioPrintf( &context->output, 0, BSMSG_ERROR "We failed to write the set inventory cache at \"" IO_RED "%s" IO_WHITE "\".\n", BS_SETINV_CACHE_FILE );
+    free( file );
+    return 0;
+  }
+
+  /* Adopt the compacted layout, dropping replaced part lists */
+  free( cache->data );
+  cache->data = malloc( datasize + 1 );
+  memcpy( cache->data, ADDRESS( file, sizeof(bsSetInvHeader) ), datasize );
+  cache->datasize = datasize;
+  cache->dataalloc = datasize;
+  memcpy( cache->entrylist, entrylist, cache->entrycount * sizeof(bsSetInvEntry) );
+  free( file );
+  cache->dirtyflag = 0;
+  return 1;
+}
+
+
+void bsSetInvCacheFree( bsContext *context )
+{
+  bsSetInvCache *cache;
+  cache = &context->setinvcache;
+  free( cache->data );
+  free( cache->entrylist );
+  memset( cache, 0, sizeof(bsSetInvCache) );
+  return;
+}
+
+
+static int bsSetInvItemCompare( const void *p0, const void *p1 )
+{
+  int cmp;
+  const bsxItem *item0, *item1;
+  item0 = *(const bsxItem **)p0;
+  item1 = *(const bsxItem **)p1;
+  if( item0->typeid != item1->typeid )
+    return ( (uint8_t)item0->typeid < (uint8_t)item1->typeid ? -1 : 1 );
+  if( ( cmp = strcmp( item0->id, item1->id ) ) )
+    return cmp;
+  if( item0->colorid != item1->colorid )
+    return ( item0->colorid < item1->colorid ? -1 : 1 );
+  return ( item0->alternateid < item1->alternateid ? -1 : ( item0->alternateid > item1->alternateid ? 1 : 0 ) );
+}
+
+/* Store the inventory as a sorted part list, replacing any previous entry */
+static int bsSetInvStore( bsContext *context, char itemtypeid, char *itemid, bsxInventory *inv )
+{
+  int entryindex, itemindex, partcount, idlength, namelength;
+  size_t size;
+  bsxItem *item;
+  bsxItem **itemsort;
+  bsSetInvPart *part;
+  bsSetInvEntry *entry;
+  bsSetInvCache *cache;
+
+  cache = &context->setinvcache;
+  if( strlen( itemid ) >= sizeof(entry->id) )
+    return 0;
+  itemsort = malloc( ( inv->itemcount + 1 ) * sizeof(bsxItem *) );
+  partcount = 0;
+  size = 0;
+  for( itemindex = 0 ; itemindex < inv->itemcount ; itemindex++ )
+  {
+    item = &inv->itemlist[itemindex];
+    if( ( item->flags & BSX_ITEM_FLAGS_DELETED ) || !( item->id ) )
+      continue;
+    itemsort[partcount++] = item;
+    size += sizeof(bsSetInvPart) + intMin( strlen( item->id ), 255 ) + ( item->name ? intMin( strlen( item->name ), 65535 ) : 0 );
+  }
+  qsort( itemsort, partcount, sizeof(bsxItem *), bsSetInvItemCompare );
+
+  if( cache->datasize + size > cache->dataalloc )
+  {
+    cache->dataalloc = ( ( cache->datasize + size ) << 1 ) + 65536;
+    cache->data = realloc( cache->data, cache->dataalloc + 1 );
+  }
+  entryindex = bsSetInvSearch( cache, itemtypeid, itemid );
+  if( entryindex < 0 )
+  {
+    entryindex = -1 - entryindex;
+    if( cache->entrycount >= cache->entryalloc )
+    {
+      cache->entryalloc = ( cache->entryalloc ? cache->entryalloc << 1 : 256 );
+      cache->entrylist = realloc( cache->entrylist, cache->entryalloc * sizeof(bsSetInvEntry) );
+    }
+    memmove( &cache->entrylist[entryindex+1], &cache->entrylist[entryindex], ( cache->entrycount - entryindex ) * sizeof(bsSetInvEntry) );
+    cache->entrycount++;
+  }
+  entry = &cache->entrylist[entryindex];
+  memset( entry, 0, sizeof(bsSetInvEntry) );
+  entry->typeid = itemtypeid;
+  strcpy( entry->id, itemid );
+  entry->modtime = context->curtime;
+  entry->offset = cache->datasize;
+  entry->size = (int32_t)size;
+  entry->partcount = partcount;
+
+  for( itemindex = 0 ; itemindex < partcount ; itemindex++ )
+  {
+    item = itemsort[itemindex];
+    idlength = intMin( strlen( item->id ), 255 );
+    namelength = ( item->name ? intMin( strlen( item->name ), 65535 ) : 0 );
+    part = (bsSetInvPart *)&cache->data[ cache->datasize ];
+    part->colorid = item->colorid;
+    part->quantity = item->quantity;
+    part->alternateid = item->alternateid;
+    part->namelength = (uint16_t)namelength;
+    part->idlength = (uint8_t)idlength;
+    part->typeid = item->typeid;
+    cache->datasize += sizeof(bsSetInvPart);
+    memcpy( &cache->data[ cache->datasize ], item->id, idlength );
+    cache->datasize += idlength;
+    if( namelength )
+      memcpy( &cache->data[ cache->datasize ], item->name, namelength );
+    cache->datasize += namelength;
+  }
+  free( itemsort );
+  cache->dirtyflag = 1;
+  return 1;
+}
+
+
+/* Build an inventory from a cached part list */
+static bsxInventory *bsSetInvDecode( bsSetInvCache *cache, bsSetInvEntry *entry )
+{
+  int partindex;
+  bsSetInvPart part;
+  char *data, *dataend;
+  bsxItem *item;
+  bsxInventory *inv;
+
+  inv = bsxNewInventory();
+  data = &cache->data[ entry->offset ];
+  dataend = data + entry->size;
+  for( partindex = 0 ; partindex < entry->partcount ; partindex++ )
+  {
+    if( data + sizeof(bsSetInvPart) > dataend )
+      break;
+    memcpy( &part, data, sizeof(bsSetInvPart) );
+    data += sizeof(bsSetInvPart);
+    if( data + part.idlength + part.namelength > dataend )
+      break;
+    item = bsxNewItem( inv );
+    item->typeid = part.typeid;
+    bsxSetItemId( item, data, part.idlength );
+    data += part.idlength;
+    bsxSetItemName( item, data, part.namelength );
+    data += part.namelength;
+    bsxSetItemQuantity( inv, item, part.quantity );
+    item->colorid = part.colorid;
+    item->alternateid = part.alternateid;
+  }
+  if( partindex < entry->partcount )
+  {
+    bsxFreeInventory( inv );
+    return 0;
+  }
+  return inv;
+}
+
+
+/* Return the cached inventory if present and recent enough */
+static bsxInventory *bsSetInvLookup( bsContext *context, char itemtypeid, char *itemid )
+{
+  int entryindex;
+  bsSetInvCache *cache;
+
+  bsSetInvLoad( context );
+  cache = &context->setinvcache;
+  entryindex = bsSetInvSearch( cache, itemtypeid, itemid );
+  if( entryindex < 0 )
+    return 0;
+  if( cache->entrylist[entryindex].modtime < context->curtime - BS_SETINV_CACHETIME )
+    return 0;
+  return bsSetInvDecode( cache, &cache->entrylist[entryindex] );
+}
+
+
+////
+
+
+typedef struct
+{
+  bsxInventory *inv;
+  int doneflag;
+} bsSetInvQuery;
+
 static void bsBrickLinkReplySetInventory( void *uservalue, int resultcode, httpResponse *response )
 {
   bsxInventory *inv;
-  bsxInventory **retinv;
+  bsSetInvQuery *query;
 
-  retinv = uservalue;
-  *retinv = 0;
-  if( ( response ) && ( ( response->httpcode < 200 ) || ( response->httpcode > 299 ) ) )
+  query = uservalue;
+  query->inv = 0;
+  query->doneflag = 1;
+  if( !( response ) || ( response->httpcode < 200 ) || ( response->httpcode > 299 ) )
     return;
 
 #if 0
@@ -192,22 +524,57 @@ static void bsBrickLinkReplySetInventory( void *uservalue, int resultcode, httpR
     bsxFreeInventory( inv );
     return;
   }
-  *retinv = inv;
+  query->inv = inv;
+  return;
+}
+
+
+static void bsBrickLinkQuerySetInventory( bsContext *context, char itemtypeid, char *itemid, bsSetInvQuery *query )
+{
+  char *querystring;
+  querystring = ccStrAllocPrintf( "GET /catalogDownload.asp?a=a&viewType=4&itemTypeInv=%c&itemNo=%s&downloadType=T HTTP/1.1\r\nHost: www.bricklink.com\r\nConnection: Keep-Alive\r\n" HTTP_ACCEPT_ENCODING "\r\n", itemtypeid, itemid );
+  httpAddQuery( context->bricklink.webhttp, querystring, strlen( querystring ), HTTP_QUERY_FLAGS_RETRY, (void *)query, bsBrickLinkReplySetInventory );
+  free( querystring );
   return;
 }
 
+/* Cache a fetched inventory, return it as decoded from the cache so that items are always in the same order */
+static bsxInventory *bsBrickLinkStoreSetInventory( bsContext *context, char itemtypeid, char *itemid, bsxInventory *inv )
+{
+  int entryindex;
+  bsxInventory *cacheinv;
+
+  bsxConsolidateInventoryByMatch( inv );
+  if( inv->itemcount == 0 )
+  {
+    bsxFreeInventory( inv );
+    return 0;
+  }
+  if( !( bsSetInvStore( context, itemtypeid, itemid, inv ) ) )
+    return inv;
+  entryindex = bsSetInvSearch( &context->setinvcache, itemtypeid, itemid );
+  cacheinv = bsSetInvDecode( &context->setinvcache, &context->setinvcache.entrylist[entryindex] );
+  if( !( cacheinv ) )
+    return inv;
+  bsxFreeInventory( inv );
+  return cacheinv;
+}
+
 
 /* Fetch the inventory for a set ID */
 bsxInventory *bsBrickLinkFetchSetInventory( bsContext *context, char itemtypeid, char *itemid )
 {
-  char *querystring;
   bsxInventory *inv;
+  bsSetInvQuery query;
 
   DEBUG_SET_TRACKER();
 
-  inv = 0;
-  querystring = ccStrAllocPrintf( "GET /catalogDownload.asp?a=a&viewType=4&itemTypeInv=%c&itemNo=%s&downloadType=T HTTP/1.1\r\nHost: www.bricklink.com\r\nConnection: Keep-Alive\r\n\r\n", itemtypeid, itemid );
-  httpAddQuery( context->bricklink.webhttp, querystring, strlen( querystring ), HTTP_QUERY_FLAGS_RETRY, (void *)&inv, bsBrickLinkReplySetInventory );
+  inv = bsSetInvLookup( context, itemtypeid, itemid );
+  if( inv )
+    return inv;
+
+  memset( &query, 0, sizeof(bsSetInvQuery) );
+  bsBrickLinkQuerySetInventory( context, itemtypeid, itemid, &query );
   for( ; ; )
   {
     bsFlushTcpProcessHttp( context );
@@ -216,18 +583,81 @@ bsxInventory *bsBrickLinkFetchSetInventory( bsContext *context, char itemtypeid,
     else
       break;
   }
-  free( querystring );
+  inv = query.inv;
   if( inv )
   {
-    bsxConsolidateInventoryByMatch( inv );
-    if( inv->itemcount == 0 )
-    {
-      bsxFreeInventory( inv );
-      inv = 0;
-    }
+    inv = bsBrickLinkStoreSetInventory( context, itemtypeid, itemid, inv );
+    bsSetInvSave( context );
   }
 
   return inv;
 }
 
 
+/* Fetch and cache the inventories of many sets, keeping the HTTP pipeline full */
+int bsBrickLinkPrefetchSetInventories( bsContext *context, char itemtypeid, char **setidlist, int setidcount, int forceflag )
+{
+  int setindex, queuedindex, doneindex, cachedcount, failcount, entryindex;
+  bsxInventory *inv;
+  bsSetInvQuery *querylist;
+  bsSetInvCache *cache;
+
+  DEBUG_SET_TRACKER();
+
+  bsSetInvLoad( context );
+  cache = &context->setinvcache;
+  querylist = malloc( ( setidcount + 1 ) * sizeof(bsSetInvQuery) );
+  memset( querylist, 0, ( setidcount + 1 ) * sizeof(bsSetInvQuery) );
+  cachedcount = 0;
+  failcount = 0;
+  for( queuedindex = 0, doneindex = 0 ; ; )
+  {
+    /* Skip sets already cached, queue the others up to the pipeline depth */
+    for( ; queuedindex < setidcount ; queuedindex++ )
+    {
+      if( httpGetQueryQueueCount( context->bricklink.webhttp ) >= bsPipelineDepth( &context->bricklink.webpipeline ) )
+        break;
+      if( !( forceflag ) )
+      {
+        entryindex = bsSetInvSearch( cache, itemtypeid, setidlist[queuedindex] );
+        if( ( entryindex >= 0 ) && ( cache->entrylist[entryindex].modtime >= context->curtime - BS_SETINV_CACHETIME ) )
+        {
+          querylist[queuedindex].doneflag = 2;
+          continue;
+        }
+      }
+      bsBrickLinkQuerySetInventory( context, itemtypeid, setidlist[queuedindex], &querylist[queuedindex] );
+    }
+    bsFlushTcpProcessHttp( context );
+
+    /* Store replies as they complete */
+    for( setindex = doneindex ; setindex < queuedindex ; setindex++ )
+    {
+      if( querylist[setindex].doneflag != 1 )
+        continue;
+      querylist[setindex].doneflag = 2;
+      inv = querylist[setindex].inv;
+      if( ( inv ) && ( inv = bsBrickLinkStoreSetInventory( context, itemtypeid, setidlist[setindex], inv ) ) )
+      {
+        bsxFreeInventory( inv );
+        cachedcount++;
+      }
+      else
+      {
+        ioPrintf( &context->output, 0, BSMSG_WARNING "We failed to fetch inventory for \"" IO_RED "%s" IO_WHITE "\".\n", setidlist[setindex] );
+        failcount++;
+      }
+    }
+    for( ; ( doneindex < queuedindex ) && ( querylist[doneindex].doneflag == 2 ) ; doneindex++ );
+
+    if( ( queuedindex >= setidcount ) && !( httpGetQueryQueueCount( context->bricklink.webhttp ) ) )
+      break;
+    if( httpGetQueryQueueCount( context->bricklink.webhttp ) > 0 )
+      tcpWait( &context->tcp, 0 );
+  }
+  free( querylist );
+  bsSetInvSave( context );
+  if( failcount )
+    ioPrintf( &context->output, 0, BSMSG_WARNING "Failed to fetch " IO_RED "%d" IO_WHITE " set inventories.\n", failcount );
+  return cachedcount;
+}
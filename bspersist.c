@@ -0,0 +1,368 @@
+/* -----------------------------------------------------------------------------
+ *
+ * Copyright (c) 2014-2019 Alexis Naveros.
+ *
+ * This software is provided 'as-is', without any express or implied
+ * warranty. In no event will the authors be held liable for any damages
+ * arising from the use of this software.
+ *
+ * Permission is granted to anyone to use this software for any purpose,
+ * including commercial applications, and to alter it and redistribute it
+ * freely, subject to the following restrictions:
+ *
+ * 1. The origin of this software must not be misrepresented; you must not
+ * claim that you wrote the original software. If you use this software
+ * in a product, an acknowledgment in the product documentation would be
+ * appreciated but is not required.
+ * 2. Altered source versions must be plainly marked as such, and must not be
+ * misrepresented as being the original software.
+ * 3. This notice may not be removed or altered from any source distribution.
+ *
+ * -----------------------------------------------------------------------------
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdarg.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+
+#include "cpuconfig.h"
+#include "cc.h"
+#include "ccstr.h"
+#include "mm.h"
+#include "mmatomic.h"
+#include "mmbitmap.h"
+#include "iolog.h"
+#include "debugtrack.h"
+#include "rand.h"
+
+#if CC_UNIX
+ #include <sys/types.h>
+ #include <sys/stat.h>
+ #include <unistd.h>
+#elif CC_WINDOWS
+ #include <windows.h>
+ #include <direct.h>
+#else
+ #error Unknown/Unsupported platform!
+#endif
+
+#include "tcp.h"
+#include "tcphttp.h"
+#include "oauth.h"
+#include "exclperm.h"
+#include "journal.h"
+
+#include "bsx.h"
+#include "bsxpg.h"
+#include "json.h"
+#include "bsorder.h"
+#include "bricklink.h"
+#include "brickowl.h"
+#include "colortable.h"
+#include "bstranslation.h"
+
+#include "bricksync.h"
+
+
+////
+
+
+/*
+The persistence thread writes state, tracked inventory and backups in the background.
+The main thread hands it private copies, the tracked inventory is shared through bsxShareInventory()
+and must not be freed or replaced while tasks are pending, bsPersistFlush() first.
+Tasks are executed in queue order, each with its own journal, so files are updated in the same
+order as the synchronous code did. The thread never prints, ioPrintf() isn't thread-safe;
+failures are recorded and reported by the main thread on the next poll or flush.
+*/
+
+enum
+{
+  BS_PERSIST_TASK_FILE,
+  BS_PERSIST_TASK_INVENTORY,
+  BS_PERSIST_TASK_BACKUP
+};
+
+typedef struct bsPersistTask
+{
+  int type;
+  char *oldpath;
+  char *newpath;
+  void *data;
+  size_t datasize;
+  bsxInventory *inv;
+  int backupindex;
+  struct bsPersistTask *next;
+} bsPersistTask;
+
+
+static void bsPersistTaskFree( bsPersistTask *task )
+{
+  if( task->type != BS_PERSIST_TASK_FILE )
+  {
+    free( task->oldpath );
+    free( task->newpath );
+  }
+  free( task->data );
+  bsxFreeInventory( task->inv );
+  free( task );
+  return;
+}
+
+
+/* Runs on the persistence thread, returns an error message to be free()'d on failure */
+static char *bsPersistTaskExecute( bsContext *context, bsPersistTask *task )
+{
+  char *failpath;
+  journalEntry journalentry;
+
+  switch( task->type )
+  {
+    case BS_PERSIST_TASK_FILE:
+      if( !( ccFileStore( task->oldpath, task->data, task->datasize, 1 ) ) )
+        return ccStrAllocPrintf( "Failed to write file as \"%s" CC_DIR_SEPARATOR_STRING "%s\".", context->cwd, task->oldpath );
+      break;
+    case BS_PERSIST_TASK_INVENTORY:
+      failpath = 0;
+      if( !( bsWriteInventory( context, task->inv, 0, 0, &failpath ) ) )
+      {
+        if( failpath )
+          return ccStrAllocPrintf( "Failed to write inventory file as \"%s" CC_DIR_SEPARATOR_STRING "%s\".", context->cwd, failpath );
+        return ccStrAllocPrintf( "Failed to execute journal for inventory update." );
+      }
+      return 0;
+    case BS_PERSIST_TASK_BACKUP:
+      if( context->backupdeltaflag )
+      {
+        if( !( bsWriteBackupDelta( context, task->inv, task->backupindex, task->oldpath, task->newpath, 0, 0 ) ) )
+          return ccStrAllocPrintf( "Failed to write inventory backup to \"%s\".", task->oldpath );
+        return 0;
+      }
+      if( !( bsxSaveInventory( task->oldpath, task->inv, 1, 0 ) ) )
+        return ccStrAllocPrintf( "Failed to write inventory backup to \"%s\".", task->oldpath );
+      break;
+    default:
+      return 0;
+  }
+
+  journalentry.oldpath = task->oldpath;
+  journalentry.newpath = task->newpath;
+  if( !( journalExecute( BS_JOURNAL_FILE, BS_JOURNAL_TEMP_FILE, 0, &journalentry, 1 ) ) )
+    return ccStrAllocPrintf( "Failed to execute journal for \"%s\".", task->newpath );
+  return 0;
+}
+
+
+static void *bsPersistThreadMain( void *value )
+{
+  char *failmessage;
+  bsContext *context;
+  bsPersist *persist;
+  bsPersistTask *task;
+
+  context = value;
+  persist = &context->persist;
+  mtMutexLock( &persist->mutex );
+  for( ; ; )
+  {
+    task = persist->taskfirst;
+    if( !( task ) )
+    {
+      if( persist->quitflag )
+        break;
+      mtSignalWait( &persist->tasksignal, &persist->mutex );
+      continue;
+    }
+    persist->taskfirst = task->next;
+    if( !( persist->taskfirst ) )
+      persist->tasklast = 0;
+    mtMutexUnlock( &persist->mutex );
+
+    /* After a failure, drop remaining tasks rather than writing files out of order */
+    failmessage = 0;
+    if( !( persist->failedflag ) )
+      failmessage = bsPersistTaskExecute( context, task );
+    bsPersistTaskFree( task );
+
+    mtMutexLock( &persist->mutex );
+    if( failmessage )
+    {
+      if( !( persist->failedflag ) )
+        persist->failmessage = failmessage;
+      else
+        free( failmessage );
+      persist->failedflag = 1;
+    }
+    persist->taskcount--;
+    if( !( persist->taskcount ) )
+      mtSignalBroadcast( &persist->idlesignal );
+  }
+  mtMutexUnlock( &persist->mutex );
+
+  return 0;
+}
+
+
+static void bsPersistQueue( bsContext *context, bsPersistTask *task )
+{
+  bsPersist *persist;
+
+  persist = &context->persist;
+  task->next = 0;
+  mtMutexLock( &persist->mutex );
+  if( persist->tasklast )
+    ((bsPersistTask *)persist->tasklast)->next = task;
+  else
+    persist->taskfirst = task;
+  persist->tasklast = task;
+  persist->taskcount++;
+  mtSignalWake( &persist->tasksignal );
+  mtMutexUnlock( &persist->mutex );
+  return;
+}
+
+
+////
+
+
+void bsPersistInit( bsContext *context )
+{
+  bsPersist *persist;
+
+  persist = &context->persist;
+  memset( persist, 0, sizeof(bsPersist) );
+  mtMutexInit( &persist->mutex );
+  mtSignalInit( &persist->tasksignal );
+  mtSignalInit( &persist->idlesignal );
+  mtThreadCreate( &persist->thread, bsPersistThreadMain, context, MT_THREAD_FLAGS_JOINABLE, 0, 0 );
+  persist->activeflag = 1;
+  return;
+}
+
+
+void bsPersistEnd( bsContext *context )
+{
+  bsPersist *persist;
+
+  persist = &context->persist;
+  if( !( persist->activeflag ) )
+    return;
+  mtMutexLock( &persist->mutex );
+  persist->quitflag = 1;
+  mtSignalWake( &persist->tasksignal );
+  mtMutexUnlock( &persist->mutex );
+  /* The thread drains the queue before exiting */
+  mtThreadJoin( &persist->thread );
+  persist->activeflag = 0;
+  mtSignalDestroy( &persist->tasksignal );
+  mtSignalDestroy( &persist->idlesignal );
+  mtMutexDestroy( &persist->mutex );
+  free( persist->failmessage );
+  persist->failmessage = 0;
+  return;
+}
+
+
+/* Called on the main thread, print the failure message once */
+static int bsPersistReport( bsContext *context )
+{
+  char *failmessage;
+  bsPersist *persist;
+
+  persist = &context->persist;
+  failmessage = persist->failmessage;
+  persist->failmessage = 0;
+  if( failmessage )
+  {
+    ioPrintf( &context->output, IO_MODEBIT_FLUSH, BSMSG_ERROR IO_RED "%s" IO_DEFAULT "\n", failmessage );
+    free( failmessage );
+  }
+  return !( persist->failedflag );
+}
+
+
+int bsPersistFlush( bsContext *context )
+{
+  int retval;
+  bsPersist *persist;
+
+  persist = &context->persist;
+  if( !( persist->activeflag ) )
+    return 1;
+  mtMutexLock( &persist->mutex );
+  while( persist->taskcount )
+    mtSignalWait( &persist->idlesignal, &persist->mutex );
+  retval = bsPersistReport( context );
+  mtMutexUnlock( &persist->mutex );
+  return retval;
+}
+
+
+int bsPersistPoll( bsContext *context )
+{
+  int retval;
+  bsPersist *persist;
+
+  persist = &context->persist;
+  if( !( persist->activeflag ) )
+    return 1;
+  mtMutexLock( &persist->mutex );
+  retval = bsPersistReport( context );
+  mtMutexUnlock( &persist->mutex );
+  return retval;
+}
+
+
+////
+
+
+void bsPersistFile( bsContext *context, char *temppath, char *path, void *data, size_t datasize )
+{
+  bsPersistTask *task;
+
+  task = malloc( sizeof(bsPersistTask) );
+  memset( task, 0, sizeof(bsPersistTask) );
+  task->type = BS_PERSIST_TASK_FILE;
+  task->oldpath = temppath;
+  task->newpath = path;
+  task->data = malloc( datasize );
+  memcpy( task->data, data, datasize );
+  task->datasize = datasize;
+  bsPersistQueue( context, task );
+  return;
+}
+
+
+void bsPersistInventory( bsContext *context )
+{
+  bsPersistTask *task;
+
+  task = malloc( sizeof(bsPersistTask) );
+  memset( task, 0, sizeof(bsPersistTask) );
+  task->type = BS_PERSIST_TASK_INVENTORY;
+  task->inv = bsxShareInventory( context->inventory );
+  bsPersistQueue( context, task );
+  return;
+}
+
+
+void bsPersistBackup( bsContext *context, int backupindex, char *backupoldpath, char *backupnewpath )
+{
+  bsPersistTask *task;
+
+  task = malloc( sizeof(bsPersistTask) );
+  memset( task, 0, sizeof(bsPersistTask) );
+  task->type = BS_PERSIST_TASK_BACKUP;
+  task->backupindex = backupindex;
+  task->oldpath = backupoldpath;
+  task->newpath = backupnewpath;
+  task->inv = bsxShareInventory( context->inventory );
+  bsPersistQueue( context, task );
+  return;
+}
+
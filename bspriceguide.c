@@ -72,54 +72,447 @@
 ////
 
 
-/* Fetch price guide for all items slightly outdated */
-int bsProcessInventoryPriceGuide( bsContext *context, bsxInventory *inv, int cachetime, void *callbackpointer, void (*callback)( bsContext *context, bsxInventory *inv, bsxItem *item, bsxPriceGuide *pg, void *callbackpointer ) )
+static inline int intMin( int x, int y )
 {
-  int retval, itemindex, fetchcount;
-  int64_t updatetime;
+  return ( x < y ? x : y );
+}
+
+
+////
+
+
+/* The directory tree backends keep recently used records in memory, the database is already mapped */
+void bsPriceGuideCacheInit( bsContext *context )
+{
+  int hashbits;
+  bsPriceGuideCache *cache;
+
+  cache = &context->pgcache;
+  memset( cache, 0, sizeof(bsPriceGuideCache) );
+  if( context->priceguidedb )
+    return;
+  for( hashbits = 4 ; ( 1 << hashbits ) < BS_PRICEGUIDE_CACHE_SIZE ; hashbits++ );
+  cache->hashmask = ( 1 << hashbits ) - 1;
+  cache->hashtable = malloc( ( cache->hashmask + 1 ) * sizeof(int) );
+  memset( cache->hashtable, -1, ( cache->hashmask + 1 ) * sizeof(int) );
+  cache->entrylist = malloc( BS_PRICEGUIDE_CACHE_SIZE * sizeof(bsPriceGuideCacheEntry) );
+  cache->lrufirst = -1;
+  cache->lrulast = -1;
+  mtMutexInit( &cache->mutex );
+  cache->activeflag = 1;
+  return;
+}
+
+void bsPriceGuideCacheFree( bsContext *context )
+{
+  int entryindex;
+  bsPriceGuideCache *cache;
+
+  cache = &context->pgcache;
+  if( !( cache->activeflag ) )
+    return;
+  for( entryindex = 0 ; entryindex < cache->entrycount ; entryindex++ )
+    free( cache->entrylist[entryindex].id );
+  free( cache->entrylist );
+  free( cache->hashtable );
+  mtMutexDestroy( &cache->mutex );
+  cache->activeflag = 0;
+  return;
+}
+
+static uint32_t bsPriceGuideCacheHash( char itemtypeid, char *itemid, int itemcolorid, char itemcondition )
+{
+  return ccHash32Data( itemid, strlen( itemid ) ) ^ ccHash32Int32( ( (uint32_t)itemcolorid << 16 ) | ( (uint32_t)(uint8_t)itemtypeid << 8 ) | (uint8_t)itemcondition );
+}
+
+static void bsPriceGuideCacheUnlink( bsPriceGuideCache *cache, int entryindex )
+{
+  bsPriceGuideCacheEntry *entry;
+  entry = &cache->entrylist[entryindex];
+  if( entry->lruprev >= 0 )
+    cache->entrylist[ entry->lruprev ].lrunext = entry->lrunext;
+  else
+    cache->lrufirst = entry->lrunext;
+  if( entry->lrunext >= 0 )
+    cache->entrylist[ entry->lrunext ].lruprev = entry->lruprev;
+  else
+    cache->lrulast = entry->lruprev;
+  return;
+}
+
+static void bsPriceGuideCacheLinkFirst( bsPriceGuideCache *cache, int entryindex )
+{
+  bsPriceGuideCacheEntry *entry;
+  entry = &cache->entrylist[entryindex];
+  entry->lruprev = -1;
+  entry->lrunext = cache->lrufirst;
+  if( cache->lrufirst >= 0 )
+    cache->entrylist[ cache->lrufirst ].lruprev = entryindex;
+  else
+    cache->lrulast = entryindex;
+  cache->lrufirst = entryindex;
+  return;
+}
+
+/* Must be called with the mutex locked, return entry index or -1 */
+static int bsPriceGuideCacheFind( bsPriceGuideCache *cache, uint32_t hashkey, char itemtypeid, char *itemid, int itemcolorid, char itemcondition )
+{
+  int entryindex;
+  bsPriceGuideCacheEntry *entry;
+
+  for( entryindex = cache->hashtable[ hashkey & cache->hashmask ] ; entryindex >= 0 ; entryindex = entry->hashnext )
+  {
+    entry = &cache->entrylist[entryindex];
+    if( ( entry->hashkey == hashkey ) && ( entry->typeid == itemtypeid ) && ( entry->colorid == itemcolorid ) && ( entry->condition == itemcondition ) && ( strcmp( entry->id, itemid ) == 0 ) )
+      return entryindex;
+  }
+  return -1;
+}
+
+/* With readflag, an existing entry is only replaced by a newer file, a worker may have read the file before it was rewritten */
+static void bsPriceGuideCacheStore( bsPriceGuideCache *cache, bsxPriceGuide *pg, char itemtypeid, char *itemid, int itemcolorid, char itemcondition, int readflag )
+{
+  int entryindex, *link;
+  uint32_t hashkey;
+  bsPriceGuideCacheEntry *entry;
+
+  hashkey = bsPriceGuideCacheHash( itemtypeid, itemid, itemcolorid, itemcondition );
+  mtMutexLock( &cache->mutex );
+  entryindex = bsPriceGuideCacheFind( cache, hashkey, itemtypeid, itemid, itemcolorid, itemcondition );
+  if( entryindex >= 0 )
+  {
+    if( ( readflag ) && ( cache->entrylist[entryindex].pg.modtime >= pg->modtime ) )
+    {
+      mtMutexUnlock( &cache->mutex );
+      return;
+    }
+    bsPriceGuideCacheUnlink( cache, entryindex );
+  }
+  else
+  {
+    if( cache->entrycount < BS_PRICEGUIDE_CACHE_SIZE )
+      entryindex = cache->entrycount++;
+    else
+    {
+      /* Evict the least recently used entry */
+      entryindex = cache->lrulast;
+      entry = &cache->entrylist[entryindex];
+      for( link = &cache->hashtable[ entry->hashkey & cache->hashmask ] ; *link != entryindex ; link = &cache->entrylist[ *link ].hashnext );
+      *link = entry->hashnext;
+      bsPriceGuideCacheUnlink( cache, entryindex );
+      free( entry->id );
+    }
+    entry = &cache->entrylist[entryindex];
+    entry->hashkey = hashkey;
+    entry->typeid = itemtypeid;
+    entry->condition = itemcondition;
+    entry->colorid = itemcolorid;
+    entry->id = ccStrDup( itemid );
+    entry->hashnext = cache->hashtable[ hashkey & cache->hashmask ];
+    cache->hashtable[ hashkey & cache->hashmask ] = entryindex;
+  }
+  cache->entrylist[entryindex].pg = *pg;
+  bsPriceGuideCacheLinkFirst( cache, entryindex );
+  mtMutexUnlock( &cache->mutex );
+  return;
+}
+
+static int bsPriceGuideCacheLookup( bsPriceGuideCache *cache, bsxPriceGuide *pg, char itemtypeid, char *itemid, int itemcolorid, char itemcondition )
+{
+  int entryindex;
+
+  mtMutexLock( &cache->mutex );
+  entryindex = bsPriceGuideCacheFind( cache, bsPriceGuideCacheHash( itemtypeid, itemid, itemcolorid, itemcondition ), itemtypeid, itemid, itemcolorid, itemcondition );
+  if( entryindex >= 0 )
+  {
+    *pg = cache->entrylist[entryindex].pg;
+    bsPriceGuideCacheUnlink( cache, entryindex );
+    bsPriceGuideCacheLinkFirst( cache, entryindex );
+    cache->hitcount++;
+  }
+  else
+    cache->misscount++;
+  mtMutexUnlock( &cache->mutex );
+  return ( entryindex >= 0 );
+}
+
+
+/* Read cached price guide from the database or the directory tree */
+int bsPriceGuideRead( bsContext *context, bsxPriceGuide *pg, char itemtypeid, char *itemid, int itemcolorid, char itemcondition )
+{
+  int retval;
   char *pgpath;
-  bsxItem *item;
+
+  if( context->priceguidedb )
+    return bsxReadPriceGuideDb( context->priceguidedb, pg, itemtypeid, itemid, itemcolorid, itemcondition );
+  if( ( context->pgcache.activeflag ) && ( itemid ) && ( bsPriceGuideCacheLookup( &context->pgcache, pg, itemtypeid, itemid, itemcolorid, itemcondition ) ) )
+    return 1;
+  pgpath = bsxPriceGuidePath( context->priceguidepath, itemtypeid, itemid, itemcolorid, context->priceguideflags );
+  retval = bsxReadPriceGuide( pg, pgpath, itemcondition );
+  free( pgpath );
+  if( ( retval ) && ( context->pgcache.activeflag ) && ( itemid ) )
+    bsPriceGuideCacheStore( &context->pgcache, pg, itemtypeid, itemid, itemcolorid, itemcondition, 1 );
+  return retval;
+}
+
+
+/* Store fetched price guide in the database or the directory tree */
+int bsPriceGuideWrite( bsContext *context, bsxPriceGuide *pgnew, bsxPriceGuide *pgused, char itemtypeid, char *itemid, int itemcolorid )
+{
+  int64_t modtime;
+  bsxPriceGuide pgcache;
+  char *pgpath;
+
+  /* Record the snapshot in the history, the cache only keeps the latest */
+  if( ( context->priceguidehistory ) && !( bsxAppendPriceGuideHistory( context->priceguidehistory, pgnew, pgused, itemtypeid, itemid, itemcolorid ) ) )
+    ioPrintf( &context->output, 0, BSMSG_WARNING "We failed to record price guide history for \"" IO_MAGENTA "%s" IO_WHITE "\", color %d.\n", ( itemid ? itemid : "???" ), itemcolorid );
+  if( context->priceguidedb )
+  {
+    if( bsxWritePriceGuideDb( context->priceguidedb, pgnew, pgused, itemtypeid, itemid, itemcolorid ) )
+      return 1;
+    ioPrintf( &context->output, 0, BSMSG_ERROR "We failed to write price guide database entry for \"" IO_MAGENTA "%s" IO_WHITE "\", color %d.\n", itemid, itemcolorid );
+    return 0;
+  }
+  pgpath = bsxPriceGuidePath( context->priceguidepath, itemtypeid, itemid, itemcolorid, context->priceguideflags | BSX_PRICEGUIDE_FLAGS_MKDIR );
+  /* Taken before writing, the new file is at least that recent and the previous one no more recent */
+  modtime = (int64_t)time( 0 );
+  if( !( bsxWritePriceGuide( pgnew, pgused, pgpath, itemtypeid, itemid, itemcolorid ) ) )
+  {
+    ioPrintf( &context->output, 0, BSMSG_ERROR "We failed to write price guide cache at \"" IO_MAGENTA "%s" IO_WHITE "\".\n", pgpath );
+    free( pgpath );
+    return 0;
+  }
+  free( pgpath );
+  if( ( context->pgcache.activeflag ) && ( itemid ) )
+  {
+    pgcache = *pgnew;
+    pgcache.modtime = modtime;
+    bsPriceGuideCacheStore( &context->pgcache, &pgcache, itemtypeid, itemid, itemcolorid, 'N', 0 );
+    pgcache = *pgused;
+    pgcache.modtime = modtime;
+    bsPriceGuideCacheStore( &context->pgcache, &pgcache, itemtypeid, itemid, itemcolorid, 'U', 0 );
+  }
+  return 1;
+}
+
+
+/* Average the quantity-averaged sale price of history snapshots since starttime, return the count of snapshots averaged */
+int bsPriceGuideHistoryAverage( bsContext *context, char itemtypeid, char *itemid, int itemcolorid, char itemcondition, int64_t starttime, float *retaverage )
+{
+  int samplecount, sampleindex, averagecount;
+  double sum;
+  bsxPriceGuide *pg;
+  bsxPriceGuideSample *samplelist;
+
+  if( !( context->priceguidehistory ) )
+    return 0;
+  samplecount = bsxReadPriceGuideHistory( context->priceguidehistory, itemtypeid, itemid, itemcolorid, starttime, INT64_MAX, &samplelist );
+  if( samplecount <= 0 )
+    return 0;
+  sum = 0.0;
+  averagecount = 0;
+  for( sampleindex = 0 ; sampleindex < samplecount ; sampleindex++ )
+  {
+    pg = &samplelist[sampleindex].pg[ itemcondition == 'N' ? 0 : 1 ];
+    if( !( pg->saleqty ) || ( pg->saleqtyaverage < 0.001 ) )
+      continue;
+    sum += pg->saleqtyaverage;
+    averagecount++;
+  }
+  free( samplelist );
+  if( averagecount )
+    *retaverage = (float)( sum / (double)averagecount );
+  return averagecount;
+}
+
+
+/* Cache files are read by worker threads in blocks, results are classified in order on the main thread */
+#define BS_PRICEGUIDE_LOOKUP_THREADS (8)
+#define BS_PRICEGUIDE_LOOKUP_BLOCK (256)
+
+#define BS_PRICEGUIDE_LOOKUP_MISS (0)
+#define BS_PRICEGUIDE_LOOKUP_FOUND (1)
+
+typedef struct
+{
   bsxPriceGuide pg;
+  int status;
+} bsPriceGuideLookupEntry;
 
-  DEBUG_SET_TRACKER();
+typedef struct
+{
+  bsContext *context;
+  bsxInventory *inv;
+  bsPriceGuideLookupEntry *entrylist;
+  int blockcount;
+  int64_t updatetime;
+  void *callbackpointer;
+  void (*callback)( bsContext *context, bsxInventory *inv, bsxItem *item, bsxPriceGuide *pg, void *callbackpointer );
 
-  updatetime = context->curtime - cachetime;
+  /* Shared with workers, guarded by mutex */
+  mtMutex mutex;
+  mtSignal signal;
+  int blocknext;
+  char *blockdone;
+  int quitflag;
 
-  ioPrintf( &context->output, 0, BSMSG_INFO "Looking up price guide cache for " IO_GREEN "%d" IO_DEFAULT " items.\n", inv->itemcount );
-  fetchcount = 0;
-  for( itemindex = 0 ; itemindex < inv->itemcount ; itemindex++ )
+  /* Main thread progress */
+  int scanblock;
+  int fetchcount;
+
+  int threadcount;
+  mtThread threadlist[BS_PRICEGUIDE_LOOKUP_THREADS];
+} bsPriceGuideLookup;
+
+
+static void bsPriceGuideLookupBlock( bsPriceGuideLookup *lookup, int blockindex )
+{
+  int itemindex, itemend;
+  bsxItem *item;
+  bsPriceGuideLookupEntry *entry;
+
+  itemindex = blockindex * BS_PRICEGUIDE_LOOKUP_BLOCK;
+  itemend = intMin( itemindex + BS_PRICEGUIDE_LOOKUP_BLOCK, lookup->inv->itemcount );
+  for( ; itemindex < itemend ; itemindex++ )
   {
-    item = &inv->itemlist[itemindex];
+    item = &lookup->inv->itemlist[itemindex];
+    entry = &lookup->entrylist[itemindex];
+    entry->status = BS_PRICEGUIDE_LOOKUP_MISS;
     if( item->flags & BSX_ITEM_FLAGS_DELETED )
       continue;
-    pgpath = bsxPriceGuidePath( context->priceguidepath, item->typeid, item->id, item->colorid, context->priceguideflags );
-    if( bsxReadPriceGuide( &pg, pgpath, item->condition ) )
+    if( bsPriceGuideRead( lookup->context, &entry->pg, item->typeid, item->id, item->colorid, item->condition ) )
+      entry->status = BS_PRICEGUIDE_LOOKUP_FOUND;
+  }
+  return;
+}
+
+
+static void *bsPriceGuideLookupThreadMain( void *value )
+{
+  int blockindex;
+  bsPriceGuideLookup *lookup;
+
+  lookup = value;
+  for( ; ; )
+  {
+    mtMutexLock( &lookup->mutex );
+    if( ( lookup->quitflag ) || ( lookup->blocknext >= lookup->blockcount ) )
     {
-      if( pg.modtime >= updatetime )
+      mtMutexUnlock( &lookup->mutex );
+      break;
+    }
+    blockindex = lookup->blocknext++;
+    mtMutexUnlock( &lookup->mutex );
+    bsPriceGuideLookupBlock( lookup, blockindex );
+    mtMutexLock( &lookup->mutex );
+    lookup->blockdone[blockindex] = 1;
+    mtSignalBroadcast( &lookup->signal );
+    mtMutexUnlock( &lookup->mutex );
+  }
+  return 0;
+}
+
+
+/* Classify looked up blocks in order, return the count of items examined */
+static int bsPriceGuideLookupScan( bsContext *context, void *scanpointer, int waitflag )
+{
+  int itemindex, itemend;
+  bsxItem *item;
+  bsPriceGuideLookupEntry *entry;
+  bsPriceGuideLookup *lookup;
+
+  lookup = scanpointer;
+  for( ; lookup->scanblock < lookup->blockcount ; lookup->scanblock++ )
+  {
+    if( lookup->threadcount )
+    {
+      mtMutexLock( &lookup->mutex );
+      while( !( lookup->blockdone[ lookup->scanblock ] ) && ( waitflag ) )
+        mtSignalWait( &lookup->signal, &lookup->mutex );
+      if( !( lookup->blockdone[ lookup->scanblock ] ) )
       {
-        if( callback )
-          callback( context, inv, item, &pg, callbackpointer );
+        mtMutexUnlock( &lookup->mutex );
+        break;
       }
-      else
-        item->flags |= BSX_ITEM_XFLAGS_FETCH_PRICE_GUIDE;
+      mtMutexUnlock( &lookup->mutex );
     }
     else
-      item->flags |= BSX_ITEM_XFLAGS_FETCH_PRICE_GUIDE;
-    free( pgpath );
-    if( item->flags & BSX_ITEM_XFLAGS_FETCH_PRICE_GUIDE )
+      bsPriceGuideLookupBlock( lookup, lookup->scanblock );
+
+    itemindex = lookup->scanblock * BS_PRICEGUIDE_LOOKUP_BLOCK;
+    itemend = intMin( itemindex + BS_PRICEGUIDE_LOOKUP_BLOCK, lookup->inv->itemcount );
+    for( ; itemindex < itemend ; itemindex++ )
     {
+      item = &lookup->inv->itemlist[itemindex];
+      if( item->flags & BSX_ITEM_FLAGS_DELETED )
+        continue;
+      entry = &lookup->entrylist[itemindex];
+      if( ( entry->status == BS_PRICEGUIDE_LOOKUP_FOUND ) && ( entry->pg.modtime >= lookup->updatetime ) )
+      {
+        if( lookup->callback )
+          lookup->callback( context, lookup->inv, item, &entry->pg, lookup->callbackpointer );
+        continue;
+      }
+      item->flags |= BSX_ITEM_XFLAGS_FETCH_PRICE_GUIDE;
       ioPrintf( &context->output, IO_MODEBIT_LOGONLY | IO_MODEBIT_NODATE, "LOG: Item flagged for price guide update: \"%s\", color %d, condition %s.\n", ( item->id ? item->id : item->name ), item->colorid, ( item->condition ? "New" : "Used" ) );
-      fetchcount++;
+      if( !( lookup->fetchcount ) )
+        ioPrintf( &context->output, 0, BSMSG_INFO "Fetching price guide data while the lookup proceeds.\n" );
+      lookup->fetchcount++;
     }
+    /* Give the caller a chance to queue fetches */
+    waitflag = 0;
   }
 
-  retval = 1;
-  if( fetchcount )
+  return ( lookup->scanblock < lookup->blockcount ? lookup->scanblock * BS_PRICEGUIDE_LOOKUP_BLOCK : lookup->inv->itemcount );
+}
+
+
+/* Fetch price guide for all items slightly outdated, fetching starts as soon as the cache lookup finds the first outdated items */
+int bsProcessInventoryPriceGuide( bsContext *context, bsxInventory *inv, int cachetime, void *callbackpointer, void (*callback)( bsContext *context, bsxInventory *inv, bsxItem *item, bsxPriceGuide *pg, void *callbackpointer ) )
+{
+  int retval, threadindex;
+  bsPriceGuideLookup lookup;
+
+  DEBUG_SET_TRACKER();
+
+  ioPrintf( &context->output, 0, BSMSG_INFO "Looking up price guide cache for " IO_GREEN "%d" IO_DEFAULT " items.\n", inv->itemcount );
+
+  memset( &lookup, 0, sizeof(bsPriceGuideLookup) );
+  lookup.context = context;
+  lookup.inv = inv;
+  lookup.updatetime = context->curtime - cachetime;
+  lookup.callbackpointer = callbackpointer;
+  lookup.callback = callback;
+  lookup.blockcount = ( inv->itemcount + BS_PRICEGUIDE_LOOKUP_BLOCK - 1 ) / BS_PRICEGUIDE_LOOKUP_BLOCK;
+  lookup.entrylist = malloc( ( inv->itemcount + 1 ) * sizeof(bsPriceGuideLookupEntry) );
+  lookup.blockdone = malloc( lookup.blockcount + 1 );
+  memset( lookup.blockdone, 0, lookup.blockcount + 1 );
+  mtMutexInit( &lookup.mutex );
+  mtSignalInit( &lookup.signal );
+
+  /* Database lookups are cheap and the mapping can move as fetched entries are stored, keep these on the main thread */
+  if( !( context->priceguidedb ) && ( lookup.blockcount > 1 ) )
   {
-    ioPrintf( &context->output, 0, BSMSG_INFO "Fetching price guide data for " IO_GREEN "%d" IO_DEFAULT " items.\n", fetchcount );
-    retval = bsBrickLinkFetchPriceGuide( context, inv, callbackpointer, callback );
+    lookup.threadcount = intMin( lookup.blockcount, BS_PRICEGUIDE_LOOKUP_THREADS );
+    for( threadindex = 0 ; threadindex < lookup.threadcount ; threadindex++ )
+      mtThreadCreate( &lookup.threadlist[threadindex], bsPriceGuideLookupThreadMain, (void *)&lookup, MT_THREAD_FLAGS_JOINABLE, 0, 0 );
   }
 
+  retval = bsBrickLinkFetchPriceGuideScan( context, inv, callbackpointer, callback, (void *)&lookup, bsPriceGuideLookupScan );
+  if( lookup.fetchcount )
+    ioPrintf( &context->output, 0, BSMSG_INFO "Fetched price guide data for " IO_GREEN "%d" IO_DEFAULT " items.\n", lookup.fetchcount );
+
+  /* Fetching may give up before the whole inventory was examined */
+  mtMutexLock( &lookup.mutex );
+  lookup.quitflag = 1;
+  mtMutexUnlock( &lookup.mutex );
+  for( threadindex = 0 ; threadindex < lookup.threadcount ; threadindex++ )
+    mtThreadJoin( &lookup.threadlist[threadindex] );
+  mtSignalDestroy( &lookup.signal );
+  mtMutexDestroy( &lookup.mutex );
+  free( lookup.blockdone );
+  free( lookup.entrylist );
+
   return retval;
 }
 
@@ -143,20 +536,182 @@ void bsPriceGuideInitState( bsPriceGuideState *pgstate, bsxInventory *inv, int s
   for( altindex = 0 ; altindex < pgstate->altcount ; altindex++ )
   {
     alt = &pgstate->altlist[ altindex ];
-    alt->itemindex = -1;
+    alt->batchindex = -1;
   }
   return;
 }
 
-void bsPriceGuideFinishState( bsPriceGuideState *pgstate )
+
+static void bsPriceGuideBatchGrow( bsPriceGuideBatch *batch )
+{
+  batch->alloc = ( batch->alloc ? batch->alloc << 1 : 1024 );
+  batch->itemindex = realloc( batch->itemindex, batch->alloc * sizeof(int) );
+  batch->alternateid = realloc( batch->alternateid, batch->alloc * sizeof(int) );
+  batch->quantity = realloc( batch->quantity, batch->alloc * sizeof(double) );
+  batch->value = realloc( batch->value, batch->alloc * sizeof(double) );
+  batch->sale = realloc( batch->sale, batch->alloc * sizeof(double) );
+  batch->price = realloc( batch->price, batch->alloc * sizeof(double) );
+  batch->pgq = realloc( batch->pgq, batch->alloc * sizeof(double) );
+  batch->pgp = realloc( batch->pgp, batch->alloc * sizeof(double) );
+  batch->stockmask = realloc( batch->stockmask, batch->alloc * sizeof(double) );
+  batch->newmask = realloc( batch->newmask, batch->alloc * sizeof(double) );
+  return;
+}
+
+static void bsPriceGuideBatchFree( bsPriceGuideBatch *batch )
+{
+  free( batch->itemindex );
+  free( batch->alternateid );
+  free( batch->quantity );
+  free( batch->value );
+  free( batch->sale );
+  free( batch->price );
+  free( batch->pgq );
+  free( batch->pgp );
+  free( batch->stockmask );
+  free( batch->newmask );
+  memset( batch, 0, sizeof(bsPriceGuideBatch) );
+  return;
+}
+
+
+static void bsPriceGuideDiscardAlt( bsPriceGuideState *pgstate, int batchindex )
+{
+  bsxItem *remitem;
+  bsPriceGuideBatch *batch;
+
+  batch = &pgstate->batch;
+  batch->stockmask[batchindex] = 0.0;
+  batch->newmask[batchindex] = 0.0;
+  remitem = &pgstate->inv->itemlist[ batch->itemindex[batchindex] ];
+  if( pgstate->removealtflag )
+    bsxRemoveItem( pgstate->inv, remitem );
+  else
+    remitem->status = 'E';
+  return;
+}
+
+/* Keep the lowest value item of each alternate group, in the order the items were gathered */
+static void bsPriceGuideResolveAlt( bsPriceGuideState *pgstate )
+{
+  int batchindex, altindex;
+  bsPriceGuideBatch *batch;
+  bsPriceGuideAlt *alt;
+
+  DEBUG_SET_TRACKER();
+
+  batch = &pgstate->batch;
+  for( batchindex = 0 ; batchindex < batch->count ; batchindex++ )
+  {
+    altindex = batch->alternateid[batchindex];
+    if( !( altindex ) )
+      continue;
+    if( (unsigned)altindex >= pgstate->altcount )
+    {
+      batch->stockmask[batchindex] = 0.0;
+      batch->newmask[batchindex] = 0.0;
+      continue;
+    }
+    alt = &pgstate->altlist[ altindex ];
+    if( alt->batchindex >= 0 )
+    {
+      if( ( batch->value[batchindex] < 0.0001 ) || ( batch->value[batchindex] >= alt->value ) )
+      {
+        bsPriceGuideDiscardAlt( pgstate, batchindex );
+        continue;
+      }
+      bsPriceGuideDiscardAlt( pgstate, alt->batchindex );
+    }
+    alt->value = batch->value[batchindex];
+    alt->batchindex = batchindex;
+  }
+  return;
+}
+
+/* Branchless pass over the columns, new and total sums follow from the masks */
+static void bsPriceGuideSumBatch( bsPriceGuideState *pgstate )
 {
+  int batchindex;
+  double quantity, itemvalue, itemsale, itemprice, itempgq, itempgp, stockmask, newmask;
+  double stocklots, stockcount, stockvalue, stocksale, stockprice, stockpgq, stockpgp;
+  double newlots, newcount, newvalue, newsale, newprice, newpgq, newpgp;
+  bsPriceGuideBatch *batch;
+
   DEBUG_SET_TRACKER();
 
+  batch = &pgstate->batch;
+  stocklots = stockcount = stockvalue = stocksale = stockprice = stockpgq = stockpgp = 0.0;
+  newlots = newcount = newvalue = newsale = newprice = newpgq = newpgp = 0.0;
+  for( batchindex = 0 ; batchindex < batch->count ; batchindex++ )
+  {
+    quantity = batch->quantity[batchindex];
+    stockmask = batch->stockmask[batchindex];
+    newmask = batch->newmask[batchindex];
+    itemvalue = quantity * batch->value[batchindex];
+    itemsale = quantity * batch->sale[batchindex];
+    itemprice = quantity * batch->price[batchindex];
+    itempgq = itemvalue * batch->pgq[batchindex];
+    itempgp = itemvalue * batch->pgp[batchindex];
+    stocklots += stockmask;
+    stockcount += stockmask * quantity;
+    stockvalue += stockmask * itemvalue;
+    stocksale += stockmask * itemsale;
+    stockprice += stockmask * itemprice;
+    stockpgq += stockmask * itempgq;
+    stockpgp += stockmask * itempgp;
+    newlots += newmask;
+    newcount += newmask * quantity;
+    newvalue += newmask * itemvalue;
+    newsale += newmask * itemsale;
+    newprice += newmask * itemprice;
+    newpgq += newmask * itempgq;
+    newpgp += newmask * itempgp;
+  }
+
+  pgstate->stocklots = (int)stocklots;
+  pgstate->stockcount = (int)stockcount;
+  pgstate->stockvalue = stockvalue;
+  pgstate->stocksale = stocksale;
+  pgstate->stockprice = stockprice;
+  pgstate->stockpgq = stockpgq;
+  pgstate->stockpgp = stockpgp;
+  pgstate->newlots = (int)newlots;
+  pgstate->newcount = (int)newcount;
+  pgstate->newvalue = newvalue;
+  pgstate->newsale = newsale;
+  pgstate->newprice = newprice;
+  pgstate->newpgq = newpgq;
+  pgstate->newpgp = newpgp;
+  pgstate->totallots = pgstate->stocklots + pgstate->newlots;
+  pgstate->totalcount = pgstate->stockcount + pgstate->newcount;
+  pgstate->totalvalue = stockvalue + newvalue;
+  pgstate->totalsale = stocksale + newsale;
+  pgstate->totalprice = stockprice + newprice;
+  pgstate->totalpgq = stockpgq + newpgq;
+  pgstate->totalpgp = stockpgp + newpgp;
+  return;
+}
+
+
+/* Release the gathered columns and alternates, for states abandoned before bsPriceGuideFinishState() */
+void bsPriceGuideFreeState( bsPriceGuideState *pgstate )
+{
+  bsPriceGuideBatchFree( &pgstate->batch );
   if( pgstate->altlist )
   {
     free( pgstate->altlist );
     pgstate->altlist = 0;
   }
+  return;
+}
+
+void bsPriceGuideFinishState( bsPriceGuideState *pgstate )
+{
+  DEBUG_SET_TRACKER();
+
+  bsPriceGuideResolveAlt( pgstate );
+  bsPriceGuideSumBatch( pgstate );
+  bsPriceGuideFreeState( pgstate );
   if( pgstate->stockvalue > 0.001 )
   {
     pgstate->stockpgq /= pgstate->stockvalue;
@@ -176,182 +731,70 @@ void bsPriceGuideFinishState( bsPriceGuideState *pgstate )
 }
 
 
-
-static int bsPriceGuideHandleAlt( bsPriceGuideState *pgstate, int altindex, int quantity, double value, double sale, double price, double pgq, double pgp, int stockflag, int itemindex )
-{
-  double itemvalue, itemsale, itemprice;
-  bsxInventory *inv;
-  bsxItem *remitem;
-  bsPriceGuideAlt *alt;
-
-  DEBUG_SET_TRACKER();
-
-  if( (unsigned)altindex >= pgstate->altcount )
-    return 0;
-  alt = &pgstate->altlist[ altindex ];
-
-  /* Compare with previous alt */
-  if( alt->itemindex >= 0 )
-  {
-    inv = pgstate->inv;
-    if( ( value < 0.0001 ) || ( value >= alt->value ) )
-    {
-      remitem = &inv->itemlist[itemindex];
-      if( pgstate->removealtflag )
-        bsxRemoveItem( inv, remitem );
-      else
-        remitem->status = 'E';
-      return 0;
-    }
-    /* Remove previous alt */
-    remitem = &inv->itemlist[alt->itemindex];
-    if( pgstate->removealtflag )
-      bsxRemoveItem( inv, remitem );
-    else
-      remitem->status = 'E';
-    itemvalue = (double)alt->quantity * (double)alt->value;
-    itemsale = (double)alt->quantity * (double)alt->sale;
-    itemprice = (double)alt->quantity * (double)alt->price;
-    if( alt->stockflag )
-    {
-      pgstate->stocklots--;
-      pgstate->stockcount -= alt->quantity;
-      pgstate->stockvalue -= itemvalue;
-      pgstate->stocksale -= itemsale;
-      pgstate->stockprice -= itemprice;
-      pgstate->stockpgq -= itemvalue * alt->pgq;
-      pgstate->stockpgp -= itemvalue * alt->pgp;
-    }
-    else
-    {
-      pgstate->newlots--;
-      pgstate->newcount -= alt->quantity;
-      pgstate->newvalue -= itemvalue;
-      pgstate->newsale -= itemsale;
-      pgstate->newprice -= itemprice;
-      pgstate->newpgq -= itemvalue * alt->pgq;
-      pgstate->newpgp -= itemvalue * alt->pgp;
-    }
-    pgstate->totallots--;
-    pgstate->totalcount -= alt->quantity;
-    pgstate->totalvalue -= itemvalue;
-    pgstate->totalsale -= itemsale;
-    pgstate->totalprice -= itemprice;
-    pgstate->totalpgq -= itemvalue * alt->pgq;
-    pgstate->totalpgp -= itemvalue * alt->pgp;
-  }
-
-  /* Accept new alt */
-  alt->quantity = quantity;
-  alt->value = value;
-  alt->sale = sale;
-  alt->price = price;
-  alt->pgq = pgq;
-  alt->pgp = pgp;
-  alt->stockflag = stockflag;
-  alt->itemindex = itemindex;
-
-  return 1;
-}
-
 /*
 Q : SaleQuantity / StockQuantity
 P : StockValue / SaleValue
 */
 void bsPriceGuideSumCallback( bsContext *context, bsxInventory *inv, bsxItem *item, bsxPriceGuide *pg, void *callbackpointer )
 {
-  int stockflag;
+  int batchindex, commentlength;
   bsPriceGuideState *pgstate;
+  bsPriceGuideBatch *batch;
   bsxItem *stockitem;
-  double pgq, pgp, itemvalue, itemsale, itemprice;
-  ccGrowth growth;
+  double pgq, pgp;
+  char comments[128];
 
   DEBUG_SET_TRACKER();
 
   pgstate = callbackpointer;
 
   stockitem = bsxFindMatchItem( context->inventory, item );
-  ccGrowthInit( &growth, 512 );
   if( pg->stockqty )
   {
     pgq = (double)pg->saleqty / (double)pg->stockqty;
-    ccGrowthPrintf( &growth, "Q:%.2f", pgq );
+    commentlength = snprintf( comments, sizeof(comments), "Q:%.2f", pgq );
     pgq = fmin( pgq, 8.0 );
   }
   else
   {
     pgq = 8.0;
-    ccGrowthPrintf( &growth, "Q:Inf" );
+    commentlength = snprintf( comments, sizeof(comments), "Q:Inf" );
   }
   pgp = 0.0;
   if( pg->stockqtyaverage > 0.01 )
     pgp = (double)pg->saleqtyaverage / (double)pg->stockqtyaverage;
-  ccGrowthPrintf( &growth, " P:%.2f", pgp );
+  commentlength += snprintf( &comments[commentlength], sizeof(comments) - commentlength, " P:%.2f", pgp );
   pgp = fmin( pgp, 3.0 );
-  if( item->alternateid )
-  {
-    if( pgstate->showaltflag )
-      ccGrowthPrintf( &growth, " Alt%02d", item->alternateid );
-  }
+  if( ( item->alternateid ) && ( pgstate->showaltflag ) )
+    commentlength += snprintf( &comments[commentlength], sizeof(comments) - commentlength, " Alt%02d", item->alternateid );
   if( !( stockitem ) )
-    ccGrowthPrintf( &growth, " New" );
-  bsxSetItemComments( item, growth.data, growth.offset );
-  ccGrowthFree( &growth );
+    commentlength += snprintf( &comments[commentlength], sizeof(comments) - commentlength, " New" );
+  bsxSetItemComments( item, comments, commentlength );
 
   /* Fill fields */
   item->price = ( pg->saleqty ? pg->saleqtyaverage : pg->stockqtyaverage );
   item->origprice = item->price;
-  itemvalue = (double)item->quantity * (double)item->price;
-  itemsale = (double)item->quantity * (double)pg->stockqtyaverage;
-  itemprice = 0.0;
-  if( stockitem )
-    itemprice = (double)item->quantity * (double)stockitem->price;
-
   if( stockitem )
   {
     item->origprice = stockitem->price;
     bsxSetItemRemarks( item, stockitem->remarks, -1 );
   }
 
-  stockflag = 0;
-  if( ( stockitem ) && ( stockitem->quantity > 0 ) )
-    stockflag = 1;
-
-  /* Validate item if alternate */
-  if( item->alternateid )
-  {
-    if( !( bsPriceGuideHandleAlt( pgstate, item->alternateid, item->quantity, item->price, pg->stockqtyaverage, ( stockflag ? stockitem->price : 0.0 ), pgq, pgp, stockflag, bsxGetItemListIndex( inv, item ) ) ) )
-      return;
-  }
-
-  /* Add to total */
-  if( stockflag )
-  {
-    pgstate->stocklots++;
-    pgstate->stockcount += item->quantity;
-    pgstate->stockvalue += itemvalue;
-    pgstate->stocksale += itemsale;
-    pgstate->stockprice += itemprice;
-    pgstate->stockpgq += itemvalue * pgq;
-    pgstate->stockpgp += itemvalue * pgp;
-  }
-  else
-  {
-    pgstate->newlots++;
-    pgstate->newcount += item->quantity;
-    pgstate->newvalue += itemvalue;
-    pgstate->newsale += itemsale;
-    pgstate->newprice += itemprice;
-    pgstate->newpgq += itemvalue * pgq;
-    pgstate->newpgp += itemvalue * pgp;
-  }
-  pgstate->totallots++;
-  pgstate->totalcount += item->quantity;
-  pgstate->totalvalue += itemvalue;
-  pgstate->totalsale += itemsale;
-  pgstate->totalprice += itemprice;
-  pgstate->totalpgq += itemvalue * pgq;
-  pgstate->totalpgp += itemvalue * pgp;
+  /* Gather columns, alternates and sums are resolved by bsPriceGuideFinishState() */
+  batch = &pgstate->batch;
+  if( batch->count >= batch->alloc )
+    bsPriceGuideBatchGrow( batch );
+  batchindex = batch->count++;
+  batch->itemindex[batchindex] = (int)bsxGetItemListIndex( inv, item );
+  batch->alternateid[batchindex] = item->alternateid;
+  batch->quantity[batchindex] = (double)item->quantity;
+  batch->value[batchindex] = (double)item->price;
+  batch->sale[batchindex] = (double)pg->stockqtyaverage;
+  batch->price[batchindex] = ( stockitem ? (double)stockitem->price : 0.0 );
+  batch->pgq[batchindex] = pgq;
+  batch->pgp[batchindex] = pgp;
+  batch->stockmask[batchindex] = ( ( stockitem ) && ( stockitem->quantity > 0 ) ? 1.0 : 0.0 );
+  batch->newmask[batchindex] = 1.0 - batch->stockmask[batchindex];
 
   return;
 }
@@ -360,7 +803,7 @@ void bsPriceGuideSumCallback( bsContext *context, bsxInventory *inv, bsxItem *it
 void bsPriceGuideListRangeCallback( bsContext *context, bsxInventory *inv, bsxItem *item, bsxPriceGuide *pg, void *callbackpointer )
 {
   float *listrange;
-  float itemratio;
+  float itemratio, average;
 
   listrange = callbackpointer;
 
@@ -372,6 +815,10 @@ void bsPriceGuideListRangeCallback( bsContext *context, bsxInventory *inv, bsxIt
 
   ioPrintf( &context->output, 0, BSMSG_INFO "Item \"" IO_CYAN "%s" IO_DEFAULT "\" (" IO_GREEN "%s" IO_DEFAULT "), color \"" IO_CYAN "%s" IO_DEFAULT "\", quantity " IO_CYAN "%d" IO_DEFAULT "; item price " IO_YELLOW "%.3f" IO_DEFAULT ", price guide " IO_CYAN "%.3f" IO_DEFAULT ", price ratio of %s%.3f" IO_DEFAULT ".\n", ( item->name ? item->name : "???" ), ( item->id ? item->id : "???" ), item->colorname, item->quantity, item->price, pg->saleqtyaverage, ( itemratio < listrange[0] ? IO_MAGENTA : IO_RED ), itemratio );
 
+  /* Compare against the moving average of recorded snapshots, a single snapshot is the current price guide itself */
+  if( bsPriceGuideHistoryAverage( context, item->typeid, item->id, item->colorid, item->condition, context->curtime - ( (int64_t)context->priceguidehistoryperiod * 24*60*60 ), &average ) >= 2 )
+    ioPrintf( &context->output, 0, BSMSG_INFO "    " IO_CYAN "%d" IO_DEFAULT " days average " IO_CYAN "%.3f" IO_DEFAULT ", item price ratio of " IO_CYAN "%.3f" IO_DEFAULT ", price guide trend of " IO_CYAN "%+.1f%%" IO_DEFAULT ".\n", context->priceguidehistoryperiod, average, (float)item->price / average, 100.0 * ( ( pg->saleqtyaverage / average ) - 1.0 ) );
+
   return;
 }
 
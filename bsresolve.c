@@ -151,7 +151,7 @@ static int bsQueueBrickOwlLookupBoid( bsContext *context, bsWorkList *worklist,
   /* Only queue so many queries over HTTP pipelining */
   for( itemindex = worklist->liststart ; itemindex < inv->itemcount ; itemindex++ )
   {
-    if( context->brickowl.querycount >= context->brickowl.pipelinequeuesize )
+    if( context->brickowl.querycount >= bsPipelineDepth( &context->brickowl.pipeline ) )
       break;
     if( mmBitMapDirectGet( &worklist->bitmap, itemindex ) )
       continue;
@@ -164,7 +164,7 @@ static int bsQueueBrickOwlLookupBoid( bsContext *context, bsWorkList *worklist,
     if( !( resolveflags & BS_RESOLVE_FLAGS_FORCEQUERY ) )
     {
       /* Check if that item was resolved by a previous query */
-      item->boid = translationBLIDtoBOID( &context->translationtable, item->typeid, item->id );
+      bsxSetItemBOID( inv, item, translationBLIDtoBOID( &context->translationtable, item->typeid, item->id ) );
       if( item->boid != -1 )
         continue;
     }
@@ -209,7 +209,7 @@ static int bsQueueBrickOwlLookupBoid( bsContext *context, bsWorkList *worklist,
     /* There's some stuff we can't query, like books or custom lots, leave them a boid of -1 */
     if( itemtypestring )
     {
-      querystring = ccStrAllocPrintf( "GET /v1/catalog/id_lookup?key=%s&id=%s&type=%s&id_type=bl_item_no HTTP/1.1\r\nHost: api.brickowl.com\r\nConnection: Keep-Alive\r\n\r\n", context->brickowl.key, item->id, itemtypestring );
+      querystring = ccStrAllocPrintf( "GET /v1/catalog/id_lookup?key=%s&id=%s&type=%s&id_type=bl_item_no HTTP/1.1\r\nHost: api.brickowl.com\r\nConnection: Keep-Alive\r\n" HTTP_ACCEPT_ENCODING "\r\n", context->brickowl.key, item->id, itemtypestring );
       reply = bsAllocReply( context, BS_QUERY_TYPE_BRICKOWL, itemindex, (void *)item, (void *)&item->boid );
       bsBrickOwlAddQuery( context, querystring, HTTP_QUERY_FLAGS_RETRY | HTTP_QUERY_FLAGS_PIPELINING, (void *)reply, bsBrickOwlReplyLookup );
       free( querystring );
@@ -229,7 +229,7 @@ static int bsQueryBrickOwlLookupPass( bsContext *context, bsxInventory *inv, int
 {
   int itemindex, misscount;
   char itemtypeid;
-  int waitcount, itemlistindex;
+  int itemlistindex;
   bsQueryReply *reply, *replynext;
   bsxItem *item;
   bsWorkList worklist;
@@ -249,7 +249,6 @@ static int bsQueryBrickOwlLookupPass( bsContext *context, bsxInventory *inv, int
 
   /* Lookup all BLID->BOID as required for creation of new lots */
   bsTrackerInit( &tracker, context->brickowl.http );
-  waitcount = context->brickowl.pipelinequeuesize;
   worklist.liststart = 0;
   mmBitMapInit( &worklist.bitmap, inv->itemcount, 0 );
   for( ; ; )
@@ -259,11 +258,9 @@ static int bsQueryBrickOwlLookupPass( bsContext *context, bsxInventory *inv, int
       bsQueueBrickOwlLookupBoid( context, &worklist, inv, resolveflags, forceitemtype, fallbacktypeflag );
     if( !( context->brickowl.querycount ) )
       break;
-    if( context->brickowl.querycount <= waitcount )
-      waitcount = context->brickowl.querycount - 1;
 
     /* Wait for replies */
-    bsWaitBrickOwlQueries( context, waitcount );
+    bsWaitBrickOwlQueries( context, bsPipelineWaitCount( &context->brickowl.pipeline, context->brickowl.querycount ) );
 
     /* Examine all queued replies */
     for( reply = context->replylist.first ; reply ; reply = replynext )
@@ -281,6 +278,8 @@ static int bsQueryBrickOwlLookupPass( bsContext *context, bsxInventory *inv, int
       }
       else
       {
+        /* The reply wrote the BOID straight into the item */
+        bsxReindexItem( inv, item );
         itemtypeid = bsResolveDecideItemType( item, forceitemtype, fallbacktypeflag );
         if( !( itemtypeid ) )
           itemtypeid = '?';
@@ -385,7 +384,7 @@ void bsResolveBrickOwlBoids( bsContext *context, bsxInventory *inv, int *lookupc
       continue;
     if( !( item->id ) )
       continue;
-    item->boid = translationBLIDtoBOID( &context->translationtable, item->typeid, item->id );
+    bsxSetItemBOID( inv, item, translationBLIDtoBOID( &context->translationtable, item->typeid, item->id ) );
     if( lookupcounts )
     {
       if( item->boid != -1 )
@@ -220,7 +220,7 @@ void bsSyncAddDeltaItem( bsContext *context, bsxInventory *deltainv, bsxItem *st
   /* Update OwlLotIDs if necessary */
   if( ( deltamode == BS_SYNC_DELTA_MODE_BRICKOWL ) && ( item->bolotid != -1 ) && ( item->bolotid != stockitem->bolotid ) )
   {
-    stockitem->bolotid = item->bolotid;
+    bsxSetItemOwlLotID( context->inventory, stockitem, item->bolotid );
     context->contextflags |= BS_CONTEXT_FLAGS_UPDATED_INVENTORY;
   }
 #endif
@@ -268,6 +268,7 @@ void bsSyncAddDeltaItem( bsContext *context, bsxInventory *deltainv, bsxItem *st
 
 
 /* Compute the delta inventory, changes necessary for "inv" to become "stockinv" */
+/* Both passes are hash joins, each item probes the other inventory through its bsxFind*() index */
 bsxInventory *bsSyncComputeDeltaInv( bsContext *context, bsxInventory *stockinv, bsxInventory *inv, bsSyncStats *stats, int deltamode )
 {
   int itemindex, stockitemindex, updateflags;
@@ -561,8 +562,8 @@ int bsMergeInv( bsContext *context, bsxInventory *inv, bsMergeInvStats *stats, i
       /* Add item to local inventory */
       stockitem = bsxAddCopyItem( stockinv, item );
       /* Remove any LotID information */
-      stockitem->lotid = -1;
-      stockitem->bolotid = -1;
+      bsxSetItemLotID( stockinv, stockitem, -1 );
+      bsxSetItemOwlLotID( stockinv, stockitem, -1 );
       /* Ensure stockitem has unique ExtID */
       if( stockitem->extid == -1 )
         bsItemSetUniqueExtID( context, stockinv, stockitem );
@@ -36,6 +36,7 @@
 #include "mm.h"
 #include "mmatomic.h"
 #include "mmbitmap.h"
+#include "mmhash.h"
 
 /* For mkdir() */
 #if CC_UNIX
@@ -166,14 +167,13 @@ int xmlStrParseFloat( char *str, float *retfloat )
 
 
 
-/* Build string with escape chars as required, returned string must be free()'d */
-char *xmlEncodeEscapeString( char *string, int length, int *retlength )
+/* Encode escape chars to dst, which must hold 6*length bytes ; returns the encoded length */
+static int xmlEncodeEscapeBuffer( char *dst, char *string, int length )
 {
-  char *dst, *dstbase;
+  char *dstbase;
   unsigned char c;
 
-  dstbase = malloc( 6*length + 1 );
-  for( dst = dstbase ; length ; length--, string++ )
+  for( dstbase = dst ; length ; length--, string++ )
   {
     c = *string;
     if( c == '&' )
@@ -224,23 +224,34 @@ char *xmlEncodeEscapeString( char *string, int length, int *retlength )
     else
       *dst++ = c;
   }
-  *dst = 0;
+  return (int)( dst - dstbase );
+}
+
+
+/* Build string with escape chars as required, returned string must be free()'d */
+char *xmlEncodeEscapeString( char *string, int length, int *retlength )
+{
+  int enclength;
+  char *dstbase;
+
+  dstbase = malloc( 6*length + 1 );
+  enclength = xmlEncodeEscapeBuffer( dstbase, string, length );
+  dstbase[enclength] = 0;
   if( retlength )
-    *retlength = (int)( dst - dstbase );
+    *retlength = enclength;
 
   return dstbase;
 }
 
 
-/* Build string with decoded escape chars, returned string must be free()'d */
-char *xmlDecodeEscapeString( char *string, int length, int *retlength )
+/* Decode escape chars to dst, which must hold length+1 bytes */
+static int xmlDecodeEscapeBuffer( char *dst, char *string, int length )
 {
   int skip;
-  char *dst, *dstbase;
+  char *dstbase;
   unsigned char c;
 
-  dstbase = malloc( length + 1 );
-  for( dst = dstbase ; length ; length -= skip, string += skip )
+  for( dstbase = dst ; length ; length -= skip, string += skip )
   {
     c = *string;
     skip = 1;
@@ -249,7 +260,7 @@ char *xmlDecodeEscapeString( char *string, int length, int *retlength )
     else
     {
       if( !( --length ) )
-        goto error;
+        return -1;
       string++;
       if( ccStrCmpSeq( string, "lt;", 3 ) )
       {
@@ -284,36 +295,32 @@ char *xmlDecodeEscapeString( char *string, int length, int *retlength )
     }
   }
   *dst = 0;
-  if( retlength )
-    *retlength = (int)( dst - dstbase );
-  return dstbase;
-
-  error:
-  free( dstbase );
-  return 0;
+  return (int)( dst - dstbase );
 }
 
 
-////
-
-
-char *bsxReadString( char **readvalue, char *string, char *closestring )
+/* Build string with decoded escape chars, returned string must be free()'d */
+char *xmlDecodeEscapeString( char *string, int length, int *retlength )
 {
-  int len, stringlen;
-  *readvalue = string;
-  len = strlen( closestring );
-  if( !( string = ccStrFindSeq( string, closestring, len ) ) )
+  int declength;
+  char *dstbase;
+
+  dstbase = malloc( length + 1 );
+  declength = xmlDecodeEscapeBuffer( dstbase, string, length );
+  if( declength < 0 )
   {
-    printf( "BSX READ ERROR: Failed to locate matching %s\n", closestring );
+    free( dstbase );
     return 0;
   }
-  *string = 0;
-  stringlen = (int)( string - *readvalue );
-  if( !( stringlen ) )
-    *readvalue = 0;
-  return string + len;
+  if( retlength )
+    *retlength = declength;
+  return dstbase;
 }
 
+
+////
+
+
 char *bsxReadStringAlloc( char **readvalue, char *string, char *closestring )
 {
   int len, stringlen;
@@ -404,352 +411,833 @@ char *bsxReadChar( char *readvalue, char *string, char *closestring )
 ////
 
 
-bsxInventory *bsxNewInventory()
+/* Inventories with fewer items are searched linearly, no index is built */
+#define BSX_INDEX_MIN_ITEMCOUNT (256)
+
+#define BSX_INDEX_HASH_BITS_MIN (10)
+#define BSX_INDEX_PAGE_BITS (4)
+
+/* Verify all indexed lookups against a full linear search */
+#define BSX_INDEX_DEBUG (0)
+
+enum
+{
+  BSX_INDEX_LOTID,
+  BSX_INDEX_OWLLOTID,
+  BSX_INDEX_EXTID,
+  /* ID, colorID and condition ; typeID is verified on lookup */
+  BSX_INDEX_MATCH,
+  /* BOID, colorID and condition */
+  BSX_INDEX_BOID,
+
+  BSX_INDEX_COUNT
+};
+
+typedef struct
+{
+  int32_t itemindex;
+  uint32_t hashkey;
+} bsxIndexEntry;
+
+typedef struct
+{
+  /* Hash keys the item was indexed with, bit set in keymask if present in table */
+  uint32_t hashkey[BSX_INDEX_COUNT];
+  uint32_t keymask;
+} bsxIndexItemKeys;
+
+typedef struct
+{
+  /* Hash tables of bsxIndexEntry, one per BSX_INDEX_* */
+  void *hashtable[BSX_INDEX_COUNT];
+  /* Keys used to index each item, so entries can be deleted after an item changed */
+  bsxIndexItemKeys *keylist;
+  int keyalloc;
+  /* Items below indexcount are indexed, the others are added on the next lookup */
+  int indexcount;
+} bsxIndex;
+
+#define BSX_INDEX_CHECK_TYPEID (0x1)
+#define BSX_INDEX_CHECK_BOIDCOLORCONDITION (0x2)
+
+typedef struct
 {
   bsxInventory *inv;
-  inv = malloc( sizeof(bsxInventory) );
-  memset( inv, 0, sizeof(bsxInventory) );
-  return inv;
+  int indextype;
+  int checkflags;
+  uint32_t hashkey;
+  int64_t value;
+  char *id;
+  char typeid;
+  char condition;
+  int colorid;
+  int64_t boid;
+  /* Lowest index of matching item, as found by linear search */
+  int bestindex;
+} bsxIndexSearch;
+
+
+static inline uint32_t bsxIndexHashInt64( int64_t value )
+{
+  return ccHash32Int64Inline( (uint64_t)value );
 }
 
+static inline uint32_t bsxIndexHashMatch( char *id, int colorid, char condition )
+{
+  return ccHash32Data( id, strlen( id ) ) ^ ccHash32Int32Inline( ( (uint32_t)colorid << 8 ) | (uint8_t)condition );
+}
 
-static char *bsxReadItem( bsxItem *item, char *input, int *successflag )
+static inline uint32_t bsxIndexHashBoid( int64_t boid, int colorid, char condition )
 {
-  int offset, itemflags;
-  char *string;
-  char *encodedstring, *decodedstring;
+  return ccHash32Int64Inline( (uint64_t)boid ) ^ ccHash32Int32Inline( ( (uint32_t)colorid << 8 ) | (uint8_t)condition );
+}
 
-  bsxClearItem( item );
-  input = ccStrFindStrSkip( input, "<Item>" );
-  if( !( input ) )
+static int bsxIndexItemMatch( bsxIndexSearch *search, bsxItem *item )
+{
+  if( item->flags & BSX_ITEM_FLAGS_DELETED )
+    return 0;
+  switch( search->indextype )
   {
-    *successflag = 1;
+    case BSX_INDEX_LOTID:
+      if( item->lotid != search->value )
+        return 0;
+      break;
+    case BSX_INDEX_OWLLOTID:
+      if( item->bolotid != search->value )
+        return 0;
+      break;
+    case BSX_INDEX_EXTID:
+      if( item->extid != search->value )
+        return 0;
+      break;
+    case BSX_INDEX_MATCH:
+      if( ( item->colorid != search->colorid ) || ( item->condition != search->condition ) )
+        return 0;
+      if( !( item->id ) || !( ccStrCmpEqualInline( item->id, search->id ) ) )
+        return 0;
+      break;
+    case BSX_INDEX_BOID:
+      if( ( item->boid != search->boid ) || ( item->colorid != search->colorid ) || ( item->condition != search->condition ) )
+        return 0;
+      break;
+    default:
+      return 0;
+  }
+  if( ( search->checkflags & BSX_INDEX_CHECK_TYPEID ) && ( item->typeid != search->typeid ) )
+    return 0;
+  if( ( search->checkflags & BSX_INDEX_CHECK_BOIDCOLORCONDITION ) && ( ( item->boid != search->boid ) || ( item->colorid != search->colorid ) || ( item->condition != search->condition ) ) )
     return 0;
+  return 1;
+}
+
+
+/* Clear the entry so that entryvalid() returns zero */
+static void bsxIndexClearEntry( void *entry )
+{
+  bsxIndexEntry *indexentry;
+  indexentry = (bsxIndexEntry *)entry;
+  indexentry->itemindex = -1;
+  return;
+}
+
+/* Returns non-zero if the entry is valid and existing */
+static int bsxIndexEntryValid( void *entry )
+{
+  bsxIndexEntry *indexentry;
+  indexentry = (bsxIndexEntry *)entry;
+  return ( indexentry->itemindex != -1 ? 1 : 0 );
+}
+
+/* Return key for an arbitrary set of user-defined data */
+static uint32_t bsxIndexEntryKey( void *entry )
+{
+  bsxIndexEntry *indexentry;
+  indexentry = (bsxIndexEntry *)entry;
+  return indexentry->hashkey;
+}
+
+/* Return MM_HASH_ENTRYCMP* to stop or continue the search */
+static int bsxIndexEntryCmp( void *entry, void *entryref )
+{
+  bsxIndexEntry *indexentry, *indexentryref;
+  indexentry = (bsxIndexEntry *)entry;
+  if( indexentry->itemindex == -1 )
+    return MM_HASH_ENTRYCMP_INVALID;
+  indexentryref = (bsxIndexEntry *)entryref;
+  if( indexentry->itemindex == indexentryref->itemindex )
+    return MM_HASH_ENTRYCMP_FOUND;
+  return MM_HASH_ENTRYCMP_SKIP;
+}
+
+/* Return MM_HASH_ENTRYLIST* to stop or continue the search */
+static int bsxIndexEntryList( void *opaque, void *entry, void *entryref )
+{
+  bsxIndexEntry *indexentry;
+  bsxIndexSearch *search;
+  indexentry = (bsxIndexEntry *)entry;
+  if( indexentry->itemindex == -1 )
+    return MM_HASH_ENTRYLIST_BREAK;
+  search = (bsxIndexSearch *)opaque;
+  if( ( indexentry->hashkey == search->hashkey ) && ( indexentry->itemindex < search->bestindex ) && ( bsxIndexItemMatch( search, &search->inv->itemlist[ indexentry->itemindex ] ) ) )
+    search->bestindex = indexentry->itemindex;
+  return MM_HASH_ENTRYLIST_CONTINUE;
+}
+
+static mmHashAccess bsxIndexHashAccess =
+{
+  .clearentry = bsxIndexClearEntry,
+  .entryvalid = bsxIndexEntryValid,
+  .entrykey = bsxIndexEntryKey,
+  .entrycmp = bsxIndexEntryCmp,
+  .entrylist = bsxIndexEntryList
+};
+
+
+static void bsxIndexFree( bsxInventory *inv )
+{
+  int indextype;
+  bsxIndex *index;
+
+  index = inv->index;
+  if( !( index ) )
+    return;
+  for( indextype = 0 ; indextype < BSX_INDEX_COUNT ; indextype++ )
+    free( index->hashtable[indextype] );
+  free( index->keylist );
+  free( index );
+  inv->index = 0;
+
+  return;
+}
+
+static void bsxIndexGrowTable( bsxIndex *index, int indextype )
+{
+  int hashbits;
+  void *newtable;
+
+  if( mmHashGetStatus( index->hashtable[indextype], &hashbits ) != MM_HASH_STATUS_MUSTGROW )
+    return;
+  hashbits++;
+  newtable = malloc( mmHashRequiredSize( sizeof(bsxIndexEntry), hashbits, BSX_INDEX_PAGE_BITS ) );
+  mmHashResize( newtable, index->hashtable[indextype], &bsxIndexHashAccess, hashbits, BSX_INDEX_PAGE_BITS );
+  free( index->hashtable[indextype] );
+  index->hashtable[indextype] = newtable;
+  return;
+}
+
+static void bsxIndexAddEntry( bsxIndex *index, int indextype, int itemindex, uint32_t hashkey )
+{
+  bsxIndexEntry entry;
+  bsxIndexItemKeys *keys;
+
+  keys = &index->keylist[ itemindex ];
+  keys->hashkey[ indextype ] = hashkey;
+  keys->keymask |= 1 << indextype;
+  entry.itemindex = itemindex;
+  entry.hashkey = hashkey;
+  mmHashDirectAddEntry( index->hashtable[ indextype ], &bsxIndexHashAccess, &entry, 0 );
+  bsxIndexGrowTable( index, indextype );
+  return;
+}
+
+static void bsxIndexAddItem( bsxInventory *inv, bsxIndex *index, int itemindex )
+{
+  bsxItem *item;
+
+  index->keylist[ itemindex ].keymask = 0x0;
+  item = &inv->itemlist[ itemindex ];
+  if( item->flags & BSX_ITEM_FLAGS_DELETED )
+    return;
+  if( item->lotid != -1 )
+    bsxIndexAddEntry( index, BSX_INDEX_LOTID, itemindex, bsxIndexHashInt64( item->lotid ) );
+  if( item->bolotid != -1 )
+    bsxIndexAddEntry( index, BSX_INDEX_OWLLOTID, itemindex, bsxIndexHashInt64( item->bolotid ) );
+  if( item->extid != -1 )
+    bsxIndexAddEntry( index, BSX_INDEX_EXTID, itemindex, bsxIndexHashInt64( item->extid ) );
+  if( item->id )
+    bsxIndexAddEntry( index, BSX_INDEX_MATCH, itemindex, bsxIndexHashMatch( item->id, item->colorid, item->condition ) );
+  if( item->boid != -1 )
+    bsxIndexAddEntry( index, BSX_INDEX_BOID, itemindex, bsxIndexHashBoid( item->boid, item->colorid, item->condition ) );
+  return;
+}
+
+static void bsxIndexRemoveItem( bsxIndex *index, int itemindex )
+{
+  int indextype;
+  bsxIndexEntry entry;
+  bsxIndexItemKeys *keys;
+
+  keys = &index->keylist[ itemindex ];
+  for( indextype = 0 ; indextype < BSX_INDEX_COUNT ; indextype++ )
+  {
+    if( !( keys->keymask & ( 1 << indextype ) ) )
+      continue;
+    entry.itemindex = itemindex;
+    entry.hashkey = keys->hashkey[ indextype ];
+    mmHashDirectDeleteEntry( index->hashtable[ indextype ], &bsxIndexHashAccess, &entry, 0 );
   }
-  itemflags = 0x0;
+  keys->keymask = 0x0;
+  return;
+}
 
-#if ITEM_READ_DEBUG
-  printf( "Start Item\n" );
-#endif
+/* Return the inventory's index with all items indexed, or null if the inventory is too small to bother */
+static bsxIndex *bsxIndexAcquire( bsxInventory *inv )
+{
+  int indextype, hashbits, itemindex;
+  bsxIndex *index;
 
-  for( ; ; )
+  index = inv->index;
+  if( !( index ) )
   {
-    offset = ccStrFindChar( input, '<' );
-    if( offset < 0 )
-    {
-      printf( "ERROR: Failed to locate matching </Item>\n" );
+    if( inv->itemcount < BSX_INDEX_MIN_ITEMCOUNT )
       return 0;
-    }
-    input = &input[offset+1];
-
-    if( ( string = ccStrCmpWord( input, "/Item>" ) ) )
-      break;
-    else if( ( string = ccStrCmpWord( input, "ItemID>" ) ) )
-    {
-      if( !( input = bsxReadString( &item->id, string, "</ItemID>" ) ) )
-        return 0;
-      itemflags |= 0x1;
-#if ITEM_READ_DEBUG
-printf( "  Read Item ID : %s\n", item->id );
-#endif
-    }
-    else if( ( string = ccStrCmpWord( input, "ItemTypeID>" ) ) )
-    {
-      if( !( input = bsxReadChar( &item->typeid, string, "</ItemTypeID>" ) ) )
-        return 0;
-      itemflags |= 0x2;
-#if ITEM_READ_DEBUG
-printf( "  Read Type ID : %c\n", item->typeid );
-#endif
-    }
-    else if( ( string = ccStrCmpWord( input, "ColorID>" ) ) )
-    {
-      if( !( input = bsxReadInt( &item->colorid, string, "</ColorID>" ) ) )
-        return 0;
-#if ITEM_READ_DEBUG
-printf( "  Read Color ID : %d\n", item->colorid );
-#endif
-    }
-    else if( ( string = ccStrCmpWord( input, "ItemName>" ) ) )
+    index = malloc( sizeof(bsxIndex) );
+    memset( index, 0, sizeof(bsxIndex) );
+    for( hashbits = BSX_INDEX_HASH_BITS_MIN ; ( 1 << hashbits ) < ( inv->itemcount << 2 ) ; hashbits++ );
+    for( indextype = 0 ; indextype < BSX_INDEX_COUNT ; indextype++ )
     {
-      if( !( input = bsxReadString( &encodedstring, string, "</ItemName>" ) ) )
-        return 0;
-      decodedstring = xmlDecodeEscapeString( encodedstring, strlen( encodedstring ), 0 );
-      bsxSetItemName( item, decodedstring, -1 );
-      free( decodedstring );
-#if ITEM_READ_DEBUG
-printf( "  Read Item Name : %s\n", item->name );
-#endif
+      index->hashtable[indextype] = malloc( mmHashRequiredSize( sizeof(bsxIndexEntry), hashbits, BSX_INDEX_PAGE_BITS ) );
+      mmHashInit( index->hashtable[indextype], &bsxIndexHashAccess, sizeof(bsxIndexEntry), hashbits, BSX_INDEX_PAGE_BITS, 0x0 );
     }
-    else if( ( string = ccStrCmpWord( input, "ItemTypeName>" ) ) )
+    inv->index = index;
+  }
+  if( index->indexcount < inv->itemcount )
+  {
+    if( index->keyalloc < inv->itemcount )
     {
-      if( !( input = bsxReadString( &item->typename, string, "</ItemTypeName>" ) ) )
-        return 0;
-#if ITEM_READ_DEBUG
-printf( "  Read Item Type Name : %s\n", item->typename );
-#endif
+      index->keyalloc = intMax( inv->itemcount, index->keyalloc << 1 );
+      index->keylist = realloc( index->keylist, index->keyalloc * sizeof(bsxIndexItemKeys) );
     }
-    else if( ( string = ccStrCmpWord( input, "ColorName>" ) ) )
-    {
-      if( !( input = bsxReadString( &item->colorname, string, "</ColorName>" ) ) )
-        return 0;
-#if ITEM_READ_DEBUG
-printf( "  Read Color Name : %s\n", item->colorname );
+    for( itemindex = index->indexcount ; itemindex < inv->itemcount ; itemindex++ )
+      bsxIndexAddItem( inv, index, itemindex );
+    index->indexcount = inv->itemcount;
+  }
+
+  return index;
+}
+
+static bsxItem *bsxIndexFind( bsxInventory *inv, bsxIndex *index, bsxIndexSearch *search )
+{
+  bsxIndexEntry entry;
+
+  search->inv = inv;
+  search->bestindex = inv->itemcount;
+  entry.itemindex = -1;
+  entry.hashkey = search->hashkey;
+  mmHashDirectListEntry( index->hashtable[ search->indextype ], &bsxIndexHashAccess, &entry, search );
+  if( search->bestindex >= inv->itemcount )
+    return 0;
+  return &inv->itemlist[ search->bestindex ];
+}
+
+#if BSX_INDEX_DEBUG
+static bsxItem *bsxIndexDebugVerify( bsxInventory *inv, bsxIndexSearch *search, bsxItem *founditem )
+{
+  int itemindex;
+  bsxItem *item;
+
+  search->inv = inv;
+  item = inv->itemlist;
+  for( itemindex = 0 ; itemindex < inv->itemcount ; itemindex++, item++ )
+  {
+    if( bsxIndexItemMatch( search, item ) )
+      break;
+  }
+  if( itemindex == inv->itemcount )
+    item = 0;
+  if( item != founditem )
+    printf( "BSX INDEX ERROR: Index lookup mismatch for table %d, found %p, expected %p\n", search->indextype, founditem, item );
+  return item;
+}
 #endif
-    }
-    else if( ( string = ccStrCmpWord( input, "CategoryID>" ) ) )
+
+
+/* Update the index after changing the ID, BOID, colorID or condition of an item */
+void bsxReindexItem( bsxInventory *inv, bsxItem *item )
+{
+  int itemindex;
+  bsxIndex *index;
+
+  index = inv->index;
+  if( !( index ) )
+    return;
+  itemindex = (int)bsxGetItemListIndex( inv, item );
+  if( itemindex >= index->indexcount )
+    return;
+  bsxIndexRemoveItem( index, itemindex );
+  bsxIndexAddItem( inv, index, itemindex );
+  return;
+}
+
+
+////
+
+
+/* Item tags, dispatched through a small hash table on the tag name */
+enum
+{
+  BSX_TAG_STRING,
+  BSX_TAG_ESCAPEDSTRING,
+  BSX_TAG_CHAR,
+  BSX_TAG_INT,
+  BSX_TAG_INT64,
+  BSX_TAG_FLOAT
+};
+
+typedef struct
+{
+  char *name;
+  int namelength;
+  int type;
+  size_t offset;
+  int itemflag;
+} bsxItemTag;
+
+#define BSX_ITEM_TAG(n,t,f,fl) { n, sizeof(n)-1, t, offsetof(bsxItem,f), fl }
+
+static const bsxItemTag bsxItemTagList[] =
+{
+  BSX_ITEM_TAG( "ItemID", BSX_TAG_STRING, id, 0x1 ),
+  BSX_ITEM_TAG( "ItemTypeID", BSX_TAG_CHAR, typeid, 0x2 ),
+  BSX_ITEM_TAG( "ColorID", BSX_TAG_INT, colorid, 0x0 ),
+  BSX_ITEM_TAG( "ItemName", BSX_TAG_ESCAPEDSTRING, name, 0x0 ),
+  BSX_ITEM_TAG( "ItemTypeName", BSX_TAG_STRING, typename, 0x0 ),
+  BSX_ITEM_TAG( "ColorName", BSX_TAG_STRING, colorname, 0x0 ),
+  BSX_ITEM_TAG( "CategoryID", BSX_TAG_INT, categoryid, 0x0 ),
+  BSX_ITEM_TAG( "CategoryName", BSX_TAG_STRING, categoryname, 0x0 ),
+  BSX_ITEM_TAG( "Status", BSX_TAG_CHAR, status, 0x0 ),
+  BSX_ITEM_TAG( "Qty", BSX_TAG_INT, quantity, 0x4 ),
+  BSX_ITEM_TAG( "Price", BSX_TAG_FLOAT, price, 0x0 ),
+  BSX_ITEM_TAG( "SalePrice", BSX_TAG_FLOAT, saleprice, 0x0 ),
+  BSX_ITEM_TAG( "Condition", BSX_TAG_CHAR, condition, 0x8 ),
+  BSX_ITEM_TAG( "UsedGrade", BSX_TAG_CHAR, usedgrade, 0x0 ),
+  BSX_ITEM_TAG( "Completeness", BSX_TAG_CHAR, completeness, 0x0 ),
+  BSX_ITEM_TAG( "Bulk", BSX_TAG_INT, bulk, 0x0 ),
+  BSX_ITEM_TAG( "OrigPrice", BSX_TAG_FLOAT, origprice, 0x0 ),
+  BSX_ITEM_TAG( "Comments", BSX_TAG_ESCAPEDSTRING, comments, 0x0 ),
+  BSX_ITEM_TAG( "Remarks", BSX_TAG_ESCAPEDSTRING, remarks, 0x0 ),
+  BSX_ITEM_TAG( "OrigQty", BSX_TAG_INT, origquantity, 0x0 ),
+  BSX_ITEM_TAG( "MyCost", BSX_TAG_FLOAT, mycost, 0x0 ),
+  BSX_ITEM_TAG( "TQ1", BSX_TAG_INT, tq1, 0x0 ),
+  BSX_ITEM_TAG( "TP1", BSX_TAG_FLOAT, tp1, 0x0 ),
+  BSX_ITEM_TAG( "TQ2", BSX_TAG_INT, tq2, 0x0 ),
+  BSX_ITEM_TAG( "TP2", BSX_TAG_FLOAT, tp2, 0x0 ),
+  BSX_ITEM_TAG( "TQ3", BSX_TAG_INT, tq3, 0x0 ),
+  BSX_ITEM_TAG( "TP3", BSX_TAG_FLOAT, tp3, 0x0 ),
+  BSX_ITEM_TAG( "LotID", BSX_TAG_INT64, lotid, 0x0 ),
+  BSX_ITEM_TAG( "OwlID", BSX_TAG_INT64, boid, 0x0 ),
+  BSX_ITEM_TAG( "OwlLotID", BSX_TAG_INT64, bolotid, 0x0 ),
+  BSX_ITEM_TAG( "Sale", BSX_TAG_INT, sale, 0x0 ),
+  BSX_ITEM_TAG( "AlternateID", BSX_TAG_INT, alternateid, 0x0 )
+};
+
+#define BSX_ITEM_TAG_COUNT ((int)(sizeof(bsxItemTagList)/sizeof(bsxItemTag)))
+
+#define BSX_ITEM_TAG_HASH_SIZE (128)
+
+static int bsxItemTagHashReady = 0;
+static int8_t bsxItemTagHash[BSX_ITEM_TAG_HASH_SIZE];
+
+static inline uint32_t bsxItemTagHashKey( char *tag, int taglength )
+{
+  return ( ( (uint32_t)taglength * 31 ) + ( (uint32_t)((unsigned char)tag[0]) * 7 ) + (uint32_t)((unsigned char)tag[taglength-1]) ) & ( BSX_ITEM_TAG_HASH_SIZE - 1 );
+}
+
+static void bsxItemTagHashInit()
+{
+  int tagindex;
+  uint32_t hashkey;
+  const bsxItemTag *itemtag;
+  memset( bsxItemTagHash, -1, BSX_ITEM_TAG_HASH_SIZE * sizeof(int8_t) );
+  for( tagindex = 0 ; tagindex < BSX_ITEM_TAG_COUNT ; tagindex++ )
+  {
+    itemtag = &bsxItemTagList[tagindex];
+    hashkey = bsxItemTagHashKey( itemtag->name, itemtag->namelength );
+    while( bsxItemTagHash[hashkey] >= 0 )
+      hashkey = ( hashkey + 1 ) & ( BSX_ITEM_TAG_HASH_SIZE - 1 );
+    bsxItemTagHash[hashkey] = tagindex;
+  }
+  bsxItemTagHashReady = 1;
+  return;
+}
+
+static const bsxItemTag *bsxItemTagLookup( char *tag, int taglength )
+{
+  uint32_t hashkey;
+  const bsxItemTag *itemtag;
+  if( taglength <= 0 )
+    return 0;
+  for( hashkey = bsxItemTagHashKey( tag, taglength ) ; bsxItemTagHash[hashkey] >= 0 ; hashkey = ( hashkey + 1 ) & ( BSX_ITEM_TAG_HASH_SIZE - 1 ) )
+  {
+    itemtag = &bsxItemTagList[ bsxItemTagHash[hashkey] ];
+    if( ( itemtag->namelength == taglength ) && !( memcmp( itemtag->name, tag, taglength ) ) )
+      return itemtag;
+  }
+  return 0;
+}
+
+
+////
+
+
+/* Item strings are packed in blocks owned by the inventory, released by bsxEmptyInventory() */
+#define BSX_STRING_BLOCK_SIZE (256*1024)
+
+/* Don't bother compacting the strings of small inventories */
+#define BSX_STRING_COMPACT_MIN (4*BSX_STRING_BLOCK_SIZE)
+
+static inline mmAtomic32 *bsxShareCount( bsxInventory *inv )
+{
+  return (mmAtomic32 *)&inv->sharecount;
+}
+
+typedef struct bsxStringBlock
+{
+  struct bsxStringBlock *next;
+  size_t used;
+  size_t size;
+} bsxStringBlock;
+
+static char *bsxStringAlloc( bsxInventory *inv, size_t size )
+{
+  char *string;
+  bsxStringBlock *block, *head;
+
+  head = inv->stringblock;
+  if( size > ( BSX_STRING_BLOCK_SIZE >> 4 ) )
+  {
+    /* Large strings get a block of their own, keep filling the current one */
+    block = malloc( sizeof(bsxStringBlock) + size );
+    block->used = size;
+    block->size = size;
+    inv->stringsize += size;
+    if( head )
     {
-      if( !( input = bsxReadInt( &item->categoryid, string, "</CategoryID>" ) ) )
-        return 0;
-#if ITEM_READ_DEBUG
-printf( "  Read Category ID : %d\n", item->categoryid );
-#endif
+      block->next = head->next;
+      head->next = block;
     }
-    else if( ( string = ccStrCmpWord( input, "CategoryName>" ) ) )
+    else
     {
-      if( !( input = bsxReadString( &item->categoryname, string, "</CategoryName>" ) ) )
-        return 0;
-#if ITEM_READ_DEBUG
-printf( "  Read Category Name : %s\n", item->categoryname );
-#endif
+      block->next = 0;
+      inv->stringblock = block;
     }
-    else if( ( string = ccStrCmpWord( input, "Status>" ) ) )
-    {
-      if( !( input = bsxReadChar( &item->status, string, "</Status>" ) ) )
-        return 0;
-#if ITEM_READ_DEBUG
-printf( "  Read Status : %c\n", item->status );
-#endif
-    }
-    else if( ( string = ccStrCmpWord( input, "Qty>" ) ) )
-    {
-      if( !( input = bsxReadInt( &item->quantity, string, "</Qty>" ) ) )
-        return 0;
-#if ITEM_READ_DEBUG
-printf( "  Read Quantity : %d\n", item->quantity );
-#endif
-      itemflags |= 0x4;
-    }
-    else if( ( string = ccStrCmpWord( input, "Price>" ) ) )
-    {
-      if( !( input = bsxReadFloat( &item->price, string, "</Price>" ) ) )
-        return 0;
-#if ITEM_READ_DEBUG
-printf( "  Read Price : %f\n", item->price );
-#endif
-    }
-    else if( ( string = ccStrCmpWord( input, "SalePrice>" ) ) )
-    {
-      if( !( input = bsxReadFloat( &item->saleprice, string, "</SalePrice>" ) ) )
-        return 0;
-#if ITEM_READ_DEBUG
-printf( "  Read SalePrice : %f\n", item->saleprice );
-#endif
-    }
-    else if( ( string = ccStrCmpWord( input, "Condition>" ) ) )
-    {
-      if( !( input = bsxReadChar( &item->condition, string, "</Condition>" ) ) )
-        return 0;
-      itemflags |= 0x8;
-#if ITEM_READ_DEBUG
-printf( "  Read Condition : %c\n", item->condition );
-#endif
-    }
-    else if( ( string = ccStrCmpWord( input, "UsedGrade>" ) ) )
-    {
-      if( !( input = bsxReadChar( &item->usedgrade, string, "</UsedGrade>" ) ) )
-        return 0;
-#if ITEM_READ_DEBUG
-printf( "  Read UsedGrade : %c\n", item->usedgrade );
-#endif
-    }
-    else if( ( string = ccStrCmpWord( input, "Completeness>" ) ) )
-    {
-      if( !( input = bsxReadChar( &item->completeness, string, "</Completeness>" ) ) )
-        return 0;
-#if ITEM_READ_DEBUG
-printf( "  Read Completeness : %c\n", item->completeness );
-#endif
-    }
-    else if( ( string = ccStrCmpWord( input, "Bulk>" ) ) )
-    {
-      if( !( input = bsxReadInt( &item->bulk, string, "</Bulk>" ) ) )
-        return 0;
-#if ITEM_READ_DEBUG
-printf( "  Read Bulk : %d\n", item->bulk );
-#endif
-    }
-    else if( ( string = ccStrCmpWord( input, "OrigPrice>" ) ) )
-    {
-      if( !( input = bsxReadFloat( &item->origprice, string, "</OrigPrice>" ) ) )
-        return 0;
-#if ITEM_READ_DEBUG
-printf( "  Read Original Price : %f\n", item->origprice );
-#endif
-    }
-    else if( ( string = ccStrCmpWord( input, "Comments>" ) ) )
-    {
-      if( !( input = bsxReadString( &encodedstring, string, "</Comments>" ) ) )
-        return 0;
-      decodedstring = xmlDecodeEscapeString( encodedstring, strlen( encodedstring ), 0 );
-      bsxSetItemComments( item, decodedstring, -1 );
-      free( decodedstring );
-#if ITEM_READ_DEBUG
-printf( "  Read Comments : %s\n", item->comments );
-#endif
-    }
-    else if( ( string = ccStrCmpWord( input, "Remarks>" ) ) )
-    {
-      if( !( input = bsxReadString( &encodedstring, string, "</Remarks>" ) ) )
-        return 0;
-      decodedstring = xmlDecodeEscapeString( encodedstring, strlen( encodedstring ), 0 );
-      bsxSetItemRemarks( item, decodedstring, -1 );
-      free( decodedstring );
-#if ITEM_READ_DEBUG
-printf( "  Read Remarks : %s\n", item->remarks );
-#endif
-    }
-    else if( ( string = ccStrCmpWord( input, "OrigQty>" ) ) )
-    {
-      if( !( input = bsxReadInt( &item->origquantity, string, "</OrigQty>" ) ) )
-        return 0;
-#if ITEM_READ_DEBUG
-printf( "  Read Original Quantity : %d\n", item->origquantity );
-#endif
-    }
-    else if( ( string = ccStrCmpWord( input, "MyCost>" ) ) )
-    {
-      if( !( input = bsxReadFloat( &item->mycost, string, "</MyCost>" ) ) )
-        return 0;
-#if ITEM_READ_DEBUG
-printf( "  Read My Cost : %f\n", item->mycost );
-#endif
-    }
-    else if( ( string = ccStrCmpWord( input, "TQ1>" ) ) )
-    {
-      if( !( input = bsxReadInt( &item->tq1, string, "</TQ1>" ) ) )
-        return 0;
-#if ITEM_READ_DEBUG
-printf( "  Read TQ1 : %d\n", item->tq1 );
-#endif
-    }
-    else if( ( string = ccStrCmpWord( input, "TP1>" ) ) )
-    {
-      if( !( input = bsxReadFloat( &item->tp1, string, "</TP1>" ) ) )
-        return 0;
-#if ITEM_READ_DEBUG
-printf( "  Read TP1 : %f\n", item->tp1 );
-#endif
-    }
-    else if( ( string = ccStrCmpWord( input, "TQ2>" ) ) )
-    {
-      if( !( input = bsxReadInt( &item->tq2, string, "</TQ2>" ) ) )
-        return 0;
-#if ITEM_READ_DEBUG
-printf( "  Read TQ2 : %d\n", item->tq2 );
-#endif
-    }
-    else if( ( string = ccStrCmpWord( input, "TP2>" ) ) )
-    {
-      if( !( input = bsxReadFloat( &item->tp2, string, "</TP2>" ) ) )
-        return 0;
-#if ITEM_READ_DEBUG
-printf( "  Read TP2 : %f\n", item->tp2 );
-#endif
-    }
-    else if( ( string = ccStrCmpWord( input, "TQ3>" ) ) )
-    {
-      if( !( input = bsxReadInt( &item->tq3, string, "</TQ3>" ) ) )
-        return 0;
-#if ITEM_READ_DEBUG
-printf( "  Read TQ3 : %d\n", item->tq3 );
-#endif
-    }
-    else if( ( string = ccStrCmpWord( input, "TP3>" ) ) )
-    {
-      if( !( input = bsxReadFloat( &item->tp3, string, "</TP3>" ) ) )
-        return 0;
-#if ITEM_READ_DEBUG
-printf( "  Read TP3 : %f\n", item->tp3 );
-#endif
-    }
-    else if( ( string = ccStrCmpWord( input, "LotID>" ) ) )
-    {
-      if( !( input = bsxReadInt64( &item->lotid, string, "</LotID>" ) ) )
-        return 0;
-#if ITEM_READ_DEBUG
-printf( "  Read LotID : "CC_LLD"\n", (long long)item->lotid );
-#endif
-    }
-    else if( ( string = ccStrCmpWord( input, "OwlID>" ) ) )
-    {
-      if( !( input = bsxReadInt64( &item->boid, string, "</OwlID>" ) ) )
-        return 0;
-#if ITEM_READ_DEBUG
-printf( "  Read OwlID : "CC_LLD"\n", (long long)item->boid );
-#endif
-    }
-    else if( ( string = ccStrCmpWord( input, "OwlLotID>" ) ) )
-    {
-      if( !( input = bsxReadInt64( &item->bolotid, string, "</OwlLotID>" ) ) )
-        return 0;
-#if ITEM_READ_DEBUG
-printf( "  Read OwlLotID : "CC_LLD"\n", (long long)item->bolotid );
-#endif
-    }
-    else if( ( string = ccStrCmpWord( input, "Sale>" ) ) )
-    {
-      if( !( input = bsxReadInt( &item->sale, string, "</Sale>" ) ) )
-        return 0;
-#if ITEM_READ_DEBUG
-printf( "  Read Sale : %d\n", item->sale );
-#endif
-    }
-    else if( ( string = ccStrCmpWord( input, "AlternateID>" ) ) )
-    {
-      if( !( input = bsxReadInt( &item->alternateid, string, "</AlternateID>" ) ) )
-        return 0;
-#if ITEM_READ_DEBUG
-printf( "  Read AlternateID : %d\n", item->alternateid );
-#endif
-    }
-    else
+    return ADDRESS( block, sizeof(bsxStringBlock) );
+  }
+  block = head;
+  if( !( block ) || ( ( block->used + size ) > block->size ) )
+  {
+    block = malloc( sizeof(bsxStringBlock) + BSX_STRING_BLOCK_SIZE );
+    block->next = head;
+    block->used = 0;
+    block->size = BSX_STRING_BLOCK_SIZE;
+    inv->stringblock = block;
+  }
+  string = ADDRESS( block, sizeof(bsxStringBlock) + block->used );
+  block->used += size;
+  inv->stringsize += size;
+  return string;
+}
+
+static void bsxStringFree( bsxInventory *inv )
+{
+  bsxStringBlock *block, *next;
+  for( block = inv->stringblock ; block ; block = next )
+  {
+    next = block->next;
+    free( block );
+  }
+  inv->stringblock = 0;
+  free( inv->stringintern );
+  inv->stringintern = 0;
+  inv->stringsize = 0;
+  return;
+}
+
+
+/* Interned strings, identical text is stored once in the blocks and shared by all items of the inventory */
+#define BSX_INTERN_HASH_BITS (10)
+#define BSX_INTERN_PAGE_BITS (4)
+
+typedef struct
+{
+  char *string;
+  uint32_t hashkey;
+  int length;
+} bsxInternEntry;
+
+static void bsxInternClearEntry( void *entry )
+{
+  bsxInternEntry *internentry;
+  internentry = (bsxInternEntry *)entry;
+  internentry->string = 0;
+  return;
+}
+
+static int bsxInternEntryValid( void *entry )
+{
+  bsxInternEntry *internentry;
+  internentry = (bsxInternEntry *)entry;
+  return ( internentry->string ? 1 : 0 );
+}
+
+static uint32_t bsxInternEntryKey( void *entry )
+{
+  bsxInternEntry *internentry;
+  internentry = (bsxInternEntry *)entry;
+  return internentry->hashkey;
+}
+
+static int bsxInternEntryCmp( void *entry, void *entryref )
+{
+  bsxInternEntry *internentry, *internentryref;
+  internentry = (bsxInternEntry *)entry;
+  if( !( internentry->string ) )
+    return MM_HASH_ENTRYCMP_INVALID;
+  internentryref = (bsxInternEntry *)entryref;
+  if( ( internentry->hashkey == internentryref->hashkey ) && ( internentry->length == internentryref->length ) && !( memcmp( internentry->string, internentryref->string, internentry->length ) ) )
+    return MM_HASH_ENTRYCMP_FOUND;
+  return MM_HASH_ENTRYCMP_SKIP;
+}
+
+static mmHashAccess bsxInternHashAccess =
+{
+  .clearentry = bsxInternClearEntry,
+  .entryvalid = bsxInternEntryValid,
+  .entrykey = bsxInternEntryKey,
+  .entrycmp = bsxInternEntryCmp
+};
+
+/* Returns a string owned by the inventory, NULL for empty strings ; the returned string must not be modified */
+char *bsxInternString( bsxInventory *inv, char *string, int length )
+{
+  int hashbits;
+  void *newtable;
+  bsxInternEntry entry, *found;
+
+  if( length <= 0 )
+    return 0;
+  entry.string = string;
+  entry.hashkey = ccHash32Data( string, length );
+  entry.length = length;
+  if( !( inv->stringintern ) )
+  {
+    inv->stringintern = malloc( mmHashRequiredSize( sizeof(bsxInternEntry), BSX_INTERN_HASH_BITS, BSX_INTERN_PAGE_BITS ) );
+    mmHashInit( inv->stringintern, &bsxInternHashAccess, sizeof(bsxInternEntry), BSX_INTERN_HASH_BITS, BSX_INTERN_PAGE_BITS, 0x0 );
+  }
+  else if( ( found = mmHashDirectFindEntry( inv->stringintern, &bsxInternHashAccess, &entry ) ) )
+    return found->string;
+  entry.string = bsxStringAlloc( inv, length + 1 );
+  memcpy( entry.string, string, length );
+  entry.string[length] = 0;
+  mmHashDirectAddEntry( inv->stringintern, &bsxInternHashAccess, &entry, 0 );
+  if( mmHashGetStatus( inv->stringintern, &hashbits ) == MM_HASH_STATUS_MUSTGROW )
+  {
+    hashbits++;
+    newtable = malloc( mmHashRequiredSize( sizeof(bsxInternEntry), hashbits, BSX_INTERN_PAGE_BITS ) );
+    mmHashResize( newtable, inv->stringintern, &bsxInternHashAccess, hashbits, BSX_INTERN_PAGE_BITS );
+    free( inv->stringintern );
+    inv->stringintern = newtable;
+  }
+  return entry.string;
+}
+
+static void bsxInternItemString( bsxInventory *inv, bsxItem *item, char **string, int allocflag )
+{
+  char *intern;
+  if( !( *string ) )
+    return;
+  intern = bsxInternString( inv, *string, strlen( *string ) );
+  if( item->flags & allocflag )
+    free( *string );
+  *string = intern;
+  item->flags &= ~allocflag;
+  return;
+}
+
+/* Move all strings of an item into the inventory's interned storage, releasing any malloc()'ed copy */
+void bsxInternItem( bsxInventory *inv, bsxItem *item )
+{
+  bsxInternItemString( inv, item, &item->id, BSX_ITEM_FLAGS_ALLOC_ID );
+  bsxInternItemString( inv, item, &item->name, BSX_ITEM_FLAGS_ALLOC_NAME );
+  bsxInternItemString( inv, item, &item->typename, BSX_ITEM_FLAGS_ALLOC_TYPENAME );
+  bsxInternItemString( inv, item, &item->colorname, BSX_ITEM_FLAGS_ALLOC_COLORNAME );
+  bsxInternItemString( inv, item, &item->categoryname, BSX_ITEM_FLAGS_ALLOC_CATEGORYNAME );
+  bsxInternItemString( inv, item, &item->comments, BSX_ITEM_FLAGS_ALLOC_COMMENTS );
+  bsxInternItemString( inv, item, &item->remarks, BSX_ITEM_FLAGS_ALLOC_REMARKS );
+  return;
+}
+
+
+////
+
+
+#define BSX_LOAD_CHUNK_SIZE (1048576)
+
+typedef struct
+{
+  FILE *file;
+  char *buffer;
+  size_t offset;
+  size_t size;
+  size_t alloc;
+  int eofflag;
+} bsxReadStream;
+
+/* Discard input before stream->offset and read the next chunk */
+static int bsxStreamRefill( bsxReadStream *stream )
+{
+  size_t readsize;
+
+  if( stream->eofflag )
+    return 0;
+  if( stream->offset )
+  {
+    memmove( stream->buffer, &stream->buffer[ stream->offset ], stream->size - stream->offset );
+    stream->size -= stream->offset;
+    stream->offset = 0;
+  }
+  if( ( stream->size + BSX_LOAD_CHUNK_SIZE + 1 ) > stream->alloc )
+  {
+    stream->alloc = stream->size + BSX_LOAD_CHUNK_SIZE + 1;
+    stream->buffer = realloc( stream->buffer, stream->alloc );
+  }
+  readsize = fread( &stream->buffer[ stream->size ], 1, BSX_LOAD_CHUNK_SIZE, stream->file );
+  if( readsize < BSX_LOAD_CHUNK_SIZE )
+    stream->eofflag = 1;
+  stream->size += readsize;
+  stream->buffer[ stream->size ] = 0;
+  return ( readsize > 0 );
+}
+
+/* Locate str at or after from, offsets are relative to stream->offset and remain valid across refills */
+static intptr_t bsxStreamFind( bsxReadStream *stream, size_t from, char *str, int length )
+{
+  size_t available;
+  char *base, *seq, *seqend;
+
+  for( ; ; )
+  {
+    /* Only scan once the buffer holds a full match past from */
+    available = stream->size - stream->offset;
+    if( available >= ( from + length ) )
     {
-#if 0
-      printf( "WARNING: Unknown tag %.*s\n", 32, input );
-#endif
-      /* Hack */
-      offset = ccStrFindChar( input, '\n' );
-      if( offset < 0 )
+      base = &stream->buffer[ stream->offset ];
+      seqend = &base[ available - ( length - 1 ) ];
+      for( seq = &base[ from ] ; seq < seqend ; seq++ )
       {
-        printf( "ERROR: Failed to locate line break\n" );
-        return 0;
+        if( !( seq = memchr( seq, str[0], seqend - seq ) ) )
+          break;
+        if( !( memcmp( seq, str, length ) ) )
+          return (intptr_t)ADDRESSDIFF( seq, base );
       }
-      input += offset;
+      from = available - ( length - 1 );
     }
+    if( !( bsxStreamRefill( stream ) ) )
+      return -1;
   }
+}
 
-  if( ( itemflags & 0xf ) != 0xf )
-  {
-    printf( "ERROR: Incomplete item ( code 0x%x )\n", itemflags );
-    return 0;
-  }
 
-  /* Item verification */
-  bsxVerifyItem( item );
 
-  /* DEBUG */
-  /* DEBUG */
-  if( item->condition == 'A' )
-    item->condition = 'U';
-  /* DEBUG */
-  /* DEBUG */
+////
 
-#if ITEM_READ_DEBUG
-  printf( "Item Done\n" );
-#endif
 
-  return input;
+bsxInventory *bsxNewInventory()
+{
+  bsxInventory *inv;
+  inv = malloc( sizeof(bsxInventory) );
+  memset( inv, 0, sizeof(bsxInventory) );
+  return inv;
+}
+
+
+#define BSX_PARSE_DECODE_SIZE (4096)
+
+/* Parse the body of an <Item> element, returns the mask of required tags found or -1 on error */
+static int bsxParseItem( bsxInventory *inv, bsxItem *item, char *input, char *inputend )
+{
+  int taglength, valuelength, itemflags;
+  int64_t readint;
+  float readfloat;
+  char *tag, *value, *valueend, *string;
+  char decode[BSX_PARSE_DECODE_SIZE];
+  void *field;
+  const bsxItemTag *itemtag;
+
+  bsxClearItem( item );
+  itemflags = 0x0;
+  for( ; ; )
+  {
+    if( !( tag = memchr( input, '<', inputend - input ) ) )
+      break;
+    tag++;
+    if( !( value = memchr( tag, '>', inputend - tag ) ) )
+      break;
+    taglength = (int)( value - tag );
+    value++;
+    input = value;
+    if( !( itemtag = bsxItemTagLookup( tag, taglength ) ) )
+    {
+#if 0
+      printf( "WARNING: Unknown tag %.*s\n", taglength, tag );
+#endif
+      continue;
+    }
+    valueend = memchr( value, '<', inputend - value );
+    if( !( valueend ) || ( ( valueend + taglength + 3 ) > inputend ) || ( valueend[1] != '/' ) || ( memcmp( &valueend[2], tag, taglength ) ) || ( valueend[taglength+2] != '>' ) )
+    {
+      printf( "BSX READ ERROR: Failed to locate matching </%.*s>\n", taglength, tag );
+      return -1;
+    }
+    valuelength = (int)( valueend - value );
+    field = ADDRESS( item, itemtag->offset );
+    switch( itemtag->type )
+    {
+      case BSX_TAG_STRING:
+        *(char **)field = bsxInternString( inv, value, valuelength );
+        break;
+      case BSX_TAG_ESCAPEDSTRING:
+        if( valuelength < BSX_PARSE_DECODE_SIZE )
+        {
+          valuelength = xmlDecodeEscapeBuffer( decode, value, valuelength );
+          *(char **)field = bsxInternString( inv, decode, intMin( valuelength, 255 ) );
+          break;
+        }
+        string = bsxStringAlloc( inv, valuelength + 1 );
+        valuelength = xmlDecodeEscapeBuffer( string, value, valuelength );
+        if( valuelength > 255 )
+          string[255] = 0;
+        *(char **)field = ( valuelength > 0 ? string : 0 );
+        break;
+      case BSX_TAG_CHAR:
+        *(char *)field = *value;
+        break;
+      case BSX_TAG_INT:
+      case BSX_TAG_INT64:
+        if( !( xmlStrParseInt( value, &readint ) ) )
+        {
+          printf( "ERROR: Failed to read int : %.*s\n", 32, value );
+          return -1;
+        }
+        if( itemtag->type == BSX_TAG_INT )
+          *(int *)field = (int)readint;
+        else
+          *(int64_t *)field = readint;
+        break;
+      case BSX_TAG_FLOAT:
+        if( !( xmlStrParseFloat( value, &readfloat ) ) )
+        {
+          printf( "ERROR: Failed to read float : %.*s\n", 32, value );
+          return -1;
+        }
+        *(float *)field = readfloat;
+        break;
+    }
+    itemflags |= itemtag->itemflag;
+    input = &valueend[taglength+3];
+  }
+
+  return itemflags;
 }
 
 
@@ -838,75 +1326,109 @@ static char *bsxReadOrder( bsxInventory *inv, char *input )
 }
 
 
+/* Single pass over the file, read in chunks; only the element being parsed needs to be buffered */
 int bsxLoadInventory( bsxInventory *inv, char *path )
 {
-  int sectionlength, offset, successflag;
+  int taglength, itemflags, inventoryflag, successflag;
+  intptr_t tagend, itemend, orderend;
+  char *tag;
   bsxItem *item;
-  char *ordersection, *inventorysection, *string;
+  bsxReadStream stream;
 
   if( inv->xmldata )
     printf( "WARNING: inv->xmldata already defined when bsxLoadInventory() is called\n" );
 
   bsxEmptyInventory( inv );
-  inv->xmldata = ccFileLoad( path, 16*1048576, &inv->xmlsize );
-  if( !( inv->xmldata ) )
+  if( !( bsxItemTagHashReady ) )
+    bsxItemTagHashInit();
+  memset( &stream, 0, sizeof(bsxReadStream) );
+  if( !( stream.file = fopen( path, "rb" ) ) )
     return 0;
 
-  /* Locate sections */
-  ordersection = ccStrFindStrSkip( inv->xmldata, "<Order>" );
-  inventorysection = ccStrFindStrSkip( inv->xmldata, "<Inventory>" );
-
-  /* Cut sections */
-  if( !( ccStrFindStr( ordersection, "</Order>" ) ) )
-    ordersection = 0;
-  if( !( ccStrFindStr( inventorysection, "</Inventory>" ) ) )
-    inventorysection = 0;
-
-  /* Validate */
-  if( !( inventorysection ) )
-  {
-    free( inv->xmldata );
-    inv->xmldata = 0;
-    return 0;
-  }
-
-  /* Reader <Order> section */
-  if( ordersection )
-  {
-    if( bsxReadOrder( inv, ordersection ) )
-      inv->orderblockflag = 1;
-    else
-      printf( "WARNING: Failed to load BSX Order block\n" );
-  }
-
-  /* Reader <Inventory> section */
-  inv->itemcount = 0;
-  inv->itemalloc = 0;
-  inv->itemlist = 0;
-  string = inventorysection;
+  inventoryflag = 0;
   successflag = 0;
   for( ; ; )
   {
-    if( inv->itemcount >= inv->itemalloc )
-    {
-      inv->itemalloc = intMax( 16384, inv->itemalloc << 1 );
-      inv->itemlist = realloc( inv->itemlist, inv->itemalloc * sizeof(bsxItem) );
-    }
-    item = &inv->itemlist[ inv->itemcount ];
-    if( !( string = bsxReadItem( item, string, &successflag ) ) )
+    /* Next tag, position stream at its '<' */
+    if( ( tagend = bsxStreamFind( &stream, 0, "<", 1 ) ) < 0 )
       break;
-    /* Increment inventory */
-    inv->partcount += item->quantity;
-    inv->totalprice += (double)item->quantity * (double)item->price;
-    inv->totalorigprice += (double)item->quantity * (double)item->origprice;
-    inv->itemcount++;
-  }
-
-  return successflag;
-}
-
+    stream.offset += tagend;
+    if( ( tagend = bsxStreamFind( &stream, 1, ">", 1 ) ) < 0 )
+      break;
+    tag = &stream.buffer[ stream.offset + 1 ];
+    taglength = (int)tagend - 1;
 
-static void bsxFreeItem( bsxItem *item, int clearflag )
+    if( !( inventoryflag ) )
+    {
+      if( ( taglength == 9 ) && !( memcmp( tag, "Inventory", 9 ) ) )
+        inventoryflag = 1;
+      else if( ( taglength == 5 ) && !( memcmp( tag, "Order", 5 ) ) )
+      {
+        /* Reader <Order> section */
+        if( ( orderend = bsxStreamFind( &stream, tagend, "</Order>", 8 ) ) >= 0 )
+        {
+          if( bsxReadOrder( inv, &stream.buffer[ stream.offset + tagend + 1 ] ) )
+            inv->orderblockflag = 1;
+          else
+            printf( "WARNING: Failed to load BSX Order block\n" );
+          tagend = orderend + 7;
+        }
+      }
+    }
+    else if( ( taglength == 4 ) && !( memcmp( tag, "Item", 4 ) ) )
+    {
+      if( ( itemend = bsxStreamFind( &stream, tagend, "</Item>", 7 ) ) < 0 )
+      {
+        printf( "ERROR: Failed to locate matching </Item>\n" );
+        break;
+      }
+      if( inv->itemcount >= inv->itemalloc )
+      {
+        inv->itemalloc = intMax( 16384, inv->itemalloc << 1 );
+        inv->itemlist = realloc( inv->itemlist, inv->itemalloc * sizeof(bsxItem) );
+      }
+      item = &inv->itemlist[ inv->itemcount ];
+      itemflags = bsxParseItem( inv, item, &stream.buffer[ stream.offset + tagend + 1 ], &stream.buffer[ stream.offset + itemend ] );
+      if( itemflags < 0 )
+        break;
+      if( ( itemflags & 0xf ) != 0xf )
+      {
+        printf( "ERROR: Incomplete item ( code 0x%x )\n", itemflags );
+        break;
+      }
+
+      /* Item verification */
+      bsxVerifyItem( item );
+
+      /* DEBUG */
+      /* DEBUG */
+      if( item->condition == 'A' )
+        item->condition = 'U';
+      /* DEBUG */
+      /* DEBUG */
+
+      /* Increment inventory */
+      inv->partcount += item->quantity;
+      inv->totalprice += (double)item->quantity * (double)item->price;
+      inv->totalorigprice += (double)item->quantity * (double)item->origprice;
+      inv->itemcount++;
+      tagend = itemend + 6;
+    }
+    else if( ( taglength == 10 ) && !( memcmp( tag, "/Inventory", 10 ) ) )
+    {
+      successflag = 1;
+      break;
+    }
+    stream.offset += tagend + 1;
+  }
+
+  fclose( stream.file );
+  free( stream.buffer );
+  return successflag;
+}
+
+
+static void bsxFreeItem( bsxItem *item, int clearflag )
 {
   if( item->flags & BSX_ITEM_FLAGS_DELETED )
     return;
@@ -953,10 +1475,16 @@ void bsxEmptyInventory( bsxInventory *inv )
   if( inv->order.currency )
     free( inv->order.currency );
 
-  /* Free xmldata */
+  /* Free xmldata and item strings */
   if( inv->xmldata )
     free( inv->xmldata );
   inv->xmldata = 0;
+  bsxStringFree( inv );
+  if( inv->sharesource )
+    mmAtomicDec32( bsxShareCount( inv->sharesource ) );
+
+  /* Free lookup index */
+  bsxIndexFree( inv );
   memset( inv, 0, sizeof(bsxInventory) );
 
   return;
@@ -974,11 +1502,97 @@ void bsxFreeInventory( bsxInventory *inv )
 }
 
 
+/* Copy of the item list sharing the interned strings of the source, only malloc()'ed strings are duplicated */
+/* Item indices and deleted items are preserved, the source must not be emptied or freed while the copy is alive */
+bsxInventory *bsxShareInventory( bsxInventory *inv )
+{
+  int itemindex;
+  bsxItem *item;
+  bsxInventory *dupinv;
+
+  dupinv = bsxNewInventory();
+  dupinv->sharesource = inv;
+  mmAtomicInc32( bsxShareCount( inv ) );
+  dupinv->itemcount = inv->itemcount;
+  dupinv->itemalloc = intMax( 1, inv->itemcount );
+  dupinv->itemfreecount = inv->itemfreecount;
+  dupinv->itemlist = malloc( dupinv->itemalloc * sizeof(bsxItem) );
+  memcpy( dupinv->itemlist, inv->itemlist, inv->itemcount * sizeof(bsxItem) );
+  item = dupinv->itemlist;
+  for( itemindex = 0 ; itemindex < dupinv->itemcount ; itemindex++, item++ )
+  {
+    if( item->flags & BSX_ITEM_FLAGS_DELETED )
+      continue;
+    if( item->flags & BSX_ITEM_FLAGS_ALLOC_ID )
+      item->id = ccStrDup( item->id );
+    if( item->flags & BSX_ITEM_FLAGS_ALLOC_NAME )
+      item->name = ccStrDup( item->name );
+    if( item->flags & BSX_ITEM_FLAGS_ALLOC_TYPENAME )
+      item->typename = ccStrDup( item->typename );
+    if( item->flags & BSX_ITEM_FLAGS_ALLOC_COLORNAME )
+      item->colorname = ccStrDup( item->colorname );
+    if( item->flags & BSX_ITEM_FLAGS_ALLOC_CATEGORYNAME )
+      item->categoryname = ccStrDup( item->categoryname );
+    if( item->flags & BSX_ITEM_FLAGS_ALLOC_COMMENTS )
+      item->comments = ccStrDup( item->comments );
+    if( item->flags & BSX_ITEM_FLAGS_ALLOC_REMARKS )
+      item->remarks = ccStrDup( item->remarks );
+  }
+  dupinv->orderblockflag = inv->orderblockflag;
+  dupinv->order = inv->order;
+  if( inv->order.service )
+    dupinv->order.service = ccStrDup( inv->order.service );
+  if( inv->order.customer )
+    dupinv->order.customer = ccStrDup( inv->order.customer );
+  if( inv->order.currency )
+    dupinv->order.currency = ccStrDup( inv->order.currency );
+  dupinv->partcount = inv->partcount;
+  dupinv->totalprice = inv->totalprice;
+  dupinv->totalorigprice = inv->totalorigprice;
+  return dupinv;
+}
+
+
+/* Copy all live strings into fresh blocks, dropping the strings of removed or changed items */
+static void bsxCompactStrings( bsxInventory *inv )
+{
+  int itemindex;
+  bsxItem *item;
+  bsxStringBlock *block, *next;
+  void *oldintern;
+
+  block = inv->stringblock;
+  oldintern = inv->stringintern;
+  inv->stringblock = 0;
+  inv->stringintern = 0;
+  inv->stringsize = 0;
+  item = inv->itemlist;
+  for( itemindex = 0 ; itemindex < inv->itemcount ; itemindex++, item++ )
+  {
+    if( item->flags & BSX_ITEM_FLAGS_DELETED )
+      continue;
+    bsxInternItem( inv, item );
+  }
+  for( ; block ; block = next )
+  {
+    next = block->next;
+    free( block );
+  }
+  free( oldintern );
+  inv->stringlivesize = inv->stringsize;
+  return;
+}
+
 void bsxPackInventory( bsxInventory *inv )
 {
   int srcindex;
   bsxItem *srcitem, *dstitem;
 
+  /* Compact once at least half of the bytes allocated since the last compaction could be dead */
+  /* Copies from bsxShareInventory() point to our strings, wait until they are all freed */
+  if( ( inv->stringsize >= BSX_STRING_COMPACT_MIN ) && ( inv->stringsize > ( inv->stringlivesize << 1 ) ) && !( mmAtomicRead32( bsxShareCount( inv ) ) ) )
+    bsxCompactStrings( inv );
+
   if( inv->itemfreecount < ( inv->itemcount >> 3 ) )
     return;
   srcitem = inv->itemlist;
@@ -994,6 +1608,9 @@ void bsxPackInventory( bsxInventory *inv )
   inv->itemcount = (int)( dstitem - inv->itemlist );
   inv->itemfreecount = 0;
 
+  /* Item indices have shifted, index will be rebuilt on next lookup */
+  bsxIndexFree( inv );
+
   return;
 }
 
@@ -1031,12 +1648,172 @@ static const char bsxSuffix[] = "\
 </BrickStoreXML>\n";
 
 
+/* Items are formatted in chunks by worker threads, chunks are then written in order */
+#define BSX_SAVE_THREAD_MAX (8)
+#define BSX_SAVE_THREAD_MIN_ITEMS (4096)
+/* Room for the tags and numeric fields of one item, strings are accounted for separately */
+#define BSX_SAVE_ITEM_OVERHEAD (2048)
+
+typedef struct
+{
+  bsxInventory *inv;
+  int itemstart;
+  int itemend;
+  char *data;
+  size_t size;
+  size_t alloc;
+  mtThread thread;
+} bsxSaveChunk;
+
+/* Escape string to dst, which must hold 6 times the string length ; returns the end of written data */
+static char *bsxSaveEscapeString( char *dst, char *string )
+{
+  size_t length;
+  /* Fast path, copy everything up to the first char requiring an escape */
+  length = strcspn( string, "&<>\"'" );
+  memcpy( dst, string, length );
+  dst += length;
+  string += length;
+  if( *string )
+    dst += xmlEncodeEscapeBuffer( dst, string, strlen( string ) );
+  return dst;
+}
+
+static size_t bsxSaveItemSize( bsxItem *item )
+{
+  size_t size;
+  size = BSX_SAVE_ITEM_OVERHEAD;
+  if( item->id )
+    size += strlen( item->id );
+  if( item->name )
+    size += 6 * strlen( item->name );
+  if( item->typename )
+    size += strlen( item->typename );
+  if( item->colorname )
+    size += strlen( item->colorname );
+  if( item->categoryname )
+    size += strlen( item->categoryname );
+  if( item->comments )
+    size += 6 * strlen( item->comments );
+  if( item->remarks )
+    size += 6 * strlen( item->remarks );
+  return size;
+}
+
+/* Format item to dst, which must hold bsxSaveItemSize() bytes ; returns the end of written data */
+static char *bsxSaveFormatItem( char *dst, bsxItem *item )
+{
+  dst += sprintf( dst, "  <Item>\n" );
+  dst += sprintf( dst, "   <ItemID>%s</ItemID>\n", ( item->id ? item->id : "Unknown" ) );
+  if( item->typeid )
+    dst += sprintf( dst, "   <ItemTypeID>%c</ItemTypeID>\n", item->typeid );
+  dst += sprintf( dst, "   <ColorID>%d</ColorID>\n", item->colorid );
+  if( item->name )
+  {
+    dst += sprintf( dst, "   <ItemName>" );
+    dst = bsxSaveEscapeString( dst, item->name );
+    dst += sprintf( dst, "</ItemName>\n" );
+  }
+  if( item->typename )
+    dst += sprintf( dst, "   <ItemTypeName>%s</ItemTypeName>\n", item->typename );
+  if( item->colorname )
+    dst += sprintf( dst, "   <ColorName>%s</ColorName>\n", item->colorname );
+  if( item->categoryid )
+    dst += sprintf( dst, "   <CategoryID>%d</CategoryID>\n", item->categoryid );
+  if( item->categoryname )
+    dst += sprintf( dst, "   <CategoryName>%s</CategoryName>\n", item->categoryname );
+  dst += sprintf( dst, "   <Status>%c</Status>\n", ( item->status ? item->status : 'I' ) );
+  dst += sprintf( dst, "   <Qty>%d</Qty>\n", item->quantity );
+  if( item->price > 0.0001 )
+    dst += sprintf( dst, "   <Price>%.3f</Price>\n", item->price );
+  if( item->saleprice > 0.0001 )
+    dst += sprintf( dst, "   <SalePrice>%.3f</SalePrice>\n", item->saleprice );
+  if( item->bulk >= 2 )
+    dst += sprintf( dst, "   <Bulk>%d</Bulk>\n", item->bulk );
+  if( item->sale > 0 )
+    dst += sprintf( dst, "   <Sale>%d</Sale>\n", item->sale );
+  if( item->alternateid > 0 )
+    dst += sprintf( dst, "   <AlternateID>%d</AlternateID>\n", item->alternateid );
+  dst += sprintf( dst, "   <Condition>%c</Condition>\n", ( item->condition ? item->condition : 'N' ) );
+  if( ( item->condition == 'U' ) && ( item->usedgrade ) )
+    dst += sprintf( dst, "   <UsedGrade>%c</UsedGrade>\n", item->usedgrade );
+  if( ( item->typeid == 'S' ) && ( item->completeness ) )
+    dst += sprintf( dst, "   <Completeness>%c</Completeness>\n", item->completeness );
+  if( item->origprice > 0.0001 )
+    dst += sprintf( dst, "   <OrigPrice>%f</OrigPrice>\n", item->origprice );
+  if( item->comments )
+  {
+    dst += sprintf( dst, "   <Comments>" );
+    dst = bsxSaveEscapeString( dst, item->comments );
+    dst += sprintf( dst, "</Comments>\n" );
+  }
+  if( item->remarks )
+  {
+    dst += sprintf( dst, "   <Remarks>" );
+    dst = bsxSaveEscapeString( dst, item->remarks );
+    dst += sprintf( dst, "</Remarks>\n" );
+  }
+  if( item->origquantity )
+    dst += sprintf( dst, "   <OrigQty>%d</OrigQty>\n", item->origquantity );
+  if( item->mycost > 0.0001 )
+    dst += sprintf( dst, "   <MyCost>%.3f</MyCost>\n", item->mycost );
+  if( item->tq1 )
+  {
+    dst += sprintf( dst, "   <TQ1>%d</TQ1>\n", item->tq1 );
+    dst += sprintf( dst, "   <TP1>%.3f</TP1>\n", item->tp1 );
+  }
+  if( item->tq2 )
+  {
+    dst += sprintf( dst, "   <TQ2>%d</TQ2>\n", item->tq2 );
+    dst += sprintf( dst, "   <TP2>%.3f</TP2>\n", item->tp2 );
+  }
+  if( item->tq3 )
+  {
+    dst += sprintf( dst, "   <TQ3>%d</TQ3>\n", item->tq3 );
+    dst += sprintf( dst, "   <TP3>%.3f</TP3>\n", item->tp3 );
+  }
+  if( item->lotid != -1 )
+    dst += sprintf( dst, "   <LotID>"CC_LLD"</LotID>\n", (long long)item->lotid );
+  if( item->boid != -1 )
+    dst += sprintf( dst, "   <OwlID>"CC_LLD"</OwlID>\n", (long long)item->boid );
+  if( item->bolotid != -1 )
+    dst += sprintf( dst, "   <OwlLotID>"CC_LLD"</OwlLotID>\n", (long long)item->bolotid );
+  dst += sprintf( dst, "  </Item>\n" );
+  return dst;
+}
+
+static void *bsxSaveChunkMain( void *value )
+{
+  int itemindex;
+  size_t itemsize;
+  bsxItem *item;
+  bsxSaveChunk *chunk;
+
+  chunk = value;
+  item = &chunk->inv->itemlist[ chunk->itemstart ];
+  for( itemindex = chunk->itemstart ; itemindex < chunk->itemend ; itemindex++, item++ )
+  {
+    if( item->flags & BSX_ITEM_FLAGS_DELETED )
+      continue;
+    itemsize = bsxSaveItemSize( item );
+    if( ( chunk->size + itemsize ) > chunk->alloc )
+    {
+      chunk->alloc = ( chunk->size + itemsize ) << 1;
+      chunk->data = realloc( chunk->data, chunk->alloc );
+    }
+    chunk->size = (size_t)( bsxSaveFormatItem( &chunk->data[ chunk->size ], item ) - chunk->data );
+  }
+
+  return 0;
+}
+
+
 int bsxSaveInventory( char *path, bsxInventory *inv, int fsyncflag, int sortcolumn )
 {
-  int itemindex, retval;
+  int chunkindex, chunkcount, retval;
   char sortdirection;
-  char *encodedstring;
-  bsxItem *item;
+  bsxSaveChunk *chunk;
+  bsxSaveChunk chunklist[BSX_SAVE_THREAD_MAX];
   FILE *out;
 
   out = fopen( path, "w" );
@@ -1046,6 +1823,23 @@ int bsxSaveInventory( char *path, bsxInventory *inv, int fsyncflag, int sortcolu
     return 0;
   }
 
+  /* Format items on worker threads, the first chunk is ours */
+  chunkcount = 1;
+  if( ( inv->itemcount >= BSX_SAVE_THREAD_MIN_ITEMS ) && ( mmcontext.cpucount > 1 ) )
+    chunkcount = intMin( mmcontext.cpucount, BSX_SAVE_THREAD_MAX );
+  for( chunkindex = 0 ; chunkindex < chunkcount ; chunkindex++ )
+  {
+    chunk = &chunklist[ chunkindex ];
+    chunk->inv = inv;
+    chunk->itemstart = (int)( ( (int64_t)inv->itemcount * chunkindex ) / chunkcount );
+    chunk->itemend = (int)( ( (int64_t)inv->itemcount * ( chunkindex + 1 ) ) / chunkcount );
+    chunk->data = 0;
+    chunk->size = 0;
+    chunk->alloc = 0;
+    if( chunkindex )
+      mtThreadCreate( &chunk->thread, bsxSaveChunkMain, (void *)chunk, MT_THREAD_FLAGS_JOINABLE, 0, 0 );
+  }
+
   errno = 0;
   retval = 1;
   if( fwrite( bsxPrefix, sizeof( bsxPrefix ) - 1, 1, out ) != 1 )
@@ -1073,182 +1867,808 @@ int bsxSaveInventory( char *path, bsxInventory *inv, int fsyncflag, int sortcolu
     fprintf( out, " </Order>\n" );
   }
 
-  fprintf( out, " <Inventory>\n" );
-  for( itemindex = 0 ; itemindex < inv->itemcount ; itemindex++ )
+  fprintf( out, " <Inventory>\n" );
+  bsxSaveChunkMain( &chunklist[0] );
+  for( chunkindex = 0 ; chunkindex < chunkcount ; chunkindex++ )
+  {
+    chunk = &chunklist[ chunkindex ];
+    if( chunkindex )
+      mtThreadJoin( &chunk->thread );
+    if( ( chunk->size ) && ( fwrite( chunk->data, chunk->size, 1, out ) != 1 ) )
+      retval = 0;
+    free( chunk->data );
+  }
+  fprintf( out, " </Inventory>\n" );
+
+  if( sortcolumn == 0 )
+    sortcolumn = 8;
+  sortdirection = 'D';
+  if( sortcolumn < 0 )
+  {
+    sortcolumn = -sortcolumn;
+    sortdirection = 'A';
+  }
+  fprintf( out, bsxSuffix, (int)sortcolumn, (char)sortdirection );
+  if( fflush( out ) != 0 )
+    retval = 0;
+  if( fsyncflag )
+  {
+#if CC_LINUX
+    if( fdatasync( fileno( out ) ) != 0 )
+      retval = 0;
+#elif CC_UNIX
+    if( fsync( fileno( out ) ) != 0 )
+      retval = 0;
+#elif CC_WINDOWS
+    if( !( FlushFileBuffers( (HANDLE)_get_osfhandle( fileno( out ) ) ) ) )
+      retval = 0;
+#endif
+  }
+  if( fclose( out ) != 0 )
+    retval = 0;
+
+  if( errno == ENOSPC )
+    return 0;
+
+  return retval;
+}
+
+
+////
+
+
+/* Binary snapshot : header, fixed-width item records, string heap */
+#define BSX_SNAPSHOT_MAGIC (0x53585342)
+#define BSX_SNAPSHOT_VERSION (1)
+
+typedef struct
+{
+  uint32_t magic;
+  uint32_t version;
+  uint32_t headersize;
+  uint32_t recordsize;
+  uint32_t itemcount;
+  uint32_t heapsize;
+  /* Checksum of records and heap */
+  uint32_t checksum;
+  uint32_t orderblockflag;
+  int64_t orderdate;
+  int32_t orderid;
+  float subtotal;
+  float grandtotal;
+  float payment;
+  uint32_t service;
+  uint32_t customer;
+  uint32_t currency;
+  /* Last log segment included in the snapshot */
+  uint32_t logsequence;
+} bsxSnapshotHeader;
+
+#define BSX_SNAPSHOT_ITEM_DELETED (0x1)
+
+/* String fields are heap offsets, offset zero is a null string */
+typedef struct
+{
+  int64_t lotid;
+  int64_t boid;
+  int64_t bolotid;
+  uint32_t id;
+  uint32_t name;
+  uint32_t typename;
+  uint32_t colorname;
+  uint32_t categoryname;
+  uint32_t comments;
+  uint32_t remarks;
+  int32_t colorid;
+  int32_t categoryid;
+  int32_t quantity;
+  int32_t bulk;
+  int32_t sale;
+  int32_t alternateid;
+  int32_t origquantity;
+  int32_t tq1;
+  int32_t tq2;
+  int32_t tq3;
+  float price;
+  float saleprice;
+  float origprice;
+  float mycost;
+  float tp1;
+  float tp2;
+  float tp3;
+  char typeid;
+  char condition;
+  char usedgrade;
+  char completeness;
+  char status;
+  uint8_t flags;
+  char reserved[2];
+} bsxSnapshotItem;
+
+static inline size_t bsxSnapshotStringSize( char *string )
+{
+  return ( string ? strlen( string ) + 1 : 0 );
+}
+
+static inline size_t bsxSnapshotItemStringSize( bsxItem *item )
+{
+  if( item->flags & BSX_ITEM_FLAGS_DELETED )
+    return 0;
+  return bsxSnapshotStringSize( item->id ) + bsxSnapshotStringSize( item->name ) + bsxSnapshotStringSize( item->typename ) + bsxSnapshotStringSize( item->colorname ) + bsxSnapshotStringSize( item->categoryname ) + bsxSnapshotStringSize( item->comments ) + bsxSnapshotStringSize( item->remarks );
+}
+
+static inline uint32_t bsxSnapshotStoreString( char *heap, size_t *heapsize, char *string )
+{
+  size_t offset, size;
+  if( !( string ) )
+    return 0;
+  offset = *heapsize;
+  size = strlen( string ) + 1;
+  memcpy( &heap[offset], string, size );
+  *heapsize = offset + size;
+  return (uint32_t)offset;
+}
+
+static inline char *bsxSnapshotLoadString( char *heap, uint32_t offset )
+{
+  return ( offset ? &heap[offset] : 0 );
+}
+
+/* Record must be zeroed, heap must have room for bsxSnapshotItemStringSize() bytes at heapsize */
+static void bsxSnapshotPackItem( bsxSnapshotItem *record, bsxItem *item, char *heap, size_t *heapsize )
+{
+  if( item->flags & BSX_ITEM_FLAGS_DELETED )
+  {
+    record->flags = BSX_SNAPSHOT_ITEM_DELETED;
+    return;
+  }
+  record->lotid = item->lotid;
+  record->boid = item->boid;
+  record->bolotid = item->bolotid;
+  record->id = bsxSnapshotStoreString( heap, heapsize, item->id );
+  record->name = bsxSnapshotStoreString( heap, heapsize, item->name );
+  record->typename = bsxSnapshotStoreString( heap, heapsize, item->typename );
+  record->colorname = bsxSnapshotStoreString( heap, heapsize, item->colorname );
+  record->categoryname = bsxSnapshotStoreString( heap, heapsize, item->categoryname );
+  record->comments = bsxSnapshotStoreString( heap, heapsize, item->comments );
+  record->remarks = bsxSnapshotStoreString( heap, heapsize, item->remarks );
+  record->colorid = item->colorid;
+  record->categoryid = item->categoryid;
+  record->quantity = item->quantity;
+  record->bulk = item->bulk;
+  record->sale = item->sale;
+  record->alternateid = item->alternateid;
+  record->origquantity = item->origquantity;
+  record->tq1 = item->tq1;
+  record->tq2 = item->tq2;
+  record->tq3 = item->tq3;
+  record->price = item->price;
+  record->saleprice = item->saleprice;
+  record->origprice = item->origprice;
+  record->mycost = item->mycost;
+  record->tp1 = item->tp1;
+  record->tp2 = item->tp2;
+  record->tp3 = item->tp3;
+  record->typeid = item->typeid;
+  record->condition = item->condition;
+  record->usedgrade = item->usedgrade;
+  record->completeness = item->completeness;
+  record->status = item->status;
+  return;
+}
+
+/* Item strings point into the heap, which must outlive the item */
+static void bsxSnapshotUnpackItem( bsxItem *item, bsxSnapshotItem *record, char *heap )
+{
+  bsxClearItem( item );
+  if( record->flags & BSX_SNAPSHOT_ITEM_DELETED )
+  {
+    item->flags |= BSX_ITEM_FLAGS_DELETED;
+    return;
+  }
+  item->lotid = record->lotid;
+  item->boid = record->boid;
+  item->bolotid = record->bolotid;
+  item->id = bsxSnapshotLoadString( heap, record->id );
+  item->name = bsxSnapshotLoadString( heap, record->name );
+  item->typename = bsxSnapshotLoadString( heap, record->typename );
+  item->colorname = bsxSnapshotLoadString( heap, record->colorname );
+  item->categoryname = bsxSnapshotLoadString( heap, record->categoryname );
+  item->comments = bsxSnapshotLoadString( heap, record->comments );
+  item->remarks = bsxSnapshotLoadString( heap, record->remarks );
+  item->colorid = record->colorid;
+  item->categoryid = record->categoryid;
+  item->quantity = record->quantity;
+  item->bulk = record->bulk;
+  item->sale = record->sale;
+  item->alternateid = record->alternateid;
+  item->origquantity = record->origquantity;
+  item->tq1 = record->tq1;
+  item->tq2 = record->tq2;
+  item->tq3 = record->tq3;
+  item->price = record->price;
+  item->saleprice = record->saleprice;
+  item->origprice = record->origprice;
+  item->mycost = record->mycost;
+  item->tp1 = record->tp1;
+  item->tp2 = record->tp2;
+  item->tp3 = record->tp3;
+  item->typeid = record->typeid;
+  item->condition = record->condition;
+  item->usedgrade = record->usedgrade;
+  item->completeness = record->completeness;
+  item->status = record->status;
+  return;
+}
+
+static int bsxWriteFile( char *path, void *data, size_t datasize, int fsyncflag )
+{
+  int retval;
+  FILE *out;
+
+  out = fopen( path, "wb" );
+  if( !( out ) )
+  {
+    printf( "ERROR: Failed to open %s for writing\n", path );
+    return 0;
+  }
+  errno = 0;
+  retval = 1;
+  if( fwrite( data, datasize, 1, out ) != 1 )
+    retval = 0;
+  if( fflush( out ) != 0 )
+    retval = 0;
+  if( fsyncflag )
+  {
+#if CC_LINUX
+    if( fdatasync( fileno( out ) ) != 0 )
+      retval = 0;
+#elif CC_UNIX
+    if( fsync( fileno( out ) ) != 0 )
+      retval = 0;
+#elif CC_WINDOWS
+    if( !( FlushFileBuffers( (HANDLE)_get_osfhandle( fileno( out ) ) ) ) )
+      retval = 0;
+#endif
+  }
+  if( fclose( out ) != 0 )
+    retval = 0;
+
+  if( errno == ENOSPC )
+    return 0;
+
+  return retval;
+}
+
+/* Returned buffer is allocated with bsxStringAlloc() and owned by the inventory */
+static char *bsxReadFile( bsxInventory *inv, char *path, size_t minsize, size_t *retsize )
+{
+  size_t filesize;
+  char *data;
+  FILE *file;
+
+  if( !( file = fopen( path, "rb" ) ) )
+    return 0;
+  fseek( file, 0, SEEK_END );
+  filesize = (size_t)ftell( file );
+  fseek( file, 0, SEEK_SET );
+  if( ( filesize < minsize ) || ( filesize > 0x7fffffff ) )
+  {
+    fclose( file );
+    printf( "ERROR: Invalid file size for %s\n", path );
+    return 0;
+  }
+  data = bsxStringAlloc( inv, filesize + 1 );
+  if( fread( data, filesize, 1, file ) != 1 )
+  {
+    fclose( file );
+    printf( "ERROR: Failed to read file %s\n", path );
+    return 0;
+  }
+  fclose( file );
+  data[filesize] = 0;
+  *retsize = filesize;
+  return data;
+}
+
+
+int bsxSaveSnapshot( char *path, bsxInventory *inv, bsxLog *log, int fsyncflag )
+{
+  int itemindex, retval;
+  size_t heapsize, datasize;
+  char *data, *heap;
+  bsxItem *item;
+  bsxSnapshotHeader *header;
+  bsxSnapshotItem *record;
+
+  /* Size the string heap, first byte is reserved for null strings */
+  heapsize = 1;
+  heapsize += bsxSnapshotStringSize( inv->order.service );
+  heapsize += bsxSnapshotStringSize( inv->order.customer );
+  heapsize += bsxSnapshotStringSize( inv->order.currency );
+  item = inv->itemlist;
+  for( itemindex = 0 ; itemindex < inv->itemcount ; itemindex++, item++ )
+    heapsize += bsxSnapshotItemStringSize( item );
+  heapsize = ( heapsize + 7 ) & ~(size_t)7;
+  datasize = sizeof(bsxSnapshotHeader) + ( inv->itemcount * sizeof(bsxSnapshotItem) ) + heapsize;
+  if( datasize > 0x7fffffff )
+  {
+    printf( "ERROR: Inventory too large for snapshot %s\n", path );
+    return 0;
+  }
+
+  /* Build the whole file in memory, deleted items are kept so that item indices match the log */
+  data = malloc( datasize );
+  memset( data, 0, datasize );
+  header = (bsxSnapshotHeader *)data;
+  record = ADDRESS( data, sizeof(bsxSnapshotHeader) );
+  heap = ADDRESS( record, inv->itemcount * sizeof(bsxSnapshotItem) );
+  header->magic = BSX_SNAPSHOT_MAGIC;
+  header->version = BSX_SNAPSHOT_VERSION;
+  header->headersize = sizeof(bsxSnapshotHeader);
+  header->recordsize = sizeof(bsxSnapshotItem);
+  header->itemcount = inv->itemcount;
+  header->heapsize = (uint32_t)heapsize;
+  header->orderblockflag = inv->orderblockflag;
+  header->orderdate = inv->order.orderdate;
+  header->orderid = inv->order.orderid;
+  header->subtotal = inv->order.subtotal;
+  header->grandtotal = inv->order.grandtotal;
+  header->payment = inv->order.payment;
+  header->logsequence = ( log ? log->sequence : 0 );
+  heapsize = 1;
+  header->service = bsxSnapshotStoreString( heap, &heapsize, inv->order.service );
+  header->customer = bsxSnapshotStoreString( heap, &heapsize, inv->order.customer );
+  header->currency = bsxSnapshotStoreString( heap, &heapsize, inv->order.currency );
+  item = inv->itemlist;
+  for( itemindex = 0 ; itemindex < inv->itemcount ; itemindex++, item++, record++ )
+    bsxSnapshotPackItem( record, item, heap, &heapsize );
+  header->checksum = ccHash32Data( ADDRESS( data, sizeof(bsxSnapshotHeader) ), (int)( datasize - sizeof(bsxSnapshotHeader) ) );
+
+  retval = bsxWriteFile( path, data, datasize, fsyncflag );
+  if( ( retval ) && ( log ) )
+    bsxLogReset( log, inv, header->logsequence, header->checksum );
+  free( data );
+
+  return retval;
+}
+
+
+/* The file is read in one piece into the inventory string storage, item strings point into its heap */
+int bsxLoadSnapshot( bsxInventory *inv, char *path, bsxLog *log )
+{
+  int itemindex;
+  size_t filesize;
+  char *data, *heap;
+  bsxItem *item;
+  bsxSnapshotHeader *header;
+  bsxSnapshotItem *record;
+
+  bsxEmptyInventory( inv );
+  if( !( data = bsxReadFile( inv, path, sizeof(bsxSnapshotHeader), &filesize ) ) )
+  {
+    bsxEmptyInventory( inv );
+    return 0;
+  }
+
+  /* Validate */
+  header = (bsxSnapshotHeader *)data;
+  if( ( header->magic != BSX_SNAPSHOT_MAGIC ) || ( header->version != BSX_SNAPSHOT_VERSION ) || ( header->headersize != sizeof(bsxSnapshotHeader) ) || ( header->recordsize != sizeof(bsxSnapshotItem) ) )
+  {
+    printf( "ERROR: Snapshot file %s has an unsupported format\n", path );
+    bsxEmptyInventory( inv );
+    return 0;
+  }
+  if( ( header->heapsize < 1 ) || ( header->itemcount > ( ( filesize - sizeof(bsxSnapshotHeader) ) / sizeof(bsxSnapshotItem) ) ) || ( filesize != ( sizeof(bsxSnapshotHeader) + ( (size_t)header->itemcount * sizeof(bsxSnapshotItem) ) + header->heapsize ) ) || ( header->checksum != ccHash32Data( ADDRESS( data, sizeof(bsxSnapshotHeader) ), (int)( filesize - sizeof(bsxSnapshotHeader) ) ) ) )
+  {
+    printf( "ERROR: Snapshot file %s is corrupted\n", path );
+    bsxEmptyInventory( inv );
+    return 0;
+  }
+  record = ADDRESS( data, sizeof(bsxSnapshotHeader) );
+  heap = ADDRESS( record, header->itemcount * sizeof(bsxSnapshotItem) );
+  /* The heap is null-terminated, guards string offsets against a corrupted tail */
+  heap[ header->heapsize - 1 ] = 0;
+
+  inv->orderblockflag = header->orderblockflag;
+  inv->order.orderdate = header->orderdate;
+  inv->order.orderid = header->orderid;
+  inv->order.subtotal = header->subtotal;
+  inv->order.grandtotal = header->grandtotal;
+  inv->order.payment = header->payment;
+  if( header->service )
+    inv->order.service = ccStrDup( bsxSnapshotLoadString( heap, header->service ) );
+  if( header->customer )
+    inv->order.customer = ccStrDup( bsxSnapshotLoadString( heap, header->customer ) );
+  if( header->currency )
+    inv->order.currency = ccStrDup( bsxSnapshotLoadString( heap, header->currency ) );
+
+  inv->itemcount = header->itemcount;
+  inv->itemalloc = intMax( 16384, inv->itemcount );
+  inv->itemlist = malloc( inv->itemalloc * sizeof(bsxItem) );
+  item = inv->itemlist;
+  for( itemindex = 0 ; itemindex < inv->itemcount ; itemindex++, item++, record++ )
+  {
+    bsxSnapshotUnpackItem( item, record, heap );
+    if( item->flags & BSX_ITEM_FLAGS_DELETED )
+    {
+      inv->itemfreecount++;
+      continue;
+    }
+    inv->partcount += item->quantity;
+    inv->totalprice += (double)item->quantity * (double)item->price;
+    inv->totalorigprice += (double)item->quantity * (double)item->origprice;
+  }
+
+  if( log )
+    bsxLogReset( log, inv, header->logsequence, header->checksum );
+
+  return 1;
+}
+
+
+////
+
+
+/* Log segment : header, then a record per changed item, each followed by its own strings */
+#define BSX_LOG_MAGIC (0x4c585342)
+#define BSX_LOG_VERSION (1)
+
+typedef struct
+{
+  uint32_t magic;
+  uint32_t version;
+  uint32_t headersize;
+  uint32_t recordsize;
+  /* Checksum of the snapshot the log applies to */
+  uint32_t basechecksum;
+  uint32_t sequence;
+  uint32_t itemcount;
+  uint32_t changecount;
+  uint32_t datasize;
+  /* Checksum of all change records */
+  uint32_t checksum;
+} bsxLogHeader;
+
+typedef struct
+{
+  int32_t itemindex;
+  /* Size of the change, including record and strings */
+  uint32_t size;
+  bsxSnapshotItem record;
+} bsxLogChange;
+
+#define BSX_LOG_CHANGE_SIZE(stringsize) ((sizeof(bsxLogChange)+(stringsize)+1+7)&~(size_t)7)
+
+static void bsxLogHashItem( bsxLog *log, bsxItem *item, uint32_t *rethash )
+{
+  size_t size, heapsize;
+  bsxSnapshotItem *record;
+
+  size = sizeof(bsxSnapshotItem) + bsxSnapshotItemStringSize( item ) + 1;
+  size = ( size + 3 ) & ~(size_t)3;
+  if( size > log->scratchsize )
+  {
+    log->scratchsize = intMax( 4096, size );
+    log->scratch = realloc( log->scratch, log->scratchsize );
+  }
+  memset( log->scratch, 0, size );
+  record = log->scratch;
+  heapsize = 1;
+  bsxSnapshotPackItem( record, item, ADDRESS( record, sizeof(bsxSnapshotItem) - 1 ), &heapsize );
+  rethash[0] = ccHash32Data( log->scratch, (int)size );
+  rethash[1] = ccHash32Array32( log->scratch, (int)( size >> 2 ) );
+  return;
+}
+
+static void bsxLogResize( bsxLog *log, int itemcount )
+{
+  if( ( itemcount > log->itemalloc ) || !( log->itemhash ) )
+  {
+    log->itemalloc = intMax( 16384, itemcount + ( itemcount >> 2 ) );
+    log->itemhash = realloc( log->itemhash, log->itemalloc * 2 * sizeof(uint32_t) );
+  }
+  log->itemcount = itemcount;
+  return;
+}
+
+void bsxLogReset( bsxLog *log, bsxInventory *inv, uint32_t sequence, uint32_t basechecksum )
+{
+  int itemindex;
+
+  log->sequence = sequence;
+  log->basechecksum = basechecksum;
+  log->segmentcount = 0;
+  log->logsize = 0;
+  bsxLogResize( log, inv->itemcount );
+  for( itemindex = 0 ; itemindex < inv->itemcount ; itemindex++ )
+    bsxLogHashItem( log, &inv->itemlist[itemindex], &log->itemhash[ itemindex << 1 ] );
+  return;
+}
+
+void bsxLogFree( bsxLog *log )
+{
+  free( log->itemhash );
+  free( log->scratch );
+  memset( log, 0, sizeof(bsxLog) );
+  return;
+}
+
+
+int bsxLogWrite( char *path, bsxLog *log, bsxInventory *inv, int maxchanges, int emptyflag, int fsyncflag )
+{
+  int itemindex, changecount, retval;
+  uint32_t hash[2];
+  uint32_t *newhash;
+  size_t datasize, heapsize, changesize;
+  char *data;
+  bsxItem *item;
+  bsxLogHeader *header;
+  bsxLogChange *change;
+
+  /* A log never reset from a snapshot has no base to apply to */
+  if( !( log->itemhash ) )
+    return BSX_LOG_WRITE_OVERFLOW;
+
+  /* Find changed items, items past the logged count are always new */
+  newhash = malloc( intMax( 1, inv->itemcount ) * 2 * sizeof(uint32_t) );
+  changecount = 0;
+  datasize = sizeof(bsxLogHeader);
+  item = inv->itemlist;
+  for( itemindex = 0 ; itemindex < inv->itemcount ; itemindex++, item++ )
+  {
+    bsxLogHashItem( log, item, hash );
+    newhash[ ( itemindex << 1 ) + 0 ] = hash[0];
+    newhash[ ( itemindex << 1 ) + 1 ] = hash[1];
+    if( ( itemindex < log->itemcount ) && ( log->itemhash[ ( itemindex << 1 ) + 0 ] == hash[0] ) && ( log->itemhash[ ( itemindex << 1 ) + 1 ] == hash[1] ) )
+      continue;
+    changecount++;
+    datasize += BSX_LOG_CHANGE_SIZE( bsxSnapshotItemStringSize( item ) );
+  }
+  if( !( changecount ) && ( inv->itemcount == log->itemcount ) && !( emptyflag ) )
+  {
+    free( newhash );
+    return BSX_LOG_WRITE_UNCHANGED;
+  }
+  if( ( changecount > maxchanges ) || ( datasize > 0x7fffffff ) )
+  {
+    free( newhash );
+    return BSX_LOG_WRITE_OVERFLOW;
+  }
+
+  data = malloc( datasize );
+  memset( data, 0, datasize );
+  header = (bsxLogHeader *)data;
+  header->magic = BSX_LOG_MAGIC;
+  header->version = BSX_LOG_VERSION;
+  header->headersize = sizeof(bsxLogHeader);
+  header->recordsize = sizeof(bsxSnapshotItem);
+  header->basechecksum = log->basechecksum;
+  header->sequence = log->sequence + 1;
+  header->itemcount = inv->itemcount;
+  header->changecount = changecount;
+  header->datasize = (uint32_t)datasize;
+  change = ADDRESS( data, sizeof(bsxLogHeader) );
+  item = inv->itemlist;
+  for( itemindex = 0 ; itemindex < inv->itemcount ; itemindex++, item++ )
+  {
+    if( ( itemindex < log->itemcount ) && ( log->itemhash[ ( itemindex << 1 ) + 0 ] == newhash[ ( itemindex << 1 ) + 0 ] ) && ( log->itemhash[ ( itemindex << 1 ) + 1 ] == newhash[ ( itemindex << 1 ) + 1 ] ) )
+      continue;
+    changesize = BSX_LOG_CHANGE_SIZE( bsxSnapshotItemStringSize( item ) );
+    change->itemindex = itemindex;
+    change->size = (uint32_t)changesize;
+    /* String offsets are relative to the byte preceding the strings, offset zero is a null string */
+    heapsize = 1;
+    bsxSnapshotPackItem( &change->record, item, ADDRESS( change, sizeof(bsxLogChange) - 1 ), &heapsize );
+    change = ADDRESS( change, changesize );
+  }
+  header->checksum = ccHash32Data( ADDRESS( data, sizeof(bsxLogHeader) ), (int)( datasize - sizeof(bsxLogHeader) ) );
+
+  retval = BSX_LOG_WRITE_FAILED;
+  if( bsxWriteFile( path, data, datasize, fsyncflag ) )
+  {
+    retval = BSX_LOG_WRITE_DONE;
+    /* The logged state is now the inventory */
+    free( log->itemhash );
+    log->itemhash = newhash;
+    log->itemcount = inv->itemcount;
+    log->itemalloc = intMax( 1, inv->itemcount );
+    log->sequence++;
+    log->segmentcount++;
+    log->logsize += datasize;
+  }
+  else
+    free( newhash );
+  free( data );
+
+  return retval;
+}
+
+
+int bsxLogApply( bsxInventory *inv, char *path, bsxLog *log )
+{
+  int changeindex, itemindex, itemcount;
+  size_t datasize, offset;
+  char *data;
+  bsxItem *item;
+  bsxLogHeader *header;
+  bsxLogChange *change;
+
+  if( !( ccFileExists( path ) ) )
+    return 0;
+  if( !( data = bsxReadFile( inv, path, sizeof(bsxLogHeader), &datasize ) ) )
+    return -1;
+  header = (bsxLogHeader *)data;
+  if( ( header->magic != BSX_LOG_MAGIC ) || ( header->version != BSX_LOG_VERSION ) || ( header->headersize != sizeof(bsxLogHeader) ) || ( header->recordsize != sizeof(bsxSnapshotItem) ) || ( header->datasize != datasize ) )
+  {
+    printf( "ERROR: Log segment %s has an unsupported format\n", path );
+    return -1;
+  }
+  /* Segment left over from before the snapshot was written */
+  if( ( header->basechecksum != log->basechecksum ) || ( header->sequence != log->sequence + 1 ) )
+    return 0;
+  if( header->checksum != ccHash32Data( ADDRESS( data, sizeof(bsxLogHeader) ), (int)( datasize - sizeof(bsxLogHeader) ) ) )
+  {
+    printf( "ERROR: Log segment %s is corrupted\n", path );
+    return -1;
+  }
+
+  /* Validate all changes before touching the inventory */
+  itemcount = (int)header->itemcount;
+  offset = sizeof(bsxLogHeader);
+  for( changeindex = 0 ; changeindex < (int)header->changecount ; changeindex++ )
+  {
+    if( ( offset + sizeof(bsxLogChange) ) > datasize )
+      break;
+    change = ADDRESS( data, offset );
+    if( ( change->itemindex < 0 ) || ( change->itemindex >= itemcount ) || ( change->size < sizeof(bsxLogChange) ) || ( ( offset + change->size ) > datasize ) )
+      break;
+    offset += change->size;
+  }
+  if( changeindex != (int)header->changecount )
+  {
+    printf( "ERROR: Log segment %s is corrupted\n", path );
+    return -1;
+  }
+
+  /* Resize item list, new slots are always part of the changes */
+  for( itemindex = itemcount ; itemindex < inv->itemcount ; itemindex++ )
+    bsxFreeItem( &inv->itemlist[itemindex], 0 );
+  if( itemcount > inv->itemalloc )
+  {
+    inv->itemalloc = intMax( 16384, itemcount );
+    inv->itemlist = realloc( inv->itemlist, inv->itemalloc * sizeof(bsxItem) );
+  }
+  for( itemindex = inv->itemcount ; itemindex < itemcount ; itemindex++ )
+    bsxClearItem( &inv->itemlist[itemindex] );
+  inv->itemcount = itemcount;
+
+  offset = sizeof(bsxLogHeader);
+  for( changeindex = 0 ; changeindex < (int)header->changecount ; changeindex++ )
   {
-    item = &inv->itemlist[itemindex];
-    if( item->flags & BSX_ITEM_FLAGS_DELETED )
-      continue;
-    fprintf( out, "  <Item>\n" );
-    fprintf( out, "   <ItemID>%s</ItemID>\n", ( item->id ? item->id : "Unknown" ) );
-    if( item->typeid )
-      fprintf( out, "   <ItemTypeID>%c</ItemTypeID>\n", item->typeid );
-    fprintf( out, "   <ColorID>%d</ColorID>\n", item->colorid );
-    if( item->name )
-    {
-      encodedstring = xmlEncodeEscapeString( item->name, strlen( item->name ), 0 );
-      fprintf( out, "   <ItemName>%s</ItemName>\n", encodedstring );
-      free( encodedstring );
-    }
-    if( item->typename )
-      fprintf( out, "   <ItemTypeName>%s</ItemTypeName>\n", item->typename );
-    if( item->colorname )
-      fprintf( out, "   <ColorName>%s</ColorName>\n", item->colorname );
-    if( item->categoryid )
-      fprintf( out, "   <CategoryID>%d</CategoryID>\n", item->categoryid );
-    if( item->categoryname )
-      fprintf( out, "   <CategoryName>%s</CategoryName>\n", item->categoryname );
-    fprintf( out, "   <Status>%c</Status>\n", ( item->status ? item->status : 'I' ) );
-    fprintf( out, "   <Qty>%d</Qty>\n", item->quantity );
-    if( item->price > 0.0001 )
-      fprintf( out, "   <Price>%.3f</Price>\n", item->price );
-    if( item->saleprice > 0.0001 )
-      fprintf( out, "   <SalePrice>%.3f</SalePrice>\n", item->saleprice );
-    if( item->bulk >= 2 )
-      fprintf( out, "   <Bulk>%d</Bulk>\n", item->bulk );
-    if( item->sale > 0 )
-      fprintf( out, "   <Sale>%d</Sale>\n", item->sale );
-    if( item->alternateid > 0 )
-      fprintf( out, "   <AlternateID>%d</AlternateID>\n", item->alternateid );
-    fprintf( out, "   <Condition>%c</Condition>\n", ( item->condition ? item->condition : 'N' ) );
-    if( ( item->condition == 'U' ) && ( item->usedgrade ) )
-      fprintf( out, "   <UsedGrade>%c</UsedGrade>\n", item->usedgrade );
-    if( ( item->typeid == 'S' ) && ( item->completeness ) )
-      fprintf( out, "   <Completeness>%c</Completeness>\n", item->completeness );
-    if( item->origprice > 0.0001 )
-      fprintf( out, "   <OrigPrice>%f</OrigPrice>\n", item->origprice );
-    if( item->comments )
-    {
-      encodedstring = xmlEncodeEscapeString( item->comments, strlen( item->comments ), 0 );
-      fprintf( out, "   <Comments>%s</Comments>\n", encodedstring );
-      free( encodedstring );
-    }
-    if( item->remarks )
-    {
-      encodedstring = xmlEncodeEscapeString( item->remarks, strlen( item->remarks ), 0 );
-      fprintf( out, "   <Remarks>%s</Remarks>\n", encodedstring );
-      free( encodedstring );
-    }
-    if( item->origquantity )
-      fprintf( out, "   <OrigQty>%d</OrigQty>\n", item->origquantity );
-    if( item->mycost > 0.0001 )
-      fprintf( out, "   <MyCost>%.3f</MyCost>\n", item->mycost );
-    if( item->tq1 )
-    {
-      fprintf( out, "   <TQ1>%d</TQ1>\n", item->tq1 );
-      fprintf( out, "   <TP1>%.3f</TP1>\n", item->tp1 );
-    }
-    if( item->tq2 )
-    {
-      fprintf( out, "   <TQ2>%d</TQ2>\n", item->tq2 );
-      fprintf( out, "   <TP2>%.3f</TP2>\n", item->tp2 );
-    }
-    if( item->tq3 )
-    {
-      fprintf( out, "   <TQ3>%d</TQ3>\n", item->tq3 );
-      fprintf( out, "   <TP3>%.3f</TP3>\n", item->tp3 );
-    }
-    if( item->lotid != -1 )
-      fprintf( out, "   <LotID>"CC_LLD"</LotID>\n", (long long)item->lotid );
-    if( item->boid != -1 )
-      fprintf( out, "   <OwlID>"CC_LLD"</OwlID>\n", (long long)item->boid );
-    if( item->bolotid != -1 )
-      fprintf( out, "   <OwlLotID>"CC_LLD"</OwlLotID>\n", (long long)item->bolotid );
-    fprintf( out, "  </Item>\n" );
+    change = ADDRESS( data, offset );
+    /* Strings of the change are terminated by the padding */
+    data[ offset + change->size - 1 ] = 0;
+    item = &inv->itemlist[ change->itemindex ];
+    bsxFreeItem( item, 0 );
+    bsxSnapshotUnpackItem( item, &change->record, ADDRESS( change, sizeof(bsxLogChange) - 1 ) );
+    offset += change->size;
   }
-  fprintf( out, " </Inventory>\n" );
 
-  if( sortcolumn == 0 )
-    sortcolumn = 8;
-  sortdirection = 'D';
-  if( sortcolumn < 0 )
+  /* Recount, item contents and positions have changed */
+  inv->itemfreecount = 0;
+  inv->totalorigprice = 0.0;
+  item = inv->itemlist;
+  for( itemindex = 0 ; itemindex < inv->itemcount ; itemindex++, item++ )
   {
-    sortcolumn = -sortcolumn;
-    sortdirection = 'A';
+    if( item->flags & BSX_ITEM_FLAGS_DELETED )
+      inv->itemfreecount++;
+    else
+      inv->totalorigprice += (double)item->quantity * (double)item->origprice;
   }
-  fprintf( out, bsxSuffix, (int)sortcolumn, (char)sortdirection );
-  if( fflush( out ) != 0 )
-    retval = 0;
-  if( fsyncflag )
+  bsxRecomputeTotals( inv );
+  bsxIndexFree( inv );
+
+  /* Follow up with hashes of the new state */
+  bsxLogResize( log, itemcount );
+  offset = sizeof(bsxLogHeader);
+  for( changeindex = 0 ; changeindex < (int)header->changecount ; changeindex++ )
   {
-#if CC_LINUX
-    fdatasync( fileno( out ) );
-#elif CC_UNIX
-    fsync( fileno( out ) );
-#elif CC_WINDOWS
-    FlushFileBuffers( (HANDLE)_get_osfhandle( fileno( out ) ) );
-#endif
+    change = ADDRESS( data, offset );
+    bsxLogHashItem( log, &inv->itemlist[ change->itemindex ], &log->itemhash[ change->itemindex << 1 ] );
+    offset += change->size;
   }
-  if( fclose( out ) != 0 )
-    retval = 0;
+  log->sequence++;
+  log->segmentcount++;
+  log->logsize += datasize;
 
-  if( errno == ENOSPC )
-    return 0;
-
-  return retval;
+  return 1;
 }
 
 
 ////
 
 
+/* Items are sorted as compact keys, two levels of 8 chars prefixes or numbers, ties fall back to the item comparator */
 typedef struct
+{
+  uint64_t key[2];
+  char *string[2];
+  uint32_t index;
+} bsxSortKey;
+
+typedef struct bsxSortContext
 {
   size_t offset;
   int reverseflag;
+  bsxItem *itemlist;
+  int (*itemcmp)( struct bsxSortContext *sortcontext, bsxItem *item0, bsxItem *item1 );
 } bsxSortContext;
 
-static inline int bsxSortCmpString( bsxSortContext *sortcontext, bsxItem *item0, bsxItem *item1 )
+/* Key of the first 8 chars, ordered as the signed chars compared by ccStrCmpStdTest() */
+static inline uint64_t bsxSortStringPrefix( char *string )
 {
   int i;
-  char *s0, *s1;
-  s0 = *(char **)ADDRESS( item0, sortcontext->offset );
-  s1 = *(char **)ADDRESS( item1, sortcontext->offset );
-  if( !( s0 ) )
+  uint64_t key;
+  unsigned char c;
+  if( !( string ) )
+    return 0;
+  key = 0;
+  for( i = 0 ; i < 8 ; i++ )
   {
-    if( !( s1 ) )
-      return sortcontext->reverseflag ^ ( item1 < item0 );
-    return 1;
+    c = (unsigned char)*string;
+    key = ( key << 8 ) | ( c ^ 0x80 );
+    if( c )
+      string++;
   }
-  else if( !( s1 ) )
-    return 0;
-  for( i = 0 ; ; i++ )
+  return key;
+}
+
+/* Key of the leading alphanumeric chars, ordered as ccSeqCmpSeqStdTest() */
+static inline uint64_t bsxSortAlphaNumPrefix( char *string )
+{
+  int i;
+  uint64_t key;
+  key = 0;
+  for( i = 0 ; i < 8 ; i++ )
   {
-    if( s0[i] != s1[i] )
-      break;
+    key <<= 8;
+    if( ( string ) && ( ccIsAlphaNum( *string ) ) )
+      key |= (unsigned char)*string++ ^ 0x80;
+    else
+      string = 0;
   }
-  return sortcontext->reverseflag ^ ( s1[i] < s0[i] );
+  return key;
 }
 
-static inline int bsxSortCmpInteger( bsxSortContext *sortcontext, bsxItem *item0, bsxItem *item1 )
+static inline uint32_t bsxSortFloatKey( float f )
 {
-  int *i0, *i1;
-  i0 = ADDRESS( item0, sortcontext->offset );
-  i1 = ADDRESS( item1, sortcontext->offset );
-  return sortcontext->reverseflag ^ ( *i1 < *i0 );
+  union
+  {
+    float f;
+    uint32_t u;
+  } value;
+  value.f = f;
+  return ( value.u & 0x80000000 ? ~value.u : value.u | 0x80000000 );
 }
 
-static inline int bsxSortCmpInt64( bsxSortContext *sortcontext, bsxItem *item0, bsxItem *item1 )
+/* Interned strings are often the same pointer */
+static inline int bsxSortCmpStr( char *s0, char *s1 )
 {
-  int64_t *i0, *i1;
-  i0 = ADDRESS( item0, sortcontext->offset );
-  i1 = ADDRESS( item1, sortcontext->offset );
-  return sortcontext->reverseflag ^ ( *i1 < *i0 );
+  return ( s0 != s1 ? ccStrCmpStdTest( s0, s1 ) : 0 );
 }
 
-static inline int bsxSortCmpFloat( bsxSortContext *sortcontext, bsxItem *item0, bsxItem *item1 )
+/* Items with equal keys keep their order */
+static int bsxSortCmpIndex( bsxSortContext *sortcontext, bsxItem *item0, bsxItem *item1 )
 {
-  float *f0, *f1;
-  f0 = ADDRESS( item0, sortcontext->offset );
-  f1 = ADDRESS( item1, sortcontext->offset );
-  return sortcontext->reverseflag ^ ( *f1 < *f0 );
+  return ( item1 < item0 );
 }
 
 static int bsxSortCmpIdColorConditionRemarksCommentsQuantity( bsxSortContext *sortcontext, bsxItem *item0, bsxItem *item1 )
 {
   int cmpvalue;
 
-  cmpvalue = ccStrCmpStdTest( item0->id, item1->id );
+  cmpvalue = bsxSortCmpStr( item0->id, item1->id );
   if( cmpvalue < 0 )
     return 0;
   else if( cmpvalue > 0 )
@@ -1264,13 +2684,13 @@ static int bsxSortCmpIdColorConditionRemarksCommentsQuantity( bsxSortContext *so
   if( item0->condition > item1->condition )
     return 1;
 
-  cmpvalue = ccStrCmpStdTest( item0->remarks, item1->remarks );
+  cmpvalue = bsxSortCmpStr( item0->remarks, item1->remarks );
   if( cmpvalue < 0 )
     return 0;
   else if( cmpvalue > 0 )
     return 1;
 
-  cmpvalue = ccStrCmpStdTest( item0->comments, item1->comments );
+  cmpvalue = bsxSortCmpStr( item0->comments, item1->comments );
   if( cmpvalue < 0 )
     return 0;
   else if( cmpvalue > 0 )
@@ -1283,13 +2703,13 @@ static int bsxSortCmpColornameNameCondition( bsxSortContext *sortcontext, bsxIte
 {
   int cmpvalue;
 
-  cmpvalue = ccStrCmpStdTest( item0->colorname, item1->colorname );
+  cmpvalue = bsxSortCmpStr( item0->colorname, item1->colorname );
   if( cmpvalue < 0 )
     return 0;
   else if( cmpvalue > 0 )
     return 1;
 
-  cmpvalue = ccStrCmpStdTest( item0->name, item1->name );
+  cmpvalue = bsxSortCmpStr( item0->name, item1->name );
   if( cmpvalue < 0 )
     return 0;
   else if( cmpvalue > 0 )
@@ -1298,52 +2718,6 @@ static int bsxSortCmpColornameNameCondition( bsxSortContext *sortcontext, bsxIte
   return ( item0->condition > item1->condition );
 }
 
-static int bsxSortCmpUpdatePriority( bsxSortContext *sortcontext, bsxItem *item0, bsxItem *item1 )
-{
-  int value0, value1;
-  int createflag, deleteflag, updateflag;
-
-  value0 = item0->flags & BSX_ITEM_XFLAGS_TO_CREATE;
-  value1 = item1->flags & BSX_ITEM_XFLAGS_TO_CREATE;
-  if( value0 != value1 )
-    return ( value0 < value1 ? 0 : 1 );
-  createflag = value0 | value1;
-
-  value0 = item0->flags & BSX_ITEM_XFLAGS_TO_DELETE;
-  value1 = item1->flags & BSX_ITEM_XFLAGS_TO_DELETE;
-  if( value0 != value1 )
-    return ( value0 < value1 ? 0 : 1 );
-  deleteflag = value0 | value1;
-  updateflag = 1 ^ ( createflag | deleteflag );
-
-  if( updateflag )
-  {
-    value0 = 0;
-    value1 = 0;
-    if( item0->flags & BSX_ITEM_XFLAGS_UPDATE_REMARKS )
-      value0 += 0x8;
-    if( item0->flags & BSX_ITEM_XFLAGS_UPDATE_QUANTITY )
-      value0 += 0x4;
-    if( item0->flags & BSX_ITEM_XFLAGS_UPDATE_PRICE )
-      value0 += 0x2;
-    if( item0->flags & BSX_ITEM_XFLAGS_UPDATE_COMMENTS )
-      value0 += 0x1;
-    if( item1->flags & BSX_ITEM_XFLAGS_UPDATE_REMARKS )
-      value1 += 0x8;
-    if( item1->flags & BSX_ITEM_XFLAGS_UPDATE_QUANTITY )
-      value1 += 0x4;
-    if( item1->flags & BSX_ITEM_XFLAGS_UPDATE_PRICE )
-      value1 += 0x2;
-    if( item1->flags & BSX_ITEM_XFLAGS_UPDATE_COMMENTS )
-      value1 += 0x1;
-    if( value0 != value1 )
-      return ( value0 < value1 ? 0 : 1 );
-  }
-
-  /* Sort by price difference magnitude */
-  return ( fabsf( item0->price * (float)item0->quantity ) > fabsf( item1->price * (float)item1->quantity ) ? 0 : 1 );
-}
-
 static int bsxSortCmpCheckListOrder( bsxSortContext *sortcontext, bsxItem *item0, bsxItem *item1 )
 {
   int cmpvalue, s0len, s1len;
@@ -1361,13 +2735,13 @@ static int bsxSortCmpCheckListOrder( bsxSortContext *sortcontext, bsxItem *item0
   else if( cmpvalue > 0 )
     return 1;
 
-  cmpvalue = ccStrCmpStdTest( item0->colorname, item1->colorname );
+  cmpvalue = bsxSortCmpStr( item0->colorname, item1->colorname );
   if( cmpvalue < 0 )
     return 0;
   else if( cmpvalue > 0 )
     return 1;
 
-  cmpvalue = ccStrCmpStdTest( item0->name, item1->name );
+  cmpvalue = bsxSortCmpStr( item0->name, item1->name );
   if( cmpvalue < 0 )
     return 0;
   else if( cmpvalue > 0 )
@@ -1377,79 +2751,35 @@ static int bsxSortCmpCheckListOrder( bsxSortContext *sortcontext, bsxItem *item0
 }
 
 
-#define HSORT_MAIN bsxSortString
-#define HSORT_CMP bsxSortCmpString
-#define HSORT_TYPE bsxItem
-#define HSORT_CONTEXT bsxSortContext *
-#include "cchybridsort.h"
-#undef HSORT_MAIN
-#undef HSORT_CMP
-#undef HSORT_TYPE
-#undef HSORT_CONTEXT
-
-#define HSORT_MAIN bsxSortInteger
-#define HSORT_CMP bsxSortCmpInteger
-#define HSORT_TYPE bsxItem
-#define HSORT_CONTEXT bsxSortContext *
-#include "cchybridsort.h"
-#undef HSORT_MAIN
-#undef HSORT_CMP
-#undef HSORT_TYPE
-#undef HSORT_CONTEXT
-
-#define HSORT_MAIN bsxSortInt64
-#define HSORT_CMP bsxSortCmpInt64
-#define HSORT_TYPE bsxItem
-#define HSORT_CONTEXT bsxSortContext *
-#include "cchybridsort.h"
-#undef HSORT_MAIN
-#undef HSORT_CMP
-#undef HSORT_TYPE
-#undef HSORT_CONTEXT
-
-#define HSORT_MAIN bsxSortFloat
-#define HSORT_CMP bsxSortCmpFloat
-#define HSORT_TYPE bsxItem
-#define HSORT_CONTEXT bsxSortContext *
-#include "cchybridsort.h"
-#undef HSORT_MAIN
-#undef HSORT_CMP
-#undef HSORT_TYPE
-#undef HSORT_CONTEXT
-
-#define HSORT_MAIN bsxSortIdColorConditionRemarksCommentsQuantity
-#define HSORT_CMP bsxSortCmpIdColorConditionRemarksCommentsQuantity
-#define HSORT_TYPE bsxItem
-#define HSORT_CONTEXT bsxSortContext *
-#include "cchybridsort.h"
-#undef HSORT_MAIN
-#undef HSORT_CMP
-#undef HSORT_TYPE
-#undef HSORT_CONTEXT
-
-#define HSORT_MAIN bsxSortColornameNameCondition
-#define HSORT_CMP bsxSortCmpColornameNameCondition
-#define HSORT_TYPE bsxItem
-#define HSORT_CONTEXT bsxSortContext *
-#include "cchybridsort.h"
-#undef HSORT_MAIN
-#undef HSORT_CMP
-#undef HSORT_TYPE
-#undef HSORT_CONTEXT
-
-#define HSORT_MAIN bsxSortUpdatePriority
-#define HSORT_CMP bsxSortCmpUpdatePriority
-#define HSORT_TYPE bsxItem
-#define HSORT_CONTEXT bsxSortContext *
-#include "cchybridsort.h"
-#undef HSORT_MAIN
-#undef HSORT_CMP
-#undef HSORT_TYPE
-#undef HSORT_CONTEXT
+static inline int bsxSortCmpKey( bsxSortContext *sortcontext, bsxSortKey *key0, bsxSortKey *key1 )
+{
+  int level, cmpvalue;
+  char *s0, *s1;
+  for( level = 0 ; level < 2 ; level++ )
+  {
+    if( key0->key[level] != key1->key[level] )
+      return sortcontext->reverseflag ^ ( key1->key[level] < key0->key[level] );
+    s0 = key0->string[level];
+    s1 = key1->string[level];
+    if( s0 == s1 )
+      continue;
+    /* A null string shares its zero key with a string of 8 chars 0x80 */
+    if( !( s0 ) || !( s1 ) )
+      break;
+    /* Same first 8 chars, compare the rest unless the strings were shorter */
+    if( ( key0->key[level] & 0xff ) != 0x80 )
+    {
+      cmpvalue = ccStrCmpStdTest( &s0[8], &s1[8] );
+      if( cmpvalue )
+        return sortcontext->reverseflag ^ ( cmpvalue > 0 );
+    }
+  }
+  return sortcontext->itemcmp( sortcontext, &sortcontext->itemlist[ key0->index ], &sortcontext->itemlist[ key1->index ] );
+}
 
-#define HSORT_MAIN bsxSortCheckListOrder
-#define HSORT_CMP bsxSortCmpCheckListOrder
-#define HSORT_TYPE bsxItem
+#define HSORT_MAIN bsxSortKeyList
+#define HSORT_CMP bsxSortCmpKey
+#define HSORT_TYPE bsxSortKey
 #define HSORT_CONTEXT bsxSortContext *
 #include "cchybridsort.h"
 #undef HSORT_MAIN
@@ -1457,89 +2787,243 @@ static int bsxSortCmpCheckListOrder( bsxSortContext *sortcontext, bsxItem *item0
 #undef HSORT_TYPE
 #undef HSORT_CONTEXT
 
+#define BSX_SORT_RADIX_BITS (11)
+
+static inline int bsxSortKeyRadix( bsxSortKey *sortkey, int bitindex )
+{
+  return (int)( sortkey->key[0] >> bitindex ) & ( ( 1 << BSX_SORT_RADIX_BITS ) - 1 );
+}
+
+#define RSORT_MAIN bsxSortRadix
+#define RSORT_RADIX bsxSortKeyRadix
+#define RSORT_TYPE bsxSortKey
+#define RSORT_RADIXBITS BSX_SORT_RADIX_BITS
+#define RSORT_BIGGEST_FIRST (0)
+#define RSORT_TESTFULLBIN (1)
+#include "ccradixsort.h"
+#undef RSORT_MAIN
+#undef RSORT_RADIX
+#undef RSORT_TYPE
+#undef RSORT_RADIXBITS
+#undef RSORT_BIGGEST_FIRST
+#undef RSORT_TESTFULLBIN
+
+
+enum
+{
+  BSX_SORT_KEY_STRING,
+  BSX_SORT_KEY_INTEGER,
+  BSX_SORT_KEY_INT64,
+  BSX_SORT_KEY_FLOAT,
+  BSX_SORT_KEY_UPDATE_PRIORITY,
+  BSX_SORT_KEY_ID_COLOR_CONDITION,
+  BSX_SORT_KEY_COLORNAME_NAME,
+  BSX_SORT_KEY_CHECK_LIST
+};
+
+static uint64_t bsxSortUpdatePriorityKey( bsxItem *item )
+{
+  uint64_t key;
+  key = 0;
+  if( item->flags & BSX_ITEM_XFLAGS_TO_CREATE )
+    key |= 0x20;
+  if( item->flags & BSX_ITEM_XFLAGS_TO_DELETE )
+    key |= 0x10;
+  if( item->flags & BSX_ITEM_XFLAGS_UPDATE_REMARKS )
+    key |= 0x8;
+  if( item->flags & BSX_ITEM_XFLAGS_UPDATE_QUANTITY )
+    key |= 0x4;
+  if( item->flags & BSX_ITEM_XFLAGS_UPDATE_PRICE )
+    key |= 0x2;
+  if( item->flags & BSX_ITEM_XFLAGS_UPDATE_COMMENTS )
+    key |= 0x1;
+  /* Largest price difference magnitude first */
+  return ( key << 32 ) | (uint32_t)~bsxSortFloatKey( fabsf( item->price * (float)item->quantity ) );
+}
 
 int bsxSortInventory( bsxInventory *inv, int sortfield, int reverseflag )
 {
-  int retvalue;
-  bsxItem *tmp;
+  int itemindex, keytype, keycount, nullcount, bitcount;
+  uint64_t keymask;
+  char *string;
+  bsxItem *item, *itemlist;
+  bsxSortKey *keylist, *tmp, *sortkey, *sortlist;
   bsxSortContext sortcontext;
 
   if( inv->itemcount <= 1 )
     return 1;
 
-  retvalue = 1;
-  tmp = malloc( inv->itemcount * sizeof(bsxItem) );
+  sortcontext.offset = 0;
   sortcontext.reverseflag = reverseflag;
+  sortcontext.itemlist = inv->itemlist;
+  sortcontext.itemcmp = bsxSortCmpIndex;
+  bitcount = 0;
   switch( sortfield )
   {
     case BSX_SORT_ID:
       sortcontext.offset = offsetof(bsxItem,id);
-      bsxSortString( inv->itemlist, tmp, inv->itemcount, &sortcontext, (uint32_t)(((uintptr_t)inv)>>8) );
+      keytype = BSX_SORT_KEY_STRING;
       break;
     case BSX_SORT_NAME:
       sortcontext.offset = offsetof(bsxItem,name);
-      bsxSortString( inv->itemlist, tmp, inv->itemcount, &sortcontext, (uint32_t)(((uintptr_t)inv)>>8) );
+      keytype = BSX_SORT_KEY_STRING;
       break;
     case BSX_SORT_TYPENAME:
       sortcontext.offset = offsetof(bsxItem,typename);
-      bsxSortString( inv->itemlist, tmp, inv->itemcount, &sortcontext, (uint32_t)(((uintptr_t)inv)>>8) );
+      keytype = BSX_SORT_KEY_STRING;
       break;
     case BSX_SORT_COLORNAME:
       sortcontext.offset = offsetof(bsxItem,colorname);
-      bsxSortString( inv->itemlist, tmp, inv->itemcount, &sortcontext, (uint32_t)(((uintptr_t)inv)>>8) );
+      keytype = BSX_SORT_KEY_STRING;
       break;
     case BSX_SORT_CATEGORYNAME:
       sortcontext.offset = offsetof(bsxItem,categoryname);
-      bsxSortString( inv->itemlist, tmp, inv->itemcount, &sortcontext, (uint32_t)(((uintptr_t)inv)>>8) );
+      keytype = BSX_SORT_KEY_STRING;
       break;
     case BSX_SORT_COLORID:
       sortcontext.offset = offsetof(bsxItem,colorid);
-      bsxSortInteger( inv->itemlist, tmp, inv->itemcount, &sortcontext, (uint32_t)(((uintptr_t)inv)>>8) );
+      keytype = BSX_SORT_KEY_INTEGER;
+      bitcount = 32;
       break;
     case BSX_SORT_QUANTITY:
       sortcontext.offset = offsetof(bsxItem,quantity);
-      bsxSortInteger( inv->itemlist, tmp, inv->itemcount, &sortcontext, (uint32_t)(((uintptr_t)inv)>>8) );
+      keytype = BSX_SORT_KEY_INTEGER;
+      bitcount = 32;
       break;
     case BSX_SORT_PRICE:
       sortcontext.offset = offsetof(bsxItem,price);
-      bsxSortFloat( inv->itemlist, tmp, inv->itemcount, &sortcontext, (uint32_t)(((uintptr_t)inv)>>8) );
+      keytype = BSX_SORT_KEY_FLOAT;
+      bitcount = 32;
       break;
     case BSX_SORT_ORIGPRICE:
       sortcontext.offset = offsetof(bsxItem,origprice);
-      bsxSortFloat( inv->itemlist, tmp, inv->itemcount, &sortcontext, (uint32_t)(((uintptr_t)inv)>>8) );
+      keytype = BSX_SORT_KEY_FLOAT;
+      bitcount = 32;
       break;
     case BSX_SORT_COMMENTS:
       sortcontext.offset = offsetof(bsxItem,comments);
-      bsxSortString( inv->itemlist, tmp, inv->itemcount, &sortcontext, (uint32_t)(((uintptr_t)inv)>>8) );
+      keytype = BSX_SORT_KEY_STRING;
       break;
     case BSX_SORT_REMARKS:
       sortcontext.offset = offsetof(bsxItem,remarks);
-      bsxSortString( inv->itemlist, tmp, inv->itemcount, &sortcontext, (uint32_t)(((uintptr_t)inv)>>8) );
+      keytype = BSX_SORT_KEY_STRING;
       break;
     case BSX_SORT_LOTID:
       sortcontext.offset = offsetof(bsxItem,lotid);
-      bsxSortInt64( inv->itemlist, tmp, inv->itemcount, &sortcontext, (uint32_t)(((uintptr_t)inv)>>8) );
+      keytype = BSX_SORT_KEY_INT64;
+      bitcount = 64;
       break;
     case BSX_SORT_ID_COLOR_CONDITION_REMARKS_COMMENTS_QUANTITY:
-      bsxSortIdColorConditionRemarksCommentsQuantity( inv->itemlist, tmp, inv->itemcount, 0, (uint32_t)(((uintptr_t)inv)>>8) );
+      sortcontext.reverseflag = 0;
+      sortcontext.itemcmp = bsxSortCmpIdColorConditionRemarksCommentsQuantity;
+      keytype = BSX_SORT_KEY_ID_COLOR_CONDITION;
       break;
     case BSX_SORT_COLORNAME_NAME_CONDITION:
-      bsxSortColornameNameCondition( inv->itemlist, tmp, inv->itemcount, 0, (uint32_t)(((uintptr_t)inv)>>8) );
+      sortcontext.reverseflag = 0;
+      sortcontext.itemcmp = bsxSortCmpColornameNameCondition;
+      keytype = BSX_SORT_KEY_COLORNAME_NAME;
       break;
     case BSX_SORT_UPDATE_PRIORITY:
-      bsxSortUpdatePriority( inv->itemlist, tmp, inv->itemcount, 0, (uint32_t)(((uintptr_t)inv)>>8) );
+      sortcontext.reverseflag = 0;
+      keytype = BSX_SORT_KEY_UPDATE_PRIORITY;
+      bitcount = 38;
       break;
     case BSX_SORT_CHECK_LIST_ORDER:
-      bsxSortCheckListOrder( inv->itemlist, tmp, inv->itemcount, 0, (uint32_t)(((uintptr_t)inv)>>8) );
+      sortcontext.reverseflag = 0;
+      sortcontext.itemcmp = bsxSortCmpCheckListOrder;
+      keytype = BSX_SORT_KEY_CHECK_LIST;
       break;
     default:
-      retvalue = 0;
-      break;
+      return 0;
   }
 
-  free( tmp );
+  /* Item indices are about to change, index will be rebuilt on next lookup */
+  bsxIndexFree( inv );
+
+  /* Build the key list, items without a string for a single string column always go last */
+  keylist = malloc( 2 * inv->itemcount * sizeof(bsxSortKey) );
+  tmp = &keylist[ inv->itemcount ];
+  keycount = 0;
+  nullcount = 0;
+  keymask = 0;
+  if( sortcontext.reverseflag )
+    keymask = ( bitcount < 64 ? ( (uint64_t)1 << bitcount ) - 1 : ~(uint64_t)0 );
+  item = inv->itemlist;
+  for( itemindex = 0 ; itemindex < inv->itemcount ; itemindex++, item++ )
+  {
+    sortkey = &keylist[ keycount ];
+    sortkey->key[1] = 0;
+    sortkey->string[0] = 0;
+    sortkey->string[1] = 0;
+    switch( keytype )
+    {
+      case BSX_SORT_KEY_STRING:
+        if( !( string = *(char **)ADDRESS( item, sortcontext.offset ) ) )
+        {
+          tmp[ nullcount++ ].index = itemindex;
+          continue;
+        }
+        /* Single column, the second level holds the next 8 chars */
+        sortkey->key[0] = bsxSortStringPrefix( string );
+        if( ( sortkey->key[0] & 0xff ) != 0x80 )
+        {
+          sortkey->key[1] = bsxSortStringPrefix( &string[8] );
+          sortkey->string[1] = &string[8];
+        }
+        break;
+      case BSX_SORT_KEY_INTEGER:
+        sortkey->key[0] = ( (uint32_t)*(int *)ADDRESS( item, sortcontext.offset ) ^ 0x80000000 ) ^ keymask;
+        break;
+      case BSX_SORT_KEY_INT64:
+        sortkey->key[0] = ( (uint64_t)*(int64_t *)ADDRESS( item, sortcontext.offset ) ^ 0x8000000000000000ULL ) ^ keymask;
+        break;
+      case BSX_SORT_KEY_FLOAT:
+        sortkey->key[0] = bsxSortFloatKey( *(float *)ADDRESS( item, sortcontext.offset ) ) ^ keymask;
+        break;
+      case BSX_SORT_KEY_UPDATE_PRIORITY:
+        sortkey->key[0] = bsxSortUpdatePriorityKey( item );
+        break;
+      case BSX_SORT_KEY_ID_COLOR_CONDITION:
+        sortkey->key[0] = bsxSortStringPrefix( item->id );
+        sortkey->string[0] = item->id;
+        sortkey->key[1] = ( (uint64_t)( (uint32_t)item->colorid ^ 0x80000000 ) << 8 ) | ( (unsigned char)item->condition ^ 0x80 );
+        break;
+      case BSX_SORT_KEY_COLORNAME_NAME:
+        sortkey->key[0] = bsxSortStringPrefix( item->colorname );
+        sortkey->string[0] = item->colorname;
+        sortkey->key[1] = bsxSortStringPrefix( item->name );
+        sortkey->string[1] = item->name;
+        break;
+      case BSX_SORT_KEY_CHECK_LIST:
+        /* Only the leading alphanumeric chars of remarks are compared, leave the rest to the item comparator */
+        sortkey->key[0] = bsxSortAlphaNumPrefix( item->remarks );
+        break;
+    }
+    sortkey->index = itemindex;
+    keycount++;
+  }
+
+  if( bitcount )
+    sortlist = bsxSortRadix( keylist, tmp, keycount, bitcount );
+  else
+  {
+    /* Items without a string keep their relative order, reversed along with the sort */
+    for( itemindex = 0 ; itemindex < nullcount ; itemindex++ )
+      keylist[ keycount + itemindex ] = tmp[ sortcontext.reverseflag ? nullcount - 1 - itemindex : itemindex ];
+    bsxSortKeyList( keylist, tmp, keycount, &sortcontext, (uint32_t)(((uintptr_t)inv)>>8) );
+    sortlist = keylist;
+  }
+
+  /* Permute the items once */
+  itemlist = malloc( inv->itemalloc * sizeof(bsxItem) );
+  for( itemindex = 0 ; itemindex < inv->itemcount ; itemindex++ )
+    itemlist[ itemindex ] = inv->itemlist[ sortlist[ itemindex ].index ];
+  free( inv->itemlist );
+  inv->itemlist = itemlist;
+
+  free( keylist );
 
-  return retvalue;
+  return 1;
 }
 
 
@@ -1566,8 +3050,27 @@ bsxItem *bsxFindMatchItem( bsxInventory *inv, bsxItem *matchitem )
 {
   int itemindex;
   bsxItem *item;
+  bsxIndex *index;
+  bsxIndexSearch search;
+
+  if( !( matchitem->id ) )
+    return 0;
+  if( ( index = bsxIndexAcquire( inv ) ) )
+  {
+    search.indextype = BSX_INDEX_MATCH;
+    search.checkflags = BSX_INDEX_CHECK_TYPEID;
+    search.hashkey = bsxIndexHashMatch( matchitem->id, matchitem->colorid, matchitem->condition );
+    search.id = matchitem->id;
+    search.typeid = matchitem->typeid;
+    search.colorid = matchitem->colorid;
+    search.condition = matchitem->condition;
+    item = bsxIndexFind( inv, index, &search );
+#if BSX_INDEX_DEBUG
+    item = bsxIndexDebugVerify( inv, &search, item );
+#endif
+    return item;
+  }
 
-  /* TODO: We really need a hash based search! */
   item = inv->itemlist;
   for( itemindex = 0 ; itemindex < inv->itemcount ; itemindex++, item++ )
   {
@@ -1593,7 +3096,12 @@ int bsxFindMatchItemIndex( bsxInventory *inv, bsxItem *matchitem )
   int itemindex;
   bsxItem *item;
 
-  /* TODO: We really need a hash based search! */
+  if( ( matchitem->id ) && ( bsxIndexAcquire( inv ) ) )
+  {
+    item = bsxFindMatchItem( inv, matchitem );
+    return ( item ? (int)bsxGetItemListIndex( inv, item ) : -1 );
+  }
+
   item = inv->itemlist;
   for( itemindex = 0 ; itemindex < inv->itemcount ; itemindex++, item++ )
   {
@@ -1618,8 +3126,27 @@ bsxItem *bsxFindItem( bsxInventory *inv, char typeid, char *id, int colorid, cha
 {
   int itemindex;
   bsxItem *item;
+  bsxIndex *index;
+  bsxIndexSearch search;
+
+  if( !( id ) )
+    return 0;
+  if( ( index = bsxIndexAcquire( inv ) ) )
+  {
+    search.indextype = BSX_INDEX_MATCH;
+    search.checkflags = BSX_INDEX_CHECK_TYPEID;
+    search.hashkey = bsxIndexHashMatch( id, colorid, condition );
+    search.id = id;
+    search.typeid = typeid;
+    search.colorid = colorid;
+    search.condition = condition;
+    item = bsxIndexFind( inv, index, &search );
+#if BSX_INDEX_DEBUG
+    item = bsxIndexDebugVerify( inv, &search, item );
+#endif
+    return item;
+  }
 
-  /* TODO: We really need a hash based search! */
   item = inv->itemlist;
   for( itemindex = 0 ; itemindex < inv->itemcount ; itemindex++, item++ )
   {
@@ -1644,8 +3171,26 @@ bsxItem *bsxFindItemNoType( bsxInventory *inv, char *id, int colorid, char condi
 {
   int itemindex;
   bsxItem *item;
+  bsxIndex *index;
+  bsxIndexSearch search;
+
+  if( !( id ) )
+    return 0;
+  if( ( index = bsxIndexAcquire( inv ) ) )
+  {
+    search.indextype = BSX_INDEX_MATCH;
+    search.checkflags = 0x0;
+    search.hashkey = bsxIndexHashMatch( id, colorid, condition );
+    search.id = id;
+    search.colorid = colorid;
+    search.condition = condition;
+    item = bsxIndexFind( inv, index, &search );
+#if BSX_INDEX_DEBUG
+    item = bsxIndexDebugVerify( inv, &search, item );
+#endif
+    return item;
+  }
 
-  /* TODO: We really need a hash based search! */
   item = inv->itemlist;
   for( itemindex = 0 ; itemindex < inv->itemcount ; itemindex++, item++ )
   {
@@ -1668,8 +3213,26 @@ bsxItem *bsxFindItemBOID( bsxInventory *inv, int64_t boid, int colorid, char con
 {
   int itemindex;
   bsxItem *item;
+  bsxIndex *index;
+  bsxIndexSearch search;
+
+  if( boid == -1 )
+    return 0;
+  if( ( index = bsxIndexAcquire( inv ) ) )
+  {
+    search.indextype = BSX_INDEX_BOID;
+    search.checkflags = 0x0;
+    search.hashkey = bsxIndexHashBoid( boid, colorid, condition );
+    search.boid = boid;
+    search.colorid = colorid;
+    search.condition = condition;
+    item = bsxIndexFind( inv, index, &search );
+#if BSX_INDEX_DEBUG
+    item = bsxIndexDebugVerify( inv, &search, item );
+#endif
+    return item;
+  }
 
-  /* TODO: We really need a hash based search! */
   item = inv->itemlist;
   for( itemindex = 0 ; itemindex < inv->itemcount ; itemindex++, item++ )
   {
@@ -1692,10 +3255,24 @@ bsxItem *bsxFindLotID( bsxInventory *inv, int64_t lotid )
 {
   int itemindex;
   bsxItem *item;
+  bsxIndex *index;
+  bsxIndexSearch search;
 
-  /* TODO: We really need a hash based search! */
   if( lotid == -1 )
     return 0;
+  if( ( index = bsxIndexAcquire( inv ) ) )
+  {
+    search.indextype = BSX_INDEX_LOTID;
+    search.checkflags = 0x0;
+    search.hashkey = bsxIndexHashInt64( lotid );
+    search.value = lotid;
+    item = bsxIndexFind( inv, index, &search );
+#if BSX_INDEX_DEBUG
+    item = bsxIndexDebugVerify( inv, &search, item );
+#endif
+    return item;
+  }
+
   item = inv->itemlist;
   for( itemindex = 0 ; itemindex < inv->itemcount ; itemindex++, item++ )
   {
@@ -1714,10 +3291,27 @@ bsxItem *bsxFindBoidColorConditionLotID( bsxInventory *inv, int64_t boid, int co
 {
   int itemindex;
   bsxItem *item;
+  bsxIndex *index;
+  bsxIndexSearch search;
 
-  /* TODO: We really need a hash based search! */
   if( lotid == -1 )
     return 0;
+  if( ( index = bsxIndexAcquire( inv ) ) )
+  {
+    search.indextype = BSX_INDEX_LOTID;
+    search.checkflags = BSX_INDEX_CHECK_BOIDCOLORCONDITION;
+    search.hashkey = bsxIndexHashInt64( lotid );
+    search.value = lotid;
+    search.boid = boid;
+    search.colorid = colorid;
+    search.condition = condition;
+    item = bsxIndexFind( inv, index, &search );
+#if BSX_INDEX_DEBUG
+    item = bsxIndexDebugVerify( inv, &search, item );
+#endif
+    return item;
+  }
+
   item = inv->itemlist;
   for( itemindex = 0 ; itemindex < inv->itemcount ; itemindex++, item++ )
   {
@@ -1742,10 +3336,24 @@ bsxItem *bsxFindOwlLotID( bsxInventory *inv, int64_t bolotid )
 {
   int itemindex;
   bsxItem *item;
+  bsxIndex *index;
+  bsxIndexSearch search;
 
-  /* TODO: We really need a hash based search! */
   if( bolotid == -1 )
     return 0;
+  if( ( index = bsxIndexAcquire( inv ) ) )
+  {
+    search.indextype = BSX_INDEX_OWLLOTID;
+    search.checkflags = 0x0;
+    search.hashkey = bsxIndexHashInt64( bolotid );
+    search.value = bolotid;
+    item = bsxIndexFind( inv, index, &search );
+#if BSX_INDEX_DEBUG
+    item = bsxIndexDebugVerify( inv, &search, item );
+#endif
+    return item;
+  }
+
   item = inv->itemlist;
   for( itemindex = 0 ; itemindex < inv->itemcount ; itemindex++, item++ )
   {
@@ -1764,10 +3372,24 @@ bsxItem *bsxFindExtID( bsxInventory *inv, int64_t extid )
 {
   int itemindex;
   bsxItem *item;
+  bsxIndex *index;
+  bsxIndexSearch search;
 
-  /* TODO: We really need a hash based search! */
   if( extid == -1 )
     return 0;
+  if( ( index = bsxIndexAcquire( inv ) ) )
+  {
+    search.indextype = BSX_INDEX_EXTID;
+    search.checkflags = 0x0;
+    search.hashkey = bsxIndexHashInt64( extid );
+    search.value = extid;
+    item = bsxIndexFind( inv, index, &search );
+#if BSX_INDEX_DEBUG
+    item = bsxIndexDebugVerify( inv, &search, item );
+#endif
+    return item;
+  }
+
   item = inv->itemlist;
   for( itemindex = 0 ; itemindex < inv->itemcount ; itemindex++, item++ )
   {
@@ -1842,8 +3464,8 @@ int bsxSubInventory( bsxInventory *dstinv, bsxInventory *srcinv )
 }
 
 
-/* Returns a difference inventory as ( dstinv - srcinv ) */
-bsxInventory *bsxDiffInventory( bsxInventory *dstinv, bsxInventory *srcinv )
+/* Join srcinv against dstinv through dstinv's index, then add all dstinv items left unmatched */
+static bsxInventory *bsxDiffInventoryJoin( bsxInventory *dstinv, bsxInventory *srcinv, int lotidonlyflag )
 {
   int srcindex, dstindex, partcount;
   size_t bitindex;
@@ -1860,10 +3482,12 @@ bsxInventory *bsxDiffInventory( bsxInventory *dstinv, bsxInventory *srcinv )
   {
     if( srcitem->flags & BSX_ITEM_FLAGS_DELETED )
       continue;
+    if( ( lotidonlyflag ) && ( srcitem->lotid == -1 ) )
+      continue;
     dstitem = 0;
     if( srcitem->lotid != -1 )
       dstitem = bsxFindLotID( dstinv, srcitem->lotid );
-    if( !( dstitem ) )
+    if( !( dstitem ) && !( lotidonlyflag ) )
       dstitem = bsxFindMatchItem( dstinv, srcitem );
     if( !( dstitem ) )
     {
@@ -1906,63 +3530,16 @@ bsxInventory *bsxDiffInventory( bsxInventory *dstinv, bsxInventory *srcinv )
 
 
 /* Returns a difference inventory as ( dstinv - srcinv ) */
-bsxInventory *bsxDiffInventoryByLotID( bsxInventory *dstinv, bsxInventory *srcinv )
+bsxInventory *bsxDiffInventory( bsxInventory *dstinv, bsxInventory *srcinv )
 {
-  int srcindex, dstindex, partcount;
-  size_t bitindex;
-  bsxInventory *diffinv;
-  bsxItem *srcitem, *dstitem, *diffitem;
-  mmBitMap stockmap;
-
-  if( !( mmBitMapInit( &stockmap, dstinv->itemcount, 0 ) ) )
-    return 0;
-  diffinv = bsxNewInventory();
-  partcount = 0;
-  srcitem = srcinv->itemlist;
-  for( srcindex = 0 ; srcindex < srcinv->itemcount ; srcindex++, srcitem++ )
-  {
-    if( srcitem->flags & BSX_ITEM_FLAGS_DELETED )
-      continue;
-    if( srcitem->lotid == -1 )
-      continue;
-    dstitem = bsxFindLotID( dstinv, srcitem->lotid );
-    if( !( dstitem ) )
-    {
-      diffitem = bsxAddCopyItem( diffinv, srcitem );
-      diffitem->quantity = -diffitem->quantity;
-      partcount += diffitem->quantity;
-    }
-    else
-    {
-      dstindex = bsxGetItemListIndex( dstinv, dstitem );
-      mmBitMapDirectSet( &stockmap, dstindex );
-      if( srcitem->quantity != dstitem->quantity )
-      {
-        diffitem = bsxAddCopyItem( diffinv, srcitem );
-        diffitem->quantity = dstitem->quantity - srcitem->quantity;
-        partcount += diffitem->quantity;
-      }
-    }
-  }
-  for( dstindex = 0 ; ; )
-  {
-    if( !( mmBitMapFindClear( &stockmap, dstindex, dstinv->itemcount - 1, &bitindex ) ) )
-      break;
-    dstindex = (int)bitindex;
-    mmBitMapDirectSet( &stockmap, dstindex );
-    dstitem = &dstinv->itemlist[ dstindex ];
-    if( dstitem->flags & BSX_ITEM_FLAGS_DELETED )
-      continue;
-    diffitem = bsxAddCopyItem( diffinv, dstitem );
-    partcount += diffitem->quantity;
-  }
-  mmBitMapFree( &stockmap );
+  return bsxDiffInventoryJoin( dstinv, srcinv, 0 );
+}
 
-  diffinv->partcount = partcount;
-  diffinv->totalprice = 0.0;
-  diffinv->totalorigprice = 0.0;
 
-  return diffinv;
+/* Returns a difference inventory as ( dstinv - srcinv ) */
+bsxInventory *bsxDiffInventoryByLotID( bsxInventory *dstinv, bsxInventory *srcinv )
+{
+  return bsxDiffInventoryJoin( dstinv, srcinv, 1 );
 }
 
 
@@ -2114,7 +3691,7 @@ int bsxImportLotIDs( bsxInventory *dstinv, bsxInventory *srcinv )
       continue;
     if( dstitem->lotid != -1 )
       continue;
-    dstitem->lotid = srcitem->lotid;
+    bsxSetItemLotID( dstinv, dstitem, srcitem->lotid );
     count++;
   }
 
@@ -2145,7 +3722,7 @@ int bsxImportOwlLotIDs( bsxInventory *dstinv, bsxInventory *srcinv )
       continue;
     if( dstitem->bolotid != -1 )
       continue;
-    dstitem->bolotid = srcitem->bolotid;
+    bsxSetItemOwlLotID( dstinv, dstitem, srcitem->bolotid );
     count++;
   }
 
@@ -2171,16 +3748,6 @@ bsxItem *bsxNewItem( bsxInventory *inv )
   return item;
 }
 
-static void bsxAddItemCopyString( bsxItem *item, char **dst, char *src, int allocflag )
-{
-  int len;
-  len = strlen( src ) + 1;
-  *dst = malloc( len );
-  memcpy( *dst, src, len );
-  item->flags |= allocflag;
-  return;
-}
-
 bsxItem *bsxAddItem( bsxInventory *inv, bsxItem *itemref )
 {
   bsxItem *item;
@@ -2192,20 +3759,7 @@ bsxItem *bsxAddItem( bsxInventory *inv, bsxItem *itemref )
   item = &inv->itemlist[ inv->itemcount ];
   memcpy( item, itemref, sizeof(bsxItem) );
   item->flags = 0x0;
-  if( itemref->flags & BSX_ITEM_FLAGS_ALLOC_ID )
-    bsxAddItemCopyString( item, &item->id, itemref->id, BSX_ITEM_FLAGS_ALLOC_ID );
-  if( itemref->flags & BSX_ITEM_FLAGS_ALLOC_NAME )
-    bsxAddItemCopyString( item, &item->name, itemref->name, BSX_ITEM_FLAGS_ALLOC_NAME );
-  if( itemref->flags & BSX_ITEM_FLAGS_ALLOC_TYPENAME )
-    bsxAddItemCopyString( item, &item->typename, itemref->typename, BSX_ITEM_FLAGS_ALLOC_TYPENAME );
-  if( itemref->flags & BSX_ITEM_FLAGS_ALLOC_COLORNAME )
-    bsxAddItemCopyString( item, &item->colorname, itemref->colorname, BSX_ITEM_FLAGS_ALLOC_COLORNAME );
-  if( itemref->flags & BSX_ITEM_FLAGS_ALLOC_CATEGORYNAME )
-    bsxAddItemCopyString( item, &item->categoryname, itemref->categoryname, BSX_ITEM_FLAGS_ALLOC_CATEGORYNAME );
-  if( itemref->flags & BSX_ITEM_FLAGS_ALLOC_COMMENTS )
-    bsxAddItemCopyString( item, &item->comments, itemref->comments, BSX_ITEM_FLAGS_ALLOC_COMMENTS );
-  if( itemref->flags & BSX_ITEM_FLAGS_ALLOC_REMARKS )
-    bsxAddItemCopyString( item, &item->remarks, itemref->remarks, BSX_ITEM_FLAGS_ALLOC_REMARKS );
+  bsxInternItem( inv, item );
   inv->itemcount++;
   inv->partcount += item->quantity;
   inv->totalprice += (double)item->quantity * (double)item->price;
@@ -2224,20 +3778,7 @@ bsxItem *bsxAddCopyItem( bsxInventory *inv, bsxItem *itemref )
   item = &inv->itemlist[ inv->itemcount ];
   memcpy( item, itemref, sizeof(bsxItem) );
   item->flags = 0x0;
-  if( itemref->id )
-    bsxAddItemCopyString( item, &item->id, itemref->id, BSX_ITEM_FLAGS_ALLOC_ID );
-  if( itemref->name )
-    bsxAddItemCopyString( item, &item->name, itemref->name, BSX_ITEM_FLAGS_ALLOC_NAME );
-  if( itemref->typename )
-    bsxAddItemCopyString( item, &item->typename, itemref->typename, BSX_ITEM_FLAGS_ALLOC_TYPENAME );
-  if( itemref->colorname )
-    bsxAddItemCopyString( item, &item->colorname, itemref->colorname, BSX_ITEM_FLAGS_ALLOC_COLORNAME );
-  if( itemref->categoryname )
-    bsxAddItemCopyString( item, &item->categoryname, itemref->categoryname, BSX_ITEM_FLAGS_ALLOC_CATEGORYNAME );
-  if( itemref->comments )
-    bsxAddItemCopyString( item, &item->comments, itemref->comments, BSX_ITEM_FLAGS_ALLOC_COMMENTS );
-  if( itemref->remarks )
-    bsxAddItemCopyString( item, &item->remarks, itemref->remarks, BSX_ITEM_FLAGS_ALLOC_REMARKS );
+  bsxInternItem( inv, item );
   inv->itemcount++;
   inv->partcount += item->quantity;
   inv->totalprice += (double)item->quantity * (double)item->price;
@@ -2248,6 +3789,13 @@ bsxItem *bsxAddCopyItem( bsxInventory *inv, bsxItem *itemref )
 
 void bsxRemoveItem( bsxInventory *inv, bsxItem *item )
 {
+  int itemindex;
+  if( inv->index )
+  {
+    itemindex = (int)bsxGetItemListIndex( inv, item );
+    if( itemindex < ((bsxIndex *)inv->index)->indexcount )
+      bsxIndexRemoveItem( inv->index, itemindex );
+  }
   inv->partcount -= item->quantity;
   inv->totalprice -= (double)item->quantity * (double)item->price;
   inv->totalorigprice -= (double)item->quantity * (double)item->origprice;
@@ -2347,6 +3895,34 @@ void bsxSetItemQuantity( bsxInventory *inv, bsxItem *item, int quantity )
   return;
 }
 
+void bsxSetItemLotID( bsxInventory *inv, bsxItem *item, int64_t lotid )
+{
+  item->lotid = lotid;
+  bsxReindexItem( inv, item );
+  return;
+}
+
+void bsxSetItemOwlLotID( bsxInventory *inv, bsxItem *item, int64_t bolotid )
+{
+  item->bolotid = bolotid;
+  bsxReindexItem( inv, item );
+  return;
+}
+
+void bsxSetItemExtID( bsxInventory *inv, bsxItem *item, int64_t extid )
+{
+  item->extid = extid;
+  bsxReindexItem( inv, item );
+  return;
+}
+
+void bsxSetItemBOID( bsxInventory *inv, bsxItem *item, int64_t boid )
+{
+  item->boid = boid;
+  bsxReindexItem( inv, item );
+  return;
+}
+
 
 size_t bsxGetItemListIndex( bsxInventory *inv, bsxItem *item )
 {
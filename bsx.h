@@ -170,6 +170,20 @@ typedef struct
   int partcount;
   double totalprice;
   double totalorigprice;
+
+  /* Hash index for bsxFind*(), built on first lookup of a large inventory */
+  void *index;
+
+  /* Storage for item strings owned by the inventory, see bsxInternString() */
+  void *stringblock;
+  void *stringintern;
+  /* Bytes allocated from stringblock, and the live bytes found by the last compaction */
+  size_t stringsize;
+  size_t stringlivesize;
+
+  /* Source of a bsxShareInventory() copy ; count of live copies, strings aren't compacted while non-zero */
+  void *sharesource;
+  int32_t sharecount;
 } bsxInventory;
 
 
@@ -181,8 +195,10 @@ int bsxLoadInventory( bsxInventory *inv, char *path );
 int bsxSaveInventory( char *path, bsxInventory *inv, int fsyncflag, int sortcolumn );
 void bsxEmptyInventory( bsxInventory *inv );
 void bsxFreeInventory( bsxInventory *inv );
+/* Copy sharing the source's interned strings, the source must outlive the copy */
+bsxInventory *bsxShareInventory( bsxInventory *inv );
 
-/* If many items were deleted from inventory, repack the list */
+/* If many items were deleted from inventory, repack the list ; compact item strings if many are dead */
 void bsxPackInventory( bsxInventory *inv );
 
 /* Clamp negative quantities to zero */
@@ -192,6 +208,50 @@ void bsxClampNegativeInventory( bsxInventory *inv );
 ////
 
 
+/* Log of item changes since the last snapshot, as numbered segment files */
+typedef struct
+{
+  /* Last segment written or applied */
+  uint32_t sequence;
+  /* Checksum of the snapshot segments apply to */
+  uint32_t basechecksum;
+  /* Segments and bytes logged since the snapshot */
+  int segmentcount;
+  size_t logsize;
+  /* Two hashes per item of the logged inventory state */
+  int itemcount;
+  int itemalloc;
+  uint32_t *itemhash;
+  void *scratch;
+  size_t scratchsize;
+} bsxLog;
+
+/* Binary snapshot with fixed-width records and a string heap, much faster than BSX */
+/* If log is non-null, the snapshot records the log sequence and the log is reset to the snapshot state */
+int bsxLoadSnapshot( bsxInventory *inv, char *path, bsxLog *log );
+int bsxSaveSnapshot( char *path, bsxInventory *inv, bsxLog *log, int fsyncflag );
+
+void bsxLogReset( bsxLog *log, bsxInventory *inv, uint32_t sequence, uint32_t basechecksum );
+void bsxLogFree( bsxLog *log );
+enum
+{
+  BSX_LOG_WRITE_FAILED,
+  BSX_LOG_WRITE_DONE,
+  /* Nothing changed, no segment written */
+  BSX_LOG_WRITE_UNCHANGED,
+  /* More than maxchanges items changed, no segment written, save a snapshot instead */
+  BSX_LOG_WRITE_OVERFLOW
+};
+
+/* Write items changed since the logged state as the next segment, with emptyflag an unchanged state still writes an empty segment */
+int bsxLogWrite( char *path, bsxLog *log, bsxInventory *inv, int maxchanges, int emptyflag, int fsyncflag );
+/* Apply the next segment; returns 1 if applied, 0 if missing or stale, -1 if corrupted */
+int bsxLogApply( bsxInventory *inv, char *path, bsxLog *log );
+
+
+////
+
+
 enum
 {
   BSX_SORT_ID,
@@ -290,6 +350,10 @@ bsxItem *bsxAddItem( bsxInventory *inv, bsxItem *itemref );
 bsxItem *bsxAddCopyItem( bsxInventory *inv, bsxItem *itemref );
 void bsxRemoveItem( bsxInventory *inv, bsxItem *item );
 
+/* Strings interned in the inventory are stored once, shared by items and released with the inventory */
+char *bsxInternString( bsxInventory *inv, char *string, int length );
+void bsxInternItem( bsxInventory *inv, bsxItem *item );
+
 void bsxSetItemId( bsxItem *item, char *id, int len );
 void bsxSetItemName( bsxItem *item, char *name, int len );
 void bsxSetItemTypeName( bsxItem *item, char *typename, int len );
@@ -299,6 +363,15 @@ void bsxSetItemRemarks( bsxItem *item, char *remarks, int len );
 
 void bsxSetItemQuantity( bsxInventory *inv, bsxItem *item, int quantity );
 
+/* Items already in an inventory must change their LotID, OwlLotID and ExtID through these */
+void bsxSetItemLotID( bsxInventory *inv, bsxItem *item, int64_t lotid );
+void bsxSetItemOwlLotID( bsxInventory *inv, bsxItem *item, int64_t bolotid );
+void bsxSetItemExtID( bsxInventory *inv, bsxItem *item, int64_t extid );
+void bsxSetItemBOID( bsxInventory *inv, bsxItem *item, int64_t boid );
+
+/* Update the index after changing the ID, BOID, colorID or condition of an item in inventory */
+void bsxReindexItem( bsxInventory *inv, bsxItem *item );
+
 size_t bsxGetItemListIndex( bsxInventory *inv, bsxItem *item );
 
 void bsxVerifyItem( bsxItem *item );
@@ -39,15 +39,20 @@
 #include "cryptsha1.h"
 
 
-/* For mkdir() */
+/* For mkdir(), mmap(), utime() and ftruncate() */
 #if CC_UNIX
  #include <sys/types.h>
  #include <sys/stat.h>
+ #include <sys/mman.h>
  #include <unistd.h>
+ #include <fcntl.h>
+ #include <utime.h>
 #elif CC_WINDOWS
  #include <windows.h>
  #include <sys/types.h>
  #include <sys/stat.h>
+ #include <sys/utime.h>
+ #include <io.h>
 #else
  #error Unknown/Unsupported platform!
 #endif
@@ -142,6 +147,7 @@ int bsxReadPriceGuide( bsxPriceGuide *pg, char *path, char itemcondition )
 {
   int donemask, retvalue;
   int lineoffset;
+  int64_t modtime;
   char *pgfile, *string;
   size_t pgsize;
 #if CC_UNIX
@@ -156,6 +162,16 @@ int bsxReadPriceGuide( bsxPriceGuide *pg, char *path, char itemcondition )
   int pgi0, pgi1;
   float pgf0, pgf1, pgf2, pgf3;
 
+  /* Stat before reading, a file replaced meanwhile is never reported older than its content */
+  modtime = 0;
+#if CC_UNIX
+  if( !( stat( path, &statbuf ) ) )
+    modtime = (int64_t)statbuf.st_mtime;
+#elif CC_WINDOWS
+  if( !( _stat( path, &statbuf ) ) )
+    modtime = (int64_t)statbuf.st_mtime;
+#endif
+
   pgfile = ccFileLoad( path, 1048576, &pgsize );
   if( !( pgfile ) )
   {
@@ -223,22 +239,18 @@ printf( "  PG Read : %c %c %d %d\n", pgc0, pgc1, pgi0, pgi1 );
   printf( "Pg Read : %d ( 0x%x )\n", retvalue, donemask );
 #endif
 
-#if CC_UNIX
-  if( !( stat( path, &statbuf ) ) )
-    pg->modtime = (int64_t)statbuf.st_mtime;
-#elif CC_WINDOWS
-  if( !( _stat( path, &statbuf ) ) )
-    pg->modtime = (int64_t)statbuf.st_mtime;
-#endif
-
+  pg->modtime = modtime;
   free( pgfile );
   return retvalue;
 }
 
 
+/* Written to a temporary file then renamed, concurrent readers see either the old or the new file */
 int bsxWritePriceGuide( bsxPriceGuide *pgnew, bsxPriceGuide *pgused, char *path, char itemtypeid, char *itemid, int itemcolorid )
 {
+  int retval;
   char timebuf[256];
+  char *temppath;
   time_t curtime;
   FILE *pgfile;
 
@@ -247,12 +259,14 @@ printf( "Writing Price Guide for : %c %s %d\n", itemtypeid, itemid, itemcolorid
 #endif
 
   /* Open price guide cache file */
-  pgfile = fopen( path, "w" );
+  temppath = ccStrAllocPrintf( "%s.tmp", path );
+  pgfile = fopen( temppath, "w" );
   if( !( pgfile ) )
   {
 #if PRICE_GUIDE_DEBUG
     printf( "ERROR: We failed to write price guide at \"%s\"\n", path );
 #endif
+    free( temppath );
     return 0;
   }
 
@@ -267,12 +281,1155 @@ printf( "Writing Price Guide for : %c %s %d\n", itemtypeid, itemid, itemcolorid
   fprintf( pgfile, "P\tU\t%d\t%d\t%.3f\t%.3f\t%.3f\t%.3f\n", pgused->saleqty, pgused->salecount, pgused->saleminimum, pgused->saleaverage, pgused->saleqtyaverage, pgused->salemaximum );
   fprintf( pgfile, "C\tN\t%d\t%d\t%.3f\t%.3f\t%.3f\t%.3f\n", pgnew->stockqty, pgnew->stockcount, pgnew->stockminimum, pgnew->stockaverage, pgnew->stockqtyaverage, pgnew->stockmaximum );
   fprintf( pgfile, "C\tU\t%d\t%d\t%.3f\t%.3f\t%.3f\t%.3f\n", pgused->stockqty, pgused->stockcount, pgused->stockminimum, pgused->stockaverage, pgused->stockqtyaverage, pgused->stockmaximum );
-  fclose( pgfile );
+  retval = 1;
+  if( ferror( pgfile ) )
+    retval = 0;
+  if( fclose( pgfile ) != 0 )
+    retval = 0;
+  if( ( retval ) && !( ccRenameFile( temppath, path ) ) )
+    retval = 0;
+  if( !( retval ) )
+    remove( temppath );
+  free( temppath );
+
+  return retval;
+}
+
+
+////
+
+
+/* Price guide database */
+
+#define BSX_PGDB_MAGIC (0x42445047)
+#define BSX_PGDB_VERSION (1)
+#define BSX_PGDB_HASHBITS_MIN (14)
+#define BSX_PGDB_ID_LENGTH (64)
+
+/* Header flag set while the table is being rebuilt */
+#define BSX_PGDB_HEADER_FLAGS_DIRTY (0x1)
+
+#define BSX_PGDB_RECORD_FLAGS_NEW (0x1)
+#define BSX_PGDB_RECORD_FLAGS_USED (0x2)
+
+typedef struct
+{
+  uint32_t magic;
+  uint32_t version;
+  uint32_t headersize;
+  uint32_t recordsize;
+  uint32_t hashbits;
+  uint32_t recordcount;
+  uint32_t flags;
+  uint32_t reserved[9];
+} bsxPgDbHeader;
+
+typedef struct
+{
+  int32_t salecount;
+  int32_t saleqty;
+  float saleminimum;
+  float saleaverage;
+  float saleqtyaverage;
+  float salemaximum;
+  int32_t stockcount;
+  int32_t stockqty;
+  float stockminimum;
+  float stockaverage;
+  float stockqtyaverage;
+  float stockmaximum;
+} bsxPgDbCondition;
+
+typedef struct
+{
+  /* Zero for an empty slot */
+  uint32_t hashkey;
+  int32_t colorid;
+  int64_t modtime;
+  char typeid;
+  uint8_t flags;
+  char reserved[6];
+  char id[BSX_PGDB_ID_LENGTH];
+  /* New, then used */
+  bsxPgDbCondition condition[2];
+} bsxPgDbRecord;
+
+struct bsxPriceGuideDb
+{
+  char *path;
+#if CC_UNIX
+  int fd;
+#elif CC_WINDOWS
+  HANDLE file;
+  HANDLE filemap;
+#endif
+  void *map;
+  size_t mapsize;
+  bsxPgDbHeader *header;
+  bsxPgDbRecord *recordlist;
+  uint32_t hashmask;
+};
+
+
+static size_t bsxPgDbSize( uint32_t hashbits )
+{
+  return sizeof(bsxPgDbHeader) + ( ( (size_t)1 << hashbits ) * sizeof(bsxPgDbRecord) );
+}
+
+static void bsxPgDbUnmap( bsxPriceGuideDb *db )
+{
+  if( !( db->map ) )
+    return;
+#if CC_UNIX
+  munmap( db->map, db->mapsize );
+#elif CC_WINDOWS
+  UnmapViewOfFile( db->map );
+  CloseHandle( db->filemap );
+#endif
+  db->map = 0;
+  db->header = 0;
+  db->recordlist = 0;
+  return;
+}
+
+/* Map the file with the size specified, growing the file if required */
+static int bsxPgDbMap( bsxPriceGuideDb *db, size_t size )
+{
+#if CC_UNIX
+  struct stat statbuf;
+  if( fstat( db->fd, &statbuf ) )
+    return 0;
+  if( ( (size_t)statbuf.st_size != size ) && ( ftruncate( db->fd, (off_t)size ) ) )
+    return 0;
+  db->map = mmap( 0, size, PROT_READ | PROT_WRITE, MAP_SHARED, db->fd, 0 );
+  if( db->map == MAP_FAILED )
+  {
+    db->map = 0;
+    return 0;
+  }
+#elif CC_WINDOWS
+  db->filemap = CreateFileMappingA( db->file, 0, PAGE_READWRITE, (DWORD)( (uint64_t)size >> 32 ), (DWORD)size, 0 );
+  if( !( db->filemap ) )
+    return 0;
+  db->map = MapViewOfFile( db->filemap, FILE_MAP_ALL_ACCESS, 0, 0, size );
+  if( !( db->map ) )
+  {
+    CloseHandle( db->filemap );
+    return 0;
+  }
+#endif
+  db->mapsize = size;
+  db->header = db->map;
+  db->recordlist = ADDRESS( db->map, sizeof(bsxPgDbHeader) );
+  return 1;
+}
+
+static int bsxPgDbReset( bsxPriceGuideDb *db, uint32_t hashbits )
+{
+  bsxPgDbUnmap( db );
+#if CC_UNIX
+  if( ftruncate( db->fd, 0 ) )
+    return 0;
+#elif CC_WINDOWS
+  SetFilePointer( db->file, 0, 0, FILE_BEGIN );
+  SetEndOfFile( db->file );
+#endif
+  if( !( bsxPgDbMap( db, bsxPgDbSize( hashbits ) ) ) )
+    return 0;
+  memset( db->map, 0, db->mapsize );
+  db->header->magic = BSX_PGDB_MAGIC;
+  db->header->version = BSX_PGDB_VERSION;
+  db->header->headersize = sizeof(bsxPgDbHeader);
+  db->header->recordsize = sizeof(bsxPgDbRecord);
+  db->header->hashbits = hashbits;
+  db->hashmask = ( 1 << hashbits ) - 1;
+  return 1;
+}
+
+
+bsxPriceGuideDb *bsxOpenPriceGuideDb( char *path )
+{
+  size_t filesize;
+  bsxPgDbHeader header;
+  bsxPriceGuideDb *db;
+
+  db = malloc( sizeof(bsxPriceGuideDb) );
+  memset( db, 0, sizeof(bsxPriceGuideDb) );
+  db->path = ccStrDup( path );
+#if CC_UNIX
+  db->fd = open( path, O_RDWR | O_CREAT, S_IRUSR | S_IWUSR | S_IRGRP | S_IROTH );
+  if( db->fd == -1 )
+  {
+    free( db->path );
+    free( db );
+    return 0;
+  }
+#elif CC_WINDOWS
+  db->file = CreateFileA( path, GENERIC_READ | GENERIC_WRITE, FILE_SHARE_READ, 0, OPEN_ALWAYS, FILE_ATTRIBUTE_NORMAL, 0 );
+  if( db->file == INVALID_HANDLE_VALUE )
+  {
+    free( db->path );
+    free( db );
+    return 0;
+  }
+#endif
+
+  /* Validate the header against the file size, anything unexpected resets the database */
+  memset( &header, 0, sizeof(bsxPgDbHeader) );
+  filesize = 0;
+#if CC_UNIX
+  if( pread( db->fd, &header, sizeof(bsxPgDbHeader), 0 ) != sizeof(bsxPgDbHeader) )
+    memset( &header, 0, sizeof(bsxPgDbHeader) );
+  filesize = (size_t)lseek( db->fd, 0, SEEK_END );
+#elif CC_WINDOWS
+  {
+    DWORD readsize;
+    LARGE_INTEGER largesize;
+    if( !( ReadFile( db->file, &header, sizeof(bsxPgDbHeader), &readsize, 0 ) ) || ( readsize != sizeof(bsxPgDbHeader) ) )
+      memset( &header, 0, sizeof(bsxPgDbHeader) );
+    if( GetFileSizeEx( db->file, &largesize ) )
+      filesize = (size_t)largesize.QuadPart;
+  }
+#endif
+  if( ( header.magic == BSX_PGDB_MAGIC ) && ( header.version == BSX_PGDB_VERSION ) && ( header.headersize == sizeof(bsxPgDbHeader) ) && ( header.recordsize == sizeof(bsxPgDbRecord) ) && ( header.hashbits >= BSX_PGDB_HASHBITS_MIN ) && ( header.hashbits < 28 ) && !( header.flags & BSX_PGDB_HEADER_FLAGS_DIRTY ) && ( filesize == bsxPgDbSize( header.hashbits ) ) )
+  {
+    if( bsxPgDbMap( db, filesize ) )
+    {
+      db->hashmask = ( 1 << header.hashbits ) - 1;
+      return db;
+    }
+  }
+  else if( filesize )
+    printf( "WARNING: Price guide database %s is invalid, resetting\n", path );
+  if( !( bsxPgDbReset( db, BSX_PGDB_HASHBITS_MIN ) ) )
+  {
+    bsxClosePriceGuideDb( db );
+    return 0;
+  }
+  return db;
+}
+
+
+void bsxClosePriceGuideDb( bsxPriceGuideDb *db )
+{
+  if( !( db ) )
+    return;
+  bsxPgDbUnmap( db );
+#if CC_UNIX
+  close( db->fd );
+#elif CC_WINDOWS
+  CloseHandle( db->file );
+#endif
+  free( db->path );
+  free( db );
+  return;
+}
+
+
+static uint32_t bsxPgDbHashKey( char itemtypeid, char *itemid, int idlength, int itemcolorid )
+{
+  uint32_t hashkey;
+  hashkey = ccHash32Data( itemid, idlength ) ^ ccHash32Int32( ( (uint32_t)itemcolorid << 8 ) | (uint8_t)itemtypeid );
+  return ( hashkey ? hashkey : 1 );
+}
+
+/* Return the matching record, or the empty slot where it belongs */
+static bsxPgDbRecord *bsxPgDbFind( bsxPriceGuideDb *db, uint32_t hashkey, char itemtypeid, char *itemid, int itemcolorid )
+{
+  uint32_t hashindex;
+  bsxPgDbRecord *record;
+
+  for( hashindex = hashkey & db->hashmask ; ; hashindex = ( hashindex + 1 ) & db->hashmask )
+  {
+    record = &db->recordlist[ hashindex ];
+    if( !( record->hashkey ) )
+      return record;
+    if( ( record->hashkey == hashkey ) && ( record->colorid == itemcolorid ) && ( record->typeid == itemtypeid ) && ( strcmp( record->id, itemid ) == 0 ) )
+      return record;
+  }
+  return 0;
+}
+
+/* Double the table when half full, the dirty flag invalidates the file if we are interrupted */
+/* The new mapping is created before the old one is released, on failure the database is left as it was */
+static int bsxPgDbGrow( bsxPriceGuideDb *db )
+{
+  uint32_t hashbits, hashindex, hashmask, recordcount, recordindex;
+  bsxPgDbRecord *oldlist, *record;
+  bsxPriceGuideDb olddb;
+
+  hashbits = db->header->hashbits;
+  recordcount = db->header->recordcount;
+  oldlist = malloc( ( (size_t)1 << hashbits ) * sizeof(bsxPgDbRecord) );
+  if( !( oldlist ) )
+    return 0;
+  memcpy( oldlist, db->recordlist, ( (size_t)1 << hashbits ) * sizeof(bsxPgDbRecord) );
+  olddb = *db;
+  if( !( bsxPgDbMap( db, bsxPgDbSize( hashbits + 1 ) ) ) )
+  {
+    *db = olddb;
+#if CC_UNIX
+    if( ftruncate( db->fd, (off_t)db->mapsize ) )
+      db->header->flags |= BSX_PGDB_HEADER_FLAGS_DIRTY;
+#endif
+    free( oldlist );
+    return 0;
+  }
+  bsxPgDbUnmap( &olddb );
+  db->header->flags |= BSX_PGDB_HEADER_FLAGS_DIRTY;
+  hashmask = ( 1 << ( hashbits + 1 ) ) - 1;
+  memset( db->recordlist, 0, ( (size_t)1 << ( hashbits + 1 ) ) * sizeof(bsxPgDbRecord) );
+  for( recordindex = 0 ; recordindex < ( (uint32_t)1 << hashbits ) ; recordindex++ )
+  {
+    if( !( oldlist[recordindex].hashkey ) )
+      continue;
+    for( hashindex = oldlist[recordindex].hashkey & hashmask ; ; hashindex = ( hashindex + 1 ) & hashmask )
+    {
+      record = &db->recordlist[ hashindex ];
+      if( !( record->hashkey ) )
+        break;
+    }
+    memcpy( record, &oldlist[recordindex], sizeof(bsxPgDbRecord) );
+  }
+  free( oldlist );
+  db->hashmask = hashmask;
+  db->header->hashbits = hashbits + 1;
+  db->header->recordcount = recordcount;
+  db->header->flags &= ~BSX_PGDB_HEADER_FLAGS_DIRTY;
+  return 1;
+}
+
 
+int bsxReadPriceGuideDb( bsxPriceGuideDb *db, bsxPriceGuide *pg, char itemtypeid, char *itemid, int itemcolorid, char itemcondition )
+{
+  int idlength, conditionindex;
+  bsxPgDbRecord *record;
+  bsxPgDbCondition *condition;
+
+  if( !( itemid ) )
+    return 0;
+  idlength = strlen( itemid );
+  if( idlength >= BSX_PGDB_ID_LENGTH )
+    return 0;
+  record = bsxPgDbFind( db, bsxPgDbHashKey( itemtypeid, itemid, idlength, itemcolorid ), itemtypeid, itemid, itemcolorid );
+  conditionindex = ( itemcondition == 'N' ? 0 : 1 );
+  if( !( record->hashkey ) || !( record->flags & ( BSX_PGDB_RECORD_FLAGS_NEW << conditionindex ) ) )
+    return 0;
+  condition = &record->condition[ conditionindex ];
+  pg->salecount = condition->salecount;
+  pg->saleqty = condition->saleqty;
+  pg->saleminimum = condition->saleminimum;
+  pg->saleaverage = condition->saleaverage;
+  pg->saleqtyaverage = condition->saleqtyaverage;
+  pg->salemaximum = condition->salemaximum;
+  pg->stockcount = condition->stockcount;
+  pg->stockqty = condition->stockqty;
+  pg->stockminimum = condition->stockminimum;
+  pg->stockaverage = condition->stockaverage;
+  pg->stockqtyaverage = condition->stockqtyaverage;
+  pg->stockmaximum = condition->stockmaximum;
+  pg->modtime = record->modtime;
+  return 1;
+}
+
+
+static void bsxPgDbStoreCondition( bsxPgDbCondition *condition, bsxPriceGuide *pg )
+{
+  condition->salecount = pg->salecount;
+  condition->saleqty = pg->saleqty;
+  condition->saleminimum = pg->saleminimum;
+  condition->saleaverage = pg->saleaverage;
+  condition->saleqtyaverage = pg->saleqtyaverage;
+  condition->salemaximum = pg->salemaximum;
+  condition->stockcount = pg->stockcount;
+  condition->stockqty = pg->stockqty;
+  condition->stockminimum = pg->stockminimum;
+  condition->stockaverage = pg->stockaverage;
+  condition->stockqtyaverage = pg->stockqtyaverage;
+  condition->stockmaximum = pg->stockmaximum;
+  return;
+}
+
+/* Either condition may be null for import of incomplete entries */
+static int bsxPgDbStore( bsxPriceGuideDb *db, bsxPriceGuide *pgnew, bsxPriceGuide *pgused, int64_t modtime, char itemtypeid, char *itemid, int itemcolorid )
+{
+  int idlength;
+  uint32_t hashkey;
+  bsxPgDbRecord *record;
+
+  if( !( itemid ) )
+    return 0;
+  idlength = strlen( itemid );
+  if( idlength >= BSX_PGDB_ID_LENGTH )
+    return 0;
+  hashkey = bsxPgDbHashKey( itemtypeid, itemid, idlength, itemcolorid );
+  record = bsxPgDbFind( db, hashkey, itemtypeid, itemid, itemcolorid );
+  if( !( record->hashkey ) )
+  {
+    if( ( db->header->recordcount + 1 ) > ( ( db->hashmask + 1 ) >> 1 ) )
+    {
+      if( !( bsxPgDbGrow( db ) ) )
+        return 0;
+      record = bsxPgDbFind( db, hashkey, itemtypeid, itemid, itemcolorid );
+    }
+    memset( record, 0, sizeof(bsxPgDbRecord) );
+    record->colorid = itemcolorid;
+    record->typeid = itemtypeid;
+    memcpy( record->id, itemid, idlength + 1 );
+    db->header->recordcount++;
+  }
+  record->flags = 0;
+  if( pgnew )
+  {
+    bsxPgDbStoreCondition( &record->condition[0], pgnew );
+    record->flags |= BSX_PGDB_RECORD_FLAGS_NEW;
+  }
+  if( pgused )
+  {
+    bsxPgDbStoreCondition( &record->condition[1], pgused );
+    record->flags |= BSX_PGDB_RECORD_FLAGS_USED;
+  }
+  record->modtime = modtime;
+  /* Slot is valid once the hashkey is set */
+  record->hashkey = hashkey;
   return 1;
 }
 
 
+int bsxWritePriceGuideDb( bsxPriceGuideDb *db, bsxPriceGuide *pgnew, bsxPriceGuide *pgused, char itemtypeid, char *itemid, int itemcolorid )
+{
+  return bsxPgDbStore( db, pgnew, pgused, pgnew->modtime, itemtypeid, itemid, itemcolorid );
+}
+
+
+////
+
+
+/* Depth of directories under the base path for each layout, the last two are item ID and color ID */
+#define BSX_PGDB_IMPORT_DEPTH_BRICKSTORE (3)
+#define BSX_PGDB_IMPORT_DEPTH_BRICKSTOCK (5)
+
+static int bsxPgDbImportDir( bsxPriceGuideDb *db, char *path, char **namelist, int depth, int maxdepth )
+{
+  int count, subcount, newflag, usedflag;
+  int32_t colorid;
+  char *filename, *subpath;
+  ccDir *dir;
+  bsxPriceGuide pgnew, pgused;
+
+  if( depth == maxdepth )
+  {
+    subpath = ccStrAllocPrintf( "%s" CC_DIR_SEPARATOR_STRING "priceguide.txt", path );
+    newflag = bsxReadPriceGuide( &pgnew, subpath, 'N' );
+    usedflag = bsxReadPriceGuide( &pgused, subpath, 'U' );
+    free( subpath );
+    if( !( newflag | usedflag ) || !( ccStrParseInt32( namelist[maxdepth-1], &colorid ) ) )
+      return 0;
+    if( !( bsxPgDbStore( db, ( newflag ? &pgnew : 0 ), ( usedflag ? &pgused : 0 ), ( newflag ? pgnew.modtime : pgused.modtime ), namelist[0][0], namelist[maxdepth-2], (int)colorid ) ) )
+      return 0;
+    return 1;
+  }
+
+  dir = ccOpenDir( path );
+  if( !( dir ) )
+    return 0;
+  count = 0;
+  for( ; ; )
+  {
+    filename = ccReadDir( dir );
+    if( !( filename ) )
+      break;
+    if( filename[0] == '.' )
+      continue;
+    /* Item types are single characters */
+    if( ( depth == 0 ) && ( filename[1] ) )
+      continue;
+    subpath = ccStrAllocPrintf( "%s" CC_DIR_SEPARATOR_STRING "%s", path, filename );
+    namelist[depth] = filename;
+    subcount = bsxPgDbImportDir( db, subpath, namelist, depth + 1, maxdepth );
+    namelist[depth] = 0;
+    free( subpath );
+    if( subcount < 0 )
+    {
+      ccCloseDir( dir );
+      return -1;
+    }
+    count += subcount;
+  }
+  ccCloseDir( dir );
+  return count;
+}
+
+
+int bsxImportPriceGuideDb( bsxPriceGuideDb *db, char *basepath, int flags )
+{
+  char *namelist[BSX_PGDB_IMPORT_DEPTH_BRICKSTOCK];
+  ccDir *dir;
+  dir = ccOpenDir( basepath );
+  if( !( dir ) )
+    return -1;
+  ccCloseDir( dir );
+  memset( namelist, 0, sizeof(namelist) );
+  if( flags & BSX_PRICEGUIDE_FLAGS_BRICKSTORE )
+    return bsxPgDbImportDir( db, basepath, namelist, 0, BSX_PGDB_IMPORT_DEPTH_BRICKSTORE );
+  else if( flags & BSX_PRICEGUIDE_FLAGS_BRICKSTOCK )
+    return bsxPgDbImportDir( db, basepath, namelist, 0, BSX_PGDB_IMPORT_DEPTH_BRICKSTOCK );
+  return -1;
+}
+
+
+static void bsxPgDbLoadCondition( bsxPriceGuide *pg, bsxPgDbCondition *condition, int validflag, int64_t modtime )
+{
+  memset( pg, 0, sizeof(bsxPriceGuide) );
+  if( validflag )
+  {
+    pg->salecount = condition->salecount;
+    pg->saleqty = condition->saleqty;
+    pg->saleminimum = condition->saleminimum;
+    pg->saleaverage = condition->saleaverage;
+    pg->saleqtyaverage = condition->saleqtyaverage;
+    pg->salemaximum = condition->salemaximum;
+    pg->stockcount = condition->stockcount;
+    pg->stockqty = condition->stockqty;
+    pg->stockminimum = condition->stockminimum;
+    pg->stockaverage = condition->stockaverage;
+    pg->stockqtyaverage = condition->stockqtyaverage;
+    pg->stockmaximum = condition->stockmaximum;
+  }
+  pg->modtime = modtime;
+  return;
+}
+
+int bsxExportPriceGuideDb( bsxPriceGuideDb *db, char *basepath, int flags )
+{
+  int count;
+  uint32_t recordindex;
+  char *path;
+  bsxPgDbRecord *record;
+  bsxPriceGuide pgnew, pgused;
+#if CC_UNIX
+  struct utimbuf filetime;
+#elif CC_WINDOWS
+  struct _utimbuf filetime;
+#endif
+
+  if( !( flags & ( BSX_PRICEGUIDE_FLAGS_BRICKSTORE | BSX_PRICEGUIDE_FLAGS_BRICKSTOCK ) ) )
+    return -1;
+  bsxPgMkDir( basepath );
+  count = 0;
+  for( recordindex = 0 ; recordindex <= db->hashmask ; recordindex++ )
+  {
+    record = &db->recordlist[ recordindex ];
+    if( !( record->hashkey ) )
+      continue;
+    bsxPgDbLoadCondition( &pgnew, &record->condition[0], record->flags & BSX_PGDB_RECORD_FLAGS_NEW, record->modtime );
+    bsxPgDbLoadCondition( &pgused, &record->condition[1], record->flags & BSX_PGDB_RECORD_FLAGS_USED, record->modtime );
+    path = bsxPriceGuidePath( basepath, record->typeid, record->id, record->colorid, flags | BSX_PRICEGUIDE_FLAGS_MKDIR );
+    if( !( bsxWritePriceGuide( &pgnew, &pgused, path, record->typeid, record->id, record->colorid ) ) )
+    {
+      free( path );
+      return -1;
+    }
+    /* Keep the fetch time, the file's modification time is what the cache expiry checks */
+    filetime.actime = (time_t)record->modtime;
+    filetime.modtime = (time_t)record->modtime;
+#if CC_UNIX
+    utime( path, &filetime );
+#elif CC_WINDOWS
+    _utime( path, &filetime );
+#endif
+    free( path );
+    count++;
+  }
+  return count;
+}
+
+
+
 ////
 
 
+#define BSX_PGHIST_MAGIC (0x48475042)
+#define BSX_PGHIST_VERSION (1)
+
+#define BSX_PGHIST_RECORD_KEY ('K')
+#define BSX_PGHIST_RECORD_SAMPLE ('S')
+#define BSX_PGHIST_RECORD_MAX (4096)
+
+#define BSX_PGHIST_SAMPLE_FLAGS_KEYFRAME (0x1)
+
+/* Every few samples of a key store absolute values, so that range queries stop walking the chain early */
+#define BSX_PGHIST_KEYFRAME_INTERVAL (16)
+
+/* Both conditions, 6 sale and 6 stock fields each */
+#define BSX_PGHIST_VALUE_COUNT (24)
+
+/* Prices are stored as fixed point with 4 decimals, BrickLink's own precision */
+#define BSX_PGHIST_PRICE_SCALE (10000.0)
+
+typedef struct
+{
+  uint32_t magic;
+  uint32_t version;
+  uint64_t reserved;
+} bsxPgHistHeader;
+
+typedef struct
+{
+  uint32_t hashkey;
+  char typeid;
+  int colorid;
+  char *id;
+  int hashnext;
+  /* Last sample of the key, base for the delta encoding of the next one */
+  int64_t lastoffset;
+  int64_t lasttime;
+  int64_t lastvalue[BSX_PGHIST_VALUE_COUNT];
+  int framecount;
+} bsxPgHistKey;
+
+struct bsxPriceGuideHistory
+{
+  char *path;
+  FILE *file;
+  int64_t filesize;
+  bsxPgHistKey *keylist;
+  int keycount;
+  int keyalloc;
+  int *hashtable;
+  uint32_t hashmask;
+  int64_t samplecount;
+};
+
+/* Decoded sample record, values are deltas unless the keyframe flag is set */
+typedef struct
+{
+  int64_t offset;
+  int64_t backdistance;
+  int flags;
+  int64_t time;
+  int64_t value[BSX_PGHIST_VALUE_COUNT];
+} bsxPgHistSample;
+
+
+static int bsxPgHistSeek( FILE *file, int64_t offset )
+{
+#if CC_WINDOWS
+  return ( _fseeki64( file, offset, SEEK_SET ) == 0 );
+#else
+  return ( fseeko( file, (off_t)offset, SEEK_SET ) == 0 );
+#endif
+}
+
+static int64_t bsxPgHistFileSize( FILE *file )
+{
+#if CC_WINDOWS
+  if( _fseeki64( file, 0, SEEK_END ) )
+    return -1;
+  return _ftelli64( file );
+#else
+  if( fseeko( file, 0, SEEK_END ) )
+    return -1;
+  return (int64_t)ftello( file );
+#endif
+}
+
+static int bsxPgHistTruncate( FILE *file, int64_t size )
+{
+  fflush( file );
+#if CC_WINDOWS
+  return ( _chsize_s( _fileno( file ), size ) == 0 );
+#else
+  return ( ftruncate( fileno( file ), (off_t)size ) == 0 );
+#endif
+}
+
+
+static int bsxPgHistPutVarint( uint8_t *dst, uint64_t value )
+{
+  int size;
+  for( size = 0 ; value >= 0x80 ; size++, value >>= 7 )
+    dst[size] = (uint8_t)( value | 0x80 );
+  dst[size++] = (uint8_t)value;
+  return size;
+}
+
+static int bsxPgHistGetVarint( uint8_t *src, int srcsize, uint64_t *retvalue )
+{
+  int size, shift;
+  uint64_t value;
+  value = 0;
+  for( size = 0, shift = 0 ; ( size < srcsize ) && ( shift < 64 ) ; size++, shift += 7 )
+  {
+    value |= (uint64_t)( src[size] & 0x7f ) << shift;
+    if( !( src[size] & 0x80 ) )
+    {
+      *retvalue = value;
+      return size + 1;
+    }
+  }
+  return 0;
+}
+
+static inline uint64_t bsxPgHistZigZag( int64_t value )
+{
+  return ( (uint64_t)value << 1 ) ^ (uint64_t)( value >> 63 );
+}
+
+static inline int64_t bsxPgHistUnZigZag( uint64_t value )
+{
+  return (int64_t)( value >> 1 ) ^ -(int64_t)( value & 0x1 );
+}
+
+
+static void bsxPgHistPackValues( int64_t *value, bsxPriceGuide *pg )
+{
+  value[0] = pg->salecount;
+  value[1] = pg->saleqty;
+  value[2] = llrint( (double)pg->saleminimum * BSX_PGHIST_PRICE_SCALE );
+  value[3] = llrint( (double)pg->saleaverage * BSX_PGHIST_PRICE_SCALE );
+  value[4] = llrint( (double)pg->saleqtyaverage * BSX_PGHIST_PRICE_SCALE );
+  value[5] = llrint( (double)pg->salemaximum * BSX_PGHIST_PRICE_SCALE );
+  value[6] = pg->stockcount;
+  value[7] = pg->stockqty;
+  value[8] = llrint( (double)pg->stockminimum * BSX_PGHIST_PRICE_SCALE );
+  value[9] = llrint( (double)pg->stockaverage * BSX_PGHIST_PRICE_SCALE );
+  value[10] = llrint( (double)pg->stockqtyaverage * BSX_PGHIST_PRICE_SCALE );
+  value[11] = llrint( (double)pg->stockmaximum * BSX_PGHIST_PRICE_SCALE );
+  return;
+}
+
+static void bsxPgHistUnpackValues( bsxPriceGuide *pg, int64_t *value, int64_t modtime )
+{
+  pg->salecount = (int)value[0];
+  pg->saleqty = (int)value[1];
+  pg->saleminimum = (float)( (double)value[2] / BSX_PGHIST_PRICE_SCALE );
+  pg->saleaverage = (float)( (double)value[3] / BSX_PGHIST_PRICE_SCALE );
+  pg->saleqtyaverage = (float)( (double)value[4] / BSX_PGHIST_PRICE_SCALE );
+  pg->salemaximum = (float)( (double)value[5] / BSX_PGHIST_PRICE_SCALE );
+  pg->stockcount = (int)value[6];
+  pg->stockqty = (int)value[7];
+  pg->stockminimum = (float)( (double)value[8] / BSX_PGHIST_PRICE_SCALE );
+  pg->stockaverage = (float)( (double)value[9] / BSX_PGHIST_PRICE_SCALE );
+  pg->stockqtyaverage = (float)( (double)value[10] / BSX_PGHIST_PRICE_SCALE );
+  pg->stockmaximum = (float)( (double)value[11] / BSX_PGHIST_PRICE_SCALE );
+  pg->modtime = modtime;
+  return;
+}
+
+
+/* Read the record at the current file position, return its total size or 0 at end of file or on a truncated record */
+static int bsxPgHistReadRecord( FILE *file, int *rettype, uint8_t *payload, int *retpayloadsize )
+{
+  int type, c, size, shift;
+  uint32_t payloadsize;
+
+  type = getc( file );
+  if( type == EOF )
+    return 0;
+  payloadsize = 0;
+  for( size = 1, shift = 0 ; ; size++, shift += 7 )
+  {
+    if( ( c = getc( file ) ) == EOF )
+      return 0;
+    payloadsize |= (uint32_t)( c & 0x7f ) << shift;
+    if( !( c & 0x80 ) )
+      break;
+    if( shift >= 14 )
+      return 0;
+  }
+  size++;
+  if( payloadsize > BSX_PGHIST_RECORD_MAX )
+    return 0;
+  if( fread( payload, 1, payloadsize, file ) != payloadsize )
+    return 0;
+  *rettype = type;
+  *retpayloadsize = (int)payloadsize;
+  return size + (int)payloadsize;
+}
+
+/* Prefix the payload with the record type and size, payload must start BSX_PGHIST_RECORD_PREFIX bytes into the buffer */
+#define BSX_PGHIST_RECORD_PREFIX (4)
+
+static int bsxPgHistWriteRecord( bsxPriceGuideHistory *hist, int type, uint8_t *buffer, int payloadsize )
+{
+  int prefixsize;
+  uint8_t prefix[BSX_PGHIST_RECORD_PREFIX];
+  uint8_t *record;
+
+  prefix[0] = (uint8_t)type;
+  prefixsize = 1 + bsxPgHistPutVarint( &prefix[1], (uint64_t)payloadsize );
+  record = &buffer[ BSX_PGHIST_RECORD_PREFIX - prefixsize ];
+  memcpy( record, prefix, prefixsize );
+  if( !( bsxPgHistSeek( hist->file, hist->filesize ) ) )
+    return 0;
+  if( ( fwrite( record, 1, prefixsize + payloadsize, hist->file ) != (size_t)( prefixsize + payloadsize ) ) || ( fflush( hist->file ) ) )
+  {
+    /* Don't leave a partial record behind */
+    bsxPgHistTruncate( hist->file, hist->filesize );
+    return 0;
+  }
+  hist->filesize += prefixsize + payloadsize;
+  return prefixsize + payloadsize;
+}
+
+
+static int bsxPgHistDecodeSample( bsxPgHistSample *sample, uint8_t *payload, int payloadsize, uint64_t *retkeyindex )
+{
+  int offset, size, valueindex;
+  uint64_t value;
+
+  offset = 0;
+  if( !( size = bsxPgHistGetVarint( &payload[offset], payloadsize - offset, retkeyindex ) ) )
+    return 0;
+  offset += size;
+  if( !( size = bsxPgHistGetVarint( &payload[offset], payloadsize - offset, &value ) ) )
+    return 0;
+  offset += size;
+  sample->backdistance = (int64_t)value;
+  if( offset >= payloadsize )
+    return 0;
+  sample->flags = payload[offset++];
+  if( !( size = bsxPgHistGetVarint( &payload[offset], payloadsize - offset, &value ) ) )
+    return 0;
+  offset += size;
+  sample->time = bsxPgHistUnZigZag( value );
+  for( valueindex = 0 ; valueindex < BSX_PGHIST_VALUE_COUNT ; valueindex++ )
+  {
+    if( !( size = bsxPgHistGetVarint( &payload[offset], payloadsize - offset, &value ) ) )
+      return 0;
+    offset += size;
+    sample->value[valueindex] = bsxPgHistUnZigZag( value );
+  }
+  return 1;
+}
+
+/* Apply a decoded sample on top of the previous values of its key */
+static void bsxPgHistApplySample( bsxPgHistSample *sample, int64_t *basetime, int64_t *basevalue )
+{
+  int valueindex;
+  if( sample->flags & BSX_PGHIST_SAMPLE_FLAGS_KEYFRAME )
+  {
+    *basetime = sample->time;
+    memcpy( basevalue, sample->value, BSX_PGHIST_VALUE_COUNT * sizeof(int64_t) );
+  }
+  else
+  {
+    *basetime += sample->time;
+    for( valueindex = 0 ; valueindex < BSX_PGHIST_VALUE_COUNT ; valueindex++ )
+      basevalue[valueindex] += sample->value[valueindex];
+  }
+  return;
+}
+
+
+static uint32_t bsxPgHistHashKey( char itemtypeid, char *itemid, int itemcolorid )
+{
+  return ccHash32Data( itemid, strlen( itemid ) ) ^ ccHash32Int32( ( (uint32_t)itemcolorid << 8 ) | (uint8_t)itemtypeid );
+}
+
+static bsxPgHistKey *bsxPgHistFindKey( bsxPriceGuideHistory *hist, uint32_t hashkey, char itemtypeid, char *itemid, int itemcolorid )
+{
+  int keyindex;
+  bsxPgHistKey *key;
+  for( keyindex = hist->hashtable[ hashkey & hist->hashmask ] ; keyindex >= 0 ; keyindex = key->hashnext )
+  {
+    key = &hist->keylist[keyindex];
+    if( ( key->hashkey == hashkey ) && ( key->colorid == itemcolorid ) && ( key->typeid == itemtypeid ) && ( strcmp( key->id, itemid ) == 0 ) )
+      return key;
+  }
+  return 0;
+}
+
+static bsxPgHistKey *bsxPgHistAddKey( bsxPriceGuideHistory *hist, uint32_t hashkey, char itemtypeid, char *itemid, int itemcolorid )
+{
+  int keyindex;
+  uint32_t hashsize;
+  bsxPgHistKey *key;
+
+  if( hist->keycount >= hist->keyalloc )
+  {
+    hist->keyalloc = ( hist->keyalloc ? hist->keyalloc << 1 : 1024 );
+    hist->keylist = realloc( hist->keylist, hist->keyalloc * sizeof(bsxPgHistKey) );
+  }
+  /* Keep the hash table at most half loaded */
+  if( ( (uint32_t)hist->keycount << 1 ) >= hist->hashmask )
+  {
+    hashsize = ( hist->hashmask + 1 ) << 1;
+    hist->hashtable = realloc( hist->hashtable, hashsize * sizeof(int) );
+    memset( hist->hashtable, -1, hashsize * sizeof(int) );
+    hist->hashmask = hashsize - 1;
+    for( keyindex = 0 ; keyindex < hist->keycount ; keyindex++ )
+    {
+      key = &hist->keylist[keyindex];
+      key->hashnext = hist->hashtable[ key->hashkey & hist->hashmask ];
+      hist->hashtable[ key->hashkey & hist->hashmask ] = keyindex;
+    }
+  }
+  keyindex = hist->keycount++;
+  key = &hist->keylist[keyindex];
+  memset( key, 0, sizeof(bsxPgHistKey) );
+  key->hashkey = hashkey;
+  key->typeid = itemtypeid;
+  key->colorid = itemcolorid;
+  key->id = ccStrDup( itemid );
+  key->hashnext = hist->hashtable[ hashkey & hist->hashmask ];
+  hist->hashtable[ hashkey & hist->hashmask ] = keyindex;
+  return key;
+}
+
+
+static int bsxPgHistReset( bsxPriceGuideHistory *hist )
+{
+  bsxPgHistHeader header;
+  if( hist->file )
+    fclose( hist->file );
+  hist->file = fopen( hist->path, "w+b" );
+  if( !( hist->file ) )
+    return 0;
+  memset( &header, 0, sizeof(bsxPgHistHeader) );
+  header.magic = BSX_PGHIST_MAGIC;
+  header.version = BSX_PGHIST_VERSION;
+  if( ( fwrite( &header, 1, sizeof(bsxPgHistHeader), hist->file ) != sizeof(bsxPgHistHeader) ) || ( fflush( hist->file ) ) )
+    return 0;
+  hist->filesize = sizeof(bsxPgHistHeader);
+  return 1;
+}
+
+/* Scan all records to rebuild the key table and the last values of each key */
+static int64_t bsxPgHistScan( bsxPriceGuideHistory *hist )
+{
+  int type, payloadsize, recordsize, size;
+  int64_t offset;
+  uint64_t keyindex, colorid;
+  uint8_t payload[BSX_PGHIST_RECORD_MAX+1];
+  bsxPgHistKey *key;
+  bsxPgHistSample sample;
+
+  offset = sizeof(bsxPgHistHeader);
+  if( !( bsxPgHistSeek( hist->file, offset ) ) )
+    return offset;
+  for( ; ; offset += recordsize )
+  {
+    recordsize = bsxPgHistReadRecord( hist->file, &type, payload, &payloadsize );
+    if( !( recordsize ) )
+      break;
+    if( type == BSX_PGHIST_RECORD_KEY )
+    {
+      if( !( payloadsize ) || !( size = bsxPgHistGetVarint( &payload[1], payloadsize - 1, &colorid ) ) || ( 1 + size >= payloadsize ) )
+        break;
+      payload[payloadsize] = 0;
+      key = bsxPgHistAddKey( hist, bsxPgHistHashKey( (char)payload[0], (char *)&payload[1+size], (int)colorid ), (char)payload[0], (char *)&payload[1+size], (int)colorid );
+    }
+    else if( type == BSX_PGHIST_RECORD_SAMPLE )
+    {
+      if( !( bsxPgHistDecodeSample( &sample, payload, payloadsize, &keyindex ) ) || ( keyindex >= (uint64_t)hist->keycount ) )
+        break;
+      key = &hist->keylist[keyindex];
+      /* The chain must link to the previous sample of the key */
+      if( offset - sample.backdistance != ( key->lastoffset ? key->lastoffset : offset ) )
+        break;
+      if( !( key->lastoffset ) && !( sample.flags & BSX_PGHIST_SAMPLE_FLAGS_KEYFRAME ) )
+        break;
+      bsxPgHistApplySample( &sample, &key->lasttime, key->lastvalue );
+      key->lastoffset = offset;
+      key->framecount = ( sample.flags & BSX_PGHIST_SAMPLE_FLAGS_KEYFRAME ? 1 : key->framecount + 1 );
+      hist->samplecount++;
+    }
+  }
+  return offset;
+}
+
+
+bsxPriceGuideHistory *bsxOpenPriceGuideHistory( char *path )
+{
+  int64_t validsize;
+  bsxPgHistHeader header;
+  bsxPriceGuideHistory *hist;
+
+  hist = malloc( sizeof(bsxPriceGuideHistory) );
+  memset( hist, 0, sizeof(bsxPriceGuideHistory) );
+  hist->path = ccStrDup( path );
+  hist->hashmask = 1024 - 1;
+  hist->hashtable = malloc( ( hist->hashmask + 1 ) * sizeof(int) );
+  memset( hist->hashtable, -1, ( hist->hashmask + 1 ) * sizeof(int) );
+
+  hist->file = fopen( path, "r+b" );
+  if( !( hist->file ) )
+  {
+    if( !( bsxPgHistReset( hist ) ) )
+      goto error;
+    return hist;
+  }
+  hist->filesize = bsxPgHistFileSize( hist->file );
+  memset( &header, 0, sizeof(bsxPgHistHeader) );
+  if( !( bsxPgHistSeek( hist->file, 0 ) ) || ( fread( &header, 1, sizeof(bsxPgHistHeader), hist->file ) != sizeof(bsxPgHistHeader) ) || ( header.magic != BSX_PGHIST_MAGIC ) || ( header.version != BSX_PGHIST_VERSION ) )
+  {
+    if( hist->filesize > 0 )
+      printf( "WARNING: Price guide history %s is invalid, resetting\n", path );
+    if( !( bsxPgHistReset( hist ) ) )
+      goto error;
+    return hist;
+  }
+
+  validsize = bsxPgHistScan( hist );
+  if( validsize != hist->filesize )
+  {
+    printf( "WARNING: Price guide history %s has a damaged tail, truncating from " CC_LLD " to " CC_LLD " bytes\n", path, (long long)hist->filesize, (long long)validsize );
+    if( !( bsxPgHistTruncate( hist->file, validsize ) ) )
+      goto error;
+    hist->filesize = validsize;
+  }
+  return hist;
+
+  error:
+  bsxClosePriceGuideHistory( hist );
+  return 0;
+}
+
+
+void bsxClosePriceGuideHistory( bsxPriceGuideHistory *hist )
+{
+  int keyindex;
+  if( !( hist ) )
+    return;
+  if( hist->file )
+    fclose( hist->file );
+  for( keyindex = 0 ; keyindex < hist->keycount ; keyindex++ )
+    free( hist->keylist[keyindex].id );
+  free( hist->keylist );
+  free( hist->hashtable );
+  free( hist->path );
+  free( hist );
+  return;
+}
+
+
+int bsxAppendPriceGuideHistory( bsxPriceGuideHistory *hist, bsxPriceGuide *pgnew, bsxPriceGuide *pgused, char itemtypeid, char *itemid, int itemcolorid )
+{
+  int idlength, payloadsize, valueindex, keyframeflag, recordsize;
+  uint32_t hashkey;
+  int64_t value[BSX_PGHIST_VALUE_COUNT];
+  uint8_t buffer[BSX_PGHIST_RECORD_PREFIX+BSX_PGHIST_RECORD_MAX];
+  uint8_t *payload;
+  bsxPgHistKey *key;
+
+  if( !( itemid ) )
+    return 0;
+  payload = &buffer[BSX_PGHIST_RECORD_PREFIX];
+  hashkey = bsxPgHistHashKey( itemtypeid, itemid, itemcolorid );
+  key = bsxPgHistFindKey( hist, hashkey, itemtypeid, itemid, itemcolorid );
+  if( !( key ) )
+  {
+    idlength = strlen( itemid );
+    if( ( idlength == 0 ) || ( idlength > BSX_PGHIST_RECORD_MAX - 16 ) )
+      return 0;
+    payload[0] = (uint8_t)itemtypeid;
+    payloadsize = 1 + bsxPgHistPutVarint( &payload[1], (uint64_t)(uint32_t)itemcolorid );
+    memcpy( &payload[payloadsize], itemid, idlength );
+    payloadsize += idlength;
+    if( !( bsxPgHistWriteRecord( hist, BSX_PGHIST_RECORD_KEY, buffer, payloadsize ) ) )
+      return 0;
+    key = bsxPgHistAddKey( hist, hashkey, itemtypeid, itemid, itemcolorid );
+  }
+
+  bsxPgHistPackValues( &value[0], pgnew );
+  bsxPgHistPackValues( &value[BSX_PGHIST_VALUE_COUNT/2], pgused );
+  keyframeflag = ( !( key->lastoffset ) || ( key->framecount >= BSX_PGHIST_KEYFRAME_INTERVAL ) );
+  payloadsize = bsxPgHistPutVarint( &payload[0], (uint64_t)( key - hist->keylist ) );
+  payloadsize += bsxPgHistPutVarint( &payload[payloadsize], (uint64_t)( key->lastoffset ? hist->filesize - key->lastoffset : 0 ) );
+  payload[payloadsize++] = ( keyframeflag ? BSX_PGHIST_SAMPLE_FLAGS_KEYFRAME : 0 );
+  payloadsize += bsxPgHistPutVarint( &payload[payloadsize], bsxPgHistZigZag( keyframeflag ? pgnew->modtime : pgnew->modtime - key->lasttime ) );
+  for( valueindex = 0 ; valueindex < BSX_PGHIST_VALUE_COUNT ; valueindex++ )
+    payloadsize += bsxPgHistPutVarint( &payload[payloadsize], bsxPgHistZigZag( keyframeflag ? value[valueindex] : value[valueindex] - key->lastvalue[valueindex] ) );
+
+  recordsize = bsxPgHistWriteRecord( hist, BSX_PGHIST_RECORD_SAMPLE, buffer, payloadsize );
+  if( !( recordsize ) )
+    return 0;
+  key->lastoffset = hist->filesize - recordsize;
+  key->lasttime = pgnew->modtime;
+  memcpy( key->lastvalue, value, BSX_PGHIST_VALUE_COUNT * sizeof(int64_t) );
+  key->framecount = ( keyframeflag ? 1 : key->framecount + 1 );
+  hist->samplecount++;
+  return 1;
+}
+
+
+int bsxReadPriceGuideHistory( bsxPriceGuideHistory *hist, char itemtypeid, char *itemid, int itemcolorid, int64_t starttime, int64_t endtime, bsxPriceGuideSample **retlist )
+{
+  int type, payloadsize, samplecount, samplealloc, sampleindex, resultcount;
+  int64_t offset, basetime;
+  int64_t basevalue[BSX_PGHIST_VALUE_COUNT];
+  uint64_t keyindex;
+  uint8_t payload[BSX_PGHIST_RECORD_MAX];
+  bsxPgHistKey *key;
+  bsxPgHistSample *samplelist, *sample;
+  bsxPriceGuideSample *resultlist;
+
+  *retlist = 0;
+  if( !( itemid ) )
+    return 0;
+  key = bsxPgHistFindKey( hist, bsxPgHistHashKey( itemtypeid, itemid, itemcolorid ), itemtypeid, itemid, itemcolorid );
+  if( !( key ) || !( key->lastoffset ) )
+    return 0;
+
+  /* Walk the chain backwards until a keyframe older than the window */
+  samplecount = 0;
+  samplealloc = 64;
+  samplelist = malloc( samplealloc * sizeof(bsxPgHistSample) );
+  for( offset = key->lastoffset ; ; offset -= sample->backdistance )
+  {
+    if( samplecount >= samplealloc )
+    {
+      samplealloc <<= 1;
+      samplelist = realloc( samplelist, samplealloc * sizeof(bsxPgHistSample) );
+    }
+    sample = &samplelist[samplecount];
+    if( !( bsxPgHistSeek( hist->file, offset ) ) || !( bsxPgHistReadRecord( hist->file, &type, payload, &payloadsize ) ) || ( type != BSX_PGHIST_RECORD_SAMPLE ) || !( bsxPgHistDecodeSample( sample, payload, payloadsize, &keyindex ) ) || ( keyindex != (uint64_t)( key - hist->keylist ) ) )
+    {
+      free( samplelist );
+      return -1;
+    }
+    sample->offset = offset;
+    samplecount++;
+    if( ( sample->flags & BSX_PGHIST_SAMPLE_FLAGS_KEYFRAME ) && ( sample->time < starttime ) )
+      break;
+    if( !( sample->backdistance ) )
+      break;
+  }
+
+  /* Decode forward, oldest first */
+  resultcount = 0;
+  resultlist = malloc( samplecount * sizeof(bsxPriceGuideSample) );
+  basetime = 0;
+  memset( basevalue, 0, BSX_PGHIST_VALUE_COUNT * sizeof(int64_t) );
+  for( sampleindex = samplecount - 1 ; sampleindex >= 0 ; sampleindex-- )
+  {
+    bsxPgHistApplySample( &samplelist[sampleindex], &basetime, basevalue );
+    if( ( basetime < starttime ) || ( basetime > endtime ) )
+      continue;
+    resultlist[resultcount].time = basetime;
+    bsxPgHistUnpackValues( &resultlist[resultcount].pg[0], &basevalue[0], basetime );
+    bsxPgHistUnpackValues( &resultlist[resultcount].pg[1], &basevalue[BSX_PGHIST_VALUE_COUNT/2], basetime );
+    resultcount++;
+  }
+  free( samplelist );
+  if( !( resultcount ) )
+  {
+    free( resultlist );
+    resultlist = 0;
+  }
+  *retlist = resultlist;
+  return resultcount;
+}
+
+
+int bsxPriceGuideHistoryKeyCount( bsxPriceGuideHistory *hist )
+{
+  return hist->keycount;
+}
+
+int64_t bsxPriceGuideHistorySampleCount( bsxPriceGuideHistory *hist )
+{
+  return hist->samplecount;
+}
@@ -46,6 +46,8 @@ char *bsxPriceGuidePath( char *basepath, char itemtypeid, char *itemid, int item
 #define BSX_PRICEGUIDE_FLAGS_BRICKSTORE (0x1)
 #define BSX_PRICEGUIDE_FLAGS_BRICKSTOCK (0x2)
 #define BSX_PRICEGUIDE_FLAGS_MKDIR (0x4)
+/* Single file database, see bsxOpenPriceGuideDb() */
+#define BSX_PRICEGUIDE_FLAGS_DATABASE (0x8)
 
 
 int bsxReadPriceGuide( bsxPriceGuide *pg, char *path, char itemcondition );
@@ -53,3 +55,49 @@ int bsxReadPriceGuide( bsxPriceGuide *pg, char *path, char itemcondition );
 int bsxWritePriceGuide( bsxPriceGuide *pgnew, bsxPriceGuide *pgused, char *path, char itemtypeid, char *itemid, int itemcolorid );
 
 
+////
+
+
+/* Price guide database: one memory-mapped file holding a hash table of fixed-size records keyed by (typeid, id, colorid) */
+typedef struct bsxPriceGuideDb bsxPriceGuideDb;
+
+/* Open or create the database, an invalid or interrupted file is reset as empty */
+bsxPriceGuideDb *bsxOpenPriceGuideDb( char *path );
+void bsxClosePriceGuideDb( bsxPriceGuideDb *db );
+
+int bsxReadPriceGuideDb( bsxPriceGuideDb *db, bsxPriceGuide *pg, char itemtypeid, char *itemid, int itemcolorid, char itemcondition );
+/* Store both conditions, the record's modtime is taken from pgnew */
+int bsxWritePriceGuideDb( bsxPriceGuideDb *db, bsxPriceGuide *pgnew, bsxPriceGuide *pgused, char itemtypeid, char *itemid, int itemcolorid );
+
+/* Convert from/to BrickStore or BrickStock directory trees, return the count of entries or -1 on error */
+int bsxImportPriceGuideDb( bsxPriceGuideDb *db, char *basepath, int flags );
+int bsxExportPriceGuideDb( bsxPriceGuideDb *db, char *basepath, int flags );
+
+
+
+////
+
+
+/* Price guide history: append-only file of snapshots, chained per (typeid, id, colorid) */
+typedef struct bsxPriceGuideHistory bsxPriceGuideHistory;
+
+typedef struct
+{
+  int64_t time;
+  /* New, then used */
+  bsxPriceGuide pg[2];
+} bsxPriceGuideSample;
+
+/* Open or create the history, scanning all records; a truncated tail is discarded */
+bsxPriceGuideHistory *bsxOpenPriceGuideHistory( char *path );
+void bsxClosePriceGuideHistory( bsxPriceGuideHistory *hist );
+
+/* Append a snapshot of both conditions, timed from pgnew->modtime */
+int bsxAppendPriceGuideHistory( bsxPriceGuideHistory *hist, bsxPriceGuide *pgnew, bsxPriceGuide *pgused, char itemtypeid, char *itemid, int itemcolorid );
+
+/* Return the count of samples within [starttime,endtime] oldest first, or -1 on error; *retlist must be freed() */
+int bsxReadPriceGuideHistory( bsxPriceGuideHistory *hist, char itemtypeid, char *itemid, int itemcolorid, int64_t starttime, int64_t endtime, bsxPriceGuideSample **retlist );
+
+int bsxPriceGuideHistoryKeyCount( bsxPriceGuideHistory *hist );
+int64_t bsxPriceGuideHistorySampleCount( bsxPriceGuideHistory *hist );
+
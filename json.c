@@ -757,6 +757,203 @@ int jsonReadDouble( jsonParser *parser, double *retdouble )
 ////
 
 
+#define JSON_STREAM_FLAGS_STRING (0x1)
+#define JSON_STREAM_FLAGS_ESCAPE (0x2)
+/* Receiving an object to parse on its own */
+#define JSON_STREAM_FLAGS_ELEMENT (0x4)
+/* Separating comma after the object must be taken out of the skeleton */
+#define JSON_STREAM_FLAGS_DROPCOMMA (0x8)
+#define JSON_STREAM_FLAGS_ERROR (0x10)
+
+void jsonStreamInit( jsonStream *stream, void *uservalue, int (*parseobject)( jsonParser *parser, void *uservalue ), ioLog *log )
+{
+  ccGrowthInit( &stream->element, 4096 );
+  ccGrowthInit( &stream->skeleton, 4096 );
+  stream->uservalue = uservalue;
+  stream->parseobject = parseobject;
+  stream->log = log;
+  jsonStreamReset( stream );
+  return;
+}
+
+void jsonStreamReset( jsonStream *stream )
+{
+  stream->flags = 0;
+  stream->depth = 0;
+  stream->listmask = 0;
+  stream->elementdepth = 0;
+  stream->element.offset = 0;
+  stream->skeleton.offset = 0;
+  stream->objectcount = 0;
+  stream->errorcount = 0;
+  return;
+}
+
+static void jsonStreamParseObject( jsonStream *stream )
+{
+  char *string;
+  jsonTokenBuffer *tokenbuf;
+  jsonParser parser;
+
+  /* Null-terminate the object's text */
+  ccGrowthData( &stream->element, "", 1 );
+  string = stream->element.data;
+  stream->element.offset = 0;
+  stream->objectcount++;
+
+  tokenbuf = jsonLexParse( string, stream->log );
+  if( !( tokenbuf ) )
+  {
+    stream->errorcount++;
+    return;
+  }
+  jsonTokenInit( &parser, string, tokenbuf, stream->log );
+  if( jsonTokenExpect( &parser, JSON_TOKEN_LBRACE ) )
+  {
+    if( stream->parseobject( &parser, stream->uservalue ) )
+      jsonTokenExpect( &parser, JSON_TOKEN_RBRACE );
+    else
+      parser.errorcount++;
+  }
+  if( parser.errorcount )
+    stream->errorcount++;
+  jsonLexFree( tokenbuf );
+  return;
+}
+
+int jsonStreamFeed( jsonStream *stream, char *data, size_t size )
+{
+  int flags;
+  char c;
+  size_t index, spanbase;
+
+  if( stream->flags & JSON_STREAM_FLAGS_ERROR )
+    return 0;
+  flags = stream->flags;
+  spanbase = 0;
+  for( index = 0 ; index < size ; index++ )
+  {
+    c = data[index];
+    if( flags & JSON_STREAM_FLAGS_STRING )
+    {
+      if( flags & JSON_STREAM_FLAGS_ESCAPE )
+        flags &= ~JSON_STREAM_FLAGS_ESCAPE;
+      else if( c == '\\' )
+        flags |= JSON_STREAM_FLAGS_ESCAPE;
+      else if( c == '\"' )
+        flags &= ~JSON_STREAM_FLAGS_STRING;
+      if( !( flags & JSON_STREAM_FLAGS_ELEMENT ) )
+        ccGrowthData( &stream->skeleton, &c, 1 );
+      continue;
+    }
+    switch( c )
+    {
+      case '\"':
+        flags |= JSON_STREAM_FLAGS_STRING;
+        break;
+      case '{':
+      case '[':
+        if( stream->depth >= JSON_STREAM_DEPTH_MAX )
+          goto error;
+        if( !( flags & JSON_STREAM_FLAGS_ELEMENT ) && ( c == '{' ) && ( stream->depth ) && ( stream->listmask & ( (uint64_t)1 << ( stream->depth - 1 ) ) ) )
+        {
+          /* Object in a list, receive it on its own and take it out of the skeleton along with a separating comma */
+          flags |= JSON_STREAM_FLAGS_ELEMENT;
+          stream->elementdepth = stream->depth;
+          spanbase = index;
+          if( ( stream->skeleton.offset ) && ( ((char *)stream->skeleton.data)[ stream->skeleton.offset - 1 ] == ',' ) )
+          {
+            stream->skeleton.offset--;
+            flags &= ~JSON_STREAM_FLAGS_DROPCOMMA;
+          }
+          else
+            flags |= JSON_STREAM_FLAGS_DROPCOMMA;
+        }
+        if( c == '[' )
+          stream->listmask |= (uint64_t)1 << stream->depth;
+        else
+          stream->listmask &= ~( (uint64_t)1 << stream->depth );
+        stream->depth++;
+        break;
+      case '}':
+      case ']':
+        if( !( stream->depth ) )
+          goto error;
+        stream->depth--;
+        if( ( flags & JSON_STREAM_FLAGS_ELEMENT ) && ( stream->depth == stream->elementdepth ) )
+        {
+          flags &= ~JSON_STREAM_FLAGS_ELEMENT;
+          ccGrowthData( &stream->element, &data[spanbase], ( index + 1 ) - spanbase );
+          jsonStreamParseObject( stream );
+          continue;
+        }
+        break;
+      case ',':
+        if( ( flags & ( JSON_STREAM_FLAGS_ELEMENT | JSON_STREAM_FLAGS_DROPCOMMA ) ) == JSON_STREAM_FLAGS_DROPCOMMA )
+        {
+          flags &= ~JSON_STREAM_FLAGS_DROPCOMMA;
+          continue;
+        }
+        break;
+      case ' ':
+      case '\t':
+      case '\r':
+      case '\n':
+        /* Keep the skeleton compact */
+        if( !( flags & JSON_STREAM_FLAGS_ELEMENT ) )
+          continue;
+        break;
+      default:
+        break;
+    }
+    if( !( flags & JSON_STREAM_FLAGS_ELEMENT ) )
+    {
+      flags &= ~JSON_STREAM_FLAGS_DROPCOMMA;
+      ccGrowthData( &stream->skeleton, &c, 1 );
+    }
+  }
+
+  /* Keep the partial object for the next call */
+  if( flags & JSON_STREAM_FLAGS_ELEMENT )
+    ccGrowthData( &stream->element, &data[spanbase], size - spanbase );
+  stream->flags = flags;
+  return 1;
+
+  error:
+  ioPrintf( stream->log, 0, "JSON STREAM: Error, unbalanced brackets or nesting too deep.\n" );
+  stream->flags = flags | JSON_STREAM_FLAGS_ERROR;
+  return 0;
+}
+
+char *jsonStreamFinish( jsonStream *stream )
+{
+  if( ( stream->flags & ( JSON_STREAM_FLAGS_STRING | JSON_STREAM_FLAGS_ELEMENT | JSON_STREAM_FLAGS_ERROR ) ) || ( stream->depth ) )
+  {
+    ioPrintf( stream->log, 0, "JSON STREAM: Error, incomplete reply.\n" );
+    return 0;
+  }
+  if( stream->errorcount )
+  {
+    ioPrintf( stream->log, 0, "JSON STREAM: Error, %d of %d objects failed to parse.\n", stream->errorcount, stream->objectcount );
+    return 0;
+  }
+  /* Null-terminate, without including the terminator in the skeleton's size */
+  ccGrowthData( &stream->skeleton, "", 1 );
+  stream->skeleton.offset--;
+  return stream->skeleton.data;
+}
+
+void jsonStreamFree( jsonStream *stream )
+{
+  ccGrowthFree( &stream->element );
+  ccGrowthFree( &stream->skeleton );
+  return;
+}
+
+
+////
+
+
 
 /* Build string with escape chars as required, returned string must be free()'d */
 char *jsonEncodeEscapeString( char *string, int length, int *retlength )
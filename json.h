@@ -151,6 +151,49 @@ int jsonReadDouble( jsonParser *parser, double *retdouble );
 ////
 
 
+/* Streaming reader, objects found in lists are parsed one by one as the text is received */
+
+#define JSON_STREAM_DEPTH_MAX (64)
+
+typedef struct
+{
+  int flags;
+  int depth;
+  /* Bit set for each depth where the container is a list */
+  uint64_t listmask;
+  /* Depth of the list holding the object being received */
+  int elementdepth;
+  /* Text of the object being received */
+  ccGrowth element;
+  /* Text of the reply with the streamed objects taken out */
+  ccGrowth skeleton;
+  int objectcount;
+  int errorcount;
+
+  void *uservalue;
+  int (*parseobject)( jsonParser *parser, void *uservalue );
+  ioLog *log;
+} jsonStream;
+
+
+/* Initialize stream, parseobject() is called with token '{' already accepted for every object of every list */
+void jsonStreamInit( jsonStream *stream, void *uservalue, int (*parseobject)( jsonParser *parser, void *uservalue ), ioLog *log );
+
+/* Discard everything received, to start over with a new reply */
+void jsonStreamReset( jsonStream *stream );
+
+/* Feed received text, return 0 on error */
+int jsonStreamFeed( jsonStream *stream, char *data, size_t size );
+
+/* Return the skeleton of the reply with streamed objects taken out, or null if the reply was incomplete or any object failed to parse */
+char *jsonStreamFinish( jsonStream *stream );
+
+void jsonStreamFree( jsonStream *stream );
+
+
+////
+
+
 /* Build string with escape chars as required, returned string must be free()'d */
 char *jsonEncodeEscapeString( char *string, int length, int *retlength );
 
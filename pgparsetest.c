@@ -0,0 +1,307 @@
+/* -----------------------------------------------------------------------------
+ *
+ * Copyright (c) 2014-2019 Alexis Naveros.
+ *
+ * This software is provided 'as-is', without any express or implied
+ * warranty. In no event will the authors be held liable for any damages
+ * arising from the use of this software.
+ *
+ * Permission is granted to anyone to use this software for any purpose,
+ * including commercial applications, and to alter it and redistribute it
+ * freely, subject to the following restrictions:
+ *
+ * 1. The origin of this software must not be misrepresented; you must not
+ * claim that you wrote the original software. If you use this software
+ * in a product, an acknowledgment in the product documentation would be
+ * appreciated but is not required.
+ * 2. Altered source versions must be plainly marked as such, and must not be
+ * misrepresented as being the original software.
+ * 3. This notice may not be removed or altered from any source distribution.
+ *
+ * -----------------------------------------------------------------------------
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+
+#include "cpuconfig.h"
+#include "cc.h"
+#include "ccstr.h"
+#include "mm.h"
+#include "iolog.h"
+#include "debugtrack.h"
+
+#include "bsx.h"
+#include "bsxpg.h"
+#include "tcp.h"
+
+#include "json.h"
+#include "bsorder.h"
+#include "bricklink.h"
+
+
+/*
+Regression and benchmark harness for blHtmlParsePriceGuide() over stored priceGuide.asp pages.
+
+gcc -std=gnu99 pgparsetest.c bricklink.c bsorder.c bsx.c json.c tcp.c iolog.c debugtrack.c cc.c ccstr.c mm.c mmhash.c mmbitmap.c -O2 -s -o pgparsetest -lm -lpthread -lssl -lcrypto
+
+./pgparsetest [-w] [-n iterations] page0.html page1.html ...
+
+Each page is checked against the previous parser kept below, and against "page.html.ref" if present.
+With -w, the reference files are written instead.
+*/
+
+
+////
+
+
+#ifndef ADDRESS
+ #define ADDRESS(p,o) ((void *)(((char *)p)+(o)))
+#endif
+
+#define PGPARSE_ITERATIONS_DEFAULT (200)
+#define PGPARSE_PAGE_SIZE_MAX (16*1048576)
+
+static const size_t pgParseOffsetTable[2][6] =
+{
+  {
+    offsetof(bsxPriceGuide,salecount), offsetof(bsxPriceGuide,saleqty),
+    offsetof(bsxPriceGuide,saleminimum), offsetof(bsxPriceGuide,saleaverage),
+    offsetof(bsxPriceGuide,saleqtyaverage), offsetof(bsxPriceGuide,salemaximum)
+  },
+  {
+    offsetof(bsxPriceGuide,stockcount), offsetof(bsxPriceGuide,stockqty),
+    offsetof(bsxPriceGuide,stockminimum), offsetof(bsxPriceGuide,stockaverage),
+    offsetof(bsxPriceGuide,stockqtyaverage), offsetof(bsxPriceGuide,stockmaximum)
+  }
+};
+
+/* Previous parser, repeated string searches over a string it modifies */
+static int pgParseReference( bsxPriceGuide *pgnew, bsxPriceGuide *pgused, char *string, int stringlength )
+{
+  int section, sub, value;
+  char *sectionstr[2], *substr[2];
+  char *valstr;
+  void *writeaddr;
+  bsxPriceGuide *pg;
+
+  memset( pgnew, 0, sizeof(bsxPriceGuide) );
+  memset( pgused, 0, sizeof(bsxPriceGuide) );
+  sectionstr[0] = ccSeqFindStrSkip( string, stringlength, "Past 6 Months Sales" );
+  sectionstr[1] = ccSeqFindStrSkip( string, stringlength, "Current Items for Sale" );
+  string[stringlength-1] = 0;
+  if( sectionstr[0] )
+    sectionstr[0][-1] = 0;
+  if( sectionstr[1] )
+    sectionstr[1][-1] = 0;
+
+  for( section = 0 ; section < 2 ; section++ )
+  {
+    if( !( sectionstr[section] ) )
+      continue;
+    substr[0] = ccStrFindStrSkip( sectionstr[section], "New" );
+    substr[1] = ccStrFindStrSkip( sectionstr[section], "Used" );
+    for( sub = 0 ; sub < 2 ; sub++ )
+    {
+      valstr = substr[sub];
+      if( !( valstr ) )
+        continue;
+      pg = ( sub ? pgused : pgnew );
+      for( value = 0 ; value < 2 ; value++ )
+      {
+        writeaddr = ADDRESS( pg, pgParseOffsetTable[section][value] );
+        valstr = ccStrFindStrSkip( valstr, "SIZE=\"2\">&nbsp;" );
+        if( !( valstr ) )
+          return 0;
+        if( sscanf( valstr, "%d", (int *)writeaddr ) != 1 )
+          return 0;
+      }
+      for( ; value < 6 ; value++ )
+      {
+        writeaddr = ADDRESS( pg, pgParseOffsetTable[section][value] );
+        valstr = ccStrFindStrSkip( valstr, "SIZE=\"2\">&nbsp;" );
+        if( !( valstr ) )
+          return 0;
+        if( sscanf( valstr, "$%f", (float *)writeaddr ) != 1 )
+          return 0;
+      }
+    }
+  }
+  return 1;
+}
+
+
+////
+
+
+typedef struct
+{
+  char *path;
+  char *data;
+  size_t size;
+} pgParsePage;
+
+/* Text form of a parse result, as stored in reference files */
+static char *pgParseFormat( int result, bsxPriceGuide *pgnew, bsxPriceGuide *pgused )
+{
+  int sub;
+  char *line[2];
+  char *text;
+  bsxPriceGuide *pg;
+
+  if( !( result ) )
+    return ccStrDup( "Failure\n" );
+  for( sub = 0 ; sub < 2 ; sub++ )
+  {
+    pg = ( sub ? pgused : pgnew );
+    line[sub] = ccStrAllocPrintf( "%s %d %d %.4f %.4f %.4f %.4f %d %d %.4f %.4f %.4f %.4f\n", ( sub ? "Used" : "New" ), pg->salecount, pg->saleqty, pg->saleminimum, pg->saleaverage, pg->saleqtyaverage, pg->salemaximum, pg->stockcount, pg->stockqty, pg->stockminimum, pg->stockaverage, pg->stockqtyaverage, pg->stockmaximum );
+  }
+  text = ccStrAllocPrintf( "%s%s", line[0], line[1] );
+  free( line[0] );
+  free( line[1] );
+  return text;
+}
+
+static char *pgParseRun( pgParsePage *page, int referenceflag )
+{
+  int result;
+  char *copy;
+  bsxPriceGuide pgnew, pgused;
+
+  copy = malloc( page->size + 1 );
+  memcpy( copy, page->data, page->size );
+  copy[page->size] = 0;
+  if( referenceflag )
+    result = pgParseReference( &pgnew, &pgused, copy, (int)page->size );
+  else
+    result = blHtmlParsePriceGuide( &pgnew, &pgused, copy, (int)page->size );
+  free( copy );
+  return pgParseFormat( result, &pgnew, &pgused );
+}
+
+/* Time parses of all pages, the reference parser is given a fresh copy each time as it modifies it */
+static double pgParseBench( pgParsePage *pagelist, int pagecount, int iterations, int referenceflag )
+{
+  int iteration, pageindex;
+  uint64_t starttime, totalsize;
+  char *copy;
+  size_t copysize;
+  bsxPriceGuide pgnew, pgused;
+
+  copysize = 0;
+  for( pageindex = 0 ; pageindex < pagecount ; pageindex++ )
+  {
+    if( pagelist[pageindex].size > copysize )
+      copysize = pagelist[pageindex].size;
+  }
+  copy = malloc( copysize + 1 );
+  totalsize = 0;
+  starttime = ccGetMicrosecondsTime();
+  for( iteration = 0 ; iteration < iterations ; iteration++ )
+  {
+    for( pageindex = 0 ; pageindex < pagecount ; pageindex++ )
+    {
+      memcpy( copy, pagelist[pageindex].data, pagelist[pageindex].size );
+      if( referenceflag )
+        pgParseReference( &pgnew, &pgused, copy, (int)pagelist[pageindex].size );
+      else
+        blHtmlParsePriceGuide( &pgnew, &pgused, copy, (int)pagelist[pageindex].size );
+      totalsize += pagelist[pageindex].size;
+    }
+  }
+  starttime = ccGetMicrosecondsTime() - starttime;
+  free( copy );
+  if( !( starttime ) )
+    starttime = 1;
+  return ( (double)totalsize / (double)starttime );
+}
+
+
+int main( int argc, char **argv )
+{
+  int argindex, writeflag, iterations, pagecount, failcount;
+  char *result, *reference, *refpath;
+  size_t refsize;
+  pgParsePage *pagelist, *page;
+
+  writeflag = 0;
+  iterations = PGPARSE_ITERATIONS_DEFAULT;
+  pagelist = malloc( argc * sizeof(pgParsePage) );
+  pagecount = 0;
+  for( argindex = 1 ; argindex < argc ; argindex++ )
+  {
+    if( ccStrCmpEqual( argv[argindex], "-w" ) )
+      writeflag = 1;
+    else if( ccStrCmpEqual( argv[argindex], "-n" ) && ( argindex + 1 < argc ) )
+      iterations = atoi( argv[++argindex] );
+    else
+    {
+      page = &pagelist[pagecount];
+      page->path = argv[argindex];
+      page->data = ccFileLoad( page->path, PGPARSE_PAGE_SIZE_MAX, &page->size );
+      if( !( page->data ) || !( page->size ) )
+      {
+        printf( "ERROR: Failed to load page \"%s\".\n", page->path );
+        return 1;
+      }
+      pagecount++;
+    }
+  }
+  if( !( pagecount ) )
+  {
+    printf( "Usage: %s [-w] [-n iterations] page0.html page1.html ...\n", argv[0] );
+    return 1;
+  }
+
+  failcount = 0;
+  for( page = pagelist ; page < &pagelist[pagecount] ; page++ )
+  {
+    result = pgParseRun( page, 0 );
+    refpath = ccStrAllocPrintf( "%s.ref", page->path );
+    if( writeflag )
+    {
+      if( !( ccFileStore( refpath, result, strlen( result ), 0 ) ) )
+      {
+        printf( "ERROR: Failed to write \"%s\".\n", refpath );
+        failcount++;
+      }
+    }
+    else
+    {
+      reference = ccFileLoad( refpath, 65536, &refsize );
+      if( ( reference ) && ( ( refsize != strlen( result ) ) || ( memcmp( reference, result, refsize ) ) ) )
+      {
+        printf( "FAIL: \"%s\" differs from \"%s\"\n%s", page->path, refpath, result );
+        failcount++;
+      }
+      free( reference );
+    }
+    free( refpath );
+    reference = pgParseRun( page, 1 );
+    if( strcmp( reference, result ) )
+    {
+      printf( "FAIL: \"%s\" differs from the previous parser\n%s%s", page->path, result, reference );
+      failcount++;
+    }
+    free( reference );
+    free( result );
+  }
+  printf( "Checked %d pages, %d failures.\n", pagecount, failcount );
+
+  if( iterations > 0 )
+  {
+    printf( "Previous parser : %.1f MB/s\n", pgParseBench( pagelist, pagecount, iterations, 1 ) );
+    printf( "Current parser  : %.1f MB/s\n", pgParseBench( pagelist, pagecount, iterations, 0 ) );
+  }
+
+  for( page = pagelist ; page < &pagelist[pagecount] ; page++ )
+    free( page->data );
+  free( pagelist );
+  return ( failcount ? 1 : 0 );
+}
+
@@ -67,6 +67,11 @@
  #include <pthread.h>
  #include <signal.h>
 #endif
+#if CC_LINUX
+ #include <sys/epoll.h>
+ #include <sys/eventfd.h>
+ #include <sys/timerfd.h>
+#endif
 
 
 #include "tcp.h"
@@ -74,6 +79,12 @@
 
 #define TCP_ENABLE_SSL_SUPPORT (1)
 
+#if CC_LINUX
+ #define TCP_ENABLE_EPOLL_SUPPORT (1)
+#else
+ #define TCP_ENABLE_EPOLL_SUPPORT (0)
+#endif
+
 #define TCP_DEBUG (0)
 #define TCP_DEBUG_EVENTS (0)
 #define TCP_DEBUG_PRINT_ERRORS (0)
@@ -119,6 +130,12 @@
 #define TCPLINK_FLAGS_SSL_ACTIVE (0x4000)
 #define TCPLINK_FLAGS_SSL_LISTEN (0x8000)
 
+/* Edge-triggered readiness recorded by the epoll backend, cleared once consumed */
+#define TCPLINK_FLAGS_READY_RECV (0x10000)
+#define TCPLINK_FLAGS_READY_SEND (0x20000)
+/* Link is queued on context->pendinglist for the epoll backend */
+#define TCPLINK_FLAGS_PENDING (0x40000)
+
 #if CC_WINDOWS
  /* A low number is required on Windows since tcpWake does *not* work! */
  #define TCP_DEFAULT_SELECT_TIMEOUT (500)
@@ -130,6 +147,8 @@
 
 #define TCP_DEFAULT_CLOSING_TIMEOUT (5000)
 
+#define TCP_EPOLL_EVENT_COUNT (64)
+
 static void *tcpThreadWork( void *p );
 
 
@@ -187,6 +206,7 @@ struct _tcpLink
 
   mmListNode list;
   mmListNode eventlist;
+  mmListNode pendinglist;
 };
 
 
@@ -346,6 +366,8 @@ static void tcpLinkFree( tcpContext *context, tcpLink *link )
     close( link->socket );
 #endif
   tcpEventQueueRemove( context, link );
+  if( link->flags & TCPLINK_FLAGS_PENDING )
+    mmListRemove( link, offsetof(tcpLink,pendinglist) );
   free( link );
   return;
 }
@@ -454,6 +476,127 @@ static void tcpDestroyWakePipe( tcpContext *context )
 ////
 
 
+#if TCP_ENABLE_EPOLL_SUPPORT
+
+static int tcpCreateEpoll( tcpContext *context )
+{
+  struct epoll_event event;
+
+  context->eventfd = -1;
+  context->timerfd = -1;
+  context->timerdeadline = INT64_MAX;
+  context->pendinglist = 0;
+  if( ( context->epollfd = epoll_create1( EPOLL_CLOEXEC ) ) == -1 )
+  {
+    TCP_ERROR();
+    return 0;
+  }
+  if( ( context->eventfd = eventfd( 0, EFD_NONBLOCK | EFD_CLOEXEC ) ) == -1 )
+    goto error;
+  if( ( context->timerfd = timerfd_create( CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC ) ) == -1 )
+    goto error;
+  /* The wake and timer descriptors are told apart from links by their data pointers */
+  memset( &event, 0, sizeof(struct epoll_event) );
+  event.events = EPOLLIN;
+  event.data.ptr = &context->eventfd;
+  if( epoll_ctl( context->epollfd, EPOLL_CTL_ADD, context->eventfd, &event ) == -1 )
+    goto error;
+  event.data.ptr = &context->timerfd;
+  if( epoll_ctl( context->epollfd, EPOLL_CTL_ADD, context->timerfd, &event ) == -1 )
+    goto error;
+  context->wakepipe[0] = -1;
+  context->wakepipe[1] = -1;
+  return 1;
+
+  error:
+  TCP_ERROR();
+  if( context->timerfd != -1 )
+    close( context->timerfd );
+  if( context->eventfd != -1 )
+    close( context->eventfd );
+  close( context->epollfd );
+  context->epollfd = -1;
+  return 0;
+}
+
+static void tcpDestroyEpoll( tcpContext *context )
+{
+  if( context->epollfd == -1 )
+    return;
+  close( context->timerfd );
+  close( context->eventfd );
+  close( context->epollfd );
+  context->epollfd = -1;
+  return;
+}
+
+/* Data links are edge-triggered, listening links stay level-triggered as tcpPollListen() accepts one connection per pass */
+static int tcpEpollRegister( tcpContext *context, tcpLink *link )
+{
+  struct epoll_event event;
+
+  if( context->epollfd == -1 )
+    return 1;
+  memset( &event, 0, sizeof(struct epoll_event) );
+  if( link->flags & TCPLINK_FLAGS_LISTEN )
+    event.events = EPOLLIN;
+  else
+    event.events = EPOLLIN | EPOLLOUT | EPOLLRDHUP | EPOLLET;
+  event.data.ptr = link;
+  if( epoll_ctl( context->epollfd, EPOLL_CTL_ADD, link->socket, &event ) == -1 )
+  {
+    TCP_ERROR();
+    return 0;
+  }
+  return 1;
+}
+
+/* Queue link to be processed on the next pass without waiting for a new edge */
+static void tcpEpollPending( tcpContext *context, tcpLink *link )
+{
+  if( ( context->epollfd == -1 ) || ( link->flags & TCPLINK_FLAGS_PENDING ) )
+    return;
+  mmListAdd( &context->pendinglist, link, offsetof(tcpLink,pendinglist) );
+  link->flags |= TCPLINK_FLAGS_PENDING;
+  return;
+}
+
+/* Bring the timer forward if deadline is earlier than the one currently armed */
+static void tcpEpollArmTimer( tcpContext *context, int64_t deadline )
+{
+  int64_t msecs;
+  struct itimerspec spec;
+
+  if( ( context->epollfd == -1 ) || ( deadline >= context->timerdeadline ) )
+    return;
+  context->timerdeadline = deadline;
+  msecs = deadline - tcpTime( context );
+  /* A zero it_value would disarm the timer */
+  if( msecs < 1 )
+    msecs = 1;
+  memset( &spec, 0, sizeof(struct itimerspec) );
+  spec.it_value.tv_sec = msecs / 1000;
+  spec.it_value.tv_nsec = ( msecs % 1000 ) * 1000000;
+  if( timerfd_settime( context->timerfd, 0, &spec, 0 ) == -1 )
+    TCP_ERROR();
+  return;
+}
+
+static void tcpEpollArmLinkTimer( tcpContext *context, tcpLink *link )
+{
+  if( ( link->timeoutmsecs ) && !( link->flags & TCPLINK_FLAGS_EVENT_TIMEOUT ) )
+    tcpEpollArmTimer( context, link->time + link->timeoutmsecs );
+  if( ( link->flags & ( TCPLINK_FLAGS_CLOSING | TCPLINK_FLAGS_TERMINATELIST ) ) == TCPLINK_FLAGS_CLOSING )
+    tcpEpollArmTimer( context, link->time + TCP_DEFAULT_CLOSING_TIMEOUT );
+  return;
+}
+
+#endif
+
+
+////
+
+
 int tcpInit( tcpContext *context, int threadflag, int sslsupportflag )
 {
   DEBUG_SET_TRACKER();
@@ -476,8 +619,15 @@ int tcpInit( tcpContext *context, int threadflag, int sslsupportflag )
 #endif
   gettimeofday( &context->reftime, 0 );
   mmBlockInit( &context->bufferblock, sizeof(tcpBuffer) + TCP_BUFFER_DEFAULT_SIZE, TCP_BUFFER_CHUNK_COUNT, TCP_BUFFER_CHUNK_COUNT, 0x10 );
-  if( !tcpCreateWakePipe( context ) )
-    return 0;
+  /* Use epoll when available, select() otherwise */
+  context->epollfd = -1;
+#if TCP_ENABLE_EPOLL_SUPPORT
+  if( !( tcpCreateEpoll( context ) ) )
+#endif
+  {
+    if( !tcpCreateWakePipe( context ) )
+      return 0;
+  }
   context->cancelflag = 0;
   context->threadstate = ( threadflag ? TCP_THREAD_STATE_NORMAL : TCP_THREAD_STATE_NONE );
   context->eventlist = 0;
@@ -530,6 +680,9 @@ void tcpEnd( tcpContext *context )
   }
   for( link = context->listenlist ; link ; link = link->list.next )
     link->flags |= TCPLINK_FLAGS_CLOSING;
+#if TCP_ENABLE_EPOLL_SUPPORT
+  tcpEpollArmTimer( context, tcpTime( context ) + TCP_DEFAULT_CLOSING_TIMEOUT );
+#endif
 
   if( !( context->threadstate & TCP_THREAD_STATE_MASK_ACTIVE ) )
     tcpFlush( context );
@@ -569,6 +722,10 @@ void tcpEnd( tcpContext *context )
     tcpLinkFree( context, link );
   }
 
+#if TCP_ENABLE_EPOLL_SUPPORT
+  tcpDestroyEpoll( context );
+#endif
+
 #if TCP_ENABLE_SSL_SUPPORT
   if( context->sslcontext )
     SSL_CTX_free( context->sslcontext );
@@ -836,6 +993,12 @@ tcpLink *tcpConnect( tcpContext *context, char *address, int port, void *userval
   }
 #endif
 
+#if TCP_ENABLE_EPOLL_SUPPORT
+  if( !( tcpEpollRegister( context, link ) ) )
+    goto error;
+  tcpEpollArmLinkTimer( context, link );
+#endif
+
   mmListAdd( &context->linklist, link, offsetof(tcpLink,list) );
 
   if( context->threadstate == TCP_THREAD_STATE_NORMAL )
@@ -937,6 +1100,11 @@ tcpLink *tcpListen( tcpContext *context, int port, void *listenvalue, tcpCallbac
     link->flags |= TCPLINK_FLAGS_SSL_LISTEN;
 #endif
 
+#if TCP_ENABLE_EPOLL_SUPPORT
+  if( !( tcpEpollRegister( context, link ) ) )
+    goto error;
+#endif
+
   mmListAdd( &context->listenlist, link, offsetof(tcpLink,list) );
 
   if( context->threadstate == TCP_THREAD_STATE_NORMAL )
@@ -968,6 +1136,9 @@ void tcpSetTimeout( tcpContext *context, tcpLink *link, int milliseconds )
   if( milliseconds < link->timeoutmsecs )
     wakeflag = 1;
   link->timeoutmsecs = milliseconds;
+#if TCP_ENABLE_EPOLL_SUPPORT
+  tcpEpollArmLinkTimer( context, link );
+#endif
   if( context->threadstate == TCP_THREAD_STATE_NORMAL )
     mtMutexUnlock( &context->mutex );
   if( wakeflag )
@@ -995,6 +1166,9 @@ void tcpClose( tcpContext *context, tcpLink *link )
 #endif
   link->flags |= TCPLINK_FLAGS_CLOSING | TCPLINK_FLAGS_TERMINATED;
   tcpEventQueueRemove( context, link );
+#if TCP_ENABLE_EPOLL_SUPPORT
+  tcpEpollArmLinkTimer( context, link );
+#endif
 
   if( context->threadstate == TCP_THREAD_STATE_NORMAL )
     mtMutexUnlock( &context->mutex );
@@ -1063,6 +1237,10 @@ void tcpQueueSendBuffer( tcpContext *context, tcpLink *link, tcpDataBuffer *netb
   mmListDualAddLast( &link->sendlist, buf, offsetof(tcpBuffer,list) );
   link->flags |= TCPLINK_FLAGS_WANT_SEND;
   link->sendbuffered += sendsize;
+#if TCP_ENABLE_EPOLL_SUPPORT
+  /* The socket may have been writable all along, no new edge would be reported */
+  tcpEpollPending( context, link );
+#endif
   if( ( netio->sendwait ) && ( link->sendbuffered >= TCP_BUFFER_SEND_READY_SIZE_TRESHOLD ) )
     netio->sendwait( link->uservalue, link->sendbuffered );
 
@@ -1128,7 +1306,7 @@ static inline void tcpPollListen( tcpContext *context )
     }
 #endif
 #if CC_UNIX
-    if( socket >= FD_SETSIZE )
+    if( ( context->epollfd == -1 ) && ( socket >= FD_SETSIZE ) )
     {
       TCP_DEBUG_PRINTF( "TCP: Error, socket >= FD_SETSIZE, %d\n", socket );
       close( socket );
@@ -1186,6 +1364,15 @@ static inline void tcpPollListen( tcpContext *context )
     }
 #endif
 
+#if TCP_ENABLE_EPOLL_SUPPORT
+    if( !( tcpEpollRegister( context, link ) ) )
+    {
+      tcpLinkFree( context, link );
+      continue;
+    }
+    tcpEpollArmLinkTimer( context, link );
+#endif
+
     mmListAdd( &context->linklist, link, offsetof(tcpLink,list) );
 
     /* Inherit the listening link's value, until it's updated by the incoming() callback */
@@ -1480,19 +1667,161 @@ static int tcpSslHandshake( tcpLink *link )
 #endif
 
 
-static int tcpProcess( tcpContext *context, int64_t maxtimeout )
+#define TCP_PROCESS_EVENT (0x1)
+#define TCP_PROCESS_WAKE (0x2)
+#define TCP_PROCESS_DONE (0x4)
+
+/* Perform pending I/O on a link given its readiness, shared by the select() and epoll backends */
+static int tcpProcessLinkIO( tcpContext *context, tcpLink *link, int readflag, int writeflag, int64_t curtime )
 {
-  int a, eventflag, tcpcode, wakeflag;
-#if CC_UNIX
-  int rmax;
+  int tcpcode, retcode;
+
+  DEBUG_SET_TRACKER();
+
+  retcode = 0;
+#if TCP_ENABLE_SSL_SUPPORT
+  if( link->flags & ( TCPLINK_FLAGS_SSL_NEEDCONNECT | TCPLINK_FLAGS_SSL_NEEDACCEPT ) )
+  {
+    if( !( readflag | writeflag ) )
+      return 0;
+    link->time = curtime;
+    link->flags &= ~( TCPLINK_FLAGS_READY_RECV | TCPLINK_FLAGS_READY_SEND );
+    if( tcpSslHandshake( link ) )
+      retcode |= TCP_PROCESS_EVENT;
+    else if( link->flags & TCPLINK_FLAGS_SSL_ACTIVE )
+    {
+      /* Handshake complete, readiness is unknown so try both directions on the next pass */
+      link->flags |= TCPLINK_FLAGS_READY_RECV | TCPLINK_FLAGS_READY_SEND;
+#if TCP_ENABLE_EPOLL_SUPPORT
+      tcpEpollPending( context, link );
 #endif
-  int64_t msecs, curtime, beftimeout;
-  tcpLink *link, *linkl, *next;
-  tcpCallbackSet *netio;
-  struct timeval timeout;
-  fd_set fdRead;
-  fd_set fdWrite;
-  fd_set fdError;
+    }
+    return retcode | TCP_PROCESS_DONE;
+  }
+#endif
+
+  if( readflag )
+  {
+    if( ( link->flags & TCPLINK_FLAGS_EVENT_MASK ) == TCPLINK_FLAGS_EVENT_TIMEOUT )
+      tcpEventQueueRemove( context, link );
+    link->time = curtime;
+    link->flags &= ~TCPLINK_FLAGS_READY_RECV;
+    tcpcode = tcpRecv( context, link );
+    if( tcpcode & TCP_CODE_DATA )
+    {
+      retcode |= TCP_PROCESS_EVENT | TCP_PROCESS_WAKE;
+      tcpEventQueueAdd( context, link, TCPLINK_FLAGS_EVENT_RECV );
+    }
+    if( tcpcode & TCP_CODE_ERROR )
+    {
+      if( !( link->flags & TCPLINK_FLAGS_CLOSING ) )
+      {
+        /* TODO: SSL version? */
+#if CC_WINDOWS
+        shutdown( link->socket, SD_BOTH );
+#else
+        shutdown( link->socket, SHUT_RDWR );
+#endif
+        link->flags |= TCPLINK_FLAGS_CLOSING;
+      }
+      else if( !( link->flags & TCPLINK_FLAGS_TERMINATELIST ) )
+      {
+        /* Remove link from active list, add to terminatelist */
+        mmListRemove( link, offsetof(tcpLink,list) );
+        mmListAdd( &context->terminatelist, link, offsetof(tcpLink,list) );
+        tcpEventQueueAdd( context, link, TCPLINK_FLAGS_EVENT_CLOSED );
+        link->flags |= TCPLINK_FLAGS_TERMINATELIST;
+      }
+      return TCP_PROCESS_EVENT | TCP_PROCESS_DONE;
+    }
+  }
+
+  if( writeflag )
+  {
+    if( ( link->flags & TCPLINK_FLAGS_EVENT_MASK ) == TCPLINK_FLAGS_EVENT_TIMEOUT )
+      tcpEventQueueRemove( context, link );
+    link->time = curtime;
+    tcpcode = tcpSend( context, link );
+    if( !( tcpcode ) )
+      link->flags &= ~TCPLINK_FLAGS_WANT_SEND;
+    else
+    {
+      /* Data left to send, the socket buffer is full */
+      if( !( tcpcode & TCP_CODE_COMPLETE ) )
+        link->flags &= ~TCPLINK_FLAGS_READY_SEND;
+      if( tcpcode & TCP_CODE_COMPLETE )
+      {
+        link->flags &= ~TCPLINK_FLAGS_WANT_SEND;
+        tcpEventQueueAdd( context, link, TCPLINK_FLAGS_EVENT_SENDFINISHED );
+        retcode |= TCP_PROCESS_EVENT | TCP_PROCESS_WAKE;
+      }
+      if( tcpcode & TCP_CODE_ERROR )
+      {
+        if( !( link->flags & TCPLINK_FLAGS_CLOSING ) )
+        {
+          /* TODO: SSL version? */
+#if CC_WINDOWS
+          shutdown( link->socket, SD_BOTH );
+#else
+          shutdown( link->socket, SHUT_RDWR );
+#endif
+          link->flags |= TCPLINK_FLAGS_CLOSING;
+        }
+        return TCP_PROCESS_EVENT | TCP_PROCESS_DONE;
+      }
+    }
+    if( link->sendbuffered < TCP_BUFFER_SEND_READY_SIZE_TRESHOLD )
+    {
+      retcode |= TCP_PROCESS_EVENT | TCP_PROCESS_WAKE;
+      tcpEventQueueAdd( context, link, TCPLINK_FLAGS_EVENT_SENDREADY );
+    }
+  }
+
+  return retcode;
+}
+
+/* Regular and closing timeouts of a link */
+static int tcpProcessLinkTimeout( tcpContext *context, tcpLink *link, int64_t curtime )
+{
+  int retcode;
+
+  DEBUG_SET_TRACKER();
+
+  retcode = 0;
+  /* Regular timeout */
+/*
+TCP_DEBUG_PRINTF( "TIMEOUT CHECK : %d %d\n", (int)( curtime - link->time ), (int)link->timeoutmsecs );
+*/
+  if( ( ( curtime - link->time ) >= link->timeoutmsecs ) && !( link->flags & TCPLINK_FLAGS_EVENT_TIMEOUT ) )
+  {
+#if TCP_DEBUG
+    TCP_DEBUG_PRINTF( "TCP: Timeout! %d msecs\n", (int)( curtime - link->time ) );
+#endif
+    tcpEventQueueAdd( context, link, TCPLINK_FLAGS_EVENT_TIMEOUT );
+    retcode |= TCP_PROCESS_EVENT | TCP_PROCESS_WAKE;
+  }
+
+  /* Closing force timeout */
+  if( ( link->flags & ( TCPLINK_FLAGS_CLOSING | TCPLINK_FLAGS_TERMINATELIST ) ) == TCPLINK_FLAGS_CLOSING )
+  {
+    if( ( curtime - link->time ) >= TCP_DEFAULT_CLOSING_TIMEOUT )
+    {
+      /* Remove link from active list, add to terminatelist */
+      mmListRemove( link, offsetof(tcpLink,list) );
+      mmListAdd( &context->terminatelist, link, offsetof(tcpLink,list) );
+      tcpEventQueueAdd( context, link, TCPLINK_FLAGS_EVENT_CLOSED );
+      link->flags |= TCPLINK_FLAGS_TERMINATELIST;
+      retcode |= TCP_PROCESS_EVENT;
+    }
+  }
+
+  return retcode;
+}
+
+/* Free terminated links, exit thread if cancelled, accept incoming connections */
+static void tcpProcessPrepare( tcpContext *context )
+{
+  tcpLink *link, *next;
 
   DEBUG_SET_TRACKER();
 
@@ -1519,6 +1848,28 @@ static int tcpProcess( tcpContext *context, int64_t maxtimeout )
 
   tcpPollListen( context );
 
+  return;
+}
+
+
+static int tcpProcessSelect( tcpContext *context, int64_t maxtimeout )
+{
+  int a, eventflag, processcode, readflag;
+#if CC_UNIX
+  int rmax;
+#endif
+  int64_t msecs, curtime, beftimeout;
+  tcpLink *link, *linkl, *next;
+  tcpCallbackSet *netio;
+  struct timeval timeout;
+  fd_set fdRead;
+  fd_set fdWrite;
+  fd_set fdError;
+
+  DEBUG_SET_TRACKER();
+
+  tcpProcessPrepare( context );
+
   FD_ZERO( &fdRead );
   FD_ZERO( &fdWrite );
   FD_ZERO( &fdError );
@@ -1622,146 +1973,179 @@ static int tcpProcess( tcpContext *context, int64_t maxtimeout )
   {
     next = link->list.next;
     netio = link->netio;
-    wakeflag = 0;
-#if TCP_ENABLE_SSL_SUPPORT
-    if( link->flags & ( TCPLINK_FLAGS_SSL_NEEDCONNECT | TCPLINK_FLAGS_SSL_NEEDACCEPT ) )
-    {
-      if( FD_ISSET( link->socket, &fdRead ) || FD_ISSET( link->socket, &fdWrite ) || FD_ISSET( link->socket, &fdError ) )
-      {
-        link->time = curtime;
-        eventflag |= tcpSslHandshake( link );
-        continue;
-      }
-      goto timeoutcheck;
-    }
+    readflag = FD_ISSET( link->socket, &fdRead ) || FD_ISSET( link->socket, &fdError );
+    processcode = tcpProcessLinkIO( context, link, readflag, FD_ISSET( link->socket, &fdWrite ), curtime );
+    if( !( processcode & TCP_PROCESS_DONE ) )
+      processcode |= tcpProcessLinkTimeout( context, link, curtime );
+    if( processcode & TCP_PROCESS_EVENT )
+      eventflag = 1;
+    /* Stuff going on with link, asynchronous notification, tcp lock active */
+    if( ( ( processcode & ( TCP_PROCESS_WAKE | TCP_PROCESS_DONE ) ) == TCP_PROCESS_WAKE ) && ( netio->wake ) )
+      netio->wake( link->uservalue );
+  }
+
+  return eventflag;
+}
+
+
+#if TCP_ENABLE_EPOLL_SUPPORT
+
+/* Timer expired: check the timeouts of all links and arm the timer for the next deadline */
+static int tcpProcessEpollTimer( tcpContext *context, int64_t curtime )
+{
+  int eventflag, processcode;
+  tcpLink *link, *next;
+  tcpCallbackSet *netio;
+
+  DEBUG_SET_TRACKER();
+
+  eventflag = 0;
+  context->timerdeadline = INT64_MAX;
+  for( link = context->linklist ; link ; link = next )
+  {
+    next = link->list.next;
+    netio = link->netio;
+    processcode = tcpProcessLinkTimeout( context, link, curtime );
+    if( processcode & TCP_PROCESS_EVENT )
+      eventflag = 1;
+    if( ( processcode & TCP_PROCESS_WAKE ) && ( netio->wake ) )
+      netio->wake( link->uservalue );
+    tcpEpollArmLinkTimer( context, link );
+  }
+
+  return eventflag;
+}
+
+static int tcpProcessEpoll( tcpContext *context, int64_t maxtimeout )
+{
+  int index, eventcount, eventflag, timerflag, processcode, readflag, writeflag;
+  uint64_t counter;
+  ssize_t dummy;
+  int64_t curtime;
+  void *pendinglist;
+  tcpLink *link;
+  tcpCallbackSet *netio;
+  struct epoll_event events[TCP_EPOLL_EVENT_COUNT];
+
+  DEBUG_SET_TRACKER();
+
+  tcpProcessPrepare( context );
+
+  /* Links queued by the user or by the previous pass can't wait for a new edge */
+  if( context->pendinglist )
+    maxtimeout = 0;
+
+  if( context->threadstate & TCP_THREAD_STATE_MASK_ACTIVE )
+    mtMutexUnlock( &context->mutex );
+
+#if TCP_DEBUG
+  TCP_DEBUG_PRINTF( "TCP: Entering epoll_wait(), %d msecs\n", (int)maxtimeout );
 #endif
-    if( FD_ISSET( link->socket, &fdRead ) || FD_ISSET( link->socket, &fdError ) )
-    {
-      if( ( link->flags & TCPLINK_FLAGS_EVENT_MASK ) == TCPLINK_FLAGS_EVENT_TIMEOUT )
-        tcpEventQueueRemove( context, link );
-      link->time = curtime;
-      tcpcode = tcpRecv( context, link );
-      if( tcpcode & TCP_CODE_DATA )
-      {
-        eventflag = 1;
-        wakeflag = 1;
-        tcpEventQueueAdd( context, link, TCPLINK_FLAGS_EVENT_RECV );
-      }
-      if( tcpcode & TCP_CODE_ERROR )
-      {
-        eventflag = 1;
-        wakeflag = 1;
-        if( !( link->flags & TCPLINK_FLAGS_CLOSING ) )
-        {
-          /* TODO: SSL version? */
-#if CC_WINDOWS
-          shutdown( link->socket, SD_BOTH );
-#else
-          shutdown( link->socket, SHUT_RDWR );
+  eventcount = epoll_wait( context->epollfd, events, TCP_EPOLL_EVENT_COUNT, (int)maxtimeout );
+  if( ( eventcount < 0 ) && ( errno != EINTR ) )
+    TCP_ERROR();
+#if TCP_DEBUG
+  TCP_DEBUG_PRINTF( "TCP: Exited epoll_wait()\n" );
 #endif
-          link->flags |= TCPLINK_FLAGS_CLOSING;
-        }
-        else if( !( link->flags & TCPLINK_FLAGS_TERMINATELIST ) )
-        {
-          /* Remove link from active list, add to terminatelist */
-          mmListRemove( link, offsetof(tcpLink,list) );
-          mmListAdd( &context->terminatelist, link, offsetof(tcpLink,list) );
-          tcpEventQueueAdd( context, link, TCPLINK_FLAGS_EVENT_CLOSED );
-          link->flags |= TCPLINK_FLAGS_TERMINATELIST;
-        }
-        goto nextfd;
-      }
-    }
 
-    if( FD_ISSET( link->socket, &fdWrite ) )
+  if( context->threadstate & TCP_THREAD_STATE_MASK_ACTIVE )
+    mtMutexLock( &context->mutex );
+
+  DEBUG_SET_TRACKER();
+
+  eventflag = 0;
+  timerflag = 0;
+  for( index = 0 ; index < eventcount ; index++ )
+  {
+    if( events[index].data.ptr == &context->eventfd )
     {
-      if( ( link->flags & TCPLINK_FLAGS_EVENT_MASK ) == TCPLINK_FLAGS_EVENT_TIMEOUT )
-        tcpEventQueueRemove( context, link );
-      link->time = curtime;
-      tcpcode = tcpSend( context, link );
-      if( !( tcpcode ) )
-        link->flags &= ~TCPLINK_FLAGS_WANT_SEND;
-      else
-      {
-        if( tcpcode & TCP_CODE_COMPLETE )
-        {
-          link->flags &= ~TCPLINK_FLAGS_WANT_SEND;
-          tcpEventQueueAdd( context, link, TCPLINK_FLAGS_EVENT_SENDFINISHED );
-          eventflag = 1;
-          wakeflag = 1;
-        }
-        if( tcpcode & TCP_CODE_ERROR )
-        {
-          if( !( link->flags & TCPLINK_FLAGS_CLOSING ) )
-          {
-            /* TODO: SSL version? */
-#if CC_WINDOWS
-            shutdown( link->socket, SD_BOTH );
-#else
-            shutdown( link->socket, SHUT_RDWR );
-#endif
-            link->flags |= TCPLINK_FLAGS_CLOSING;
-          }
-          eventflag = 1;
-          wakeflag = 1;
-          goto nextfd;
-        }
-      }
-      if( link->sendbuffered < TCP_BUFFER_SEND_READY_SIZE_TRESHOLD )
-      {
+      dummy = read( context->eventfd, &counter, sizeof(uint64_t) );
+      if( context->threadstate & TCP_THREAD_STATE_MASK_ACTIVE )
         eventflag = 1;
-        wakeflag = 1;
-        tcpEventQueueAdd( context, link, TCPLINK_FLAGS_EVENT_SENDREADY );
-      }
+      continue;
+    }
+    if( events[index].data.ptr == &context->timerfd )
+    {
+      dummy = read( context->timerfd, &counter, sizeof(uint64_t) );
+      timerflag = 1;
+      continue;
     }
+    link = events[index].data.ptr;
+    /* Listening links are polled by tcpPollListen() */
+    if( link->flags & TCPLINK_FLAGS_LISTEN )
+      continue;
+    if( events[index].events & ( EPOLLIN | EPOLLRDHUP | EPOLLERR | EPOLLHUP ) )
+      link->flags |= TCPLINK_FLAGS_READY_RECV;
+    if( events[index].events & ( EPOLLOUT | EPOLLERR | EPOLLHUP ) )
+      link->flags |= TCPLINK_FLAGS_READY_SEND;
+    tcpEpollPending( context, link );
+  }
+  dummy = dummy;
 
-#if TCP_ENABLE_SSL_SUPPORT
-    timeoutcheck:
-#endif
+  DEBUG_SET_TRACKER();
 
-    /* Regular timeout */
-/*
-TCP_DEBUG_PRINTF( "TIMEOUT CHECK : %d %d\n", (int)( curtime - link->time ), (int)link->timeoutmsecs );
-*/
-    if( ( ( curtime - link->time ) >= link->timeoutmsecs ) && !( link->flags & TCPLINK_FLAGS_EVENT_TIMEOUT ) )
-    {
-#if TCP_DEBUG
-      TCP_DEBUG_PRINTF( "TCP: Timeout! %d msecs\n", (int)( curtime - link->time ) );
+  /* Process only the links with fresh readiness or queued work, links queued again wait for the next pass */
+  curtime = tcpTime( context );
+  mmListMoveList( &pendinglist, &context->pendinglist, offsetof(tcpLink,pendinglist) );
+  while( ( link = pendinglist ) )
+  {
+    mmListRemove( link, offsetof(tcpLink,pendinglist) );
+    link->flags &= ~TCPLINK_FLAGS_PENDING;
+    if( link->flags & TCPLINK_FLAGS_TERMINATELIST )
+      continue;
+    netio = link->netio;
+    readflag = ( link->flags & TCPLINK_FLAGS_READY_RECV ) && ( link->flags & ( TCPLINK_FLAGS_WANT_RECV | TCPLINK_FLAGS_CLOSING ) );
+    writeflag = ( link->flags & TCPLINK_FLAGS_READY_SEND );
+    /* SSL_write() may be waiting on incoming data */
+    if( ( link->flags & TCPLINK_FLAGS_SSL_ACTIVE ) && ( readflag ) )
+      writeflag = 1;
+    if( ( link->flags & ( TCPLINK_FLAGS_WANT_SEND | TCPLINK_FLAGS_CLOSING ) ) != TCPLINK_FLAGS_WANT_SEND )
+      writeflag = 0;
+#if TCP_ENABLE_SSL_SUPPORT
+    if( link->flags & ( TCPLINK_FLAGS_SSL_NEEDCONNECT | TCPLINK_FLAGS_SSL_NEEDACCEPT ) )
+      readflag = writeflag = ( link->flags & ( TCPLINK_FLAGS_READY_RECV | TCPLINK_FLAGS_READY_SEND ) );
 #endif
-      tcpEventQueueAdd( context, link, TCPLINK_FLAGS_EVENT_TIMEOUT );
+    processcode = tcpProcessLinkIO( context, link, readflag, writeflag, curtime );
+    if( processcode & TCP_PROCESS_EVENT )
       eventflag = 1;
-      wakeflag = 1;
-    }
-
-    /* Closing force timeout */
-    if( ( link->flags & ( TCPLINK_FLAGS_CLOSING | TCPLINK_FLAGS_TERMINATELIST ) ) == TCPLINK_FLAGS_CLOSING )
+    if( processcode & TCP_PROCESS_DONE )
     {
-      if( ( curtime - link->time ) >= TCP_DEFAULT_CLOSING_TIMEOUT )
+      /* A link that just started closing won't see another edge, finish it on the next pass */
+      if( ( link->flags & ( TCPLINK_FLAGS_CLOSING | TCPLINK_FLAGS_TERMINATELIST ) ) == TCPLINK_FLAGS_CLOSING )
       {
-        /* Remove link from active list, add to terminatelist */
-        mmListRemove( link, offsetof(tcpLink,list) );
-        mmListAdd( &context->terminatelist, link, offsetof(tcpLink,list) );
-        tcpEventQueueAdd( context, link, TCPLINK_FLAGS_EVENT_CLOSED );
-        link->flags |= TCPLINK_FLAGS_TERMINATELIST;
-        eventflag = 1;
+        link->flags |= TCPLINK_FLAGS_READY_RECV;
+        tcpEpollPending( context, link );
       }
     }
-
-    /* Stuff going on with link, asynchronous notification, tcp lock active */
-    if( ( wakeflag ) && ( netio->wake ) )
+    else if( ( processcode & TCP_PROCESS_WAKE ) && ( netio->wake ) )
       netio->wake( link->uservalue );
-
-    nextfd:
-    continue;
+    if( !( link->flags & TCPLINK_FLAGS_TERMINATELIST ) )
+      tcpEpollArmLinkTimer( context, link );
   }
 
+  if( timerflag )
+    eventflag |= tcpProcessEpollTimer( context, curtime );
+
   return eventflag;
 }
 
+#endif
+
+
+static int tcpProcess( tcpContext *context, int64_t maxtimeout )
+{
+#if TCP_ENABLE_EPOLL_SUPPORT
+  if( context->epollfd != -1 )
+    return tcpProcessEpoll( context, maxtimeout );
+#endif
+  return tcpProcessSelect( context, maxtimeout );
+}
+
 
 /* Background thread's main(), processing all sockets in a loop */
 static void *tcpThreadWork( void *p )
 {
+  int64_t timeout;
   tcpContext *context;
 
   DEBUG_SET_TRACKER();
@@ -1770,10 +2154,12 @@ static void *tcpThreadWork( void *p )
 #if CC_UNIX
   signal( SIGPIPE, SIG_IGN );
 #endif
+  /* With epoll, link timeouts are driven by the timerfd and tcpWake() by the eventfd */
+  timeout = ( context->epollfd != -1 ? -1 : TCP_DEFAULT_SELECT_TIMEOUT );
   mtMutexLock( &context->mutex );
   for( ; ; )
   {
-    if( tcpProcess( context, TCP_DEFAULT_SELECT_TIMEOUT ) )
+    if( tcpProcess( context, timeout ) )
       mtSignalBroadcast( &context->signal );
   }
   mtMutexUnlock( &context->mutex );
@@ -1849,6 +2235,9 @@ static int tcpFlushCallbacks( tcpContext *context )
       {
         netio->timeout( link->uservalue );
         link->time = curtime;
+#if TCP_ENABLE_EPOLL_SUPPORT
+        tcpEpollArmTimer( context, curtime + link->timeoutmsecs );
+#endif
 
         DEBUG_SET_TRACKER();
       }
@@ -1923,6 +2312,18 @@ int tcpFlush( tcpContext *context )
 void tcpWake( tcpContext *context )
 {
   DEBUG_SET_TRACKER();
+#if TCP_ENABLE_EPOLL_SUPPORT
+  uint64_t increment;
+  if( context->epollfd != -1 )
+  {
+    ssize_t dummy;
+    increment = 1;
+    if( context->threadstate & TCP_THREAD_STATE_MASK_ACTIVE )
+      dummy = write( context->eventfd, &increment, sizeof(uint64_t) );
+    dummy = dummy;
+    return;
+  }
+#endif
 #if CC_UNIX
   char c;
   int dummy;
@@ -50,6 +50,13 @@ typedef struct
   int wakepipe[2];
 #endif
 
+  /* Linux epoll backend, epollfd is -1 when select() is used */
+  int epollfd;
+  int eventfd;
+  int timerfd;
+  int64_t timerdeadline;
+  void *pendinglist;
+
   void *linklist;
   void *listenlist;
   void *eventlist;
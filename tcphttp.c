@@ -40,6 +40,10 @@
 #include "tcp.h"
 #include "tcphttp.h"
 
+#if HTTP_ENABLE_ZLIB_SUPPORT
+ #include <zlib.h>
+#endif
+
 
 ////
 
@@ -73,6 +77,9 @@
 /* Maximum count of retry for a failing query */
 #define HTTP_FAILED_RETRY_MAXIMUM (3)
 
+/* Minimum room to reserve for each pass of content decoding */
+#define HTTP_DECODE_OUTPUT_MIN (16384)
+
 
 ////
 
@@ -110,6 +117,8 @@ typedef struct
   size_t querylength;
   /* HTTP pipelining index */
   int pipelineindex;
+  /* Time when query was last sent, in milliseconds */
+  int64_t sendtime;
 
   httpResponse response;
 
@@ -117,6 +126,8 @@ typedef struct
   void *uservalue;
   /* User callback */
   void (*querycallback)( void *uservalue, int resultcode, httpResponse *response );
+  /* User callback for content as it is received, null to assemble the content in data */
+  void (*contentcallback)( void *uservalue, httpResponse *response, void *data, size_t size );
   /* Return status for query callback, HTTP_RESULT_xxx */
   int resultcode;
 
@@ -124,6 +135,12 @@ typedef struct
   ssize_t chunksize;
   /* Offset where the chunk size string begins */
   size_t chunkoffset;
+  /* Count of content bytes received, before decoding */
+  size_t contentreceived;
+#if HTTP_ENABLE_ZLIB_SUPPORT
+  /* Decoder state for gzip/deflate content, allocated on first content bytes */
+  z_stream *zstream;
+#endif
 
   /* List of pending queries */
   mmListNode list;
@@ -139,6 +156,10 @@ typedef struct
 #define HTTP_QUERY_FLAGS_SENT (0x40000)
 /* Abort pending query, return NOREPLY */
 #define HTTP_QUERY_FLAGS_ABORTED (0x80000)
+/* Content failed to decode, resending the query won't help */
+#define HTTP_QUERY_FLAGS_DECODEERROR (0x100000)
+/* Compressed content reached the end of its stream */
+#define HTTP_QUERY_FLAGS_DECODED (0x200000)
 
 enum
 {
@@ -352,7 +373,7 @@ httpConnection *httpOpen( tcpContext *tcp, char *address, int port, int flags )
 }
 
 
-int httpAddQuery( httpConnection *http, char *querystring, size_t querylen, int queryflags, void *queryuservalue, void (*querycallback)( void *uservalue, int resultcode, httpResponse *response ) )
+static int httpQueueQuery( httpConnection *http, char *querystring, size_t querylen, int queryflags, void *queryuservalue, void (*querycallback)( void *uservalue, int resultcode, httpResponse *response ), void (*contentcallback)( void *uservalue, httpResponse *response, void *data, size_t size ) )
 {
   httpQuery *query;
 
@@ -363,12 +384,17 @@ int httpAddQuery( httpConnection *http, char *querystring, size_t querylen, int
   query->flags = queryflags;
   query->dataalloc = 0;
   query->dataoffset = 0;
+  query->contentreceived = 0;
   query->data = 0;
   query->querystring = 0;
   query->querylength = 0;
   query->pipelineindex = 0;
+#if HTTP_ENABLE_ZLIB_SUPPORT
+  query->zstream = 0;
+#endif
   query->uservalue = queryuservalue;
   query->querycallback = querycallback;
+  query->contentcallback = contentcallback;
   query->resultcode = HTTP_RESULT_SUCCESS;
   memset( &query->response, 0, sizeof(httpResponse) );
   mmListDualAddLast( &http->querywaitlist, query, offsetof(httpQuery,list) );
@@ -386,6 +412,34 @@ int httpAddQuery( httpConnection *http, char *querystring, size_t querylen, int
   return 1;
 }
 
+/* Pick the link of the pool with the shortest queue */
+static httpConnection *httpPickPoolLink( httpConnection *http )
+{
+  httpConnection *target, *conn;
+
+  target = http;
+  for( conn = http->poolnext ; conn ; conn = conn->poolnext )
+  {
+    if( conn->queryqueuecount < target->queryqueuecount )
+      target = conn;
+  }
+  return target;
+}
+
+int httpAddQuery( httpConnection *http, char *querystring, size_t querylen, int queryflags, void *queryuservalue, void (*querycallback)( void *uservalue, int resultcode, httpResponse *response ) )
+{
+  DEBUG_SET_TRACKER();
+
+  return httpQueueQuery( httpPickPoolLink( http ), querystring, querylen, queryflags, queryuservalue, querycallback, 0 );
+}
+
+int httpAddStreamQuery( httpConnection *http, char *querystring, size_t querylen, int queryflags, void *queryuservalue, void (*querycallback)( void *uservalue, int resultcode, httpResponse *response ), void (*contentcallback)( void *uservalue, httpResponse *response, void *data, size_t size ) )
+{
+  DEBUG_SET_TRACKER();
+
+  return httpQueueQuery( httpPickPoolLink( http ), querystring, querylen, queryflags, queryuservalue, querycallback, contentcallback );
+}
+
 
 static void httpCloseLink( httpConnection *http )
 {
@@ -418,11 +472,26 @@ static void httpCloseLink( httpConnection *http )
 }
 
 
+static void httpFreeDecoder( httpQuery *query )
+{
+#if HTTP_ENABLE_ZLIB_SUPPORT
+  if( query->zstream )
+  {
+    inflateEnd( query->zstream );
+    free( query->zstream );
+    query->zstream = 0;
+  }
+  query->flags &= ~HTTP_QUERY_FLAGS_DECODED;
+#endif
+  return;
+}
+
 static void httpFreeQuery( httpConnection *http, httpQuery *query )
 {
   DEBUG_SET_TRACKER();
 
   http->queryqueuecount--;
+  httpFreeDecoder( query );
   if( query->querystring )
     free( query->querystring );
   if( query->data )
@@ -433,12 +502,23 @@ static void httpFreeQuery( httpConnection *http, httpQuery *query )
 
 static void httpFinishFreeQuery( httpConnection *http, httpQuery *query )
 {
+  int64_t replytime;
+
   DEBUG_SET_TRACKER();
 
 #if TCPHTTP_DEBUG
   TCPHTTP_DEBUG_PRINTF( "TcpHttp: httpFinishFreeQuery() called, status : %d %d\n", query->status, query->response.httpcode );
 #endif
 
+#if HTTP_ENABLE_ZLIB_SUPPORT
+  /* A compressed reply is truncated if its content ended before the end of the stream */
+  if( ( query->status == HTTP_QUERY_STATUS_COMPLETE ) && ( query->zstream ) && !( query->flags & HTTP_QUERY_FLAGS_DECODED ) )
+  {
+    TCPHTTP_DEBUG_PRINTF( "HTTP ERROR: Compressed content ended before the end of its stream.\n" );
+    query->status = HTTP_QUERY_STATUS_ERROR;
+    query->resultcode = HTTP_RESULT_BADFORMAT_ERROR;
+  }
+#endif
   if( ( query->status == HTTP_QUERY_STATUS_FAILED ) || ( query->status == HTTP_QUERY_STATUS_ERROR ) )
     query->querycallback( query->uservalue, query->resultcode, 0 );
   else
@@ -448,6 +528,12 @@ static void httpFinishFreeQuery( httpConnection *http, httpQuery *query )
 #if HTTP_APPEND_ZERO_BYTE
     ((char *)query->response.body)[ query->response.bodysize ] = 0;
 #endif
+    /* Sample the reply time before the callback, which may spend time parsing the reply */
+    /* Pipelined replies queue behind each other, time from the later of our send or the previous reply */
+    replytime = (int64_t)ccGetMillisecondsTime();
+    http->roundtripsum += replytime - ( http->lastreplytime > query->sendtime ? http->lastreplytime : query->sendtime );
+    http->roundtripcount++;
+    http->lastreplytime = replytime;
     query->querycallback( query->uservalue, HTTP_RESULT_SUCCESS, &query->response );
     /* Reset count of retry failures */
     http->retryfailurecount = 0;
@@ -485,7 +571,7 @@ static void httpFailQueryList( httpConnection *http, httpQuery *query, mmListDua
 }
 
 
-void httpClose( httpConnection *http )
+static void httpFreeConnection( httpConnection *http )
 {
   tcpDataBuffer *recvbuf, *recvbufnext;
 
@@ -512,13 +598,81 @@ void httpClose( httpConnection *http )
   return;
 }
 
+void httpClose( httpConnection *http )
+{
+  httpConnection *conn, *connnext;
+
+  DEBUG_SET_TRACKER();
+
+  for( conn = http->poolnext ; conn ; conn = connnext )
+  {
+    connnext = conn->poolnext;
+    httpFreeConnection( conn );
+  }
+  httpFreeConnection( http );
+  return;
+}
+
+
+void httpSetPoolSize( httpConnection *http, int linkcount )
+{
+  int poolsize;
+  httpConnection *conn, *last, *connnext;
+
+  DEBUG_SET_TRACKER();
+
+  if( linkcount < 1 )
+    linkcount = 1;
+  /* Keep the first linkcount links, queries pending on the others are failed */
+  last = http;
+  for( poolsize = 1 ; ( poolsize < linkcount ) && ( last->poolnext ) ; poolsize++ )
+    last = last->poolnext;
+  for( conn = last->poolnext ; conn ; conn = connnext )
+  {
+    connnext = conn->poolnext;
+    httpFreeConnection( conn );
+  }
+  last->poolnext = 0;
+  /* Additional links inherit the settings of the first one */
+  for( ; poolsize < linkcount ; poolsize++ )
+  {
+    conn = httpOpen( http->tcp, http->address, http->port, http->flags );
+    conn->idletimeout = http->idletimeout;
+    conn->waitingtimeout = http->waitingtimeout;
+    conn->wake = http->wake;
+    conn->wakecontext = http->wakecontext;
+    last->poolnext = conn;
+    last = conn;
+  }
+  return;
+}
+
+
+int httpGetPoolSize( httpConnection *http )
+{
+  int poolsize;
+  httpConnection *conn;
+
+  DEBUG_SET_TRACKER();
+
+  poolsize = 0;
+  for( conn = http ; conn ; conn = conn->poolnext )
+    poolsize++;
+  return poolsize;
+}
+
 
 void httpSetTimeout( httpConnection *http, int idletimeout, int waitingtimeout )
 {
-  http->idletimeout = idletimeout;
-  http->waitingtimeout = waitingtimeout;
-  if( http->link )
-    tcpSetTimeout( http->tcp, http->link, ( http->flags & HTTP_CONNECTION_FLAGS_IDLE ? http->idletimeout : http->waitingtimeout ) );
+  httpConnection *conn;
+
+  for( conn = http ; conn ; conn = conn->poolnext )
+  {
+    conn->idletimeout = idletimeout;
+    conn->waitingtimeout = waitingtimeout;
+    if( conn->link )
+      tcpSetTimeout( conn->tcp, conn->link, ( conn->flags & HTTP_CONNECTION_FLAGS_IDLE ? conn->idletimeout : conn->waitingtimeout ) );
+  }
   return;
 }
 
@@ -584,6 +738,14 @@ static char *httpParseHeaderLine( httpResponse *response, char *headerline, int
   }
   else if( ( string = ccStrCmpWordIgnoreCase( headerline, "transfer-encoding: chunked" ) ) )
     response->chunkedflag = 1;
+  else if( ( string = ccStrCmpWordIgnoreCase( headerline, "content-encoding:" ) ) )
+  {
+    string = ccStrNextWord( string );
+    if( ccStrCmpWordIgnoreCase( string, "gzip" ) || ccStrCmpWordIgnoreCase( string, "x-gzip" ) )
+      response->encoding = HTTP_ENCODING_GZIP;
+    else if( ccStrCmpWordIgnoreCase( string, "deflate" ) )
+      response->encoding = HTTP_ENCODING_DEFLATE;
+  }
   else if( ( string = ccStrCmpWordIgnoreCase( headerline, "content-length:" ) ) )
   {
     string = ccStrNextWord( string );
@@ -645,6 +807,7 @@ static int httpParseHeader( httpResponse *response, char *data, size_t datasize
   response->chunkedflag = 0;
   response->trailerflag = 0;
   response->contentlength = -1;
+  response->encoding = HTTP_ENCODING_IDENTITY;
   response->location = 0;
 
   headerline = &header[linelength+1];
@@ -721,6 +884,8 @@ static int httpParseTrailerEnd( httpQuery *query, char *str, size_t length )
 /* Specifies minimum total buffer size, may allocate more */
 static inline int httpAllocData( httpQuery *query, size_t datasize )
 {
+  ptrdiff_t locationoffset;
+
   DEBUG_SET_TRACKER();
 
 #if HTTP_APPEND_ZERO_BYTE
@@ -732,10 +897,107 @@ static inline int httpAllocData( httpQuery *query, size_t datasize )
   {
     query->dataalloc = intMax( 4096, intMax( datasize, query->dataalloc << 1 ) );
 #endif
+    locationoffset = ( query->response.location ? query->response.location - (char *)query->data : 0 );
     query->data = realloc( query->data, query->dataalloc );
     if( !( query->data ) )
       return 0;
+    /* Parsed header pointers follow the buffer, the header is always at its start */
+    if( query->response.header )
+    {
+      query->response.header = query->data;
+      if( query->response.location )
+        query->response.location = ADDRESS( query->data, locationoffset );
+    }
+  }
+  return 1;
+}
+
+/* Append received content to the query's data, or hand it to the content callback, decoding it if the server compressed it */
+/* Returns 0 on error */
+static int httpAppendContent( httpQuery *query, void *data, size_t size )
+{
+#if HTTP_ENABLE_ZLIB_SUPPORT
+  int zret, windowbits;
+  size_t outsize;
+  unsigned char *bytes;
+#endif
+
+  DEBUG_SET_TRACKER();
+
+  query->contentreceived += size;
+#if HTTP_ENABLE_ZLIB_SUPPORT
+  if( query->response.encoding != HTTP_ENCODING_IDENTITY )
+  {
+    if( !( size ) )
+      return 1;
+    if( !( query->zstream ) )
+    {
+      /* Some servers send raw deflate data for "deflate" instead of the zlib format, check the header */
+      bytes = data;
+      windowbits = MAX_WBITS + 32;
+      if( ( query->response.encoding == HTTP_ENCODING_DEFLATE ) && ( ( ( bytes[0] & 0x0f ) != Z_DEFLATED ) || ( ( size >= 2 ) && ( ( ( bytes[0] << 8 ) | bytes[1] ) % 31 ) ) ) )
+        windowbits = -MAX_WBITS;
+      query->zstream = calloc( 1, sizeof(z_stream) );
+      if( !( query->zstream ) )
+        return 0;
+      if( inflateInit2( query->zstream, windowbits ) != Z_OK )
+      {
+        free( query->zstream );
+        query->zstream = 0;
+        return 0;
+      }
+    }
+    query->zstream->next_in = data;
+    query->zstream->avail_in = size;
+    for( ; ; )
+    {
+      /* Compressed text typically expands several times */
+      outsize = size << 2;
+      if( outsize < HTTP_DECODE_OUTPUT_MIN )
+        outsize = HTTP_DECODE_OUTPUT_MIN;
+      if( !( httpAllocData( query, query->dataoffset + outsize ) ) )
+        return 0;
+      outsize = query->dataalloc - query->dataoffset - HTTP_APPEND_ZERO_BYTE;
+      query->zstream->next_out = ADDRESS( query->data, query->dataoffset );
+      query->zstream->avail_out = outsize;
+      zret = inflate( query->zstream, Z_NO_FLUSH );
+      /* When streaming, the decoded data is handed over and the window is reused */
+      if( !( query->contentcallback ) )
+        query->dataoffset += outsize - query->zstream->avail_out;
+      else if( outsize - query->zstream->avail_out )
+        query->contentcallback( query->uservalue, &query->response, ADDRESS( query->data, query->dataoffset ), outsize - query->zstream->avail_out );
+      /* Ignore anything past the end of the compressed stream */
+      if( zret == Z_STREAM_END )
+      {
+        query->flags |= HTTP_QUERY_FLAGS_DECODED;
+        break;
+      }
+      if( ( zret != Z_OK ) && ( zret != Z_BUF_ERROR ) )
+      {
+        TCPHTTP_DEBUG_PRINTF( "HTTP ERROR: Failed to decode content, zlib error %d.\n", zret );
+        query->flags |= HTTP_QUERY_FLAGS_DECODEERROR;
+        return 0;
+      }
+      /* Input is exhausted if inflate() didn't fill the output buffer */
+      if( query->zstream->avail_out )
+        break;
+    }
+    return 1;
   }
+#endif
+
+  /* Streaming, pass along data straight from the receive buffer */
+  if( query->contentcallback )
+  {
+    if( size )
+      query->contentcallback( query->uservalue, &query->response, data, size );
+    return 1;
+  }
+
+  if( !( httpAllocData( query, query->dataoffset + size ) ) )
+    return 0;
+  memcpy( ADDRESS( query->data, query->dataoffset ), data, size );
+  query->dataoffset += size;
   return 1;
 }
 
@@ -855,8 +1117,8 @@ static int httpParseRecvChunk( httpQuery *query, void **retbufdata, size_t *retb
     if( copysize > bufsize )
       copysize = bufsize;
 
-    httpAllocData( query, query->dataoffset + copysize );
-    memcpy( ADDRESS( query->data, query->dataoffset ), bufdata, copysize );
+    if( !( httpAppendContent( query, bufdata, copysize ) ) )
+      return 0;
 
 #if TCPHTTP_DEBUG_CHUNK && 0
     TCPHTTP_DEBUG_PRINTF( "============== Chunk Start\n" );
@@ -864,7 +1126,6 @@ static int httpParseRecvChunk( httpQuery *query, void **retbufdata, size_t *retb
     TCPHTTP_DEBUG_PRINTF( "============== Chunk End\n" );
 #endif
 
-    query->dataoffset += copysize;
     bufdata = ADDRESS( bufdata, copysize );
     bufsize -= copysize;
     query->chunksize -= copysize;
@@ -997,9 +1258,13 @@ static int httpParseRecvData( httpConnection *http )
         }
         http->serverflags &= http->flags;
 
-        /* Allocate content buffer */
-        httpAllocData( query, query->response.headerlength + ( ( query->flags & ( HTTP_QUERY_FLAGS_NOCONTENTLENGTH | HTTP_QUERY_FLAGS_CHUNKED ) ) ? 1048576 : query->response.contentlength ) );
+        /* Allocate content buffer, preallocate the whole content when we know its length */
+        if( query->contentcallback )
+          query->contentcallback( query->uservalue, &query->response, 0, 0 );
+        else
+          httpAllocData( query, query->response.headerlength + ( ( query->flags & ( HTTP_QUERY_FLAGS_NOCONTENTLENGTH | HTTP_QUERY_FLAGS_CHUNKED ) ) ? 1048576 : query->response.contentlength ) );
         query->dataoffset = query->response.headerlength;
+        query->contentreceived = 0;
         /* Skip header to get remaining data */
         bufdata = ADDRESS( bufdata, query->response.headerlength );
         bufsize -= query->response.headerlength;
@@ -1013,33 +1278,38 @@ static int httpParseRecvData( httpConnection *http )
           TCPHTTP_DEBUG_PRINTF( "HTTP ERROR: Failed to parse chunked transfer-encoding reply.\n" );
           query->status = HTTP_QUERY_STATUS_ERROR;
           query->resultcode = HTTP_RESULT_BADFORMAT_ERROR;
+          if( query->flags & HTTP_QUERY_FLAGS_DECODEERROR )
+            httpFinishFreeQuery( http, query );
           return 0;
         }
       }
       else
       {
         if( query->flags & HTTP_QUERY_FLAGS_NOCONTENTLENGTH )
-        {
-          httpAllocData( query, query->dataoffset + bufsize );
           copysize = bufsize;
-        }
         else
         {
-          copysize = ( query->response.contentlength + query->response.headerlength ) - query->dataoffset;
+          copysize = (size_t)query->response.contentlength - query->contentreceived;
           if( copysize > bufsize )
             copysize = bufsize;
         }
-        /* Copy buffer to content */
-        memcpy( ADDRESS( query->data, query->dataoffset ), bufdata, copysize );
-        query->dataoffset += copysize;
+        /* Copy buffer to content, decoding as required */
+        if( !( httpAppendContent( query, bufdata, copysize ) ) )
+        {
+          query->status = HTTP_QUERY_STATUS_ERROR;
+          query->resultcode = HTTP_RESULT_BADFORMAT_ERROR;
+          if( query->flags & HTTP_QUERY_FLAGS_DECODEERROR )
+            httpFinishFreeQuery( http, query );
+          return 0;
+        }
         bufdata = ADDRESS( bufdata, copysize );
         bufsize -= copysize;
         if( !( query->flags & HTTP_QUERY_FLAGS_NOCONTENTLENGTH ) )
         {
 #if TCPHTTP_DEBUG
-          TCPHTTP_DEBUG_PRINTF( "TcpHttp : Is query %p complete? Received %d == Total %d ( %d + %d )\n", query, (int)query->dataoffset, (int)query->response.contentlength + (int)query->response.headerlength, (int)query->response.contentlength, (int)query->response.headerlength );
+          TCPHTTP_DEBUG_PRINTF( "TcpHttp : Is query %p complete? Received %d == Total %d\n", query, (int)query->contentreceived, (int)query->response.contentlength );
 #endif
-          if( query->dataoffset == ( query->response.contentlength + query->response.headerlength ) )
+          if( query->contentreceived == (size_t)query->response.contentlength )
           {
             query->status = HTTP_QUERY_STATUS_COMPLETE;
             query->resultcode = HTTP_RESULT_SUCCESS;
@@ -1107,6 +1377,7 @@ static void httpSendQueries( httpConnection *http )
 
     /* Pipelining index for query since last reconnect */
     query->pipelineindex = http->sentquerycount;
+    query->sendtime = (int64_t)ccGetMillisecondsTime();
     /* Queue send query */
     tcpbuffer = tcpAllocSendBuffer( http->tcp, http->link, query->querylength );
     memcpy( tcpbuffer->pointer, query->querystring, query->querylength );
@@ -1233,6 +1504,8 @@ static int httpAttemptConnect( httpConnection *http )
     if( query->data )
       free( query->data );
     query->data = 0;
+    memset( &query->response, 0, sizeof(httpResponse) );
+    httpFreeDecoder( query );
 
 #if TCPHTTP_DEBUG
     TCPHTTP_DEBUG_PRINTF( "TcpHttp : Queued for retry %p\n", query );
@@ -1264,8 +1537,8 @@ static int httpAttemptConnect( httpConnection *http )
 }
 
 
-/* Update status of http connection and all its queries */
-int httpProcess( httpConnection *http )
+/* Update status of a single link of the pool and all its queries */
+static int httpProcessConnection( httpConnection *http )
 {
   httpQuery *query;
 
@@ -1326,25 +1599,49 @@ int httpProcess( httpConnection *http )
   return 1;
 }
 
+/* Update status of http connection and all its queries */
+int httpProcess( httpConnection *http )
+{
+  int retval;
+  httpConnection *conn;
+
+  DEBUG_SET_TRACKER();
+
+  retval = 0;
+  for( conn = http ; conn ; conn = conn->poolnext )
+    retval |= httpProcessConnection( conn );
+  return retval;
+}
+
 
 int httpGetQueryQueueCount( httpConnection *http )
 {
+  int queryqueuecount;
+  httpConnection *conn;
+
   DEBUG_SET_TRACKER();
 
-  return http->queryqueuecount;
+  queryqueuecount = 0;
+  for( conn = http ; conn ; conn = conn->poolnext )
+    queryqueuecount += conn->queryqueuecount;
+  return queryqueuecount;
 }
 
 
 void httpAbortQueue( httpConnection *http )
 {
   httpQuery *query;
+  httpConnection *conn;
 
   DEBUG_SET_TRACKER();
 
-  for( query = http->querysentlist.first ; query ; query = query->list.next )
-    query->flags |= HTTP_QUERY_FLAGS_ABORTED;
-  for( query = http->querywaitlist.first ; query ; query = query->list.next )
-    query->flags |= HTTP_QUERY_FLAGS_ABORTED;
+  for( conn = http ; conn ; conn = conn->poolnext )
+  {
+    for( query = conn->querysentlist.first ; query ; query = query->list.next )
+      query->flags |= HTTP_QUERY_FLAGS_ABORTED;
+    for( query = conn->querywaitlist.first ; query ; query = query->list.next )
+      query->flags |= HTTP_QUERY_FLAGS_ABORTED;
+  }
   return;
 }
 
@@ -1352,8 +1649,14 @@ void httpAbortQueue( httpConnection *http )
 int httpGetClearErrorCount( httpConnection *http )
 {
   int errorcount;
-  errorcount = http->errorcount;
-  http->errorcount = 0;
+  httpConnection *conn;
+
+  errorcount = 0;
+  for( conn = http ; conn ; conn = conn->poolnext )
+  {
+    errorcount += conn->errorcount;
+    conn->errorcount = 0;
+  }
 /*
   http->retryfailurecount = 0;
 */
@@ -1364,25 +1667,50 @@ int httpGetClearErrorCount( httpConnection *http )
 }
 
 
+int httpGetClearRoundTrip( httpConnection *http, int64_t *retroundtripsum )
+{
+  int roundtripcount;
+  int64_t roundtripsum;
+  httpConnection *conn;
+
+  roundtripcount = 0;
+  roundtripsum = 0;
+  for( conn = http ; conn ; conn = conn->poolnext )
+  {
+    roundtripcount += conn->roundtripcount;
+    roundtripsum += conn->roundtripsum;
+    conn->roundtripcount = 0;
+    conn->roundtripsum = 0;
+  }
+  *retroundtripsum = roundtripsum;
+  return roundtripcount;
+}
+
+
+/* Connected if any link of the pool is connected */
 int httpGetStatus( httpConnection *http )
 {
   int retval;
+  httpConnection *conn;
 
   DEBUG_SET_TRACKER();
 
-  switch( http->status )
+  retval = 0;
+  for( conn = http ; conn ; conn = conn->poolnext )
   {
-    case HTTP_CONNECTION_STATUS_READY:
-    case HTTP_CONNECTION_STATUS_WAIT:
-    case HTTP_CONNECTION_STATUS_FLUSH:
-      retval = 1;
-      break;
-    case HTTP_CONNECTION_STATUS_CONNECTING:
-    case HTTP_CONNECTION_STATUS_CLOSING:
-    case HTTP_CONNECTION_STATUS_CLOSED:
-    default:
-      retval = 0;
-      break;
+    switch( conn->status )
+    {
+      case HTTP_CONNECTION_STATUS_READY:
+      case HTTP_CONNECTION_STATUS_WAIT:
+      case HTTP_CONNECTION_STATUS_FLUSH:
+        retval = 1;
+        break;
+      case HTTP_CONNECTION_STATUS_CONNECTING:
+      case HTTP_CONNECTION_STATUS_CLOSING:
+      case HTTP_CONNECTION_STATUS_CLOSED:
+      default:
+        break;
+    }
   }
   return retval;
 }
@@ -1390,8 +1718,13 @@ int httpGetStatus( httpConnection *http )
 
 void httpSetWakeCallback( httpConnection *http, void (*wake)( tcpContext *tcp, httpConnection *http, void *wakecontext ), void *wakecontext )
 {
-  http->wake = wake;
-  http->wakecontext = wakecontext;
+  httpConnection *conn;
+
+  for( conn = http ; conn ; conn = conn->poolnext )
+  {
+    conn->wake = wake;
+    conn->wakecontext = wakecontext;
+  }
   return;
 }
 
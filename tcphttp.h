@@ -49,10 +49,19 @@ struct httpConnection
   void (*wake)( tcpContext *tcp, httpConnection *http, void *wakecontext );
   void *wakecontext;
 
+  /* Reply times of completed queries, in milliseconds */
+  int64_t roundtripsum;
+  int roundtripcount;
+  /* Time the previous reply completed, pipelined replies queue behind it */
+  int64_t lastreplytime;
+
   int queryqueuecount;
   mmListDualHead querywaitlist;
   mmListDualHead querysentlist;
   mmListDualHead recvbuflist;
+
+  /* Connection pool, additional links to the same server, chained from the connection returned by httpOpen() */
+  httpConnection *poolnext;
 };
 
 #define HTTP_CONNECTION_FLAGS_KEEPALIVE (0x1)
@@ -68,6 +77,25 @@ struct httpConnection
 #define HTTP_QUERY_FLAGS_PIPELINING (0x2)
 
 
+/* Decode gzip and deflate content encodings, requires zlib */
+#define HTTP_ENABLE_ZLIB_SUPPORT (1)
+
+/* Header line for query strings, announce which content encodings we can decode */
+#if HTTP_ENABLE_ZLIB_SUPPORT
+ #define HTTP_ACCEPT_ENCODING "Accept-Encoding: gzip, deflate\r\n"
+#else
+ #define HTTP_ACCEPT_ENCODING ""
+#endif
+
+/* Content encoding of reply, response body is always returned decoded */
+enum
+{
+  HTTP_ENCODING_IDENTITY,
+  HTTP_ENCODING_GZIP,
+  HTTP_ENCODING_DEFLATE
+};
+
+
 typedef struct
 {
   int httpcode;
@@ -82,6 +110,7 @@ typedef struct
   int chunkedflag;
   int trailerflag;
   int contentlength;
+  int encoding;
 
   char *location;
 } httpResponse;
@@ -96,12 +125,23 @@ httpConnection *httpOpen( tcpContext *tcp, char *address, int port, int flags );
 /* Close HTTP connection */
 void httpClose( httpConnection *http );
 
+/* Open up to linkcount parallel links to the server, queries are distributed by queue depth */
+void httpSetPoolSize( httpConnection *http, int linkcount );
+
+/* Get the count of links in the connection pool */
+int httpGetPoolSize( httpConnection *http );
+
 /* Set timeouts for connection in milliseconds */
 void httpSetTimeout( httpConnection *http, int idletimeout, int waitingtimeout );
 
 /* Queue a query for connection, querycallback() is called when finished */
 int httpAddQuery( httpConnection *http, char *querystring, size_t querylen, int queryflags, void *queryuservalue, void (*querycallback)( void *uservalue, int resultcode, httpResponse *response ) );
 
+/* Queue a query whose reply content is handed to contentcallback() as it is received, straight from the receive buffers without being assembled */
+/* Each reply begins with a call where data is null, the consumer must then discard anything received before as the query may have been resent */
+/* The data is de-chunked and decoded but not null-terminated, querycallback() is called when finished with an empty response body */
+int httpAddStreamQuery( httpConnection *http, char *querystring, size_t querylen, int queryflags, void *queryuservalue, void (*querycallback)( void *uservalue, int resultcode, httpResponse *response ), void (*contentcallback)( void *uservalue, httpResponse *response, void *data, size_t size ) );
+
 /* Write queries, parse received data, call querycallback() for queries as appropriate */
 int httpProcess( httpConnection *http );
 
@@ -114,6 +154,9 @@ int httpGetQueryQueueCount( httpConnection *http );
 /* Returns the count of errors and clear it back to zero */
 int httpGetClearErrorCount( httpConnection *http );
 
+/* Returns the count of queries completed since last call, their summed reply time in milliseconds is stored in retroundtripsum */
+int httpGetClearRoundTrip( httpConnection *http, int64_t *retroundtripsum );
+
 /* Returns non-zero if connected */
 int httpGetStatus( httpConnection *http );
 